@@ -10,7 +10,9 @@
 #include <eosio/chain/account_object.hpp>
 #include <eosio/chain/code_object.hpp>
 #include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/contract_profiler.hpp>
 #include <boost/container/flat_set.hpp>
+#include <fc/scoped_exit.hpp>
 
 using boost::container::flat_set;
 
@@ -65,6 +67,7 @@ void apply_context::exec_one()
          privileged = receiver_account->is_privileged();
          auto native = control.find_apply_handler( receiver, act->account, act->name );
          if( native ) {
+            trx_context.require_writable( "state with native actions" );
             if( trx_context.enforce_whiteblacklist && control.is_producing_block() ) {
                control.check_contract_list( receiver );
                control.check_action_list( act->account, act->name );
@@ -83,8 +86,19 @@ void apply_context::exec_one()
                control.check_contract_list( receiver );
                control.check_action_list( act->account, act->name );
             }
+            contract_profiler& profiler = control.get_contract_profiler();
+            const bool profiling = profiler.enabled();
+            const auto wasm_start = profiling ? fc::time_point::now() : fc::time_point();
+            const action_name act_name = act->name; // act may be invalidated by the contract scheduling actions
+            intrinsic_time = fc::microseconds();
+            profile_intrinsics = profiling;
+            auto record_profile = fc::make_scoped_exit( [&]() {
+               if( !profiling ) return;
+               profile_intrinsics = false;
+               profiler.record( receiver, act_name, fc::time_point::now() - wasm_start, intrinsic_time );
+            } );
             try {
-               control.get_wasm_interface().apply( receiver_account->code_hash, receiver_account->vm_type, receiver_account->vm_version, *this );
+               trx_context.get_wasm_interface().apply( receiver_account->code_hash, receiver_account->vm_type, receiver_account->vm_version, *this );
             } catch( const wasm_exit& ) {}
          }
 
@@ -124,8 +138,10 @@ void apply_context::exec_one()
    //    * a pointer to an object in a chainbase index is not invalidated if the fields of that object are modified;
    //    * and, the *receiver_account object itself cannot be removed because accounts cannot be deleted in EOSIO.
 
-   r.global_sequence  = next_global_sequence();
-   r.recv_sequence    = next_recv_sequence( *receiver_account );
+   // read-only transactions leave the sequences as they are, their receipts are never part of a block
+   const bool read_only = trx_context.is_read_only();
+   r.global_sequence  = read_only ? 0 : next_global_sequence();
+   r.recv_sequence    = read_only ? 0 : next_recv_sequence( *receiver_account );
 
    const account_metadata_object* first_receiver_account = nullptr;
    if( act->account == receiver ) {
@@ -138,7 +154,7 @@ void apply_context::exec_one()
    r.abi_sequence     = first_receiver_account->abi_sequence;  // could be modified by action execution above
 
    for( const auto& auth : act->authorization ) {
-      r.auth_sequence[auth.actor] = next_auth_sequence( auth.actor );
+      r.auth_sequence[auth.actor] = read_only ? 0 : next_auth_sequence( auth.actor );
    }
 
    action_trace& trace = trx_context.get_action_trace( action_ordinal );
@@ -358,6 +374,7 @@ void apply_context::execute_context_free_inline( action&& a ) {
 
 
 void apply_context::schedule_deferred_transaction( const uint128_t& sender_id, account_name payer, transaction&& trx, bool replace_existing ) {
+   trx_context.require_writable( "deferred transactions" );
    EOS_ASSERT( trx.context_free_actions.size() == 0, cfa_inside_generated_tx, "context free actions are not currently allowed in generated transactions" );
 
    bool enforce_actor_whitelist_blacklist = trx_context.enforce_whiteblacklist && control.is_producing_block()
@@ -540,6 +557,7 @@ void apply_context::schedule_deferred_transaction( const uint128_t& sender_id, a
 }
 
 bool apply_context::cancel_deferred_transaction( const uint128_t& sender_id, account_name sender ) {
+   trx_context.require_writable( "deferred transactions" );
    auto& generated_transaction_idx = db.get_mutable_index<generated_transaction_multi_index>();
    const auto* gto = db.find<generated_transaction_object,by_sender_id>(boost::make_tuple(sender, sender_id));
    if ( gto ) {
@@ -579,6 +597,8 @@ const table_id_object& apply_context::find_or_create_table( name code, name scop
       return *existing_tid;
    }
 
+   trx_context.require_writable( "contract tables" );
+
    update_db_usage(payer, config::billable_size_v<table_id_object>);
 
    return db.create<table_id_object>([&](table_id_object &t_id){
@@ -594,6 +614,10 @@ void apply_context::remove_table( const table_id_object& tid ) {
    db.remove(tid);
 }
 
+void apply_context::require_writable( const char* what )const {
+   trx_context.require_writable( what );
+}
+
 vector<account_name> apply_context::get_active_producers() const {
    const auto& ap = control.active_producers();
    vector<account_name> accounts; accounts.reserve( ap.producers.size() );
@@ -670,6 +694,7 @@ int apply_context::db_store_i64( name scope, name table, const account_name& pay
 
 int apply_context::db_store_i64( name code, name scope, name table, const account_name& payer, uint64_t id, const char* buffer, size_t buffer_size ) {
 //   require_write_lock( scope );
+   trx_context.require_writable( "contract tables" );
    const auto& tab = find_or_create_table( code, scope, table, payer );
    auto tableid = tab.id;
 
@@ -700,6 +725,7 @@ void apply_context::db_update_i64( int iterator, account_name payer, const char*
    EOS_ASSERT( table_obj.code == receiver, table_access_violation, "db access violation" );
 
 //   require_write_lock( table_obj.scope );
+   trx_context.require_writable( "contract tables" );
 
    const int64_t overhead = config::billable_size_v<key_value_object>;
    int64_t old_size = (int64_t)(obj.value.size() + overhead);
@@ -730,6 +756,7 @@ void apply_context::db_remove_i64( int iterator ) {
    EOS_ASSERT( table_obj.code == receiver, table_access_violation, "db access violation" );
 
 //   require_write_lock( table_obj.scope );
+   trx_context.require_writable( "contract tables" );
 
    update_db_usage( obj.payer,  -(obj.value.size() + config::billable_size_v<key_value_object>) );
 
@@ -92,8 +92,9 @@ namespace eosio { namespace chain {
       };
    }
 
-   void authorization_manager::add_to_snapshot( const snapshot_writer_ptr& snapshot ) const {
-      authorization_index_set::walk_indices([this, &snapshot]( auto utils ){
+   void authorization_manager::add_to_snapshot( const snapshot_writer_ptr& snapshot,
+                                                const std::function<bool(const std::string&)>& include_section ) const {
+      authorization_index_set::walk_indices([this, &snapshot, &include_section]( auto utils ){
          using section_t = typename decltype(utils)::index_t::value_type;
 
          // skip the permission_usage_index as its inlined with permission_index
@@ -101,6 +102,10 @@ namespace eosio { namespace chain {
             return;
          }
 
+         if (include_section && !include_section(detail::snapshot_section_traits<section_t>::section_name())) {
+            return;
+         }
+
          snapshot->write_section<section_t>([this]( auto& section ){
             decltype(utils)::walk(_db, [this, &section]( const auto &row ) {
                section.add_row(row, _db);
@@ -129,6 +134,34 @@ namespace eosio { namespace chain {
       });
    }
 
+   void authorization_manager::add_changed_snapshot_sections( std::set<std::string>& sections ) const {
+      authorization_index_set::walk_indices([this, &sections]( auto utils ){
+         using section_t = typename decltype(utils)::index_t::value_type;
+
+         if (!decltype(utils)::changed_in_head_undo_session(_db)) {
+            return;
+         }
+
+         // the permission_usage_index is inlined with permission_index
+         if (std::is_same<section_t, permission_usage_object>::value) {
+            sections.insert(detail::snapshot_section_traits<permission_object>::section_name());
+         } else {
+            sections.insert(detail::snapshot_section_traits<section_t>::section_name());
+         }
+      });
+   }
+
+   void authorization_manager::add_snapshot_sections( std::set<std::string>& sections ) const {
+      authorization_index_set::walk_indices([&sections]( auto utils ){
+         using section_t = typename decltype(utils)::index_t::value_type;
+
+         // the permission_usage_index is inlined with permission_index
+         if (!std::is_same<section_t, permission_usage_object>::value) {
+            sections.insert(detail::snapshot_section_traits<section_t>::section_name());
+         }
+      });
+   }
+
    const permission_object& authorization_manager::create_permission( account_name account,
                                                                       permission_name name,
                                                                       permission_id_type parent,
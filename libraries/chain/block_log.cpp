@@ -1,9 +1,23 @@
 #include <eosio/chain/block_log.hpp>
+#include <eosio/chain/compressed_block_file.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <fstream>
 #include <fc/bitutil.hpp>
 #include <fc/io/cfile.hpp>
 #include <fc/io/raw.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
 
 
 #define LOG_READ  (std::ios::in | std::ios::binary)
@@ -36,6 +50,139 @@ namespace eosio { namespace chain {
 
    namespace detail {
       using unique_file = std::unique_ptr<FILE, decltype(&fclose)>;
+      namespace bip = boost::interprocess;
+
+      /*
+       *  @brief immutable read-only mapping of blocks.log and blocks.index covering [first_block_num, last_block_num]
+       *
+       *  A new mapping is created when a reader asks for a block appended after this one was made; readers still
+       *  holding the old mapping (directly or through a packed_block_span) keep it alive until they release it.
+       */
+      struct mapped_block_log {
+         mapped_block_log( const fc::path& block_file_name, const fc::path& index_file_name,
+                           uint64_t log_size, uint32_t first, uint32_t last )
+         : block_mapping( block_file_name.generic_string().c_str(), bip::read_only )
+         , block_region( block_mapping, bip::read_only, 0, log_size )
+         , index_mapping( index_file_name.generic_string().c_str(), bip::read_only )
+         , index_region( index_mapping, bip::read_only, 0, sizeof(uint64_t) * (last - first + 1) )
+         , log_size( log_size )
+         , first_block_num( first )
+         , last_block_num( last ) {
+         }
+
+         // blocks are inflated from the compressed file, only the index is mapped
+         mapped_block_log( std::shared_ptr<const compressed_block_file> compressed_file, const fc::path& index_file_name,
+                           uint32_t first, uint32_t last )
+         : index_mapping( index_file_name.generic_string().c_str(), bip::read_only )
+         , index_region( index_mapping, bip::read_only, 0, sizeof(uint64_t) * (last - first + 1) )
+         , compressed( std::move( compressed_file ) )
+         , log_size( compressed->size() )
+         , first_block_num( first )
+         , last_block_num( last ) {
+         }
+
+         bool contains( uint32_t block_num )const {
+            return block_num >= first_block_num && block_num <= last_block_num;
+         }
+
+         const char* data()const { return reinterpret_cast<const char*>( block_region.get_address() ); }
+
+         uint64_t block_pos( uint32_t block_num )const {
+            return reinterpret_cast<const uint64_t*>( index_region.get_address() )[block_num - first_block_num];
+         }
+
+         // every block is followed by its own position, so it ends 8 bytes before the next block starts
+         uint64_t block_end( uint32_t block_num )const {
+            return (block_num == last_block_num ? log_size : block_pos( block_num + 1 )) - sizeof(uint64_t);
+         }
+
+         bip::file_mapping  block_mapping;
+         bip::mapped_region block_region;
+         bip::file_mapping  index_mapping;
+         bip::mapped_region index_region;
+         const std::shared_ptr<const compressed_block_file> compressed;
+         const uint64_t     log_size;
+         const uint32_t     first_block_num;
+         const uint32_t     last_block_num;
+      };
+      using mapped_block_log_ptr = std::shared_ptr<const mapped_block_log>;
+
+      packed_block_span packed_span( mapped_block_log_ptr m, uint32_t block_num ) {
+         packed_block_span span;
+         const uint64_t pos = m->block_pos( block_num );
+         const uint64_t end = m->block_end( block_num );
+         EOS_ASSERT( pos < end && end <= m->log_size, block_log_exception,
+                     "Block log index entry for block ${num} points outside of the mapped block log: ${pos} to ${end} of ${size}",
+                     ("num", block_num)("pos", pos)("end", end)("size", m->log_size) );
+         if( m->compressed ) {
+            auto buffer = std::make_shared<std::vector<char>>( m->compressed->read( pos, end - pos ) );
+            span.data = buffer->data();
+            span.size = buffer->size();
+            span.owner = std::move( buffer );
+            return span;
+         }
+         span.data = m->data() + pos;
+         span.size = end - pos;
+         span.owner = std::move( m );
+         return span;
+      }
+
+      /*
+       *  @brief a completed part of the block log, blocks-<first>-<last>.log with its own blocks-<first>-<last>.index
+       *
+       *  Retained segments are never written again, so they are always read through a mapping created on first use.
+       *  A compressed segment is stored as blocks-<first>-<last>.clog next to the same, uncompressed, index.
+       */
+      struct block_log_segment {
+         uint32_t             first_block_num = 0;
+         uint32_t             last_block_num  = 0;
+         bool                 compressed = false;
+         fc::path             log_path;
+         fc::path             index_path;
+         mapped_block_log_ptr mapping;
+
+         block_log_segment( const fc::path& dir, uint32_t first, uint32_t last, bool compressed = false )
+         : first_block_num( first )
+         , last_block_num( last )
+         , compressed( compressed ) {
+            log_path = dir / (base_name() + (compressed ? ".clog" : ".log"));
+            index_path = dir / (base_name() + ".index");
+         }
+
+         std::string base_name()const {
+            return "blocks-" + std::to_string( first_block_num ) + "-" + std::to_string( last_block_num );
+         }
+
+         fc::path compressed_path()const {
+            return log_path.parent_path() / (base_name() + ".clog");
+         }
+
+         /// the segment stored in the file dir/name, if name is blocks-<first>-<last>.log or .clog
+         static fc::optional<block_log_segment> from_file_name( const fc::path& dir, const std::string& name ) {
+            uint32_t first = 0, last = 0;
+            int consumed = 0;
+            if( sscanf( name.c_str(), "blocks-%u-%u.%n", &first, &last, &consumed ) != 2 || first == 0 || first > last ) {
+               return fc::optional<block_log_segment>();
+            }
+            const auto ext = name.substr( consumed );
+            if( ext != "log" && ext != "clog" ) {
+               return fc::optional<block_log_segment>();
+            }
+            return block_log_segment( dir, first, last, ext == "clog" );
+         }
+
+         mapped_block_log_ptr map()const {
+            if( compressed ) {
+               return std::make_shared<const mapped_block_log>( std::make_shared<const compressed_block_file>( log_path ), index_path,
+                                                                first_block_num, last_block_num );
+            }
+            return std::make_shared<const mapped_block_log>( log_path, index_path, fc::file_size( log_path ),
+                                                             first_block_num, last_block_num );
+         }
+      };
+
+      // the previous block id stored in the header carries the big endian number of the preceding block
+      uint32_t packed_block_num( const packed_block_span& span );
 
       class block_log_impl {
          public:
@@ -48,6 +195,29 @@ namespace eosio { namespace chain {
             uint32_t                 version = 0;
             uint32_t                 first_block_num = 0;
 
+            bool                     mapped_reads = false;
+            std::mutex               mapping_mtx;               // only taken to remap or publish, never for reads
+            mapped_block_log_ptr     mapping;                   // accessed through std::atomic_load/atomic_store
+            uint64_t                 published_log_size = 0;    // guarded by mapping_mtx
+            uint32_t                 published_first_num = 0;   // guarded by mapping_mtx
+            uint32_t                 published_head_num = 0;    // guarded by mapping_mtx
+
+            uint32_t                 stride = std::numeric_limits<uint32_t>::max();
+            uint16_t                 max_retained_files = 0;
+            fc::path                 archive_dir;
+            std::unique_ptr<named_thread_pool> archive_pool;    // copies retired segments to an archive_dir on another filesystem
+            std::vector<std::future<void>> archive_copies;      // only touched by the appending thread
+            mutable std::mutex       catalog_mtx;
+            std::map<uint32_t, block_log_segment> catalog;      // by first block num, guarded by catalog_mtx
+            // declared last so queued compressions are stopped before the catalog goes away
+            std::unique_ptr<named_thread_pool> compress_pool;
+
+            ~block_log_impl() {
+               for( auto& f : archive_copies ) {
+                  f.wait();
+               }
+            }
+
             inline void check_open_files() {
                if( !open_files ) {
                   reopen();
@@ -70,12 +240,42 @@ namespace eosio { namespace chain {
 
             void write( const chain_id_type& chain_id );
 
+            void write_header( const chain_id_type& chain_id, uint32_t first_bnum );
+
             void flush();
 
             uint64_t append(const signed_block_ptr& b);
 
+            void publish_head( uint64_t log_size );
+
+            void unmap();
+
+            mapped_block_log_ptr get_mapping( uint32_t block_num );
+
+            packed_block_span read_mapped_block( uint32_t block_num );
+
+            void open_catalog( const fc::path& data_dir );
+
+            void roll_segment();
+
+            void queue_compression( uint32_t first_block_num );
+
+            void compress_segment( uint32_t first_block_num );
+
+            void retire_segments();
+
+            void copy_to_archive( const fc::path& p, const fc::path& target );
+
+            packed_block_span read_segment_block( uint32_t block_num );
+
+            packed_block_span read_span( uint32_t block_num );
+
             template <typename ChainContext, typename Lambda>
-            static fc::optional<ChainContext> extract_chain_context( const fc::path& data_dir, Lambda&& lambda );
+            static fc::optional<ChainContext> extract_chain_context( const fc::path& block_file_name, Lambda&& lambda );
+
+            static chain_id_type extract_chain_id( const fc::path& block_file_name );
+
+            static fc::optional<fc::path> oldest_segment_file( const fc::path& data_dir );
       };
 
       void detail::block_log_impl::reopen() {
@@ -94,6 +294,258 @@ namespace eosio { namespace chain {
          open_files = true;
       }
 
+      void detail::block_log_impl::publish_head( uint64_t log_size ) {
+         if( !mapped_reads )
+            return;
+
+         std::lock_guard<std::mutex> g( mapping_mtx );
+         published_log_size = log_size;
+         published_first_num = first_block_num;
+         published_head_num = head ? block_header::num_from_id( head_id ) : 0;
+      }
+
+      void detail::block_log_impl::unmap() {
+         if( !mapped_reads )
+            return;
+
+         std::lock_guard<std::mutex> g( mapping_mtx );
+         published_log_size = 0;
+         published_first_num = 0;
+         published_head_num = 0;
+         std::atomic_store( &mapping, mapped_block_log_ptr() );
+      }
+
+      mapped_block_log_ptr detail::block_log_impl::get_mapping( uint32_t block_num ) {
+         auto m = std::atomic_load( &mapping );
+         if( m && m->contains( block_num ) )
+            return m;
+
+         std::lock_guard<std::mutex> g( mapping_mtx );
+         // another reader may have remapped while we were waiting
+         m = std::atomic_load( &mapping );
+         if( m && m->contains( block_num ) )
+            return m;
+         if( published_head_num == 0 || block_num < published_first_num || block_num > published_head_num )
+            return {};
+
+         m = std::make_shared<const mapped_block_log>( block_file.get_file_path(), index_file.get_file_path(),
+                                                       published_log_size, published_first_num, published_head_num );
+         std::atomic_store( &mapping, m );
+         return m;
+      }
+
+      packed_block_span detail::block_log_impl::read_mapped_block( uint32_t block_num ) {
+         auto m = get_mapping( block_num );
+         if( !m )
+            return {};
+         return packed_span( std::move( m ), block_num );
+      }
+
+      packed_block_span detail::block_log_impl::read_segment_block( uint32_t block_num ) {
+         mapped_block_log_ptr m;
+         {
+            std::lock_guard<std::mutex> g( catalog_mtx );
+            auto itr = catalog.upper_bound( block_num );
+            if( itr == catalog.begin() )
+               return {};
+            auto& seg = (--itr)->second;
+            if( block_num > seg.last_block_num )
+               return {};
+            if( !seg.mapping ) {
+               seg.mapping = seg.map();
+            }
+            m = seg.mapping;
+         }
+         return packed_span( std::move( m ), block_num );
+      }
+
+      // blocks in retained segments, and with mapped reads every block, are served from a mapping
+      packed_block_span detail::block_log_impl::read_span( uint32_t block_num ) {
+         if( mapped_reads ) {
+            auto span = read_mapped_block( block_num );
+            if( !span.empty() )
+               return span;
+         }
+         return read_segment_block( block_num );
+      }
+
+      void detail::block_log_impl::open_catalog( const fc::path& data_dir ) {
+         std::map<uint32_t, block_log_segment> found;
+         for( boost::filesystem::directory_iterator itr( data_dir ), end; itr != end; ++itr ) {
+            auto parsed = block_log_segment::from_file_name( data_dir, itr->path().filename().generic_string() );
+            if( !parsed ) {
+               continue;
+            }
+            block_log_segment seg = std::move( *parsed );
+            const uint32_t first = seg.first_block_num;
+            auto existing = found.find( first );
+            if( existing != found.end() ) {
+               // compression finished but the uncompressed original was not removed yet
+               auto& raw = seg.compressed ? existing->second : seg;
+               fc::remove( raw.log_path );
+               if( seg.compressed )
+                  existing->second = std::move( seg );
+               continue;
+            }
+            found.emplace( first, std::move( seg ) );
+         }
+
+         for( auto& f : found ) {
+            auto& seg = f.second;
+            if( fc::exists( seg.index_path ) && fc::file_size( seg.index_path ) == sizeof(uint64_t) * (seg.last_block_num - seg.first_block_num + 1) )
+               continue;
+            ilog( "Reconstructing index of block log segment ${file}", ("file", seg.log_path.generic_string()) );
+            if( seg.compressed ) {
+               const auto tmp = seg.log_path.parent_path() / (seg.base_name() + ".log.tmp");
+               compressed_block_file::decompress( seg.log_path, tmp );
+               block_log::construct_index( tmp, seg.index_path );
+               fc::remove( tmp );
+            } else {
+               block_log::construct_index( seg.log_path, seg.index_path );
+            }
+         }
+
+         // only the run of segments leading up to the active blocks.log is usable
+         std::lock_guard<std::mutex> g( catalog_mtx );
+         catalog.clear();
+         for( auto itr = found.rbegin(); itr != found.rend(); ++itr ) {
+            const uint32_t expected_last = catalog.empty() ? itr->second.last_block_num : catalog.begin()->first - 1;
+            if( itr->second.last_block_num != expected_last ) {
+               wlog( "Ignoring block log segment ${file} and earlier, it does not adjoin block ${num}",
+                     ("file", itr->second.log_path.generic_string())("num", expected_last + 1) );
+               break;
+            }
+            catalog.emplace( itr->first, std::move( itr->second ) );
+         }
+      }
+
+      void detail::block_log_impl::roll_segment() {
+         const uint32_t seg_first = first_block_num;
+         const uint32_t last = block_header::num_from_id( head_id );
+         const auto data_dir = block_file.get_file_path().parent_path();
+         const auto chain_id = extract_chain_id( block_file.get_file_path() );
+         block_log_segment seg( data_dir, first_block_num, last );
+         ilog( "Rolling block log blocks ${first} to ${last} into ${file}",
+               ("first", first_block_num)("last", last)("file", seg.log_path.generic_string()) );
+
+         unmap();
+         close();
+         fc::rename( block_file.get_file_path(), seg.log_path );
+         fc::rename( index_file.get_file_path(), seg.index_path );
+         {
+            std::lock_guard<std::mutex> g( catalog_mtx );
+            catalog.emplace( seg.first_block_num, std::move( seg ) );
+         }
+
+         reopen();
+         write_header( chain_id, last + 1 );
+         publish_head( block_file.tellp() );
+         retire_segments();
+         queue_compression( seg_first );
+      }
+
+      void detail::block_log_impl::queue_compression( uint32_t first_block_num ) {
+         if( !compress_pool )
+            return;
+         boost::asio::post( compress_pool->get_executor(), [this, first_block_num]() {
+            compress_segment( first_block_num );
+         });
+      }
+
+      // runs on compress_pool, the segment stays readable uncompressed until the compressed file is complete
+      void detail::block_log_impl::compress_segment( uint32_t first_block_num ) {
+         fc::optional<block_log_segment> seg;
+         {
+            std::lock_guard<std::mutex> g( catalog_mtx );
+            auto itr = catalog.find( first_block_num );
+            if( itr == catalog.end() || itr->second.compressed )
+               return;
+            seg = itr->second;
+         }
+
+         const auto compressed_path = seg->compressed_path();
+         const auto tmp_path = compressed_path.parent_path() / (seg->base_name() + ".clog.tmp");
+         try {
+            const auto start = fc::time_point::now();
+            compressed_block_file::compress( seg->log_path, seg->index_path, tmp_path );
+            ilog( "Compressed block log segment ${file} from ${size} to ${csize} bytes in ${ms} ms",
+                  ("file", seg->log_path.generic_string())("size", fc::file_size( seg->log_path ))
+                  ("csize", fc::file_size( tmp_path ))("ms", (fc::time_point::now() - start).count() / 1000) );
+         } catch( const fc::exception& e ) {
+            wlog( "Unable to compress block log segment ${file}: ${e}", ("file", seg->log_path.generic_string())("e", e.to_detail_string()) );
+            fc::remove( tmp_path );
+            return;
+         }
+
+         std::lock_guard<std::mutex> g( catalog_mtx );
+         auto itr = catalog.find( first_block_num );
+         if( itr == catalog.end() || itr->second.compressed ) {
+            // retired or reset while it was being compressed
+            fc::remove( tmp_path );
+            return;
+         }
+         fc::rename( tmp_path, compressed_path );
+         itr->second = block_log_segment( compressed_path.parent_path(), seg->first_block_num, seg->last_block_num, true );
+         // readers holding spans into the old mapping keep reading the unlinked file
+         fc::remove( seg->log_path );
+      }
+
+      void detail::block_log_impl::retire_segments() {
+         std::vector<block_log_segment> retired;
+         {
+            std::lock_guard<std::mutex> g( catalog_mtx );
+            while( catalog.size() > max_retained_files ) {
+               // readers still holding spans into the segment keep its mapping alive
+               retired.push_back( std::move( catalog.begin()->second ) );
+               catalog.erase( catalog.begin() );
+            }
+         }
+
+         // no reader finds the retired segments in the catalog anymore, so their files are moved without the lock
+         for( const auto& seg : retired ) {
+            if( archive_dir.empty() ) {
+               ilog( "Removing block log segment ${file}", ("file", seg.log_path.generic_string()) );
+               fc::remove( seg.log_path );
+               fc::remove( seg.index_path );
+            } else {
+               ilog( "Archiving block log segment ${file} to ${dir}", ("file", seg.log_path.generic_string())("dir", archive_dir.generic_string()) );
+               if( !fc::is_directory( archive_dir ) )
+                  fc::create_directories( archive_dir );
+               for( const auto& p : { seg.log_path, seg.index_path } ) {
+                  const auto target = archive_dir / p.filename();
+                  boost::system::error_code ec;
+                  boost::filesystem::rename( p.generic_string(), target.generic_string(), ec );
+                  if( ec ) { // archive on another filesystem
+                     copy_to_archive( p, target );
+                  }
+               }
+            }
+         }
+      }
+
+      // copying a segment can take long, it is done on archive_pool to not hold up appending blocks
+      void detail::block_log_impl::copy_to_archive( const fc::path& p, const fc::path& target ) {
+         if( !archive_pool )
+            archive_pool = std::make_unique<named_thread_pool>( "blkarc", 1 );
+         archive_copies.erase( std::remove_if( archive_copies.begin(), archive_copies.end(), []( const auto& f ) {
+            return f.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+         }), archive_copies.end() );
+
+         archive_copies.push_back( async_thread_pool( archive_pool->get_executor(), [p, target]() {
+            // the archive never holds a partial copy, and the segment is only removed once it was copied
+            const auto tmp_path = target.parent_path() / (target.filename().generic_string() + ".tmp");
+            try {
+               fc::copy( p, tmp_path );
+               fc::rename( tmp_path, target );
+               fc::remove( p );
+            } catch( const fc::exception& e ) {
+               wlog( "Unable to archive block log segment file ${file}: ${e}", ("file", p.generic_string())("e", e.to_detail_string()) );
+               boost::system::error_code ec;
+               boost::filesystem::remove( tmp_path.generic_string(), ec );
+            }
+         }));
+      }
+
       class reverse_iterator {
       public:
          reverse_iterator();
@@ -122,8 +574,9 @@ namespace eosio { namespace chain {
          constexpr static uint64_t      _position_size                    = sizeof(_current_position_in_file);
       };
 
-      constexpr uint64_t buffer_location_to_file_location(uint32_t buffer_location) { return buffer_location << 3; }
-      constexpr uint32_t file_location_to_buffer_location(uint32_t file_location) { return file_location >> 3; }
+      // index files of 2^29 blocks or more are past 4 GiB, so file locations are computed in 64 bits
+      constexpr uint64_t buffer_location_to_file_location(uint64_t buffer_location) { return buffer_location << 3; }
+      constexpr uint32_t file_location_to_buffer_location(uint64_t file_location) { return file_location >> 3; }
 
       class index_writer {
       public:
@@ -147,6 +600,47 @@ namespace eosio { namespace chain {
          constexpr static uint64_t          _max_buffer_length        = file_location_to_buffer_location(_buffer_bytes);
       };
 
+      /*
+       *  @brief builds blocks.index from a read-only mapping of blocks.log using several threads
+       *
+       *  The log is split into equally sized regions. For every region boundary the last block starting before it
+       *  is located by scanning forward for a trailing position word that validates against its neighbouring blocks
+       *  (an anchor). Each thread then follows the backward links from its anchor down to the anchor of the region
+       *  below, writing positions straight into the mapped index file. Every link is checked, and each walk has to
+       *  end exactly on the anchor below it, which stitches the regions together.
+       */
+      class parallel_index_builder {
+      public:
+         parallel_index_builder(const fc::path& block_file_name, const fc::path& index_file_name);
+         void build(uint32_t num_threads);
+
+         constexpr static uint32_t _validation_depth = 3;
+
+      private:
+         struct anchor {
+            uint64_t pos       = 0;
+            uint32_t block_num = 0;
+         };
+
+         uint64_t word_at(uint64_t pos) const;
+         uint32_t block_num_at(uint64_t pos) const;
+         bool     previous(const anchor& a, anchor& prev) const;
+         bool     is_trailing_word(uint64_t word_pos, anchor& a) const;
+         bool     find_anchor(uint64_t boundary, anchor& a) const;
+         void     walk(const anchor& from, const anchor* to, uint64_t* index);
+
+         const std::string                  _block_file_name;
+         const std::string                  _index_file_name;
+         bip::file_mapping                  _block_mapping;
+         bip::mapped_region                 _block_region;
+         const char*                        _data                    = nullptr;
+         uint64_t                           _size                    = 0;
+         uint32_t                           _version                 = 0;
+         uint32_t                           _first_block_num         = 0;
+         anchor                             _head;
+         std::atomic<uint32_t>              _blocks_indexed{0};
+      };
+
       /*
        *  @brief datastream adapter that adapts FILE* for use with fc unpack
        *
@@ -181,8 +675,17 @@ namespace eosio { namespace chain {
       };
    }
 
-   block_log::block_log(const fc::path& data_dir)
+   block_log::block_log(const fc::path& data_dir, const block_log_config& config)
    :my(new detail::block_log_impl()) {
+      my->mapped_reads = config.mapped_reads;
+      my->stride = config.stride;
+      my->max_retained_files = config.max_retained_files;
+      if (config.compress_segments) {
+         my->compress_pool = std::make_unique<named_thread_pool>( "blkcmp", 1 );
+      }
+      if (!config.archive_dir.empty()) {
+         my->archive_dir = config.archive_dir.is_relative() ? data_dir / config.archive_dir : config.archive_dir;
+      }
       open(data_dir);
    }
 
@@ -199,6 +702,7 @@ namespace eosio { namespace chain {
    }
 
    void block_log::open(const fc::path& data_dir) {
+      my->unmap();
       my->close();
 
       if (!fc::is_directory(data_dir))
@@ -207,6 +711,7 @@ namespace eosio { namespace chain {
       my->block_file.set_file_path( data_dir / "blocks.log" );
       my->index_file.set_file_path( data_dir / "blocks.index" );
 
+      my->open_catalog( data_dir );
       my->reopen();
 
       /* On startup of the block log, there are several states the log file and the index file can be
@@ -278,12 +783,53 @@ namespace eosio { namespace chain {
             ilog("Index is empty");
             construct_index();
          }
+
+         my->publish_head( log_size );
       } else if (index_size) {
          ilog("Index is nonempty, remove and recreate it");
          my->close();
          fc::remove_all( my->index_file.get_file_path() );
          my->reopen();
       }
+
+      fc::optional<block_log_segment> last_seg;
+      {
+         std::lock_guard<std::mutex> g( my->catalog_mtx );
+         if (!my->catalog.empty())
+            last_seg = my->catalog.rbegin()->second;
+      }
+      if (last_seg) {
+         if (!log_size) {
+            // blocks.log was rolled into a segment but the next one was never started
+            ilog("Starting blocks.log after block log segment ${file}", ("file", last_seg->log_path.generic_string()));
+            my->write_header( detail::block_log_impl::extract_chain_id( last_seg->log_path ), last_seg->last_block_num + 1 );
+            my->genesis_written_to_block_log = true;
+         }
+         if (my->first_block_num != last_seg->last_block_num + 1) {
+            wlog("Ignoring block log segments, they end at block ${last} but blocks.log starts at ${first}",
+                 ("last", last_seg->last_block_num)("first", my->first_block_num));
+            std::lock_guard<std::mutex> g( my->catalog_mtx );
+            my->catalog.clear();
+         } else if (!my->head) {
+            my->head = read_block_by_num( last_seg->last_block_num );
+            EOS_ASSERT( my->head, block_log_exception, "Unable to read head block from block log segment ${file}",
+                        ("file", last_seg->log_path.generic_string()) );
+            my->head_id = my->head->id();
+         }
+      }
+      my->retire_segments();
+
+      std::vector<uint32_t> uncompressed;
+      {
+         std::lock_guard<std::mutex> g( my->catalog_mtx );
+         for (const auto& seg : my->catalog) {
+            if (!seg.second.compressed)
+               uncompressed.push_back(seg.first);
+         }
+      }
+      for (auto first : uncompressed) {
+         my->queue_compression(first);
+      }
    }
 
    uint64_t block_log::append(const signed_block_ptr& b) {
@@ -312,6 +858,11 @@ namespace eosio { namespace chain {
          head_id = b->id();
 
          flush();
+         publish_head( block_file.tellp() );
+
+         if( stride != std::numeric_limits<uint32_t>::max() && b->block_num() % stride == 0 ) {
+            roll_segment();
+         }
 
          return pos;
       }
@@ -329,10 +880,19 @@ namespace eosio { namespace chain {
 
    template<typename T>
    void detail::block_log_impl::reset( const T& t, const signed_block_ptr& first_block, uint32_t first_bnum ) {
+      unmap();
       close();
 
       fc::remove_all( block_file.get_file_path() );
       fc::remove_all( index_file.get_file_path() );
+      {
+         std::lock_guard<std::mutex> g( catalog_mtx );
+         for( const auto& seg : catalog ) {
+            fc::remove( seg.second.log_path );
+            fc::remove( seg.second.index_path );
+         }
+         catalog.clear();
+      }
 
       reopen();
 
@@ -388,6 +948,31 @@ namespace eosio { namespace chain {
       block_file << chain_id;
    }
 
+   // header of a block log that starts after an earlier segment, keeps head since it lives in that segment
+   void detail::block_log_impl::write_header( const chain_id_type& chain_id, uint32_t first_bnum ) {
+      check_open_files();
+      EOS_ASSERT( first_bnum > 1, block_log_exception, "Block log header without genesis state cannot start at block 1" );
+
+      version = 0; // version of 0 is invalid; it indicates that subsequent data was not properly written to the block log
+      first_block_num = first_bnum;
+
+      block_file.seek_end(0);
+      block_file.write((char*)&version, sizeof(version));
+      block_file.write((char*)&first_block_num, sizeof(first_block_num));
+      write(chain_id);
+
+      // append a totem to indicate the division between blocks and header
+      auto totem = block_log::npos;
+      block_file.write((char*)&totem, sizeof(totem));
+      auto pos = block_file.tellp();
+
+      version = block_log::max_supported_version;
+      block_file.seek( 0 );
+      block_file.write( (char*)&version, sizeof(version) );
+      block_file.seek( pos );
+      flush();
+   }
+
    signed_block_ptr block_log::read_block(uint64_t pos)const {
       my->check_open_files();
 
@@ -409,6 +994,17 @@ namespace eosio { namespace chain {
    signed_block_ptr block_log::read_block_by_num(uint32_t block_num)const {
       try {
          signed_block_ptr b;
+         if (my->mapped_reads || block_num < my->first_block_num) {
+            auto span = my->read_span(block_num);
+            if (!span.empty()) {
+               b = std::make_shared<signed_block>();
+               fc::datastream<const char*> ds(span.data, span.size);
+               fc::raw::unpack(ds, *b);
+               EOS_ASSERT(b->block_num() == block_num, reversible_blocks_exception,
+                         "Wrong block was read from block log.", ("returned", b->block_num())("expected", block_num));
+            }
+            return b;
+         }
          uint64_t pos = get_block_pos(block_num);
          if (pos != npos) {
             b = read_block(pos);
@@ -419,8 +1015,53 @@ namespace eosio { namespace chain {
       } FC_LOG_AND_RETHROW()
    }
 
+   packed_block_span block_log::read_packed_block_by_num(uint32_t block_num)const {
+      try {
+         packed_block_span span;
+         if (my->mapped_reads || block_num < my->first_block_num) {
+            span = my->read_span(block_num);
+         } else {
+            uint64_t pos = get_block_pos(block_num);
+            if (pos == npos)
+               return span;
+            uint64_t end;
+            if (block_num < block_header::num_from_id(my->head_id)) {
+               end = get_block_pos(block_num + 1) - sizeof(uint64_t);
+            } else {
+               my->block_file.seek_end(0);
+               end = my->block_file.tellp() - sizeof(uint64_t);
+            }
+            EOS_ASSERT(pos < end, block_log_exception,
+                       "Block log position of block ${num} is not before its end: ${pos} >= ${end}",
+                       ("num", block_num)("pos", pos)("end", end));
+            auto buffer = std::make_shared<std::vector<char>>(end - pos);
+            my->block_file.seek(pos);
+            my->block_file.read(buffer->data(), buffer->size());
+            span.data = buffer->data();
+            span.size = buffer->size();
+            span.owner = std::move(buffer);
+         }
+         if (!span.empty()) {
+            EOS_ASSERT(detail::packed_block_num(span) == block_num, reversible_blocks_exception,
+                       "Wrong block was read from block log.", ("returned", detail::packed_block_num(span))("expected", block_num));
+         }
+         return span;
+      } FC_LOG_AND_RETHROW()
+   }
+
    block_id_type block_log::read_block_id_by_num(uint32_t block_num)const {
       try {
+         if (my->mapped_reads || block_num < my->first_block_num) {
+            auto span = my->read_span(block_num);
+            if (span.empty())
+               return {};
+            block_header bh;
+            fc::datastream<const char*> ds(span.data, span.size);
+            fc::raw::unpack(ds, bh);
+            EOS_ASSERT(bh.block_num() == block_num, reversible_blocks_exception,
+                       "Wrong block header was read from block log.", ("returned", bh.block_num())("expected", block_num));
+            return bh.id();
+         }
          uint64_t pos = get_block_pos(block_num);
          if (pos != npos) {
             block_header bh;
@@ -471,11 +1112,13 @@ namespace eosio { namespace chain {
    }
 
    uint32_t block_log::first_block_num() const {
-      return my->first_block_num;
+      std::lock_guard<std::mutex> g( my->catalog_mtx );
+      return my->catalog.empty() ? my->first_block_num : my->catalog.begin()->first;
    }
 
    void block_log::construct_index() {
       ilog("Reconstructing Block Log Index...");
+      my->unmap();
       my->close();
 
       fc::remove_all( my->index_file.get_file_path() );
@@ -490,7 +1133,16 @@ namespace eosio { namespace chain {
       my->reopen();
    } // construct_index
 
-   void block_log::construct_index(const fc::path& block_file_name, const fc::path& index_file_name) {
+   void block_log::construct_index(const fc::path& block_file_name, const fc::path& index_file_name, uint32_t num_threads) {
+      if (num_threads == 0) {
+         num_threads = std::max(1u, std::thread::hardware_concurrency());
+      }
+      if (num_threads > 1) {
+         detail::parallel_index_builder builder(block_file_name, index_file_name);
+         builder.build(num_threads);
+         return;
+      }
+
       detail::reverse_iterator block_log_iter;
 
       ilog("Will read existing blocks.log file ${file}", ("file", block_file_name.generic_string()));
@@ -501,6 +1153,8 @@ namespace eosio { namespace chain {
       ilog("block log version= ${version}", ("version", block_log_iter.version()));
 
       if (num_blocks == 0) {
+         detail::unique_file index_file(FC_FOPEN(index_file_name.generic_string().c_str(), "w"), &fclose);
+         EOS_ASSERT( index_file, block_log_exception, "Could not open Block index file at '${blocks_index}'", ("blocks_index", index_file_name.generic_string()) );
          return;
       }
 
@@ -702,29 +1356,53 @@ namespace eosio { namespace chain {
    }
 
    template <typename ChainContext, typename Lambda>
-   fc::optional<ChainContext> detail::block_log_impl::extract_chain_context( const fc::path& data_dir, Lambda&& lambda ) {
-      EOS_ASSERT( fc::is_directory(data_dir) && fc::is_regular_file(data_dir / "blocks.log"), block_log_not_found,
-                  "Block log not found in '${blocks_dir}'", ("blocks_dir", data_dir)          );
+   fc::optional<ChainContext> detail::block_log_impl::extract_chain_context( const fc::path& block_file_name, Lambda&& lambda ) {
+      EOS_ASSERT( fc::is_regular_file(block_file_name), block_log_not_found,
+                  "Block log not found in '${blocks_dir}'", ("blocks_dir", block_file_name.parent_path()) );
+
+      auto extract = [&lambda](auto& block_stream) {
+         uint32_t version = 0;
+         block_stream.read( (char*)&version, sizeof(version) );
+         EOS_ASSERT( version >= block_log::min_supported_version && version <= block_log::max_supported_version, block_log_unsupported_version,
+                     "Unsupported version of block log. Block log version is ${version} while code supports version(s) [${min},${max}]",
+                     ("version", version)("min", block_log::min_supported_version)("max", block_log::max_supported_version) );
 
-      std::fstream  block_stream;
-      block_stream.open( (data_dir / "blocks.log").generic_string().c_str(), LOG_READ );
+         uint32_t first_block_num = 1;
+         if (version != 1) {
+            block_stream.read ( (char*)&first_block_num, sizeof(first_block_num) );
+         }
 
-      uint32_t version = 0;
-      block_stream.read( (char*)&version, sizeof(version) );
-      EOS_ASSERT( version >= block_log::min_supported_version && version <= block_log::max_supported_version, block_log_unsupported_version,
-                  "Unsupported version of block log. Block log version is ${version} while code supports version(s) [${min},${max}]",
-                  ("version", version)("min", block_log::min_supported_version)("max", block_log::max_supported_version) );
+         return lambda(block_stream, version, first_block_num);
+      };
 
-      uint32_t first_block_num = 1;
-      if (version != 1) {
-         block_stream.read ( (char*)&first_block_num, sizeof(first_block_num) );
+      if (compressed_block_file::is_compressed(block_file_name)) {
+         compressed_block_file file(block_file_name);
+         compressed_block_file_datastream block_stream(file);
+         return extract(block_stream);
       }
 
-      return lambda(block_stream, version, first_block_num);
+      std::fstream  block_stream;
+      block_stream.open( block_file_name.generic_string().c_str(), LOG_READ );
+      return extract(block_stream);
+   }
+
+   // the retained segment with the lowest first block, it holds the genesis state unless block 1 was retired
+   fc::optional<fc::path> detail::block_log_impl::oldest_segment_file( const fc::path& data_dir ) {
+      fc::optional<block_log_segment> oldest;
+      if( !fc::is_directory( data_dir ) )
+         return fc::optional<fc::path>();
+      for( boost::filesystem::directory_iterator itr( data_dir ), end; itr != end; ++itr ) {
+         auto seg = block_log_segment::from_file_name( data_dir, itr->path().filename().generic_string() );
+         if( seg && ( !oldest || seg->first_block_num < oldest->first_block_num ) )
+            oldest = std::move( seg );
+      }
+      if( !oldest )
+         return fc::optional<fc::path>();
+      return oldest->log_path;
    }
 
    fc::optional<genesis_state> block_log::extract_genesis_state( const fc::path& data_dir ) {
-      return detail::block_log_impl::extract_chain_context<genesis_state>(data_dir, [](std::fstream& block_stream, uint32_t version, uint32_t first_block_num ) -> fc::optional<genesis_state> {
+      auto extract = [](auto& block_stream, uint32_t version, uint32_t first_block_num ) -> fc::optional<genesis_state> {
          if (contains_genesis_state(version, first_block_num)) {
             genesis_state gs;
             fc::raw::unpack(block_stream, gs);
@@ -733,11 +1411,33 @@ namespace eosio { namespace chain {
 
          // current versions only have a genesis state if they start with block number 1
          return fc::optional<genesis_state>();
-      });
+      };
+
+      const auto block_file_name = data_dir / "blocks.log";
+      const auto oldest = detail::block_log_impl::oldest_segment_file( data_dir );
+      if( !oldest )
+         return detail::block_log_impl::extract_chain_context<genesis_state>( block_file_name, extract );
+
+      if( fc::is_regular_file( block_file_name ) ) {
+         auto gs = detail::block_log_impl::extract_chain_context<genesis_state>( block_file_name, extract );
+         if( gs )
+            return gs;
+      }
+      // blocks.log was begun by a roll, block 1 is in the oldest retained segment if it was not retired
+      return detail::block_log_impl::extract_chain_context<genesis_state>( *oldest, extract );
    }
 
    chain_id_type block_log::extract_chain_id( const fc::path& data_dir ) {
-      return *(detail::block_log_impl::extract_chain_context<chain_id_type>(data_dir, [](std::fstream& block_stream, uint32_t version, uint32_t first_block_num ) -> fc::optional<chain_id_type> {
+      // a blocks.log begun by a roll carries the chain id as well
+      if( !fc::is_regular_file( data_dir / "blocks.log" ) ) {
+         if( auto oldest = detail::block_log_impl::oldest_segment_file( data_dir ) )
+            return detail::block_log_impl::extract_chain_id( *oldest );
+      }
+      return detail::block_log_impl::extract_chain_id( data_dir / "blocks.log" );
+   }
+
+   chain_id_type detail::block_log_impl::extract_chain_id( const fc::path& block_file_name ) {
+      return *(detail::block_log_impl::extract_chain_context<chain_id_type>(block_file_name, [](auto& block_stream, uint32_t version, uint32_t first_block_num ) -> fc::optional<chain_id_type> {
          // supported versions either contain a genesis state, or else the chain id only
          if (contains_genesis_state(version, first_block_num)) {
             genesis_state gs;
@@ -944,6 +1644,202 @@ namespace eosio { namespace chain {
       }
    }
 
+   uint32_t detail::packed_block_num(const packed_block_span& span) {
+      uint32_t prior_blknum = 0;
+      EOS_ASSERT(span.size >= trim_data::blknum_offset + sizeof(prior_blknum), block_log_exception,
+                 "Packed block of ${size} bytes is too small to contain a block header", ("size", span.size));
+      memcpy(&prior_blknum, span.data + trim_data::blknum_offset, sizeof(prior_blknum));
+      return fc::endian_reverse_u32(prior_blknum) + 1;
+   }
+
+   detail::parallel_index_builder::parallel_index_builder(const fc::path& block_file_name, const fc::path& index_file_name)
+   : _block_file_name(block_file_name.generic_string())
+   , _index_file_name(index_file_name.generic_string()) {
+      ilog("Will read existing blocks.log file ${file}", ("file", _block_file_name));
+      ilog("Will write new blocks.index file ${file}", ("file", _index_file_name));
+
+      _size = boost::filesystem::file_size(_block_file_name);
+      EOS_ASSERT( _size > sizeof(_version) + sizeof(uint64_t), block_log_exception,
+                  "Block log file at '${blocks_log}' could not be read.", ("blocks_log", _block_file_name) );
+      _block_mapping = bip::file_mapping(_block_file_name.c_str(), bip::read_only);
+      _block_region = bip::mapped_region(_block_mapping, bip::read_only, 0, _size);
+      _data = reinterpret_cast<const char*>(_block_region.get_address());
+
+      memcpy(&_version, _data, sizeof(_version));
+      EOS_ASSERT( block_log::is_supported_version(_version), block_log_unsupported_version,
+                  "block log version ${v} is not supported", ("v", _version));
+      _first_block_num = 1;
+      if (_version != 1) {
+         memcpy(&_first_block_num, _data + sizeof(_version), sizeof(_first_block_num));
+      }
+      ilog("block log version= ${version}", ("version", _version));
+
+      _head.pos = word_at(_size - sizeof(uint64_t));
+      if (_head.pos != block_log::npos) {
+         _head.block_num = block_num_at(_head.pos);
+         EOS_ASSERT( _head.block_num >= _first_block_num, block_log_exception,
+                     "Block log file at '${blocks_log}' ends with block ${num} before its first block ${first}",
+                     ("blocks_log", _block_file_name)("num", _head.block_num)("first", _first_block_num) );
+      }
+   }
+
+   uint64_t detail::parallel_index_builder::word_at(uint64_t pos) const {
+      uint64_t word;
+      memcpy(&word, _data + pos, sizeof(word));
+      return word;
+   }
+
+   uint32_t detail::parallel_index_builder::block_num_at(uint64_t pos) const {
+      uint32_t prior_blknum;
+      EOS_ASSERT( pos + trim_data::blknum_offset + sizeof(prior_blknum) <= _size, block_log_exception,
+                  "Block log file at '${blocks_log}' has a block position ${pos} past the end of the file",
+                  ("blocks_log", _block_file_name)("pos", pos) );
+      memcpy(&prior_blknum, _data + pos + trim_data::blknum_offset, sizeof(prior_blknum));
+      return fc::endian_reverse_u32(prior_blknum) + 1;            //convert from big endian to little endian and add 1
+   }
+
+   // follows the trailing position word of the block before a, which must be a strictly earlier block numbered one less
+   bool detail::parallel_index_builder::previous(const anchor& a, anchor& prev) const {
+      if (a.block_num <= _first_block_num || a.pos < sizeof(uint64_t) + sizeof(_version))
+         return false;
+      prev.pos = word_at(a.pos - sizeof(uint64_t));
+      if (prev.pos >= a.pos - sizeof(uint64_t) || prev.pos + trim_data::blknum_offset + sizeof(uint32_t) > a.pos)
+         return false;
+      prev.block_num = block_num_at(prev.pos);
+      return prev.block_num + 1 == a.block_num;
+   }
+
+   bool detail::parallel_index_builder::is_trailing_word(uint64_t word_pos, anchor& a) const {
+      a.pos = word_at(word_pos);
+      if (a.pos >= word_pos || a.pos + trim_data::blknum_offset + sizeof(uint32_t) > word_pos)
+         return false;
+      a.block_num = block_num_at(a.pos);
+      if (a.block_num < _first_block_num || a.block_num > _head.block_num)
+         return false;
+
+      // the block following this word has to be the next block
+      const uint64_t next_pos = word_pos + sizeof(uint64_t);
+      if (next_pos == _size) {
+         if (a.block_num != _head.block_num)
+            return false;
+      } else if (next_pos + trim_data::blknum_offset + sizeof(uint32_t) > _size || block_num_at(next_pos) != a.block_num + 1) {
+         return false;
+      }
+
+      // and the blocks before it have to link back consistently
+      anchor cur = a;
+      for (uint32_t i = 0; i < _validation_depth && cur.block_num > _first_block_num; ++i) {
+         anchor prev;
+         if (!previous(cur, prev))
+            return false;
+         cur = prev;
+      }
+      return true;
+   }
+
+   // locate the last block starting before boundary
+   bool detail::parallel_index_builder::find_anchor(uint64_t boundary, anchor& a) const {
+      for (uint64_t word_pos = boundary; word_pos + sizeof(uint64_t) <= _size; ++word_pos) {
+         if (!is_trailing_word(word_pos, a))
+            continue;
+         while (a.pos >= boundary) {
+            anchor prev;
+            if (!previous(a, prev))
+               return false;
+            a = prev;
+         }
+         return true;
+      }
+      return false;
+   }
+
+   // index every block from `from` down to, but excluding, `to` (or down to the first block when there is no `to`)
+   void detail::parallel_index_builder::walk(const anchor& from, const anchor* to, uint64_t* index) {
+      const uint32_t last = to ? to->block_num : _first_block_num - 1;
+      anchor cur = from;
+      uint32_t since_report = 0;
+      while (true) {
+         index[cur.block_num - _first_block_num] = cur.pos;
+         if (++since_report == 0x10000) {
+            _blocks_indexed += since_report;
+            since_report = 0;
+         }
+         if (cur.block_num == last + 1)
+            break;
+         anchor prev;
+         EOS_ASSERT( previous(cur, prev), block_log_exception,
+                     "Block log file at '${blocks_log}' formatting is incorrect, block ${num} at position ${pos} does not link back to block ${prev}",
+                     ("blocks_log", _block_file_name)("num", cur.block_num)("pos", cur.pos)("prev", cur.block_num - 1) );
+         cur = prev;
+      }
+      _blocks_indexed += since_report;
+
+      if (to) {
+         anchor below;
+         EOS_ASSERT( previous(cur, below) && below.pos == to->pos, block_log_exception,
+                     "Block log file at '${blocks_log}' regions do not stitch together at block ${num}",
+                     ("blocks_log", _block_file_name)("num", to->block_num) );
+      } else if (_version != 1) {
+         EOS_ASSERT( cur.pos >= sizeof(uint64_t) && word_at(cur.pos - sizeof(uint64_t)) == block_log::npos, block_log_exception,
+                     "Block log file at '${blocks_log}' does not have the separator between header and first block ${num}",
+                     ("blocks_log", _block_file_name)("num", cur.block_num) );
+      }
+   }
+
+   void detail::parallel_index_builder::build(uint32_t num_threads) {
+      if (_head.pos == block_log::npos) {
+         // no blocks, leave an empty index as the serial builder does
+         unique_file index_file(FC_FOPEN(_index_file_name.c_str(), "w"), &fclose);
+         EOS_ASSERT( index_file, block_log_exception, "Could not open Block index file at '${blocks_index}'", ("blocks_index", _index_file_name) );
+         return;
+      }
+      const uint32_t num_blocks = _head.block_num - _first_block_num + 1;
+      ilog("first block= ${first}         last block= ${last}", ("first", _first_block_num)("last", _head.block_num));
+
+      // anchors sorted from the bottom up; regions too small to be worth a thread are merged
+      std::vector<anchor> anchors;
+      const uint64_t region_size = std::max<uint64_t>(_size / num_threads, reverse_iterator::_buf_len);
+      for (uint64_t boundary = region_size; boundary < _size; boundary += region_size) {
+         anchor a;
+         if (find_anchor(boundary, a) && (anchors.empty() || anchors.back().block_num < a.block_num) &&
+             a.block_num < _head.block_num) {
+            anchors.push_back(a);
+         }
+      }
+      anchors.push_back(_head);
+      ilog("indexing ${n} blocks in ${r} regions", ("n", num_blocks)("r", anchors.size()));
+
+      {
+         unique_file index_file(FC_FOPEN(_index_file_name.c_str(), "w"), &fclose);
+         EOS_ASSERT( index_file, block_log_exception, "Could not open Block index file at '${blocks_index}'", ("blocks_index", _index_file_name) );
+      }
+      boost::filesystem::resize_file(_index_file_name, buffer_location_to_file_location(num_blocks));
+      bip::file_mapping index_mapping(_index_file_name.c_str(), bip::read_write);
+      bip::mapped_region index_region(index_mapping, bip::read_write);
+      uint64_t* index = reinterpret_cast<uint64_t*>(index_region.get_address());
+
+      named_thread_pool pool("blklog", std::min<size_t>(num_threads, anchors.size()));
+      std::vector<std::future<void>> walks;
+      for (size_t i = 0; i < anchors.size(); ++i) {
+         const anchor* to = i == 0 ? nullptr : &anchors[i - 1];
+         walks.emplace_back(async_thread_pool(pool.get_executor(), [this, &anchors, i, to, index]() {
+            walk(anchors[i], to, index);
+         }));
+      }
+
+      for (auto& w : walks) {
+         while (w.wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+            ilog("indexed ${n} of ${total} blocks", ("n", _blocks_indexed.load())("total", num_blocks));
+         }
+      }
+      for (auto& w : walks) {
+         w.get();
+      }
+
+      index_region.flush();
+      ilog("indexed ${n} of ${total} blocks", ("n", _blocks_indexed.load())("total", num_blocks));
+   }
+
    bool block_log::contains_genesis_state(uint32_t version, uint32_t first_block_num) {
       return version <= 2 || first_block_num == 1;
    }
@@ -0,0 +1,293 @@
+#include <eosio/chain/compressed_block_file.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <fc/io/cfile.hpp>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <zlib.h>
+
+namespace eosio { namespace chain {
+
+   namespace {
+      struct seek_point_entry {
+         uint64_t uncompressed_offset;
+         uint64_t compressed_offset;
+      };
+
+      struct compressed_trailer {
+         uint64_t uncompressed_size;
+         uint32_t seek_point_count;
+         uint32_t magic;
+      };
+
+      // These are hard-coded expectations in the written file format
+      //
+      static_assert(sizeof(seek_point_entry) == 16, "unexpected size for seek point");
+      static_assert(sizeof(compressed_trailer) == 16, "unexpected size for compressed block log trailer");
+
+      constexpr int    raw_zlib_window_bits = -15;
+      constexpr size_t buffer_size = 64 * 1024;
+      // zlib counts available bytes with a 32 bit unsigned, so very large inputs are fed in pieces
+      constexpr uint64_t max_zlib_chunk = 1ull << 30;
+
+      struct inflater {
+         inflater() {
+            strm.zalloc = Z_NULL;
+            strm.zfree = Z_NULL;
+            strm.opaque = Z_NULL;
+            strm.avail_in = 0;
+            strm.next_in = Z_NULL;
+            EOS_ASSERT( inflateInit2(&strm, raw_zlib_window_bits) == Z_OK, block_log_exception,
+                        "Failed to initialize compressed block log decompression" );
+         }
+         ~inflater() { inflateEnd(&strm); }
+
+         z_stream strm;
+      };
+   }
+
+   namespace detail {
+      namespace bip = boost::interprocess;
+
+      struct compressed_block_file_impl {
+         explicit compressed_block_file_impl( const fc::path& file_path )
+         : file_path( file_path )
+         , mapping( file_path.generic_string().c_str(), bip::read_only )
+         , region( mapping, bip::read_only ) {
+            const auto file_size = region.get_size();
+            EOS_ASSERT( file_size >= sizeof(compressed_trailer), block_log_exception,
+                        "Compressed block log ${file} is too small", ("file", file_path.generic_string()) );
+            memcpy( &trailer, data() + file_size - sizeof(trailer), sizeof(trailer) );
+            EOS_ASSERT( trailer.magic == compressed_block_file::magic, block_log_exception,
+                        "${file} is not a compressed block log", ("file", file_path.generic_string()) );
+            const uint64_t table_size = sizeof(seek_point_entry) * trailer.seek_point_count;
+            EOS_ASSERT( trailer.seek_point_count > 0 && table_size + sizeof(trailer) <= file_size, block_log_exception,
+                        "Compressed block log ${file} has a malformed seek point table", ("file", file_path.generic_string()) );
+            data_size = file_size - sizeof(trailer) - table_size;
+            seek_points = reinterpret_cast<const seek_point_entry*>( data() + data_size );
+         }
+
+         const char* data()const { return reinterpret_cast<const char*>( region.get_address() ); }
+
+         // inflate from the seek point at or before pos, discarding output up to pos
+         void read( uint64_t pos, char* d, size_t n )const {
+            EOS_ASSERT( pos + n <= trailer.uncompressed_size, block_log_exception,
+                        "Attempting to read past the end of compressed block log ${file}: ${pos} + ${n} > ${size}",
+                        ("file", file_path.generic_string())("pos", pos)("n", n)("size", trailer.uncompressed_size) );
+            if( n == 0 )
+               return;
+
+            auto seek_pt = std::upper_bound( seek_points, seek_points + trailer.seek_point_count, pos,
+                                             []( uint64_t p, const seek_point_entry& e ) { return p < e.uncompressed_offset; } );
+            --seek_pt;
+
+            inflater z;
+            uint64_t in_pos = seek_pt->compressed_offset;
+            uint64_t to_skip = pos - seek_pt->uncompressed_offset;
+            std::vector<char> scratch( to_skip ? std::min<uint64_t>( to_skip, buffer_size ) : 0 );
+            size_t written = 0;
+
+            while( written < n ) {
+               if( z.strm.avail_in == 0 ) {
+                  EOS_ASSERT( in_pos < data_size, block_log_exception,
+                              "Compressed block log ${file} ended before offset ${pos}", ("file", file_path.generic_string())("pos", pos + n) );
+                  const auto chunk = std::min( data_size - in_pos, max_zlib_chunk );
+                  z.strm.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( data() + in_pos ) );
+                  z.strm.avail_in = chunk;
+                  in_pos += chunk;
+               }
+
+               size_t out_len;
+               if( to_skip ) {
+                  out_len = std::min<uint64_t>( to_skip, scratch.size() );
+                  z.strm.next_out = reinterpret_cast<Bytef*>( scratch.data() );
+               } else {
+                  out_len = std::min<uint64_t>( n - written, max_zlib_chunk );
+                  z.strm.next_out = reinterpret_cast<Bytef*>( d + written );
+               }
+               z.strm.avail_out = out_len;
+
+               const auto ret = inflate( &z.strm, Z_NO_FLUSH );
+               EOS_ASSERT( ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR, block_log_exception,
+                           "Error decompressing block log ${file}: ${msg}",
+                           ("file", file_path.generic_string())("msg", z.strm.msg ? z.strm.msg : std::to_string(ret)) );
+
+               const size_t produced = out_len - z.strm.avail_out;
+               if( to_skip ) {
+                  to_skip -= produced;
+               } else {
+                  written += produced;
+               }
+               EOS_ASSERT( ret != Z_STREAM_END || (to_skip == 0 && written == n), block_log_exception,
+                           "Compressed block log ${file} ended before offset ${pos}", ("file", file_path.generic_string())("pos", pos + n) );
+            }
+         }
+
+         fc::path                file_path;
+         bip::file_mapping       mapping;
+         bip::mapped_region      region;
+         compressed_trailer      trailer;
+         uint64_t                data_size = 0;
+         const seek_point_entry* seek_points = nullptr;
+      };
+   }
+
+   compressed_block_file::compressed_block_file( const fc::path& file_path )
+   : my( std::make_unique<detail::compressed_block_file_impl>( file_path ) ) {
+   }
+
+   compressed_block_file::~compressed_block_file() {}
+
+   uint64_t compressed_block_file::size()const {
+      return my->trailer.uncompressed_size;
+   }
+
+   size_t compressed_block_file::seek_point_count()const {
+      return my->trailer.seek_point_count;
+   }
+
+   void compressed_block_file::read( uint64_t pos, char* d, size_t n )const {
+      my->read( pos, d, n );
+   }
+
+   bool compressed_block_file::is_compressed( const fc::path& file_path ) {
+      if( !fc::is_regular_file( file_path ) || fc::file_size( file_path ) < sizeof(compressed_trailer) )
+         return false;
+      fc::cfile file;
+      file.set_file_path( file_path );
+      file.open( "rb" );
+      compressed_trailer trailer;
+      file.seek_end( -sizeof(trailer) );
+      file.read( reinterpret_cast<char*>(&trailer), sizeof(trailer) );
+      return trailer.magic == magic;
+   }
+
+   void compressed_block_file::compress( const fc::path& block_file_name, const fc::path& index_file_name,
+                                         const fc::path& output_file_name, size_t seek_point_stride ) {
+      EOS_ASSERT( fc::is_regular_file( block_file_name ), block_log_not_found,
+                  "Block log ${file} not found", ("file", block_file_name.generic_string()) );
+      EOS_ASSERT( fc::is_regular_file( index_file_name ), block_index_not_found,
+                  "Block index ${file} not found", ("file", index_file_name.generic_string()) );
+      EOS_ASSERT( seek_point_stride > 0, block_log_exception, "Seek point stride must be greater than 0" );
+
+      const uint64_t input_size = fc::file_size( block_file_name );
+      EOS_ASSERT( input_size > 0, block_log_exception, "Block log ${file} is empty", ("file", block_file_name.generic_string()) );
+
+      fc::cfile input_file;
+      input_file.set_file_path( block_file_name );
+      input_file.open( "rb" );
+
+      fc::cfile index_file;
+      index_file.set_file_path( index_file_name );
+      index_file.open( "rb" );
+      uint64_t positions_remaining = fc::file_size( index_file_name ) / sizeof(uint64_t);
+
+      fc::cfile output_file;
+      output_file.set_file_path( output_file_name );
+      output_file.open( "wb" );
+
+      z_stream strm;
+      strm.zalloc = Z_NULL;
+      strm.zfree = Z_NULL;
+      strm.opaque = Z_NULL;
+      EOS_ASSERT( deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, raw_zlib_window_bits, 8, Z_DEFAULT_STRATEGY) == Z_OK,
+                  block_log_exception, "Failed to initialize block log compression" );
+      std::unique_ptr<z_stream, decltype(&deflateEnd)> strm_guard( &strm, &deflateEnd );
+
+      auto input_buffer = std::vector<uint8_t>( buffer_size );
+      auto output_buffer = std::vector<uint8_t>( buffer_size );
+
+      // process a single chunk of input completely, draining as many output buffers as the compressor produces
+      auto process_chunk = [&]( size_t size, int mode ) {
+         strm.avail_in = size;
+         strm.next_in = input_buffer.data();
+         do {
+            strm.avail_out = output_buffer.size();
+            strm.next_out = output_buffer.data();
+            const auto ret = deflate( &strm, mode );
+            EOS_ASSERT( ret == Z_OK || ret == Z_BUF_ERROR || (mode == Z_FINISH && ret == Z_STREAM_END), block_log_exception,
+                        "Compressing block log ${file} failed: ${ret}", ("file", block_file_name.generic_string())("ret", ret) );
+            output_file.write( reinterpret_cast<const char*>(output_buffer.data()), output_buffer.size() - strm.avail_out );
+         } while( strm.avail_out == 0 );
+      };
+
+      // the next block starting at least seek_point_stride bytes after the last seek point, or the end of the file
+      auto next_seek_point = [&]( uint64_t last ) {
+         uint64_t pos = 0;
+         while( positions_remaining > 0 ) {
+            index_file.read( reinterpret_cast<char*>(&pos), sizeof(pos) );
+            --positions_remaining;
+            if( pos >= last + seek_point_stride && pos < input_size )
+               return pos;
+         }
+         return input_size;
+      };
+
+      std::vector<seek_point_entry> seek_points{ { 0, 0 } };
+      uint64_t read_offset = 0;
+      uint64_t sync_at = next_seek_point( 0 );
+      while( read_offset < input_size ) {
+         const auto read_size = std::min<uint64_t>( buffer_size, sync_at - read_offset );
+         input_file.read( reinterpret_cast<char*>(input_buffer.data()), read_size );
+         process_chunk( read_size, Z_NO_FLUSH );
+         read_offset += read_size;
+
+         if( read_offset == input_size ) {
+            process_chunk( 0, Z_FINISH );
+         } else if( read_offset == sync_at ) {
+            // create a seek point by flushing the compressor so a decompressor can start at this offset
+            process_chunk( 0, Z_FULL_FLUSH );
+            seek_points.push_back( { read_offset, output_file.tellp() } );
+            sync_at = next_seek_point( read_offset );
+         }
+      }
+
+      const compressed_trailer trailer{ input_size, static_cast<uint32_t>(seek_points.size()), magic };
+      output_file.write( reinterpret_cast<const char*>(seek_points.data()), seek_points.size() * sizeof(seek_point_entry) );
+      output_file.write( reinterpret_cast<const char*>(&trailer), sizeof(trailer) );
+      output_file.flush();
+      output_file.close();
+   }
+
+   void compressed_block_file::decompress( const fc::path& input_file_name, const fc::path& output_file_name ) {
+      compressed_block_file input( input_file_name );
+
+      fc::cfile output_file;
+      output_file.set_file_path( output_file_name );
+      output_file.open( "wb" );
+
+      // one inflate pass rather than read() per buffer, which would restart at a seek point every time
+      const auto& impl = *input.my;
+      inflater z;
+      auto output_buffer = std::vector<char>( buffer_size );
+      uint64_t in_pos = 0;
+      uint64_t written = 0;
+      int ret = Z_OK;
+      while( ret != Z_STREAM_END ) {
+         if( z.strm.avail_in == 0 ) {
+            EOS_ASSERT( in_pos < impl.data_size, block_log_exception,
+                        "Compressed block log ${file} is truncated", ("file", input_file_name.generic_string()) );
+            const auto chunk = std::min( impl.data_size - in_pos, max_zlib_chunk );
+            z.strm.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( impl.data() + in_pos ) );
+            z.strm.avail_in = chunk;
+            in_pos += chunk;
+         }
+         z.strm.avail_out = output_buffer.size();
+         z.strm.next_out = reinterpret_cast<Bytef*>( output_buffer.data() );
+         ret = inflate( &z.strm, Z_NO_FLUSH );
+         EOS_ASSERT( ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR, block_log_exception,
+                     "Error decompressing block log ${file}: ${msg}",
+                     ("file", input_file_name.generic_string())("msg", z.strm.msg ? z.strm.msg : std::to_string(ret)) );
+         const size_t produced = output_buffer.size() - z.strm.avail_out;
+         output_file.write( output_buffer.data(), produced );
+         written += produced;
+      }
+      EOS_ASSERT( written == input.size(), block_log_exception,
+                  "Decompressed ${n} bytes from ${file} but expected ${size}",
+                  ("n", written)("file", input_file_name.generic_string())("size", input.size()) );
+      output_file.flush();
+      output_file.close();
+   }
+
+} }
@@ -23,8 +23,11 @@
 #include <eosio/chain/authorization_manager.hpp>
 #include <eosio/chain/resource_limits.hpp>
 #include <eosio/chain/chain_snapshot.hpp>
+#include <eosio/chain/snapshot_delta.hpp>
 #include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/recovered_keys_cache.hpp>
 #include <eosio/chain/platform_timer.hpp>
+#include <eosio/chain/contract_profiler.hpp>
 
 #include <chainbase/chainbase.hpp>
 #include <fc/io/json.hpp>
@@ -32,6 +35,9 @@
 #include <fc/scoped_exit.hpp>
 #include <fc/variant_object.hpp>
 
+#include <deque>
+#include <fstream>
+#include <mutex>
 #include <new>
 
 namespace eosio { namespace chain {
@@ -92,6 +98,10 @@ class maybe_session {
             _session->push();
       }
 
+      bool valid() const {
+         return _session.valid();
+      }
+
       maybe_session& operator = ( maybe_session&& mv ) {
          if (mv._session) {
             _session = move(*mv._session);
@@ -215,6 +225,29 @@ struct pending_state {
    }
 };
 
+struct controller::read_only_thread_state {
+   /// eos-vm-oc keeps a single code cache per data directory, so read-only threads use the fastest other runtime
+   static wasm_interface::vm_type read_only_runtime( wasm_interface::vm_type vm ) {
+      if( vm != wasm_interface::vm_type::eos_vm_oc ) return vm;
+#if defined(EOSIO_EOS_VM_JIT_RUNTIME_ENABLED)
+      return wasm_interface::vm_type::eos_vm_jit;
+#elif defined(EOSIO_EOS_VM_RUNTIME_ENABLED)
+      return wasm_interface::vm_type::eos_vm;
+#else
+      return wasm_interface::vm_type::wabt;
+#endif
+   }
+
+   read_only_thread_state( const controller::config& cfg, const chainbase::database& db )
+   : wasmif( read_only_runtime( cfg.wasm_runtime ), false, db, cfg.state_dir, cfg.eosvmoc_config ) {}
+
+   platform_timer                 timer;
+#if defined(EOSIO_EOS_VM_RUNTIME_ENABLED) || defined(EOSIO_EOS_VM_JIT_RUNTIME_ENABLED)
+   vm::wasm_allocator             wasm_alloc;
+#endif
+   wasm_interface                 wasmif;
+};
+
 struct controller_impl {
 
    // LLVM sets the new handler, we need to reset this to throw a bad_alloc exception so we can possibly exit cleanly
@@ -232,22 +265,27 @@ struct controller_impl {
    block_state_ptr                head;
    fork_database                  fork_db;
    wasm_interface                 wasmif;
+   contract_profiler              profiler;
    resource_limits_manager        resource_limits;
    authorization_manager          authorization;
    protocol_feature_manager       protocol_features;
    controller::config             conf;
    const chain_id_type            chain_id; // read by thread_pool threads, value will not be changed
    optional<fc::time_point>       replay_head_time;
+   uint32_t                       replay_trusted_through = 0; ///< replayed blocks up to this one skip authorization and transaction checks
    db_read_mode                   read_mode = db_read_mode::SPECULATIVE;
    bool                           in_trx_requiring_checks = false; ///< if true, checks that are normally skipped on replay (e.g. auth checks) cannot be skipped
    optional<fc::microseconds>     subjective_cpu_leeway;
    bool                           trusted_producer_light_validation = false;
    uint32_t                       snapshot_head_block = 0;
-   named_thread_pool              thread_pool;
+   mutable named_thread_pool      thread_pool; // also serializes snapshot sections from const snapshot writes
+   recovered_keys_cache           recovered_keys;
+   mutable optional<snapshot_delta_tracker> delta_tracker; ///< set if conf.track_snapshot_deltas, reset by snapshot writes
    platform_timer                 timer;
 #if defined(EOSIO_EOS_VM_RUNTIME_ENABLED) || defined(EOSIO_EOS_VM_JIT_RUNTIME_ENABLED)
    vm::wasm_allocator                 wasm_alloc;
 #endif
+   vector<std::weak_ptr<controller::read_only_thread_state>> read_only_states; ///< to evict their runtime caches
 
    typedef pair<scope_name,action_name>                   handler_key;
    map< account_name, map<handler_key, apply_handler> >   apply_handlers;
@@ -270,6 +308,11 @@ struct controller_impl {
          EOS_ASSERT( head->block, block_validate_exception, "attempting to pop a block that was sparsely loaded from a snapshot");
       }
 
+      // undoing the block a delta would be based on loses changes that were made before it
+      if( delta_tracker && delta_tracker->valid && block_header::num_from_id( delta_tracker->base_block_id ) >= head->block_num ) {
+         delta_tracker->invalidate();
+      }
+
       head = prev;
 
       db.undo();
@@ -305,16 +348,19 @@ struct controller_impl {
     reversible_blocks( cfg.blocks_dir/config::reversible_blocks_dir_name,
         cfg.read_only ? database::read_only : database::read_write,
         cfg.reversible_cache_size, false, cfg.db_map_mode, cfg.db_hugepage_paths ),
-    blog( cfg.blocks_dir ),
+    blog( cfg.blocks_dir, block_log_config{ cfg.blocks_log_mapped_reads, cfg.blocks_log_stride,
+                                            cfg.max_retained_block_files, cfg.blocks_archive_dir,
+                                            cfg.compress_block_log_segments } ),
     fork_db( cfg.state_dir ),
-    wasmif( cfg.wasm_runtime, cfg.eosvmoc_tierup, db, cfg.state_dir, cfg.eosvmoc_config ),
+    wasmif( cfg.wasm_runtime, cfg.eosvmoc_tierup, db, cfg.state_dir, cfg.eosvmoc_config, cfg.wasm_instantiation ),
     resource_limits( db ),
     authorization( s, db ),
     protocol_features( std::move(pfs) ),
     conf( cfg ),
     chain_id( chain_id ),
     read_mode( cfg.read_mode ),
-    thread_pool( "chain", cfg.thread_pool_size )
+    thread_pool( "chain", cfg.thread_pool_size ),
+    recovered_keys( cfg.recovered_keys_cache_size )
    {
       fork_db.open( [this]( block_timestamp_type timestamp,
                             const flat_set<digest_type>& cur_features,
@@ -322,6 +368,10 @@ struct controller_impl {
                            { check_protocol_features( timestamp, cur_features, new_features ); }
       );
 
+      if( conf.track_snapshot_deltas ) {
+         delta_tracker.emplace();
+      }
+
       set_activation_handler<builtin_protocol_feature_t::preactivate_feature>();
       set_activation_handler<builtin_protocol_feature_t::replace_deferred>();
       set_activation_handler<builtin_protocol_feature_t::get_sender>();
@@ -330,6 +380,7 @@ struct controller_impl {
 
       self.irreversible_block.connect([this](const block_state_ptr& bsp) {
          wasmif.current_lib(bsp->block_num);
+         for_each_read_only_wasmif([&](wasm_interface& w) { w.current_lib(bsp->block_num); });
       });
 
 
@@ -469,6 +520,109 @@ struct controller_impl {
       initialize_database(genesis);
    }
 
+   /// a block of the block log read and prepared on the thread pool ahead of its turn to be applied
+   struct replay_block {
+      signed_block_ptr                  block;
+      bool                              keys_recovered = false;
+      /// one per packed transaction, those still being recovered are null and have a valid future instead
+      vector<transaction_metadata_ptr>  trx_metas;
+      vector<recover_keys_future>       recovering;
+
+      vector<transaction_metadata_ptr> take_trx_metas() {
+         for( size_t i = 0; i < trx_metas.size(); ++i ) {
+            if( !trx_metas[i] )
+               trx_metas[i] = recovering[i].get();
+         }
+         return std::move( trx_metas );
+      }
+   };
+
+   /// true while applying a replayed irreversible block no later than the trusted block
+   bool in_trusted_replay() const {
+      return pending && pending->_block_status == controller::block_status::irreversible &&
+             head->block_num < replay_trusted_through;
+   }
+
+   std::future<replay_block> start_replay_read( uint32_t block_num, bool recover_keys, std::mutex& read_mtx ) {
+      return async_thread_pool( thread_pool.get_executor(), [this, block_num, recover_keys, &read_mtx]() {
+         replay_block result;
+         {
+            // block log reads share its file position
+            std::lock_guard<std::mutex> g( read_mtx );
+            result.block = blog.read_block_by_num( block_num );
+         }
+         if( !result.block )
+            return result;
+
+         auto trx_mroot = calculate_trx_merkle( result.block->transactions );
+         EOS_ASSERT( result.block->transaction_mroot == trx_mroot, block_validate_exception,
+                     "invalid block transaction merkle root ${b} != ${c}", ("b", result.block->transaction_mroot)("c", trx_mroot) );
+
+         result.keys_recovered = recover_keys;
+         for( const auto& receipt : result.block->transactions ) {
+            if( !receipt.trx.contains<packed_transaction>() )
+               continue;
+            const auto& pt = receipt.trx.get<packed_transaction>();
+            if( recover_keys ) {
+               result.trx_metas.emplace_back();
+               result.recovering.emplace_back( transaction_metadata::start_recover_keys(
+                     std::make_shared<packed_transaction>( pt ), thread_pool.get_executor(), chain_id, microseconds::maximum() ) );
+            } else {
+               result.trx_metas.emplace_back( transaction_metadata::create_no_recover_keys( pt, transaction_metadata::trx_type::input ) );
+               result.recovering.emplace_back();
+            }
+         }
+         return result;
+      } );
+   }
+
+   /// the highest block of the block log that replay may trust, verifying the checkpoints within the log
+   uint32_t trusted_replay_block_num( uint32_t start_block_num, uint32_t blog_head_num ) const {
+      uint32_t trusted = conf.trust_block_log_replay ? blog_head_num : 0;
+      for( const auto& cp : conf.trusted_replay_checkpoints ) {
+         if( cp.first < start_block_num || cp.first > blog_head_num )
+            continue;
+         const auto id = blog.read_block_id_by_num( cp.first );
+         EOS_ASSERT( id == cp.second, checkpoint_exception,
+                     "Trusted replay checkpoint does not match the block log for block number ${num}: expected: ${expected} actual: ${actual}",
+                     ("num", cp.first)("expected", cp.second)("actual", id) );
+         trusted = std::max( trusted, cp.first );
+      }
+      return trusted;
+   }
+
+   fc::path replay_snapshot_path( uint32_t block_num ) const {
+      return conf.replay_snapshots_dir / fc::format_string( "replay-snapshot-${n}.bin", fc::mutable_variant_object()( "n", block_num ) );
+   }
+
+   /// write a snapshot of the state at head for resuming an interrupted replay, removing the ones written before
+   void write_replay_snapshot() {
+      fc::create_directories( conf.replay_snapshots_dir );
+      const auto temp_path = conf.replay_snapshots_dir / ".incomplete-replay-snapshot.bin";
+      {
+         std::ofstream out( temp_path.generic_string(), (std::ios::out | std::ios::binary) );
+         auto writer = std::make_shared<compressed_ostream_snapshot_writer>( out );
+         add_to_snapshot( writer );
+         writer->finalize();
+      }
+      const auto final_path = replay_snapshot_path( head->block_num );
+      fc::rename( temp_path, final_path );
+      remove_replay_snapshots( head->block_num );
+      ilog( "wrote replay snapshot ${path}", ("path", final_path.generic_string()) );
+   }
+
+   /// remove the replay snapshots other than the one of keep_block_num
+   void remove_replay_snapshots( uint32_t keep_block_num = 0 ) const {
+      if( conf.replay_snapshots_dir.empty() || !fc::is_directory( conf.replay_snapshots_dir ) )
+         return;
+      const auto keep = replay_snapshot_path( keep_block_num ).filename().generic_string();
+      for( boost::filesystem::directory_iterator itr( conf.replay_snapshots_dir ), end; itr != end; ++itr ) {
+         const auto name = itr->path().filename().generic_string();
+         if( name.find( "replay-snapshot-" ) == 0 && name != keep )
+            fc::remove( itr->path() );
+      }
+   }
+
    void replay(std::function<bool()> shutdown) {
       auto blog_head = blog.head();
       auto blog_head_time = blog_head->timestamp.to_time_point();
@@ -481,18 +635,74 @@ struct controller_impl {
       if( start_block_num <= blog_head->block_num() ) {
          ilog( "existing block log, attempting to replay from ${s} to ${n} blocks",
                ("s", start_block_num)("n", blog_head->block_num()) );
+
+         replay_trusted_through = trusted_replay_block_num( start_block_num, blog_head->block_num() );
+         auto reset_trusted = fc::make_scoped_exit( [this]() { replay_trusted_through = 0; } );
+         if( replay_trusted_through >= start_block_num ) {
+            ilog( "skipping authorization and transaction checks of blocks up to trusted block ${n}",
+                  ("n", replay_trusted_through) );
+         }
+
+         // blocks are read, unpacked and have their keys recovered on the thread pool while earlier ones are applied
+         const bool force_checks = conf.force_all_checks;
+         const uint32_t read_ahead = std::max<uint32_t>( conf.replay_read_ahead_blocks, 1 );
+         std::mutex read_mtx;
+         std::deque<std::future<replay_block>> ahead;
+         uint32_t next_read = start_block_num;
+         auto wait_for_reads = fc::make_scoped_exit( [&ahead]() {
+            // the reads refer to read_mtx
+            for( auto& f : ahead )
+               f.wait();
+         } );
+
+         fc::microseconds waited;
+         auto interval_start = fc::time_point::now();
+         uint32_t interval_blocks = 0;
          try {
-            while( auto next = blog.read_block_by_num( head->block_num + 1 ) ) {
-               replay_push_block( next, controller::block_status::irreversible );
-               if( next->block_num() % 500 == 0 ) {
-                  ilog( "${n} of ${head}", ("n", next->block_num())("head", blog_head->block_num()) );
+            while( true ) {
+               while( ahead.size() < read_ahead && next_read <= blog_head->block_num() ) {
+                  ahead.push_back( start_replay_read( next_read, force_checks && next_read > replay_trusted_through, read_mtx ) );
+                  ++next_read;
+               }
+               if( ahead.empty() )
+                  break;
+
+               auto wait_start = fc::time_point::now();
+               auto next = ahead.front().get();
+               ahead.pop_front();
+               if( !next.block )
+                  break;
+               auto metas = next.take_trx_metas();
+               waited += fc::time_point::now() - wait_start;
+
+               replay_push_block( next.block, controller::block_status::irreversible, std::move( metas ), next.keys_recovered );
+               ++interval_blocks;
+               if( conf.replay_snapshot_interval && next.block->block_num() % conf.replay_snapshot_interval == 0 &&
+                   next.block->block_num() < blog_head->block_num() ) {
+                  write_replay_snapshot();
+               }
+               if( next.block->block_num() % 500 == 0 ) {
+                  auto now = fc::time_point::now();
+                  ilog( "${n} of ${head}, ${bps} blocks/sec",
+                        ("n", next.block->block_num())("head", blog_head->block_num())
+                        ("bps", interval_blocks * 1000000 / std::max<int64_t>( (now - interval_start).count(), 1 )) );
+                  interval_start = now;
+                  interval_blocks = 0;
                   if( shutdown() ) break;
                }
             }
          } catch(  const database_guard_exception& e ) {
             except_ptr = std::current_exception();
          }
-         ilog( "${n} irreversible blocks replayed", ("n", 1 + head->block_num - start_block_num) );
+         auto replayed = 1 + head->block_num - start_block_num;
+         if( !except_ptr && head->block_num == blog_head->block_num() ) {
+            // the replay completed, nothing to resume from
+            remove_replay_snapshots();
+         }
+         ilog( "${n} irreversible blocks replayed, ${bps} blocks/sec, ${w} ms waiting for blocks read ahead",
+               ("n", replayed)
+               ("bps", uint64_t(replayed) * 1000000 / std::max<int64_t>( (fc::time_point::now() - start).count(), 1 ))
+               ("w", waited.count() / 1000) );
 
          auto pending_head = fork_db.pending_head();
          if( pending_head->block_num < head->block_num || head->block_num < fork_db.root()->block_num ) {
@@ -536,24 +746,89 @@ struct controller_impl {
       }
    }
 
-   void startup(std::function<bool()> shutdown, const snapshot_reader_ptr& snapshot) {
+   /// ensure every delta is based on the state left by the snapshot before it
+   void check_snapshot_delta_chain( const snapshot_reader_ptr& snapshot, const std::vector<snapshot_reader_ptr>& deltas ) {
+      chain_snapshot_header header;
+      snapshot->read_section<chain_snapshot_header>([this, &header]( auto &section ){
+         section.read_row(header, db);
+         header.validate();
+      });
+      EOS_ASSERT( header.version == chain_snapshot_header::current_version, snapshot_exception,
+                  "Snapshot deltas can only be applied to a snapshot of version ${current}, the snapshot is version ${version}",
+                  ("current", chain_snapshot_header::current_version)("version", header.version) );
+
+      block_header_state head_header_state;
+      snapshot->read_section<block_state>([this, &head_header_state]( auto &section ){
+         section.read_row(head_header_state, db);
+      });
+
+      block_id_type expected_base = head_header_state.id;
+      for( const auto& delta : deltas ) {
+         EOS_ASSERT( delta, snapshot_exception, "No snapshot delta reader provided" );
+         delta->validate();
+         EOS_ASSERT( delta->has_section<snapshot_delta_header>(), snapshot_exception, "Snapshot is not a snapshot delta" );
+
+         snapshot_delta_header delta_header;
+         delta->read_section<snapshot_delta_header>([this, &delta_header]( auto &section ){
+            section.read_row(delta_header, db);
+         });
+         EOS_ASSERT( delta_header.base_block_id == expected_base, snapshot_exception,
+                     "Snapshot delta is based on block ${base} but the state it applies to is at block ${expected}",
+                     ("base", delta_header.base_block_id)("expected", expected_base) );
+         expected_base = delta_header.block_id;
+      }
+   }
+
+   void startup(std::function<bool()> shutdown, const snapshot_reader_ptr& snapshot, const std::vector<snapshot_reader_ptr>& deltas) {
       EOS_ASSERT( snapshot, snapshot_exception, "No snapshot reader provided" );
       ilog( "Starting initialization from snapshot, this may take a significant amount of time" );
       try {
          snapshot->validate();
+
+         snapshot_reader_ptr state = snapshot;
+         if( !deltas.empty() ) {
+            EOS_ASSERT( !snapshot->has_section<snapshot_delta_header>(), snapshot_exception,
+                        "Snapshot deltas must be applied to a full snapshot" );
+            check_snapshot_delta_chain( snapshot, deltas );
+            ilog( "Applying ${n} snapshot deltas", ("n", deltas.size()) );
+
+            std::vector<snapshot_reader_ptr> layers;
+            layers.reserve( deltas.size() + 1 );
+            layers.push_back( snapshot );
+            layers.insert( layers.end(), deltas.begin(), deltas.end() );
+            state = std::make_shared<layered_snapshot_reader>( std::move(layers) );
+         }
+
          if( blog.head() ) {
-            read_from_snapshot( snapshot, blog.first_block_num(), blog.head()->block_num() );
+            read_from_snapshot( state, blog.first_block_num(), blog.head()->block_num() );
+            if( head->block_num >= blog.first_block_num() ) {
+               const auto log_id = blog.read_block_id_by_num( head->block_num );
+               EOS_ASSERT( log_id == head->id, block_log_exception,
+                           "Snapshot head block ${id} does not match block ${num} of the block log: ${log_id}",
+                           ("id", head->id)("num", head->block_num)("log_id", log_id) );
+            }
          } else {
-            read_from_snapshot( snapshot, 0, std::numeric_limits<uint32_t>::max() );
+            read_from_snapshot( state, 0, std::numeric_limits<uint32_t>::max() );
             const uint32_t lib_num = head->block_num;
             EOS_ASSERT( lib_num > 0, snapshot_exception,
                         "Snapshot indicates controller head at block number 0, but that is not allowed. "
                         "Snapshot is invalid." );
             blog.reset( chain_id, lib_num + 1 );
          }
+
+         // contract rows are not part of the layered sections, the changes of each delta are applied in order
+         for( const auto& delta : deltas ) {
+            read_contract_tables_delta_from_snapshot( delta );
+         }
+
          const auto hash = calculate_integrity_hash();
          ilog( "database initialized with hash: ${hash}", ("hash", hash) );
 
+         // the loaded state is a base the next snapshot delta can build on
+         if( delta_tracker ) {
+            delta_tracker->reset( head->id );
+         }
+
          init(shutdown);
       } catch (boost::interprocess::bad_alloc& e) {
          elog( "db storage not configured to have enough storage for the provided snapshot, please increase and retry snapshot" );
@@ -677,6 +952,13 @@ struct controller_impl {
 
       protocol_features.init( db );
 
+      wasmif.warm_up( head->block_num + 1 );
+      for( const auto& account : conf.eosvmoc_precompile_accounts ) {
+         const auto* metadata = db.find<account_metadata_object,by_name>( account );
+         if( metadata && metadata->code_hash != digest_type() )
+            wasmif.eosvmoc_precompile( metadata->code_hash, metadata->vm_version );
+      }
+
       const auto& rbi = reversible_blocks.get_index<reversible_block_index,by_num>();
       auto last_block_num = lib_num;
 
@@ -785,9 +1067,96 @@ struct controller_impl {
                   */
    }
 
-   void add_contract_tables_to_snapshot( const snapshot_writer_ptr& snapshot ) const {
-      snapshot->write_section("contract_tables", [this]( auto& section ) {
-         index_utils<table_id_multi_index>::walk(db, [this, &section]( const table_id_object& table_row ){
+   /// remember what the undo session of the block being committed changed, for the next delta snapshot
+   void record_snapshot_delta() {
+      auto& delta = *delta_tracker;
+      if( !delta.valid ) {
+         return;
+      }
+
+      if( !pending->_db_session.valid() ) {
+         // there is nothing to enumerate the changes from, the next snapshot has to be a full one
+         delta.invalidate();
+         return;
+      }
+
+      controller_index_set::walk_indices([this, &delta]( auto utils ){
+         using value_t = typename decltype(utils)::index_t::value_type;
+
+         // table_id_object changes are tracked per table along with the contract rows
+         if (std::is_same<value_t, table_id_object>::value || std::is_same<value_t, database_header_object>::value) {
+            return;
+         }
+
+         if (decltype(utils)::changed_in_head_undo_session(db)) {
+            delta.changed_sections.insert(detail::snapshot_section_traits<value_t>::section_name());
+         }
+      });
+      authorization.add_changed_snapshot_sections(delta.changed_sections);
+      resource_limits.add_changed_snapshot_sections(delta.changed_sections);
+
+      const auto& table_index = db.get_index<table_id_multi_index>();
+      if( table_index.stack().empty() ) {
+         return;
+      }
+
+      const auto& table_undo = table_index.stack().back();
+      auto mark_table = [&delta]( const table_id_object& table ) -> snapshot_delta_tracker::table_changes& {
+         return delta.changed_tables[ snapshot_delta_tracker::table_key( table.code, table.scope, table.table ) ];
+      };
+
+      for( const auto& old : table_undo.old_values )
+         mark_table( old.second );
+      for( const auto& rem : table_undo.removed_values )
+         mark_table( rem.second );
+      for( const auto& id : table_undo.new_ids )
+         mark_table( table_index.get( id ) );
+
+      // rows refer to their table by id, which may have been removed in this block as well
+      auto find_table = [&]( table_id t_id ) -> const table_id_object* {
+         if( const auto* table = table_index.find( t_id ) )
+            return table;
+         auto itr = table_undo.removed_values.find( t_id );
+         return itr != table_undo.removed_values.end() ? &itr->second : nullptr;
+      };
+
+      bool unknown_table = false;
+      size_t index_num = 0;
+      contract_database_index_set::walk_indices([&]( auto utils ) {
+         const auto& index = db.get_index<typename decltype(utils)::index_t>();
+         const size_t num = index_num++;
+         if( index.stack().empty() ) {
+            return;
+         }
+
+         auto mark_row = [&]( const auto& row ) {
+            if( const auto* table = find_table( row.t_id ) ) {
+               mark_table( *table ).mark_row( num, row.primary_key );
+            } else {
+               unknown_table = true;
+            }
+         };
+
+         const auto& undo = index.stack().back();
+         for( const auto& old : undo.old_values ) {
+            mark_row( old.second );
+            mark_row( index.get( old.first ) );
+         }
+         for( const auto& rem : undo.removed_values )
+            mark_row( rem.second );
+         for( const auto& id : undo.new_ids )
+            mark_row( index.get( id ) );
+      });
+
+      if( unknown_table ) {
+         wlog( "unable to find the table of a changed contract row, the next snapshot will be a full snapshot" );
+         delta.invalidate();
+      }
+   }
+
+   void add_contract_tables_to_snapshot( const snapshot_writer_ptr& snapshot, table_id_object::id_type begin, table_id_object::id_type end ) const {
+      snapshot->write_section("contract_tables", [this, begin, end]( auto& section ) {
+         index_utils<table_id_multi_index>::walk_range<by_id>(db, begin, end, [this, &section]( const table_id_object& table_row ){
             // add a row for the table
             section.add_row(table_row, db);
 
@@ -811,6 +1180,28 @@ struct controller_impl {
       });
    }
 
+   /// the contract_tables section is usually most of a snapshot, so it is written as a run of table ranges
+   void add_contract_tables_to_snapshot( std::vector<snapshot_writer::section_job>& jobs, size_t parts ) const {
+      const auto& tables = db.get_index<table_id_multi_index>().indices();
+      const size_t tables_per_part = std::max<size_t>( 1, (tables.size() + parts - 1) / std::max<size_t>( parts, 1 ) );
+
+      std::vector<table_id_object::id_type> bounds{ table_id_object::id_type(0) };
+      size_t count = 0;
+      for( const auto& table_row : tables ) {
+         if( count > 0 && count % tables_per_part == 0 ) {
+            bounds.push_back( table_row.id );
+         }
+         ++count;
+      }
+      bounds.push_back( table_id_object::id_type(std::numeric_limits<int64_t>::max()) );
+
+      for( size_t i = 0; i + 1 < bounds.size(); ++i ) {
+         jobs.emplace_back([this, begin = bounds[i], end = bounds[i + 1]]( const snapshot_writer_ptr& snapshot ) {
+            add_contract_tables_to_snapshot( snapshot, begin, end );
+         });
+      }
+   }
+
    void read_contract_tables_from_snapshot( const snapshot_reader_ptr& snapshot ) {
       snapshot->read_section("contract_tables", [this]( auto& section ) {
          bool more = !section.empty();
@@ -840,16 +1231,142 @@ struct controller_impl {
       });
    }
 
-   void add_to_snapshot( const snapshot_writer_ptr& snapshot ) const {
-      snapshot->write_section<chain_snapshot_header>([this]( auto &section ){
-         section.add_row(chain_snapshot_header(), db);
+   void remove_contract_table( const table_id_object& table ) {
+      contract_database_index_set::walk_indices([this, t_id = table.id]( auto utils ) {
+         using value_t = typename decltype(utils)::index_t::value_type;
+         using by_table_id = object_to_table_id_tag_t<value_t>;
+
+         const auto& index = db.get_index<typename decltype(utils)::index_t, by_table_id>();
+         for( auto itr = index.lower_bound( boost::make_tuple( t_id ) ); itr != index.end() && itr->t_id == t_id;
+              itr = index.lower_bound( boost::make_tuple( t_id ) ) ) {
+            db.remove( *itr );
+         }
+      });
+      db.remove( table );
+   }
+
+   void read_contract_tables_delta_from_snapshot( const snapshot_reader_ptr& snapshot ) {
+      snapshot->read_section("contract_tables_delta", [this]( auto& section ) {
+         bool more = !section.empty();
+         while (more) {
+            snapshot_contract_table_delta table_delta;
+            more = section.read_row(table_delta, db);
+
+            const auto* table = db.find<table_id_object, by_code_scope_table>(
+                                   boost::make_tuple( table_delta.code, table_delta.scope, table_delta.table ) );
+            if( table_delta.removed ) {
+               if( table ) {
+                  remove_contract_table( *table );
+               }
+               continue;
+            }
+
+            if( table ) {
+               db.modify( *table, [this, &section, &more]( auto& row ) {
+                  more = section.read_row(row, db);
+               });
+            } else {
+               table = &db.create<table_id_object>([this, &section, &more]( auto& row ) {
+                  more = section.read_row(row, db);
+               });
+            }
+
+            // remove every changed row, then recreate the ones that still exist
+            contract_database_index_set::walk_indices([this, &section, &more, t_id = table->id]( auto utils ) {
+               using utils_t = decltype(utils);
+               using value_t = typename utils_t::index_t::value_type;
+               using by_table_id = object_to_table_id_tag_t<value_t>;
+
+               unsigned_int count;
+               more = section.read_row(count, db);
+               for( size_t idx = 0; idx < count.value; ++idx ) {
+                  uint64_t primary_key = 0;
+                  more = section.read_row(primary_key, db);
+                  if( const auto* row = db.find<value_t, by_table_id>( boost::make_tuple( t_id, primary_key ) ) ) {
+                     db.remove( *row );
+                  }
+               }
+
+               more = section.read_row(count, db);
+               for( size_t idx = 0; idx < count.value; ++idx ) {
+                  utils_t::create(db, [this, &section, &more, t_id]( auto& row ) {
+                     row.t_id = t_id;
+                     more = section.read_row(row, db);
+                  });
+               }
+            });
+         }
+      });
+   }
+
+   void add_contract_tables_delta_to_snapshot( const snapshot_writer_ptr& snapshot, const snapshot_delta_tracker& delta ) const {
+      snapshot->write_section("contract_tables_delta", [this, &delta]( auto& section ) {
+         for( const auto& changed : delta.changed_tables ) {
+            const auto& key = changed.first;
+            const auto* table = db.find<table_id_object, by_code_scope_table>(
+                                   boost::make_tuple( std::get<0>(key), std::get<1>(key), std::get<2>(key) ) );
+
+            section.add_row(snapshot_contract_table_delta{ std::get<0>(key), std::get<1>(key), std::get<2>(key), table == nullptr }, db);
+            if( !table ) {
+               continue;
+            }
+            section.add_row(*table, db);
+
+            // for each type of table, the keys of all changed rows and then the rows that still exist
+            size_t index_num = 0;
+            contract_database_index_set::walk_indices([this, &section, &changes = changed.second, &index_num, table]( auto utils ) {
+               using value_t = typename decltype(utils)::index_t::value_type;
+               using by_table_id = object_to_table_id_tag_t<value_t>;
+
+               const auto& primary_keys = changes.rows_of( index_num++ );
+               section.add_row(unsigned_int(primary_keys.size()), db);
+
+               std::vector<const value_t*> rows;
+               for( uint64_t primary_key : primary_keys ) {
+                  section.add_row(primary_key, db);
+                  if( const auto* row = db.find<value_t, by_table_id>( boost::make_tuple( table->id, primary_key ) ) ) {
+                     rows.push_back( row );
+                  }
+               }
+
+               section.add_row(unsigned_int(rows.size()), db);
+               for( const auto* row : rows ) {
+                  section.add_row(*row, db);
+               }
+            });
+         }
       });
+   }
+
+   /// the block the state is at; while replaying the block log the fork database does not follow it
+   block_state_ptr snapshot_head() const {
+      return replay_head_time ? head : fork_db.head();
+   }
 
-      snapshot->write_section<block_state>([this]( auto &section ){
-         section.template add_row<block_header_state>(*fork_db.head(), db);
+   /// writes the full state, or with delta only what changed since the snapshot delta is based on
+   void add_to_snapshot( const snapshot_writer_ptr& snapshot, const snapshot_delta_tracker* delta = nullptr ) const {
+      std::vector<snapshot_writer::section_job> jobs;
+      auto include_section = [delta]( const std::string& section_name ) {
+         return !delta || delta->section_changed( section_name );
+      };
+
+      jobs.emplace_back([this, delta]( const snapshot_writer_ptr& snapshot ) {
+         snapshot->write_section<chain_snapshot_header>([this]( auto &section ){
+            section.add_row(chain_snapshot_header(), db);
+         });
+
+         if( delta ) {
+            snapshot->write_section<snapshot_delta_header>([this, delta]( auto &section ){
+               section.add_row(snapshot_delta_header{ delta->base_block_id, snapshot_head()->id }, db);
+            });
+         }
+
+         snapshot->write_section<block_state>([this]( auto &section ){
+            section.template add_row<block_header_state>(*snapshot_head(), db);
+         });
       });
 
-      controller_index_set::walk_indices([this, &snapshot]( auto utils ){
+      controller_index_set::walk_indices([this, &jobs, &include_section]( auto utils ){
          using value_t = typename decltype(utils)::index_t::value_type;
 
          // skip the table_id_object as its inlined with contract tables section
@@ -862,17 +1379,36 @@ struct controller_impl {
             return;
          }
 
-         snapshot->write_section<value_t>([this]( auto& section ){
-            decltype(utils)::walk(db, [this, &section]( const auto &row ) {
-               section.add_row(row, db);
+         if (!include_section(detail::snapshot_section_traits<value_t>::section_name())) {
+            return;
+         }
+
+         jobs.emplace_back([this]( const snapshot_writer_ptr& snapshot ) {
+            snapshot->write_section<value_t>([this]( auto& section ){
+               decltype(utils)::walk(db, [this, &section]( const auto &row ) {
+                  section.add_row(row, db);
+               });
             });
          });
       });
 
-      add_contract_tables_to_snapshot(snapshot);
+      if( delta ) {
+         jobs.emplace_back([this, delta]( const snapshot_writer_ptr& snapshot ) {
+            add_contract_tables_delta_to_snapshot(snapshot, *delta);
+         });
+      } else {
+         add_contract_tables_to_snapshot(jobs, conf.thread_pool_size * 4);
+      }
+
+      jobs.emplace_back([this, include_section]( const snapshot_writer_ptr& snapshot ) {
+         authorization.add_to_snapshot(snapshot, include_section);
+      });
+      jobs.emplace_back([this, include_section]( const snapshot_writer_ptr& snapshot ) {
+         resource_limits.add_to_snapshot(snapshot, include_section);
+      });
 
-      authorization.add_to_snapshot(snapshot);
-      resource_limits.add_to_snapshot(snapshot);
+      // sections are serialized concurrently from the unchanging database and streamed out in order
+      snapshot->write_sections(jobs, &thread_pool.get_executor());
    }
 
    static fc::optional<genesis_state> extract_legacy_genesis_state( snapshot_reader& snapshot, uint32_t version ) {
@@ -926,7 +1462,11 @@ struct controller_impl {
 
       }
 
-      controller_index_set::walk_indices([this, &snapshot, &header]( auto utils ){
+      // the sections of each job are read and decoded on the thread pool, but rows are unpacked and created on this
+      // thread, one job after the other: chainbase is not safe for concurrent writers
+      std::vector<snapshot_reader::section_job> jobs;
+
+      controller_index_set::walk_indices([this, &jobs, &header]( auto utils ){
          using value_t = typename decltype(utils)::index_t::value_type;
 
          // skip the table_id_object as its inlined with contract tables section
@@ -939,41 +1479,57 @@ struct controller_impl {
             return;
          }
 
-         // special case for in-place upgrade of global_property_object
-         if (std::is_same<value_t, global_property_object>::value) {
-            using v2 = legacy::snapshot_global_property_object_v2;
-
-            if (std::clamp(header.version, v2::minimum_version, v2::maximum_version) == header.version ) {
-               fc::optional<genesis_state> genesis = extract_legacy_genesis_state(*snapshot, header.version);
-               EOS_ASSERT( genesis, snapshot_exception,
-                           "Snapshot indicates chain_snapshot_header version 2, but does not contain a genesis_state. "
-                           "It must be corrupted.");
-               snapshot->read_section<global_property_object>([&db=this->db,gs_chain_id=genesis->compute_chain_id()]( auto &section ) {
-                  v2 legacy_global_properties;
-                  section.read_row(legacy_global_properties, db);
-
-                  db.create<global_property_object>([&legacy_global_properties,&gs_chain_id](auto& gpo ){
-                     gpo.initalize_from(legacy_global_properties, gs_chain_id);
+         jobs.push_back({ { detail::snapshot_section_traits<value_t>::section_name() },
+                          [this, &header]( const snapshot_reader_ptr& snapshot ) {
+            // special case for in-place upgrade of global_property_object
+            if (std::is_same<value_t, global_property_object>::value) {
+               using v2 = legacy::snapshot_global_property_object_v2;
+
+               if (std::clamp(header.version, v2::minimum_version, v2::maximum_version) == header.version ) {
+                  fc::optional<genesis_state> genesis = extract_legacy_genesis_state(*snapshot, header.version);
+                  EOS_ASSERT( genesis, snapshot_exception,
+                              "Snapshot indicates chain_snapshot_header version 2, but does not contain a genesis_state. "
+                              "It must be corrupted.");
+                  snapshot->read_section<global_property_object>([&db=this->db,gs_chain_id=genesis->compute_chain_id()]( auto &section ) {
+                     v2 legacy_global_properties;
+                     section.read_row(legacy_global_properties, db);
+
+                     db.create<global_property_object>([&legacy_global_properties,&gs_chain_id](auto& gpo ){
+                        gpo.initalize_from(legacy_global_properties, gs_chain_id);
+                     });
                   });
-               });
-               return; // early out to avoid default processing
+                  return; // early out to avoid default processing
+               }
             }
-         }
 
-         snapshot->read_section<value_t>([this]( auto& section ) {
-            bool more = !section.empty();
-            while(more) {
-               decltype(utils)::create(db, [this, &section, &more]( auto &row ) {
-                  more = section.read_row(row, db);
-               });
-            }
-         });
+            snapshot->read_section<value_t>([this]( auto& section ) {
+               bool more = !section.empty();
+               while(more) {
+                  decltype(utils)::create(db, [this, &section, &more]( auto &row ) {
+                     more = section.read_row(row, db);
+                  });
+               }
+            });
+         }});
       });
 
-      read_contract_tables_from_snapshot(snapshot);
+      jobs.push_back({ { "contract_tables" }, [this]( const snapshot_reader_ptr& snapshot ) {
+         read_contract_tables_from_snapshot(snapshot);
+      }});
+
+      std::set<std::string> authorization_sections;
+      authorization.add_snapshot_sections( authorization_sections );
+      jobs.push_back({ { authorization_sections.begin(), authorization_sections.end() }, [this]( const snapshot_reader_ptr& snapshot ) {
+         authorization.read_from_snapshot(snapshot);
+      }});
 
-      authorization.read_from_snapshot(snapshot);
-      resource_limits.read_from_snapshot(snapshot);
+      std::set<std::string> resource_sections;
+      resource_limits.add_snapshot_sections( resource_sections );
+      jobs.push_back({ { resource_sections.begin(), resource_sections.end() }, [this]( const snapshot_reader_ptr& snapshot ) {
+         resource_limits.read_from_snapshot(snapshot);
+      }});
+
+      snapshot->read_sections(jobs, &thread_pool.get_executor());
 
       db.set_revision( head->block_num );
       db.create<database_header_object>([](const auto& header){
@@ -1513,6 +2069,49 @@ struct controller_impl {
       } FC_CAPTURE_AND_RETHROW((trace))
    } /// push_transaction
 
+   template<typename F>
+   void for_each_read_only_wasmif( F&& f ) {
+      auto itr = read_only_states.begin();
+      while( itr != read_only_states.end() ) {
+         if( auto s = itr->lock() ) {
+            f( s->wasmif );
+            ++itr;
+         } else {
+            itr = read_only_states.erase( itr );
+         }
+      }
+   }
+
+   transaction_trace_ptr push_read_only_transaction( const transaction_metadata_ptr& trx, fc::time_point deadline,
+                                                     controller::read_only_thread_state& thread_state )
+   {
+      EOS_ASSERT( pending, block_validate_exception, "read-only transactions require a pending block" );
+      EOS_ASSERT( deadline != fc::time_point(), transaction_exception, "deadline cannot be uninitialized" );
+
+      transaction_trace_ptr trace;
+      try {
+         const signed_transaction& trn = trx->packed_trx()->get_signed_transaction();
+         transaction_checktime_timer trx_timer( thread_state.timer );
+         transaction_context trx_context( self, trn, trx->id(), std::move(trx_timer), fc::time_point::now(), true );
+         trx_context.wasmif_override = &thread_state.wasmif;
+#if defined(EOSIO_EOS_VM_RUNTIME_ENABLED) || defined(EOSIO_EOS_VM_JIT_RUNTIME_ENABLED)
+         trx_context.wasm_alloc_override = &thread_state.wasm_alloc;
+#endif
+         trx_context.deadline = deadline;
+         trace = trx_context.trace;
+         try {
+            trx_context.init_for_read_only_trx();
+            trx_context.exec();
+            trx_context.finalize();
+         } catch( const fc::exception& e ) {
+            trace->error_code = controller::convert_exception_to_error_code( e );
+            trace->except = e;
+            trace->except_ptr = std::current_exception();
+         }
+         return trace;
+      } FC_CAPTURE_AND_RETHROW((trace))
+   } /// push_read_only_transaction
+
    void start_block( block_timestamp_type when,
                      uint16_t confirm_block_count,
                      const vector<digest_type>& new_protocol_feature_activations,
@@ -1755,6 +2354,10 @@ struct controller_impl {
             });
          }
 
+         if( delta_tracker ) {
+            record_snapshot_delta();
+         }
+
          emit( self.accepted_block, bsp );
 
          if( add_to_fork_db ) {
@@ -1884,7 +2487,8 @@ struct controller_impl {
                   } else {
                      auto ptrx = std::make_shared<packed_transaction>( pt );
                      auto fut = transaction_metadata::start_recover_keys(
-                           std::move( ptrx ), thread_pool.get_executor(), chain_id, microseconds::maximum() );
+                           std::move( ptrx ), thread_pool.get_executor(), chain_id, microseconds::maximum(),
+                           UINT32_MAX, &recovered_keys );
                      trx_metas.emplace_back( transaction_metadata_ptr{}, std::move( fut ) );
                   }
                }
@@ -2026,7 +2630,8 @@ struct controller_impl {
       } FC_LOG_AND_RETHROW( )
    }
 
-   void replay_push_block( const signed_block_ptr& b, controller::block_status s ) {
+   void replay_push_block( const signed_block_ptr& b, controller::block_status s,
+                           vector<transaction_metadata_ptr>&& trx_metas = {}, bool keys_recovered = false ) {
       self.validate_db_available_size();
       self.validate_reversible_available_size();
 
@@ -2050,6 +2655,10 @@ struct controller_impl {
                         skip_validate_signee
          );
 
+         if( !trx_metas.empty() ) {
+            bsp->set_trxs_metas( std::move( trx_metas ), keys_recovered );
+         }
+
          if( s != controller::block_status::irreversible ) {
             fork_db.add( bsp, true );
          }
@@ -2459,8 +3068,9 @@ void controller::add_indices() {
    my->add_indices();
 }
 
-void controller::startup( std::function<bool()> shutdown, const snapshot_reader_ptr& snapshot ) {
-   my->startup(shutdown, snapshot);
+void controller::startup( std::function<bool()> shutdown, const snapshot_reader_ptr& snapshot,
+                          const std::vector<snapshot_reader_ptr>& deltas ) {
+   my->startup(shutdown, snapshot, deltas);
 }
 
 void controller::startup( std::function<bool()> shutdown, const genesis_state& genesis ) {
@@ -2674,6 +3284,10 @@ boost::asio::io_context& controller::get_thread_pool() {
    return my->thread_pool.get_executor();
 }
 
+recovered_keys_cache& controller::get_recovered_keys_cache() {
+   return my->recovered_keys;
+}
+
 std::future<block_state_ptr> controller::create_block_state_future( const signed_block_ptr& b ) {
    return my->create_block_state_future( b );
 }
@@ -2871,6 +3485,10 @@ signed_block_ptr controller::fetch_block_by_number( uint32_t block_num )const  {
    return my->blog.read_block_by_num(block_num);
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
+packed_block_span controller::fetch_packed_block_by_number( uint32_t block_num )const  { try {
+   return my->blog.read_packed_block_by_num(block_num);
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
 block_state_ptr controller::fetch_block_state_by_id( block_id_type id )const {
    auto state = my->fork_db.get_block(id);
    return state;
@@ -2929,7 +3547,26 @@ sha256 controller::calculate_integrity_hash()const { try {
 
 void controller::write_snapshot( const snapshot_writer_ptr& snapshot ) const {
    EOS_ASSERT( !my->pending, block_validate_exception, "cannot take a consistent snapshot with a pending block" );
-   return my->add_to_snapshot(snapshot);
+   my->add_to_snapshot(snapshot);
+}
+
+void controller::write_delta_base_snapshot( const snapshot_writer_ptr& snapshot ) {
+   write_snapshot(snapshot);
+   if( my->delta_tracker ) {
+      my->delta_tracker->reset( my->head->id );
+   }
+}
+
+bool controller::has_snapshot_delta_base() const {
+   return my->delta_tracker && my->delta_tracker->valid;
+}
+
+void controller::write_delta_snapshot( const snapshot_writer_ptr& snapshot ) {
+   EOS_ASSERT( !my->pending, block_validate_exception, "cannot take a consistent snapshot with a pending block" );
+   EOS_ASSERT( has_snapshot_delta_base(), snapshot_exception,
+               "cannot write a snapshot delta without a snapshot to base it on since the changes were tracked" );
+   my->add_to_snapshot(snapshot, &*my->delta_tracker);
+   my->delta_tracker->reset( my->head->id );
 }
 
 int64_t controller::set_proposed_producers( vector<producer_authority> producers ) {
@@ -3042,7 +3679,7 @@ bool controller::light_validation_allowed(bool replay_opts_disabled_by_policy) c
 
 
 bool controller::skip_auth_check() const {
-   return light_validation_allowed(my->conf.force_all_checks);
+   return light_validation_allowed(my->conf.force_all_checks && !my->in_trusted_replay());
 }
 
 bool controller::skip_db_sessions( block_status bs ) const {
@@ -3061,7 +3698,7 @@ bool controller::skip_db_sessions( ) const {
 }
 
 bool controller::skip_trx_checks() const {
-   return light_validation_allowed(my->conf.disable_replay_opts);
+   return light_validation_allowed(my->conf.disable_replay_opts && !my->in_trusted_replay());
 }
 
 bool controller::is_trusted_producer( const account_name& producer) const {
@@ -3098,6 +3735,33 @@ wasm_interface& controller::get_wasm_interface() {
    return my->wasmif;
 }
 
+const wasm_interface& controller::get_wasm_interface()const {
+   return my->wasmif;
+}
+
+contract_profiler& controller::get_contract_profiler() {
+   return my->profiler;
+}
+
+void controller::code_block_num_last_used( const digest_type& code_hash, uint8_t vm_type, uint8_t vm_version, uint32_t block_num ) {
+   my->wasmif.code_block_num_last_used( code_hash, vm_type, vm_version, block_num );
+   my->for_each_read_only_wasmif( [&]( wasm_interface& w ) {
+      w.code_block_num_last_used( code_hash, vm_type, vm_version, block_num );
+   } );
+}
+
+std::shared_ptr<controller::read_only_thread_state> controller::create_read_only_thread_state() {
+   auto s = std::make_shared<read_only_thread_state>( my->conf, my->db );
+   my->read_only_states.emplace_back( s );
+   return s;
+}
+
+transaction_trace_ptr controller::push_read_only_transaction( const transaction_metadata_ptr& trx, fc::time_point deadline,
+                                                              read_only_thread_state& thread_state ) {
+   EOS_ASSERT( trx && !trx->implicit && !trx->scheduled, transaction_type_exception, "Implicit/Scheduled transaction not allowed" );
+   return my->push_read_only_transaction( trx, deadline, thread_state );
+}
+
 const account_object& controller::get_account( account_name name )const
 { try {
    return my->db.get<account_object, by_name>(name);
@@ -155,7 +155,7 @@ void apply_rem_setcode(apply_context& context) {
       old_size  = (int64_t)old_code_entry.code.size() * config::setcode_ram_bytes_multiplier;
       if( old_code_entry.code_ref_count == 1 ) {
          db.remove(old_code_entry);
-         context.control.get_wasm_interface().code_block_num_last_used(account.code_hash, account.vm_type, account.vm_version, context.control.head_block_num() + 1);
+         context.control.code_block_num_last_used(account.code_hash, account.vm_type, account.vm_version, context.control.head_block_num() + 1);
       } else {
          db.modify(old_code_entry, [](code_object& o) {
             --o.code_ref_count;
@@ -179,6 +179,8 @@ void apply_rem_setcode(apply_context& context) {
             o.vm_type = act.vmtype;
             o.vm_version = act.vmversion;
          });
+         context.trx_context.get_wasm_interface().instantiate_in_background( code_hash, act.vmtype, act.vmversion, act.code,
+                                                                             context.control.head_block_num() + 1 );
       }
    }
 
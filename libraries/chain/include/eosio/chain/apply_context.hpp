@@ -179,6 +179,7 @@ class apply_context {
                EOS_ASSERT( payer != account_name(), invalid_table_payer, "must specify a valid account to pay for new record" );
 
 //               context.require_write_lock( scope );
+               context.require_writable( "contract tables" );
 
                const auto& tab = context.find_or_create_table( context.receiver, name(scope), name(table), payer );
 
@@ -207,6 +208,7 @@ class apply_context {
                EOS_ASSERT( table_obj.code == context.receiver, table_access_violation, "db access violation" );
 
 //               context.require_write_lock( table_obj.scope );
+               context.require_writable( "contract tables" );
 
                context.db.modify( table_obj, [&]( auto& t ) {
                   --t.count;
@@ -227,6 +229,7 @@ class apply_context {
                EOS_ASSERT( table_obj.code == context.receiver, table_access_violation, "db access violation" );
 
 //               context.require_write_lock( table_obj.scope );
+               context.require_writable( "contract tables" );
 
                if( payer == account_name() ) payer = obj.payer;
 
@@ -526,6 +529,8 @@ class apply_context {
       const table_id_object* find_table( name code, name scope, name table );
       const table_id_object& find_or_create_table( name code, name scope, name table, const account_name &payer );
       void                   remove_table( const table_id_object& tid );
+      /// throws in read-only transactions, see transaction_context::require_writable
+      void                   require_writable( const char* what )const;
 
       int  db_store_i64( name code, name scope, name table, const account_name& payer, uint64_t id, const char* buffer, size_t buffer_size );
 
@@ -559,6 +564,8 @@ class apply_context {
       controller&                   control;
       chainbase::database&          db;  ///< database where state is stored
       transaction_context&          trx_context; ///< transaction context in which the action is running
+      bool                          profile_intrinsics = false; ///< add the time of each intrinsic call to intrinsic_time
+      fc::microseconds              intrinsic_time;
 
    private:
       const action*                 act = nullptr; ///< action being applied
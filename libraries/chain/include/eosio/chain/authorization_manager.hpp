@@ -6,6 +6,7 @@
 
 #include <utility>
 #include <functional>
+#include <set>
 
 namespace eosio { namespace chain {
 
@@ -24,8 +25,14 @@ namespace eosio { namespace chain {
 
          void add_indices();
          void initialize_database();
-         void add_to_snapshot( const snapshot_writer_ptr& snapshot ) const;
+         /// include_section, if set, selects the sections to write, for delta snapshots
+         void add_to_snapshot( const snapshot_writer_ptr& snapshot,
+                               const std::function<bool(const std::string&)>& include_section = {} ) const;
          void read_from_snapshot( const snapshot_reader_ptr& snapshot );
+         /// add the names of the snapshot sections changed by the head undo session
+         void add_changed_snapshot_sections( std::set<std::string>& sections ) const;
+         /// add the names of the snapshot sections read by read_from_snapshot
+         void add_snapshot_sections( std::set<std::string>& sections ) const;
 
          const permission_object& create_permission( account_name account,
                                                      permission_name name,
@@ -7,6 +7,27 @@ namespace eosio { namespace chain {
 
    namespace detail { class block_log_impl; }
 
+   struct block_log_config {
+      bool     mapped_reads = false; ///< serve random access reads from memory mapped blocks.log and blocks.index
+      uint32_t stride = std::numeric_limits<uint32_t>::max(); ///< roll blocks.log into a segment after each multiple of this block number
+      uint16_t max_retained_files = 10; ///< number of rolled segments kept in the blocks directory
+      fc::path archive_dir = "archive"; ///< where retired segments are moved, relative to the blocks directory; empty to delete them
+      bool     compress_segments = false; ///< compress rolled segments in the background, see compressed_block_file
+   };
+
+   /**
+    * Serialized bytes of a single block as stored in the block log. The owner keeps the backing storage
+    * (either a read-only mapping of the block log or a private buffer) alive for as long as the span is held,
+    * so the bytes stay valid even if the block log is later remapped, reset or closed.
+    */
+   struct packed_block_span {
+      std::shared_ptr<const void> owner;
+      const char*                 data = nullptr;
+      size_t                      size = 0;
+
+      bool empty()const { return size == 0; }
+   };
+
    /* The block log is an external append only log of the blocks with a header. Blocks should only
     * be written to the log after they irreverisble as the log is append only. The log is a doubly
     * linked list of blocks. There is a secondary index file of only block positions that enables
@@ -30,11 +51,26 @@ namespace eosio { namespace chain {
     *
     * The main file is the only file that needs to persist. The index file can be reconstructed during a
     * linear scan of the main file.
+    *
+    * When block_log_config::mapped_reads is set, both files are additionally mapped read-only and
+    * read_block_by_num()/read_packed_block_by_num() are served directly from the mapping. Those reads do
+    * not touch the shared FILE state, so they may be issued from any thread for blocks up to head().
+    *
+    * When block_log_config::stride is set, blocks.log and blocks.index are renamed to
+    * blocks-<first>-<last>.log and blocks-<first>-<last>.index once a block number divisible by the stride
+    * is appended, and a new blocks.log starting with the next block is begun. The newest
+    * max_retained_files segments stay readable through read_block_by_num() and first_block_num() reports
+    * the oldest of them; older segments are moved to archive_dir or deleted. Moving a segment to an archive_dir
+    * on another filesystem copies it on a background thread and removes it from the blocks directory once copied.
+    *
+    * With block_log_config::compress_segments, each rolled segment is compressed on a background thread into
+    * blocks-<first>-<last>.clog, which replaces the .log once complete. Blocks in compressed segments are still
+    * located through the segment's uncompressed index and read by inflating from the nearest seek point.
     */
 
    class block_log {
       public:
-         block_log(const fc::path& data_dir);
+         explicit block_log(const fc::path& data_dir, const block_log_config& config = block_log_config());
          block_log(block_log&& other);
          ~block_log();
 
@@ -51,6 +87,12 @@ namespace eosio { namespace chain {
             return read_block_by_num(block_header::num_from_id(id));
          }
 
+         /**
+          * Return the packed bytes of a block without unpacking it, or an empty span if it does not exist.
+          * With mapped reads enabled the span points directly into the mapped block log.
+          */
+         packed_block_span read_packed_block_by_num(uint32_t block_num)const;
+
          /**
           * Return offset of block in file, or block_log::npos if it does not exist.
           */
@@ -71,7 +113,11 @@ namespace eosio { namespace chain {
 
          static chain_id_type extract_chain_id( const fc::path& data_dir );
 
-         static void construct_index(const fc::path& block_file_name, const fc::path& index_file_name);
+         /**
+          * Reconstruct blocks.index from blocks.log. Unless num_threads is 1, disjoint regions of the log are
+          * scanned concurrently by num_threads threads (0 uses one thread per core) and stitched together.
+          */
+         static void construct_index(const fc::path& block_file_name, const fc::path& index_file_name, uint32_t num_threads = 0);
 
          static bool contains_genesis_state(uint32_t version, uint32_t first_block_num);
 
@@ -0,0 +1,120 @@
+#pragma once
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace eosio { namespace chain {
+
+   namespace detail { struct compressed_block_file_impl; }
+
+   /**
+    * Read-only random access to a block log file compressed with compressed_block_file::compress().
+    *
+    * This follows the seek point approach of the trace_api compressed_file: the data is a single raw zlib
+    * stream in which the compressor was fully flushed at each seek point, so decompression can start at any
+    * of them. Seek points are only placed at the start of a block, at least seek_point_stride uncompressed
+    * bytes apart, so reading one block inflates at most the stride plus the block itself. Offsets are those of
+    * the uncompressed file, so the matching blocks.index is used unchanged.
+    *
+    * +-----------------+-------------------------------------------+-------------------+-------+-------+
+    * | Compressed Data | (uncompressed offset, compressed offset)* | uncompressed size | count | magic |
+    * +-----------------+-------------------------------------------+-------------------+-------+-------+
+    *                      16 bytes per seek point                    8 bytes             4       4
+    *
+    * The file is memory mapped and reads keep no decompressor state between calls, so read() may be called
+    * from any number of threads at once.
+    */
+   class compressed_block_file {
+      public:
+         static constexpr uint32_t magic = 0x315a4c42; // "BLZ1"
+         static constexpr size_t   default_seek_point_stride = 512 * 1024;
+
+         explicit compressed_block_file( const fc::path& file_path );
+         ~compressed_block_file();
+
+         /// size of the original, uncompressed file
+         uint64_t size()const;
+
+         size_t seek_point_count()const;
+
+         /// copy n uncompressed bytes starting at uncompressed offset pos to d
+         void read( uint64_t pos, char* d, size_t n )const;
+
+         std::vector<char> read( uint64_t pos, size_t n )const {
+            std::vector<char> result( n );
+            read( pos, result.data(), n );
+            return result;
+         }
+
+         /// true if the file ends with the trailer written by compress()
+         static bool is_compressed( const fc::path& file_path );
+
+         /**
+          * Compress the block log at block_file_name into output_file_name, using index_file_name to place seek
+          * points on block boundaries.
+          */
+         static void compress( const fc::path& block_file_name, const fc::path& index_file_name,
+                               const fc::path& output_file_name, size_t seek_point_stride = default_seek_point_stride );
+
+         /// restore the original block log from a file written by compress()
+         static void decompress( const fc::path& input_file_name, const fc::path& output_file_name );
+
+      private:
+         std::unique_ptr<detail::compressed_block_file_impl> my;
+   };
+
+   /*
+    *  @brief datastream adapter for sequential unpacking from a compressed_block_file
+    *
+    *  This class supports unpack functionality but not pack.
+    */
+   class compressed_block_file_datastream {
+      public:
+         explicit compressed_block_file_datastream( const compressed_block_file& file, uint64_t pos = 0 )
+         : _file( file ), _pos( pos ) {}
+
+         bool skip( size_t s ) {
+            _pos += s;
+            return true;
+         }
+
+         bool read( char* d, size_t s ) {
+            while( s > 0 ) {
+               if( _pos < _window_pos || _pos >= _window_pos + _window.size() )
+                  fill();
+               const size_t offset = _pos - _window_pos;
+               const size_t n = std::min( s, _window.size() - offset );
+               memcpy( d, _window.data() + offset, n );
+               d += n;
+               s -= n;
+               _pos += n;
+            }
+            return true;
+         }
+
+         bool get( unsigned char& c ) { return get( *(char*)&c ); }
+
+         bool get( char& c ) { return read( &c, 1 ); }
+
+         uint64_t tellp()const { return _pos; }
+
+      private:
+         static constexpr size_t _window_size = 64 * 1024;
+
+         void fill() {
+            _window_pos = _pos;
+            _window = _file.read( _pos, std::min<uint64_t>( _window_size, _file.size() - std::min( _pos, _file.size() ) ) );
+            FC_ASSERT( !_window.empty(), "Attempting to read past the end of a compressed block log" );
+         }
+
+         const compressed_block_file& _file;
+         uint64_t                     _pos = 0;
+         uint64_t                     _window_pos = 0;
+         std::vector<char>            _window;
+   };
+
+} }
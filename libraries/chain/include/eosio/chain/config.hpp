@@ -84,6 +84,7 @@ const static uint32_t   default_sig_cpu_bill_pct                     = 50 * perc
 const static uint32_t   default_block_cpu_effort_pct                 = 80 * percent_1; // percentage of block time used for producing block
 const static uint16_t   default_controller_thread_pool_size          = 2;
 const static uint32_t   default_max_variable_signature_length        = 16384u;
+const static uint32_t   default_recovered_keys_cache_size            = 100000; // signatures whose recovered keys are kept
 const static uint32_t   default_max_nonprivileged_inline_action_size = 4 * 1024; // 4 KB
 
 const static uint32_t   min_net_usage_delta_between_base_and_max_for_trx  = 10*1024;
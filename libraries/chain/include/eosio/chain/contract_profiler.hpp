@@ -0,0 +1,104 @@
+#pragma once
+
+#include <eosio/chain/types.hpp>
+
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace eosio { namespace chain {
+
+/**
+ * Wall time of contract executions, aggregated per receiver and action name.
+ *
+ * Off unless enabled. When enabled, each execution of contract code records its wall time and the part of it spent
+ * in intrinsics, the rest being spent in wasm. Native actions are not recorded. Executions of notifications are
+ * recorded for the notified receiver.
+ *
+ * Thread safe, read-only transactions execute contracts on other threads.
+ */
+class contract_profiler {
+public:
+   struct entry {
+      account_name receiver;
+      action_name  action;
+      uint64_t     executions = 0;
+      uint64_t     wall_us = 0;
+      uint64_t     max_wall_us = 0;
+      uint64_t     intrinsic_us = 0;  ///< part of wall_us spent in intrinsics
+   };
+
+   bool enabled()const { return is_enabled.load( std::memory_order_relaxed ); }
+
+   /// enabling a disabled profiler discards what it recorded before
+   void enable( bool enable ) {
+      std::lock_guard<std::mutex> g( mtx );
+      if( enable && !enabled() ) {
+         profile.clear();
+         enabled_since = fc::time_point::now();
+      }
+      is_enabled = enable;
+   }
+
+   void record( const account_name& receiver, const action_name& action, fc::microseconds wall, fc::microseconds intrinsic ) {
+      if( !enabled() ) return;
+      std::lock_guard<std::mutex> g( mtx );
+      auto& e = profile[std::make_pair( receiver, action )];
+      e.receiver = receiver;
+      e.action = action;
+      ++e.executions;
+      e.wall_us += wall.count();
+      e.max_wall_us = std::max<uint64_t>( e.max_wall_us, wall.count() );
+      e.intrinsic_us += std::min( intrinsic.count(), wall.count() );
+   }
+
+   /// most wall time first
+   std::vector<entry> entries()const {
+      std::vector<entry> result;
+      {
+         std::lock_guard<std::mutex> g( mtx );
+         result.reserve( profile.size() );
+         for( const auto& p : profile )
+            result.push_back( p.second );
+      }
+      std::sort( result.begin(), result.end(), []( const entry& a, const entry& b ) { return a.wall_us > b.wall_us; } );
+      return result;
+   }
+
+   fc::time_point since()const {
+      std::lock_guard<std::mutex> g( mtx );
+      return enabled_since;
+   }
+
+   /**
+    * Entries in folded stack format, as read by flamegraph.pl and pprof: one line per stack with its frames separated by
+    * ';' followed by its weight, here in microseconds. Each entry is a receiver;action stack with a wasm and an
+    * intrinsics frame.
+    */
+   static std::string to_folded( const std::vector<entry>& entries ) {
+      std::ostringstream out;
+      for( const auto& e : entries ) {
+         const std::string stack = e.receiver.to_string() + ";" + e.action.to_string();
+         if( e.wall_us > e.intrinsic_us )
+            out << stack << ";wasm " << e.wall_us - e.intrinsic_us << "\n";
+         if( e.intrinsic_us > 0 )
+            out << stack << ";intrinsics " << e.intrinsic_us << "\n";
+      }
+      return out.str();
+   }
+
+private:
+   mutable std::mutex                                         mtx;
+   std::atomic<bool>                                          is_enabled{false};
+   fc::time_point                                             enabled_since;
+   std::map<std::pair<account_name, action_name>, entry>      profile;
+};
+
+} } // eosio::chain
+
+FC_REFLECT( eosio::chain::contract_profiler::entry, (receiver)(action)(executions)(wall_us)(max_wall_us)(intrinsic_us) )
@@ -1,5 +1,6 @@
 #pragma once
 #include <eosio/chain/block_state.hpp>
+#include <eosio/chain/block_log.hpp>
 #include <eosio/chain/trace.hpp>
 #include <eosio/chain/genesis_state.hpp>
 #include <chainbase/pinnable_mapped_file.hpp>
@@ -42,6 +43,8 @@ namespace eosio { namespace chain {
    using trx_meta_cache_lookup = std::function<transaction_metadata_ptr( const transaction_id_type&)>;
 
    class fork_database;
+   class recovered_keys_cache;
+   class contract_profiler;
 
    enum class db_read_mode {
       SPECULATIVE,
@@ -66,6 +69,11 @@ namespace eosio { namespace chain {
             flat_set< pair<account_name, action_name> > action_blacklist;
             flat_set<public_key_type> key_blacklist;
             path                     blocks_dir             =  chain::config::default_blocks_dir_name;
+            bool                     blocks_log_mapped_reads = false;
+            uint32_t                 blocks_log_stride      =  std::numeric_limits<uint32_t>::max();
+            uint16_t                 max_retained_block_files = 10;
+            path                     blocks_archive_dir     =  "archive";
+            bool                     compress_block_log_segments = false;
             path                     state_dir              =  chain::config::default_state_dir_name;
             uint64_t                 state_size             =  chain::config::default_state_size;
             uint64_t                 state_guard_size       =  chain::config::default_state_guard_size;
@@ -73,18 +81,27 @@ namespace eosio { namespace chain {
             uint64_t                 reversible_guard_size  =  chain::config::default_reversible_guard_size;
             uint32_t                 sig_cpu_bill_pct       =  chain::config::default_sig_cpu_bill_pct;
             uint16_t                 thread_pool_size       =  chain::config::default_controller_thread_pool_size;
+            uint32_t                 replay_read_ahead_blocks = 64; ///< blocks read and prepared on the thread pool ahead of replay
+            flat_map<uint32_t,block_id_type> trusted_replay_checkpoints; ///< replay skips checks of blocks up to the highest one in the block log
+            bool                     trust_block_log_replay =  false; ///< replay skips checks of every block in the block log
+            uint32_t                 replay_snapshot_interval = 0;  ///< blocks between snapshots written while replaying, 0 for none
+            path                     replay_snapshots_dir;
             uint32_t   max_nonprivileged_inline_action_size =  chain::config::default_max_nonprivileged_inline_action_size;
             bool                     read_only              =  false;
             bool                     force_all_checks       =  false;
             bool                     disable_replay_opts    =  false;
+            bool                     track_snapshot_deltas  =  false;
             bool                     contracts_console      =  false;
             bool                     allow_ram_billing_in_notify = false;
             uint32_t                 maximum_variable_signature_length = chain::config::default_max_variable_signature_length;
+            uint32_t                 recovered_keys_cache_size = chain::config::default_recovered_keys_cache_size;
             bool                     disable_all_subjective_mitigations = false; //< for testing purposes only
 
             wasm_interface::vm_type  wasm_runtime = chain::config::default_wasm_runtime;
             eosvmoc::config          eosvmoc_config;
             bool                     eosvmoc_tierup         = false;
+            flat_set<account_name>   eosvmoc_precompile_accounts; ///< code compiled with EOS VM OC at startup, ahead of any other
+            wasm_interface::instantiation_config wasm_instantiation;
 
             db_read_mode             read_mode              = db_read_mode::SPECULATIVE;
             validation_mode          block_validation_mode  = validation_mode::FULL;
@@ -109,7 +126,8 @@ namespace eosio { namespace chain {
          ~controller();
 
          void add_indices();
-         void startup( std::function<bool()> shutdown, const snapshot_reader_ptr& snapshot);
+         void startup( std::function<bool()> shutdown, const snapshot_reader_ptr& snapshot,
+                       const std::vector<snapshot_reader_ptr>& deltas = {} );
          void startup( std::function<bool()> shutdown, const genesis_state& genesis);
          void startup( std::function<bool()> shutdown);
 
@@ -153,6 +171,26 @@ namespace eosio { namespace chain {
          transaction_trace_ptr push_scheduled_transaction( const transaction_id_type& scheduled, fc::time_point deadline,
                                                            uint32_t billed_cpu_time_us, bool explicit_billed_cpu_time );
 
+         /// wasm runtime and checktime timer of one thread executing read-only transactions
+         struct read_only_thread_state;
+
+         /**
+          * Create the state needed by a thread to call push_read_only_transaction, one per thread. Runtime caches
+          * of the states are evicted along with the controller's while the states are alive.
+          */
+         std::shared_ptr<read_only_thread_state> create_read_only_thread_state();
+
+         /**
+          * Execute the actions of trx against the current state, including the pending block, without changing it:
+          * authorizations are not checked, nothing is billed or recorded, no signals are emitted, and an action
+          * that tries to change state fails with read_only_trx_write_exception. Requires a pending block.
+          *
+          * Can be called from several threads at once, each with its own thread_state, as long as nothing else
+          * uses the controller meanwhile.
+          */
+         transaction_trace_ptr push_read_only_transaction( const transaction_metadata_ptr& trx, fc::time_point deadline,
+                                                           read_only_thread_state& thread_state );
+
          block_state_ptr finalize_block( const signer_callback_type& signer_callback );
          void sign_block( const signer_callback_type& signer_callback );
          void commit_block();
@@ -169,6 +207,8 @@ namespace eosio { namespace chain {
                           const trx_meta_cache_lookup& trx_lookup );
 
          boost::asio::io_context& get_thread_pool();
+         /// keys recovered from signatures of incoming transactions and of validated blocks, thread safe
+         recovered_keys_cache& get_recovered_keys_cache();
 
          const chainbase::database& db()const;
 
@@ -232,6 +272,8 @@ namespace eosio { namespace chain {
 
          signed_block_ptr fetch_block_by_number( uint32_t block_num )const;
          signed_block_ptr fetch_block_by_id( block_id_type id )const;
+         /// packed bytes of an irreversible block straight from the block log, empty if not in the block log
+         packed_block_span fetch_packed_block_by_number( uint32_t block_num )const;
 
          block_state_ptr fetch_block_state_by_number( uint32_t block_num )const;
          block_state_ptr fetch_block_state_by_id( block_id_type id )const;
@@ -240,6 +282,14 @@ namespace eosio { namespace chain {
 
          sha256 calculate_integrity_hash()const;
          void write_snapshot( const snapshot_writer_ptr& snapshot )const;
+         /// write_snapshot, and with track_snapshot_deltas base the next snapshot delta on this snapshot
+         void write_delta_base_snapshot( const snapshot_writer_ptr& snapshot );
+
+         /// true if the changes since the last base snapshot were tracked and a snapshot delta can be written
+         bool has_snapshot_delta_base()const;
+         /// write only the state changed since the last base snapshot or delta, and base the next delta on this one,
+         /// see snapshot_delta.hpp
+         void write_delta_snapshot( const snapshot_writer_ptr& snapshot );
 
          bool sender_avoids_whitelist_blacklist_enforcement( account_name sender )const;
          void check_actor_list( const flat_set<account_name>& actors )const;
@@ -322,6 +372,13 @@ namespace eosio { namespace chain {
 
          const apply_handler* find_apply_handler( account_name contract, scope_name scope, action_name act )const;
          wasm_interface& get_wasm_interface();
+         const wasm_interface& get_wasm_interface()const;
+
+         /// execution time of contracts per receiver and action, when enabled
+         contract_profiler& get_contract_profiler();
+
+         /// indicate that a particular code probably won't be used after block_num, to all wasm runtimes
+         void code_block_num_last_used( const digest_type& code_hash, uint8_t vm_type, uint8_t vm_version, uint32_t block_num );
 
 
          optional<abi_serializer> get_abi_serializer( account_name n, const abi_serializer::yield_function_t& yield )const {
@@ -50,6 +50,16 @@ namespace eosio { namespace chain {
          static void create( chainbase::database& db, F cons ) {
             db.create<typename index_t::value_type>(cons);
          }
+
+         /// true if the most recent undo session created, modified or removed any row
+         static bool changed_in_head_undo_session( const chainbase::database& db ) {
+            const auto& stack = db.get_index<Index>().stack();
+            if (stack.empty()) {
+               return false;
+            }
+            const auto& undo = stack.back();
+            return !undo.old_values.empty() || !undo.new_ids.empty() || !undo.removed_values.empty();
+         }
    };
 
    template<typename Index>
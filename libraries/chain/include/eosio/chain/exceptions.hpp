@@ -306,6 +306,8 @@ namespace eosio { namespace chain {
                                     3050011, "eosio_assert_code assertion failure uses restricted error code value" )
       FC_DECLARE_DERIVED_EXCEPTION( inline_action_too_big_nonprivileged, action_validate_exception,
                                     3050012, "Inline action exceeds maximum size limit for a non-privileged account" )
+      FC_DECLARE_DERIVED_EXCEPTION( read_only_trx_write_exception, action_validate_exception,
+                                    3050013, "Read-only transaction attempted to change state" )
 
    FC_DECLARE_DERIVED_EXCEPTION( database_exception, chain_exception,
                                  3060000, "Database exception" )
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <eosio/chain/transaction.hpp>
+
+#include <mutex>
+#include <unordered_map>
+
+namespace eosio { namespace chain {
+
+/**
+ * Public keys recently recovered from transaction signatures, keyed by signature digest and signature.
+ *
+ * A transaction is usually seen twice by a node: when it is received on its own and again in the block that
+ * includes it. Recovering its keys through the same cache both times recovers them only once.
+ *
+ * Holds at most max_entries keys. Entries not used for max_entries / 2 insertions are dropped. Thread safe.
+ */
+class recovered_keys_cache {
+   public:
+      /// max_entries of 0 disables the cache
+      explicit recovered_keys_cache( uint32_t max_entries )
+         : max_entries( max_entries ) {}
+
+      /// Same as signed_transaction::get_signature_keys, but recovers only the keys that are not cached.
+      fc::microseconds get_signature_keys( const signed_transaction& trx, const chain_id_type& chain_id, fc::time_point deadline,
+                                           flat_set<public_key_type>& recovered_pub_keys, bool allow_duplicate_keys = false );
+
+      size_t size()const;
+      uint64_t hits()const;
+      uint64_t misses()const;
+
+   private:
+      using entries_type = std::unordered_map<digest_type, public_key_type>;
+
+      bool find( const digest_type& key, public_key_type& result );
+      void add( const digest_type& key, const public_key_type& pub_key );
+
+      const uint32_t     max_entries;
+      mutable std::mutex mtx;
+      entries_type       current;  ///< entries added or used since the last rotation
+      entries_type       previous; ///< entries of the generation before, moved to current when used
+      uint64_t           hit_count = 0;
+      uint64_t           miss_count = 0;
+};
+
+} } // eosio::chain
@@ -3,15 +3,23 @@
 #include <eosio/chain/database_utils.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <fc/variant_object.hpp>
+#include <boost/asio/io_context.hpp>
 #include <boost/core/demangle.hpp>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <ostream>
+#include <sstream>
 
 namespace eosio { namespace chain {
    /**
     * History:
     * Version 1: initial version with string identified sections and rows
+    * Version 2: binary snapshots only, the rows of each section are stored as independently compressed and
+    *            checksummed chunks (see compressed_ostream_snapshot_writer)
     */
    static const uint32_t current_snapshot_version = 1;
+   static const uint32_t compressed_snapshot_version = 2;
 
    namespace detail {
       template<typename T>
@@ -112,6 +120,20 @@ namespace eosio { namespace chain {
       }
    }
 
+   /**
+    * Rows of a section in the binary snapshot row encoding, serialized away from the final writer. A job
+    * may produce only part of a section; adjacent buffers of the same section are joined when written.
+    */
+   struct snapshot_section_buffer {
+      std::string section_name;
+      uint64_t    row_count = 0;
+      std::string rows;
+      bool        encoded = false; ///< rows are in the storage encoding of a writer or reader (e.g. compressed)
+   };
+
+   class snapshot_writer;
+   using snapshot_writer_ptr = std::shared_ptr<snapshot_writer>;
+
    class snapshot_writer {
       public:
          class section_writer {
@@ -144,15 +166,34 @@ namespace eosio { namespace chain {
             write_section(detail::snapshot_section_traits<T>::section_name(), f);
          }
 
+         /// writes one or more complete sections
+         using section_job = std::function<void(const snapshot_writer_ptr&)>;
+
+         /**
+          * Write the sections produced by jobs, in job order.
+          *
+          * With a thread_pool and a writer that supports row buffers, every job serializes into its own
+          * buffered_snapshot_writer concurrently and finished buffers are streamed here in job order while
+          * later jobs are still running. Otherwise the jobs write here one after the other. Either way
+          * adjacent sections with the same name are joined, so a large section can be split across jobs.
+          */
+         void write_sections( const std::vector<section_job>& jobs, boost::asio::io_context* thread_pool = nullptr );
+
       virtual ~snapshot_writer(){};
 
       protected:
          virtual void write_start_section( const std::string& section_name ) = 0;
          virtual void write_row( const detail::abstract_snapshot_row_writer& row_writer ) = 0;
          virtual void write_end_section() = 0;
-   };
 
-   using snapshot_writer_ptr = std::shared_ptr<snapshot_writer>;
+         virtual bool supports_row_buffers() const { return false; }
+         virtual void write_row_buffer( const snapshot_section_buffer& buffer );
+         /// convert a buffer to the storage encoding, called concurrently from the jobs of write_sections
+         virtual void encode_row_buffer( snapshot_section_buffer& ) const {}
+
+      private:
+         class section_joining_writer;
+   };
 
    namespace detail {
       struct abstract_snapshot_row_reader {
@@ -221,6 +262,9 @@ namespace eosio { namespace chain {
       }
    }
 
+   class snapshot_reader;
+   using snapshot_reader_ptr = std::shared_ptr<snapshot_reader>;
+
    class snapshot_reader {
       public:
          class section_reader {
@@ -277,6 +321,22 @@ namespace eosio { namespace chain {
          return has_section(suffix + detail::snapshot_section_traits<T>::section_name());
       }
 
+      /// reads one or more complete sections
+      struct section_job {
+         std::vector<std::string>                         sections; ///< read ahead of the job, others are read when it asks for them
+         std::function<void(const snapshot_reader_ptr&)>  read;
+      };
+
+      /**
+       * Run jobs that each read a disjoint set of sections, one after the other on the calling thread.
+       *
+       * With a thread_pool and a reader that supports row buffers, the sections each job lists are copied out of
+       * this reader under a lock and decoded on the thread pool while earlier jobs run, and each job reads them from
+       * its own buffered_snapshot_reader. The jobs themselves never run concurrently, so they may write to a
+       * chainbase database.
+       */
+      void read_sections( const std::vector<section_job>& jobs, boost::asio::io_context* thread_pool = nullptr );
+
       virtual void validate() const = 0;
 
       virtual void return_to_header() = 0;
@@ -289,9 +349,16 @@ namespace eosio { namespace chain {
          virtual bool read_row( detail::abstract_snapshot_row_reader& row_reader ) = 0;
          virtual bool empty( ) = 0;
          virtual void clear_section() = 0;
-   };
 
-   using snapshot_reader_ptr = std::shared_ptr<snapshot_reader>;
+         virtual bool supports_row_buffers() const { return false; }
+         virtual snapshot_section_buffer read_row_buffer( const std::string& section_name );
+         /// undo the storage encoding of a buffer returned by read_row_buffer, called concurrently without the lock
+         virtual void decode_row_buffer( snapshot_section_buffer& ) const {}
+
+      private:
+         friend class buffered_snapshot_reader;
+         friend class layered_snapshot_reader;
+   };
 
    class variant_snapshot_writer : public snapshot_writer {
       public:
@@ -337,7 +404,12 @@ namespace eosio { namespace chain {
 
          static const uint32_t magic_number = 0x30510550;
 
-      private:
+      protected:
+         ostream_snapshot_writer(std::ostream& snapshot, uint32_t version);
+
+         bool supports_row_buffers() const override { return true; }
+         void write_row_buffer( const snapshot_section_buffer& buffer ) override;
+
          detail::ostream_wrapper snapshot;
          std::streampos          header_pos;
          std::streampos          section_pos;
@@ -357,15 +429,116 @@ namespace eosio { namespace chain {
          void clear_section() override;
          void return_to_header() override;
 
-      private:
-         bool validate_section() const;
+      protected:
+         istream_snapshot_reader(std::istream& snapshot, uint32_t version);
+
+         bool supports_row_buffers() const override { return true; }
+         snapshot_section_buffer read_row_buffer( const std::string& section_name ) override;
+
+         /// called with the stream just past the section size, must leave it at section_end
+         virtual void validate_section_contents( const std::streampos& section_end ) const;
 
          std::istream&  snapshot;
+         const uint32_t version;
          std::streampos header_pos;
+         std::streampos section_end;
          uint64_t       num_rows;
          uint64_t       cur_row;
+
+      private:
+         bool validate_section() const;
+   };
+
+   /**
+    * Writes the binary snapshot format with the rows of each section zlib compressed (snapshot version 2).
+    *
+    * Section framing is unchanged from ostream_snapshot_writer, but the rows are stored as a series of chunks
+    * of at most chunk_size uncompressed bytes:
+    *
+    * +-----------------+-------------------+-------------------------------+-----------------+
+    * | compressed size | uncompressed size | sha256 of the compressed data | compressed data |
+    * +-----------------+-------------------+-------------------------------+-----------------+
+    *   8 bytes           8 bytes             32 bytes
+    *
+    * Chunks are independent, so the sections written by write_sections jobs are compressed on the jobs'
+    * threads and can be decompressed in parallel when loading. The checksums let a reader detect a corrupt
+    * file in validate(), before any state has been loaded from it.
+    */
+   class compressed_ostream_snapshot_writer : public ostream_snapshot_writer {
+      public:
+         static constexpr size_t chunk_size = 4 * 1024 * 1024;
+
+         explicit compressed_ostream_snapshot_writer(std::ostream& snapshot);
+
+         void write_row( const detail::abstract_snapshot_row_writer& row_writer ) override;
+         void write_end_section( ) override;
+
+      protected:
+         void write_row_buffer( const snapshot_section_buffer& buffer ) override;
+         void encode_row_buffer( snapshot_section_buffer& buffer ) const override;
+
+      private:
+         void flush_pending_rows( bool include_partial_chunk );
+
+         std::ostringstream      pending_rows;
+         detail::ostream_wrapper pending_rows_wrapper;
+   };
+
+   /**
+    * Reads snapshots written by compressed_ostream_snapshot_writer. Sections are decompressed a chunk at a
+    * time while reading rows; validate() verifies the checksum of every chunk.
+    */
+   class compressed_istream_snapshot_reader : public istream_snapshot_reader {
+      public:
+         explicit compressed_istream_snapshot_reader(std::istream& snapshot);
+         ~compressed_istream_snapshot_reader();
+
+         void set_section( const string& section_name ) override;
+         bool read_row( detail::abstract_snapshot_row_reader& row_reader ) override;
+         void clear_section() override;
+
+      protected:
+         snapshot_section_buffer read_row_buffer( const std::string& section_name ) override;
+         void decode_row_buffer( snapshot_section_buffer& buffer ) const override;
+         void validate_section_contents( const std::streampos& section_end ) const override;
+
+      private:
+         class chunk_streambuf;
+
+         std::unique_ptr<chunk_streambuf> section_buf;
+         std::unique_ptr<std::istream>    section_rows;
    };
 
+   /**
+    * Presents a base snapshot followed by delta snapshots as a single snapshot: each section is read from the last
+    * layer that contains it, as a delta only contains the sections that changed since the layer before it.
+    */
+   class layered_snapshot_reader : public snapshot_reader {
+      public:
+         explicit layered_snapshot_reader( std::vector<snapshot_reader_ptr> layers );
+
+         void validate() const override;
+         bool has_section( const string& section_name ) override;
+         void set_section( const string& section_name ) override;
+         bool read_row( detail::abstract_snapshot_row_reader& row_reader ) override;
+         bool empty ( ) override;
+         void clear_section() override;
+         void return_to_header() override;
+
+      protected:
+         bool supports_row_buffers() const override;
+         snapshot_section_buffer read_row_buffer( const std::string& section_name ) override;
+
+      private:
+         snapshot_reader& layer_for( const std::string& section_name );
+
+         std::vector<snapshot_reader_ptr> layers;
+         snapshot_reader*                 current = nullptr;
+   };
+
+   /// peek at the header of a binary snapshot and return the matching reader
+   std::shared_ptr<istream_snapshot_reader> make_istream_snapshot_reader(std::istream& snapshot);
+
    class integrity_hash_snapshot_writer : public snapshot_writer {
       public:
          explicit integrity_hash_snapshot_writer(fc::sha256::encoder&  enc);
@@ -375,9 +548,62 @@ namespace eosio { namespace chain {
          void write_end_section( ) override;
          void finalize();
 
+      protected:
+         // the hash covers only row bytes, so hashing serialized rows matches hashing them one at a time
+         bool supports_row_buffers() const override { return true; }
+         void write_row_buffer( const snapshot_section_buffer& buffer ) override;
+
       private:
          fc::sha256::encoder&  enc;
 
    };
 
+   /**
+    * Serializes sections into memory instead of a stream, so they can be produced on a worker thread and
+    * copied to the final writer afterwards.
+    */
+   class buffered_snapshot_writer : public snapshot_writer {
+      public:
+         buffered_snapshot_writer();
+
+         void write_start_section( const std::string& section_name ) override;
+         void write_row( const detail::abstract_snapshot_row_writer& row_writer ) override;
+         void write_end_section( ) override;
+
+         std::vector<snapshot_section_buffer> sections;
+
+      private:
+         std::ostringstream      rows;
+         detail::ostream_wrapper rows_wrapper;
+   };
+
+   /**
+    * Reads sections of another reader from memory: each section is copied out of the source under a lock
+    * shared by all buffered readers of that source, and then decoded without holding it. Sections can be
+    * prefetched on another thread than the one reading rows.
+    */
+   class buffered_snapshot_reader : public snapshot_reader {
+      public:
+         buffered_snapshot_reader( snapshot_reader& source, std::mutex& source_mtx );
+
+         /// copy and decode a section ahead of set_section, nothing if the source does not have it
+         void prefetch( const string& section_name );
+
+         void validate() const override;
+         bool has_section( const string& section_name ) override;
+         void set_section( const string& section_name ) override;
+         bool read_row( detail::abstract_snapshot_row_reader& row_reader ) override;
+         bool empty ( ) override;
+         void clear_section() override;
+         void return_to_header() override;
+
+      private:
+         snapshot_reader&                 source;
+         std::mutex&                      source_mtx;
+         std::map<std::string, snapshot_section_buffer> prefetched;
+         snapshot_section_buffer          section;
+         std::unique_ptr<std::istream>    rows;
+         uint64_t                         cur_row = 0;
+   };
+
 }}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <eosio/chain/types.hpp>
+
+#include <map>
+#include <set>
+#include <tuple>
+#include <vector>
+
+namespace eosio { namespace chain {
+
+/**
+ * A delta snapshot holds only the state that changed since the snapshot it is based on, which is either a full
+ * snapshot or another delta. It is loaded by layering it over its base with layered_snapshot_reader.
+ *
+ * Sections other than contract tables are included whole if any of their rows changed. Contract tables are
+ * recorded per row in the contract_tables_delta section: for every changed table a snapshot_contract_table_delta,
+ * then the table row and, for each contract database index, the primary keys of the changed rows followed by
+ * those of the rows that still exist. Rows are identified by table and primary key rather than by id, since ids
+ * are not preserved by loading a snapshot.
+ */
+struct snapshot_delta_header {
+   block_id_type base_block_id;
+   block_id_type block_id;
+};
+
+struct snapshot_contract_table_delta {
+   account_name code;
+   scope_name   scope;
+   table_name   table;
+   bool         removed = false;
+};
+
+/**
+ * Changes to the state since the last snapshot, collected from the undo session of every committed block.
+ *
+ * Changes of blocks that are later popped are kept, as writing the current value of a row that did not end up
+ * changing is harmless. Anything that makes the changes unknowable, such as a block applied without an undo
+ * session or popping the base block itself, invalidates the tracker until the next full snapshot.
+ */
+struct snapshot_delta_tracker {
+   using table_key = std::tuple<account_name, scope_name, table_name>;
+
+   struct table_changes {
+      /// primary keys of the changed rows, per contract database index
+      std::vector<std::set<uint64_t>> rows;
+
+      void mark_row( size_t index_num, uint64_t primary_key ) {
+         if( rows.size() <= index_num )
+            rows.resize( index_num + 1 );
+         rows[index_num].insert( primary_key );
+      }
+
+      const std::set<uint64_t>& rows_of( size_t index_num ) const {
+         static const std::set<uint64_t> none;
+         return index_num < rows.size() ? rows[index_num] : none;
+      }
+   };
+
+   void reset( const block_id_type& base ) {
+      valid = true;
+      base_block_id = base;
+      changed_sections.clear();
+      changed_tables.clear();
+   }
+
+   void invalidate() {
+      valid = false;
+      changed_sections.clear();
+      changed_tables.clear();
+   }
+
+   bool section_changed( const std::string& section_name ) const {
+      return changed_sections.count( section_name ) > 0;
+   }
+
+   bool                                valid = false;
+   block_id_type                       base_block_id;
+   std::set<std::string>               changed_sections;
+   std::map<table_key, table_changes>  changed_tables;
+};
+
+} }
+
+FC_REFLECT(eosio::chain::snapshot_delta_header, (base_block_id)(block_id))
+FC_REFLECT(eosio::chain::snapshot_contract_table_delta, (code)(scope)(table)(removed))
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <eosio/chain/types.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/member.hpp>
+
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace eosio { namespace chain {
+
+/**
+ * CPU time spent by this node on transactions that failed, billed to their first authorizer.
+ *
+ * Failed transactions are not included in a block, so the chain never charges anyone for executing them. The
+ * ledger charges them subjectively instead: each account accumulates the cpu of its failed transactions, which
+ * decays linearly to zero over decay_window. A producer can then drop transactions of accounts whose billed cpu
+ * exceeds account_budget_us before executing them. An account_budget_us of 0 only keeps the ledger, a
+ * decay_window of 0 disables it.
+ *
+ * Not thread safe, used from the main thread only.
+ */
+class subjective_billing {
+public:
+   struct account_billing {
+      account_name   account;
+      uint64_t       billed_us = 0;    ///< as of last_update
+      fc::time_point last_update;
+   };
+
+   explicit subjective_billing( fc::microseconds decay_window = fc::microseconds(), uint64_t account_budget_us = 0 )
+   : decay_window( decay_window )
+   , account_budget_us( account_budget_us ) {}
+
+   bool enabled()const { return decay_window.count() > 0; }
+
+   /// charge account for cpu spent on one of its transactions that failed
+   void bill_failed( const account_name& account, fc::microseconds cpu, const fc::time_point& now ) {
+      if( !enabled() || cpu.count() <= 0 ) return;
+      ++failed_count;
+      total_billed += cpu.count();
+      auto& idx = ledger.get<by_account>();
+      auto itr = idx.find( account );
+      if( itr == idx.end() ) {
+         ledger.insert( account_billing{ account, static_cast<uint64_t>( cpu.count() ), now } );
+         return;
+      }
+      idx.modify( itr, [&]( account_billing& b ) {
+         b.billed_us = decayed( b, now ) + cpu.count();
+         b.last_update = now;
+      } );
+   }
+
+   /// cpu billed to account, decayed to now
+   uint64_t get_billed_us( const account_name& account, const fc::time_point& now )const {
+      const auto& idx = ledger.get<by_account>();
+      auto itr = idx.find( account );
+      return itr == idx.end() ? 0 : decayed( *itr, now );
+   }
+
+   /// true if transactions of account should be dropped without being executed; counts them as rejected
+   bool reject( const account_name& account, const fc::time_point& now ) {
+      if( !enabled() || account_budget_us == 0 ) return false;
+      if( get_billed_us( account, now ) <= account_budget_us ) return false;
+      ++rejected_count;
+      return true;
+   }
+
+   /**
+    * Forget accounts whose billing has decayed to zero.
+    * @return the number of accounts removed
+    */
+   size_t expire( const fc::time_point& now ) {
+      auto& idx = ledger.get<by_last_update>();
+      auto end = idx.upper_bound( now - decay_window );
+      size_t removed = std::distance( idx.begin(), end );
+      idx.erase( idx.begin(), end );
+      return removed;
+   }
+
+   /// up to limit accounts with the most cpu billed as of now, most billed first
+   std::vector<std::pair<account_name, uint64_t>> top( uint32_t limit, const fc::time_point& now )const {
+      std::vector<std::pair<account_name, uint64_t>> result;
+      result.reserve( ledger.size() );
+      for( const auto& b : ledger ) {
+         auto billed = decayed( b, now );
+         if( billed > 0 ) result.emplace_back( b.account, billed );
+      }
+      auto by_billed = []( const auto& a, const auto& b ) { return a.second > b.second; };
+      if( result.size() > limit ) {
+         std::partial_sort( result.begin(), result.begin() + limit, result.end(), by_billed );
+         result.resize( limit );
+      } else {
+         std::sort( result.begin(), result.end(), by_billed );
+      }
+      return result;
+   }
+
+   size_t   size()const           { return ledger.size(); }
+   uint64_t failed_trxs()const    { return failed_count; }
+   uint64_t rejected_trxs()const  { return rejected_count; }
+   uint64_t total_billed_us()const { return total_billed; }
+
+private:
+   struct by_account;
+   struct by_last_update;
+
+   typedef boost::multi_index_container<
+      account_billing,
+      boost::multi_index::indexed_by<
+         boost::multi_index::ordered_unique< boost::multi_index::tag<by_account>,
+            boost::multi_index::member<account_billing, account_name, &account_billing::account>
+         >,
+         boost::multi_index::ordered_non_unique< boost::multi_index::tag<by_last_update>,
+            boost::multi_index::member<account_billing, fc::time_point, &account_billing::last_update>
+         >
+      >
+   > ledger_type;
+
+   uint64_t decayed( const account_billing& b, const fc::time_point& now )const {
+      const int64_t elapsed = std::max<int64_t>( ( now - b.last_update ).count(), 0 );
+      if( elapsed >= decay_window.count() ) return 0;
+      // remaining fraction of the window, in 128 bits so large bills do not overflow
+      return static_cast<uint64_t>( static_cast<uint128_t>( b.billed_us ) * ( decay_window.count() - elapsed )
+                                    / decay_window.count() );
+   }
+
+   fc::microseconds       decay_window;
+   uint64_t               account_budget_us = 0;
+   ledger_type            ledger;
+   uint64_t               failed_count = 0;
+   uint64_t               rejected_count = 0;
+   uint64_t               total_billed = 0;
+};
+
+} } // eosio::chain
@@ -6,6 +6,8 @@
 
 namespace eosio { namespace chain {
 
+   class wasm_interface;
+
    struct transaction_checktime_timer {
       public:
          transaction_checktime_timer() = delete;
@@ -39,7 +41,8 @@ namespace eosio { namespace chain {
                               const signed_transaction& t,
                               const transaction_id_type& trx_id,
                               transaction_checktime_timer&& timer,
-                              fc::time_point start = fc::time_point::now() );
+                              fc::time_point start = fc::time_point::now(),
+                              bool read_only = false );
 
          void init_for_implicit_trx( uint64_t initial_net_usage = 0 );
 
@@ -49,6 +52,9 @@ namespace eosio { namespace chain {
 
          void init_for_deferred_trx( fc::time_point published );
 
+         /// for transactions that only read state: nothing is billed or recorded and no state may be changed
+         void init_for_read_only_trx();
+
          void exec();
          void finalize();
          void squash();
@@ -69,6 +75,17 @@ namespace eosio { namespace chain {
 
          void validate_referenced_accounts( const transaction& trx, bool enforce_actor_whitelist_blacklist )const;
 
+         bool is_read_only()const { return read_only; }
+
+         /// throws read_only_trx_write_exception if the transaction is read-only
+         void require_writable( const char* what )const;
+
+         /// the wasm runtime executing the actions of this transaction, the controller's unless executed off the main thread
+         wasm_interface& get_wasm_interface();
+#if defined(EOSIO_EOS_VM_RUNTIME_ENABLED) || defined(EOSIO_EOS_VM_JIT_RUNTIME_ENABLED)
+         vm::wasm_allocator& get_wasm_allocator();
+#endif
+
       private:
 
          friend struct controller_impl;
@@ -135,6 +152,12 @@ namespace eosio { namespace chain {
 
       private:
          bool                          is_initialized = false;
+         const bool                    read_only = false;
+
+         wasm_interface*               wasmif_override = nullptr;     ///< set by the controller for read-only threads
+#if defined(EOSIO_EOS_VM_RUNTIME_ENABLED) || defined(EOSIO_EOS_VM_JIT_RUNTIME_ENABLED)
+         vm::wasm_allocator*           wasm_alloc_override = nullptr; ///< set by the controller for read-only threads
+#endif
 
 
          uint64_t                      net_limit = 0;
@@ -11,6 +11,7 @@ namespace boost { namespace asio {
 namespace eosio { namespace chain {
 
 class transaction_metadata;
+class recovered_keys_cache;
 using transaction_metadata_ptr = std::shared_ptr<transaction_metadata>;
 using recover_keys_future = std::future<transaction_metadata_ptr>;
 
@@ -71,11 +72,18 @@ class transaction_metadata {
       const flat_set<public_key_type>& recovered_keys()const { return _recovered_pub_keys; }
 
       /// Thread safe.
+      /// @param cache if not null, keys are looked up in and added to cache
       /// @returns transaction_metadata_ptr or exception via future
       static recover_keys_future
       start_recover_keys( packed_transaction_ptr trx, boost::asio::io_context& thread_pool,
                           const chain_id_type& chain_id, fc::microseconds time_limit,
-                          uint32_t max_variable_sig_size = UINT32_MAX );
+                          uint32_t max_variable_sig_size = UINT32_MAX, recovered_keys_cache* cache = nullptr );
+
+      /// Thread safe. Recovers the keys on the calling thread, for callers that recover batches of transactions.
+      /// @returns transaction_metadata_ptr, throws on failure
+      static transaction_metadata_ptr
+      recover_keys( packed_transaction_ptr trx, const chain_id_type& chain_id, fc::microseconds time_limit,
+                    uint32_t max_variable_sig_size = UINT32_MAX, recovered_keys_cache* cache = nullptr );
 
       /// @returns constructed transaction_metadata with no key recovery (sig_cpu_usage=0, recovered_pub_keys=empty)
       static transaction_metadata_ptr
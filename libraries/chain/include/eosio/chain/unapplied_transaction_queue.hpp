@@ -8,6 +8,9 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
+#include <boost/multi_index/composite_key.hpp>
+
+#include <map>
 
 namespace fc {
   inline std::size_t hash_value( const fc::sha256& v ) {
@@ -30,6 +33,9 @@ struct unapplied_transaction {
    const transaction_metadata_ptr trx_meta;
    const fc::time_point           expiry;
    trx_enum_type                  trx_type = trx_enum_type::unknown;
+   account_name                   authorizer;  ///< first authorizer, used by speculative_fair_producer
+   uint64_t                       round = 0;   ///< scheduling round, used by speculative_fair_producer
+   uint32_t                       cpu_us = 0;  ///< billed cpu of the last execution, used by speculative_fair_producer
 
    const transaction_id_type& id()const { return trx_meta->id(); }
 
@@ -42,13 +48,19 @@ struct unapplied_transaction {
 /**
  * Track unapplied transactions for persisted, forked blocks, and aborted blocks.
  * Persisted are first so that they can be applied in each block until expired.
+ *
+ * In speculative_fair_producer mode transactions of each type are also scheduled by account: each account with
+ * transactions in the queue, identified by the first authorizer, gets one transaction per round, and within a round
+ * the transactions that used the least cpu when last executed come first. An account sending many transactions
+ * then only delays its own, instead of every transaction queued after them.
  */
 class unapplied_transaction_queue {
 public:
    enum class process_mode {
       non_speculative,           // HEAD, READ_ONLY, IRREVERSIBLE
       speculative_non_producer,  // will never produce
-      speculative_producer       // can produce
+      speculative_producer,      // can produce
+      speculative_fair_producer  // can produce, schedules by account and cpu
    };
 
 private:
@@ -61,13 +73,58 @@ private:
          hashed_unique< tag<by_trx_id>,
                const_mem_fun<unapplied_transaction, const transaction_id_type&, &unapplied_transaction::id>
          >,
-         ordered_non_unique< tag<by_type>, member<unapplied_transaction, trx_enum_type, &unapplied_transaction::trx_type> >,
+         // round and cpu_us are 0 unless speculative_fair_producer, leaving insertion order within a type
+         ordered_non_unique< tag<by_type>,
+               composite_key< unapplied_transaction,
+                     member<unapplied_transaction, trx_enum_type, &unapplied_transaction::trx_type>,
+                     member<unapplied_transaction, uint64_t, &unapplied_transaction::round>,
+                     member<unapplied_transaction, uint32_t, &unapplied_transaction::cpu_us>
+               >
+         >,
          ordered_non_unique< tag<by_expiry>, member<unapplied_transaction, const fc::time_point, &unapplied_transaction::expiry> >
       >
    > unapplied_trx_queue_type;
 
+   /// transactions of a type in the queue of an account and the round of the last one, speculative_fair_producer only
+   struct account_rounds {
+      uint32_t count = 0;
+      uint64_t last_round = 0;
+   };
+
    unapplied_trx_queue_type queue;
    process_mode mode = process_mode::speculative_producer;
+   // each type is scheduled in its own rounds
+   std::map<std::pair<trx_enum_type, account_name>, account_rounds> rounds;
+
+   void insert( const transaction_metadata_ptr& trx, trx_enum_type trx_type ) {
+      fc::time_point expiry = trx->packed_trx()->expiration();
+      if( mode != process_mode::speculative_fair_producer ) {
+         queue.insert( { trx, expiry, trx_type } );
+         return;
+      }
+      const account_name authorizer = trx->packed_trx()->get_transaction().first_authorizer();
+      // an account joins the earliest round still queued, or follows its own last transaction
+      auto& idx = queue.get<by_type>();
+      auto first = idx.lower_bound( boost::make_tuple( trx_type ) );
+      uint64_t round = ( first != idx.end() && first->trx_type == trx_type ) ? first->round : 0;
+      const auto key = std::make_pair( trx_type, authorizer );
+      auto& r = rounds[key];
+      if( r.count > 0 ) round = std::max( round, r.last_round + 1 );
+      auto result = queue.insert( { trx, expiry, trx_type, authorizer, round, trx->billed_cpu_time_us } );
+      if( result.second ) {
+         ++r.count;
+         r.last_round = round;
+      } else if( r.count == 0 ) {
+         rounds.erase( key );
+      }
+   }
+
+   /// call before erasing u
+   void erased( const unapplied_transaction& u ) {
+      if( mode != process_mode::speculative_fair_producer ) return;
+      auto itr = rounds.find( std::make_pair( u.trx_type, u.authorizer ) );
+      if( itr != rounds.end() && --itr->second.count == 0 ) rounds.erase( itr );
+   }
 
 public:
 
@@ -88,10 +145,11 @@ public:
 
    void clear() {
       queue.clear();
+      rounds.clear();
    }
 
    bool contains_persisted()const {
-      return queue.get<by_type>().find( trx_enum_type::persisted ) != queue.get<by_type>().end();
+      return queue.get<by_type>().find( boost::make_tuple( trx_enum_type::persisted ) ) != queue.get<by_type>().end();
    }
 
    bool is_persisted(const transaction_metadata_ptr& trx)const {
@@ -114,6 +172,7 @@ public:
             return false;
          }
          callback( persisted_by_expiry.begin()->id(), persisted_by_expiry.begin()->trx_type );
+         erased( *persisted_by_expiry.begin() );
          persisted_by_expiry.erase( persisted_by_expiry.begin() );
       }
       return true;
@@ -128,7 +187,8 @@ public:
             auto itr = queue.get<by_trx_id>().find( pt.id() );
             if( itr != queue.get<by_trx_id>().end() ) {
                if( itr->trx_type != trx_enum_type::persisted ) {
-                  idx.erase( pt.id() );
+                  erased( *itr );
+                  idx.erase( itr );
                }
             }
          }
@@ -141,9 +201,7 @@ public:
       for( auto ritr = forked_branch.rbegin(), rend = forked_branch.rend(); ritr != rend; ++ritr ) {
          const block_state_ptr& bsptr = *ritr;
          for( auto itr = bsptr->trxs_metas().begin(), end = bsptr->trxs_metas().end(); itr != end; ++itr ) {
-            const auto& trx = *itr;
-            fc::time_point expiry = trx->packed_trx()->expiration();
-            queue.insert( { trx, expiry, trx_enum_type::forked } );
+            insert( *itr, trx_enum_type::forked );
          }
       }
    }
@@ -151,8 +209,7 @@ public:
    void add_aborted( std::vector<transaction_metadata_ptr> aborted_trxs ) {
       if( mode == process_mode::non_speculative || mode == process_mode::speculative_non_producer ) return;
       for( auto& trx : aborted_trxs ) {
-         fc::time_point expiry = trx->packed_trx()->expiration();
-         queue.insert( { std::move( trx ), expiry, trx_enum_type::aborted } );
+         insert( trx, trx_enum_type::aborted );
       }
    }
 
@@ -160,12 +217,18 @@ public:
       if( mode == process_mode::non_speculative ) return;
       auto itr = queue.get<by_trx_id>().find( trx->id() );
       if( itr == queue.get<by_trx_id>().end() ) {
-         fc::time_point expiry = trx->packed_trx()->expiration();
-         queue.insert( { trx, expiry, trx_enum_type::persisted } );
+         insert( trx, trx_enum_type::persisted );
       } else if( itr->trx_type != trx_enum_type::persisted ) {
-         queue.get<by_trx_id>().modify( itr, [](auto& un){
-            un.trx_type = trx_enum_type::persisted;
-         } );
+         if( mode == process_mode::speculative_fair_producer ) {
+            // its round was in the rounds of its old type
+            erased( *itr );
+            queue.get<by_trx_id>().erase( itr );
+            insert( trx, trx_enum_type::persisted );
+         } else {
+            queue.get<by_trx_id>().modify( itr, [](auto& un){
+               un.trx_type = trx_enum_type::persisted;
+            } );
+         }
       }
    }
 
@@ -174,10 +237,13 @@ public:
    iterator begin() { return queue.get<by_type>().begin(); }
    iterator end() { return queue.get<by_type>().end(); }
 
-   iterator persisted_begin() { return queue.get<by_type>().lower_bound( trx_enum_type::persisted ); }
-   iterator persisted_end() { return queue.get<by_type>().upper_bound( trx_enum_type::persisted ); }
+   iterator persisted_begin() { return queue.get<by_type>().lower_bound( boost::make_tuple( trx_enum_type::persisted ) ); }
+   iterator persisted_end() { return queue.get<by_type>().upper_bound( boost::make_tuple( trx_enum_type::persisted ) ); }
 
-   iterator erase( iterator itr ) { return queue.get<by_type>().erase( itr ); }
+   iterator erase( iterator itr ) {
+      erased( *itr );
+      return queue.get<by_type>().erase( itr );
+   }
 
 };
 
@@ -19,6 +19,9 @@
 
 namespace eosio { namespace chain { namespace wasm_injections {
    using namespace IR;
+
+   // identifies the output of injection, increment whenever a change to it would change the injected code
+   constexpr uint32_t injection_version = 1;
    // helper functions for injection
 
    struct injector_utils {
@@ -96,7 +96,42 @@ namespace eosio { namespace chain {
              }
          }
 
-         wasm_interface(vm_type vm, bool eosvmoc_tierup, const chainbase::database& d, const boost::filesystem::path data_dir, const eosvmoc::config& eosvmoc_config);
+         struct instantiation_config {
+            uint16_t threads = 0;       ///< threads instantiating modules ahead of their first use, 0 instantiates on first use only
+            uint32_t warmup_modules = 0; ///< number of most used modules recorded at shutdown and instantiated at the next startup
+            uint64_t disk_cache_size = 0; ///< bytes of prepared modules kept on disk across restarts, 0 disables
+            uint32_t jit_tierup_threshold = 0; ///< executions after which eos-vm interpreted modules are compiled by eos-vm-jit, 0 disables
+         };
+
+         struct instantiation_stats {
+            uint64_t hits = 0;                ///< module was instantiated when executed
+            uint64_t misses = 0;              ///< module was instantiated by the executing thread
+            uint64_t waits = 0;               ///< executing thread waited for a module instantiated in the background
+            uint64_t stall_us = 0;            ///< time executing threads spent instantiating or waiting
+            uint64_t background = 0;          ///< modules instantiated in the background
+            uint64_t background_failures = 0; ///< background instantiations that failed, retried when executed
+            uint64_t disk_cache_hits = 0;     ///< modules prepared by a previous run, instantiated without preparing them again
+            uint64_t disk_cache_misses = 0;
+            uint32_t cached_modules = 0;
+            uint64_t jit_tierups = 0;         ///< modules compiled by eos-vm-jit in the background and executed by it since
+            uint64_t jit_tierup_failures = 0; ///< kept on the interpreter
+         };
+
+         struct eosvmoc_tierup_stats {
+            bool     enabled = false;
+            uint32_t queued = 0;              ///< codes waiting for a compile thread
+            uint32_t compiling = 0;
+            uint32_t cached = 0;              ///< compiled codes in the code cache
+            uint32_t blacklisted = 0;         ///< codes that failed to compile, always executed by the base runtime
+            uint64_t compiled = 0;
+            uint64_t failed = 0;
+            uint64_t avg_compile_us = 0;
+            uint64_t max_compile_us = 0;
+            uint64_t fallbacks = 0;           ///< executions by the base runtime because code was not compiled yet
+         };
+
+         wasm_interface(vm_type vm, bool eosvmoc_tierup, const chainbase::database& d, const boost::filesystem::path data_dir, const eosvmoc::config& eosvmoc_config,
+                        const instantiation_config& inst_config = instantiation_config());
          ~wasm_interface();
 
          //call before dtor to skip what can be minutes of dtor overhead with some runtimes; can cause leaks
@@ -111,6 +146,19 @@ namespace eosio { namespace chain {
          //indicate the current LIB. evicts old cache entries
          void current_lib(const uint32_t lib);
 
+         //instantiate code in the background ahead of its first use, expected no earlier than block_num
+         void instantiate_in_background(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, const bytes& code, uint32_t block_num);
+
+         //instantiate in the background the modules used most before the last shutdown
+         void warm_up(uint32_t block_num);
+
+         instantiation_stats get_instantiation_stats()const;
+
+         //compile code with EOS VM OC ahead of its execution, when tier up is enabled
+         void eosvmoc_precompile(const digest_type& code_hash, const uint8_t& vm_version);
+
+         eosvmoc_tierup_stats get_eosvmoc_tierup_stats()const;
+
          //Calls apply or error on a given code
          void apply(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, apply_context& context);
 
@@ -129,3 +177,8 @@ namespace eosio{ namespace chain {
 }}
 
 FC_REFLECT_ENUM( eosio::chain::wasm_interface::vm_type, (wabt)(eos_vm)(eos_vm_jit)(eos_vm_oc) )
+FC_REFLECT( eosio::chain::wasm_interface::instantiation_stats,
+            (hits)(misses)(waits)(stall_us)(background)(background_failures)(disk_cache_hits)(disk_cache_misses)(cached_modules)
+            (jit_tierups)(jit_tierup_failures) )
+FC_REFLECT( eosio::chain::wasm_interface::eosvmoc_tierup_stats,
+            (enabled)(queued)(compiling)(cached)(blacklisted)(compiled)(failed)(avg_compile_us)(max_compile_us)(fallbacks) )
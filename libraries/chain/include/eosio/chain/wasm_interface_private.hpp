@@ -13,7 +13,15 @@
 #include <eosio/chain/transaction_context.hpp>
 #include <eosio/chain/code_object.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/wasm_module_cache.hpp>
 #include <fc/scoped_exit.hpp>
+#include <fc/io/raw.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <future>
+#include <mutex>
 
 #include "IR/Module.h"
 #include "Runtime/Intrinsics.h"
@@ -39,6 +47,19 @@ namespace eosio { namespace chain {
 
    namespace eosvmoc { struct config; }
 
+   /// a module to instantiate at startup, recorded at shutdown
+   struct wasm_warmup_entry {
+      digest_type code_hash;
+      uint8_t     vm_type = 0;
+      uint8_t     vm_version = 0;
+   };
+
+} } // eosio::chain
+
+FC_REFLECT( eosio::chain::wasm_warmup_entry, (code_hash)(vm_type)(vm_version) )
+
+namespace eosio { namespace chain {
+
    struct wasm_interface_impl {
       struct wasm_cache_entry {
          digest_type                                          code_hash;
@@ -47,7 +68,13 @@ namespace eosio { namespace chain {
          std::unique_ptr<wasm_instantiated_module_interface>  module;
          uint8_t                                              vm_type = 0;
          uint8_t                                              vm_version = 0;
+         bool                                                 speculative = false; ///< instantiated before first use, evicted unless used
+         mutable uint64_t                                     use_count = 0;
+         mutable std::future<std::unique_ptr<wasm_instantiated_module_interface>> pending; ///< valid while instantiated in the background
+         bool                                                 jit_tierup_done = false; ///< executed by eos-vm-jit, or failed to compile with it
+         mutable std::future<std::unique_ptr<wasm_instantiated_module_interface>> jit_tierup; ///< valid while compiled by eos-vm-jit
       };
+      static constexpr uint32_t warmup_file_version = 1;
       struct by_hash;
       struct by_first_block_num;
       struct by_last_block_num;
@@ -61,7 +88,10 @@ namespace eosio { namespace chain {
       };
 #endif
 
-      wasm_interface_impl(wasm_interface::vm_type vm, bool eosvmoc_tierup, const chainbase::database& d, const boost::filesystem::path data_dir, const eosvmoc::config& eosvmoc_config) : db(d), wasm_runtime_time(vm) {
+      wasm_interface_impl(wasm_interface::vm_type vm, bool eosvmoc_tierup, const chainbase::database& d, const boost::filesystem::path data_dir, const eosvmoc::config& eosvmoc_config,
+                          const wasm_interface::instantiation_config& inst_config)
+      : db(d), wasm_runtime_time(vm), warmup_path(data_dir / "wasm-warmup.bin"), warmup_modules(inst_config.warmup_modules),
+        jit_tierup_threshold(inst_config.jit_tierup_threshold) {
          if(vm == wasm_interface::vm_type::wabt)
             runtime_interface = std::make_unique<webassembly::wabt_runtime::wabt_runtime>();
 #ifdef EOSIO_EOS_VM_RUNTIME_ENABLED
@@ -85,9 +115,29 @@ namespace eosio { namespace chain {
             eosvmoc.emplace(data_dir, eosvmoc_config, d);
          }
 #endif
+         // eos-vm-oc instantiates from its own code cache
+         if(inst_config.disk_cache_size > 0 && vm != wasm_interface::vm_type::eos_vm_oc)
+            module_cache.emplace(data_dir / "wasm-cache", inst_config.disk_cache_size, static_cast<uint8_t>(vm), wasm_injections::injection_version);
+         if(inst_config.threads > 0)
+            instantiation_pool.emplace("wasmin", inst_config.threads);
+         if(jit_tierup_threshold > 0) {
+#if defined(EOSIO_EOS_VM_RUNTIME_ENABLED) && defined(EOSIO_EOS_VM_JIT_RUNTIME_ENABLED)
+            EOS_ASSERT(vm == wasm_interface::vm_type::eos_vm, wasm_exception, "eos-vm-jit tier up requires the eos-vm runtime, not ${r}", ("r", vm));
+            jit_runtime_interface = std::make_unique<webassembly::eos_vm_runtime::eos_vm_runtime<eosio::vm::jit>>();
+            jit_tierup_pool.emplace("wasmjit", 1);
+#else
+            EOS_THROW(wasm_exception, "eos-vm-jit tier up not supported on this platform and/or configuration");
+#endif
+         }
       }
 
       ~wasm_interface_impl() {
+         if(jit_tierup_pool)
+            jit_tierup_pool->stop();
+         if(instantiation_pool)
+            instantiation_pool->stop();
+         if(warmup_modules > 0)
+            save_warmup_entries();
          if(is_shutting_down)
             for(wasm_cache_index::iterator it = wasm_instantiation_cache.begin(); it != wasm_instantiation_cache.end(); ++it)
                wasm_instantiation_cache.modify(it, [](wasm_cache_entry& e) {
@@ -132,6 +182,63 @@ namespace eosio { namespace chain {
          wasm_instantiation_cache.get<by_last_block_num>().erase(first_it, last_it);
       }
 
+      // parses, injects and instantiates code, or instantiates what a previous run prepared; does not touch the
+      // instantiation cache or chainbase, so may run on any thread. The eos-vm-jit tier prepares code as the eos-vm
+      // runtime does, neither injects it
+      std::unique_ptr<wasm_instantiated_module_interface> instantiate( const char* code, size_t code_size, const digest_type& code_hash,
+                                                                       const uint8_t& vm_type, const uint8_t& vm_version )
+      {
+         return instantiate(*runtime_interface, code, code_size, code_hash, vm_type, vm_version);
+      }
+
+      std::unique_ptr<wasm_instantiated_module_interface> instantiate( wasm_runtime_interface& runtime, const char* code, size_t code_size,
+                                                                       const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version )
+      {
+         if(module_cache) {
+            wasm_module_cache::loaded_module prepared;
+            if(module_cache->load(code_hash, vm_type, vm_version, prepared))
+               return runtime.instantiate_module(prepared.code, prepared.code_size, std::move(prepared.initial_memory), code_hash, vm_type, vm_version);
+         }
+
+         IR::Module module;
+         std::vector<U8> bytes = { (const U8*)code, (const U8*)code + code_size };
+         try {
+            Serialization::MemoryInputStream stream((const U8*)bytes.data(),
+                                                    bytes.size());
+            WASM::serialize(stream, module);
+            module.userSections.clear();
+         } catch (const Serialization::FatalSerializationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         } catch (const IR::ValidationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         }
+         bool injected = false;
+         {
+            // injection keeps its state in statics, and read-only and background threads may instantiate modules at the same time
+            static std::mutex injection_mtx;
+            std::lock_guard<std::mutex> g( injection_mtx );
+            injected = runtime.inject_module(module);
+         }
+         if (injected) {
+            try {
+               Serialization::ArrayOutputStream outstream;
+               WASM::serialize(outstream, module);
+               bytes = outstream.getBytes();
+            } catch (const Serialization::FatalSerializationException& e) {
+               EOS_ASSERT(false, wasm_serialization_error,
+                          e.message.c_str());
+            } catch (const IR::ValidationException& e) {
+               EOS_ASSERT(false, wasm_serialization_error,
+                          e.message.c_str());
+            }
+         }
+
+         auto initial_memory = parse_initial_memory(module);
+         if(module_cache)
+            module_cache->store(code_hash, vm_type, vm_version, (const char*)bytes.data(), bytes.size(), initial_memory);
+         return runtime.instantiate_module((const char*)bytes.data(), bytes.size(), std::move(initial_memory), code_hash, vm_type, vm_version);
+      }
+
       const std::unique_ptr<wasm_instantiated_module_interface>& get_instantiated_module( const digest_type& code_hash, const uint8_t& vm_type,
                                                                                  const uint8_t& vm_version, transaction_context& trx_context )
       {
@@ -149,49 +256,193 @@ namespace eosio { namespace chain {
                                                       .vm_type = vm_type,
                                                       .vm_version = vm_version
                                                    } ).first;
+         } else if(it->speculative) {
+            wasm_instantiation_cache.modify(it, [](wasm_cache_entry& e) {
+               e.speculative = false;
+               e.last_block_num_used = UINT32_MAX;
+            });
+         }
+         ++it->use_count;
+
+         // done in the background by now, as good as a module already in the cache
+         if(!it->module && it->pending.valid() && it->pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            std::unique_ptr<wasm_instantiated_module_interface> module;
+            try {
+               module = it->pending.get();
+            } catch(...) {
+               // failed in the background, instantiated again below so that the failure is reported to the transaction
+            }
+            if(module) {
+               wasm_instantiation_cache.modify(it, [&](auto& c) {
+                  c.module = std::move(module);
+               });
+            }
+         }
+
+         if(it->module) {
+            ++stats.hits;
+            if(jit_tierup_pool && !it->jit_tierup_done)
+               jit_tierup(it);
+            return it->module;
          }
 
-         if(!it->module) {
+         // the executing thread blocks from here on, waiting for the background or instantiating
+         const auto start = fc::time_point::now();
+         auto timer_pause = fc::make_scoped_exit([&](){
+            stats.stall_us += (fc::time_point::now() - start).count();
+            trx_context.resume_billing_timer();
+         });
+         trx_context.pause_billing_timer();
+
+         std::unique_ptr<wasm_instantiated_module_interface> module;
+         if(it->pending.valid()) {
+            ++stats.waits;
+            try {
+               module = it->pending.get();
+            } catch(...) {
+               // failed in the background, instantiated again below so that the failure is reported to the transaction
+            }
+         }
+         if(!module) {
+            ++stats.misses;
             if(!codeobject)
                codeobject = &db.get<code_object,by_code_hash>(boost::make_tuple(code_hash, vm_type, vm_version));
+            module = instantiate(codeobject->code.data(), codeobject->code.size(), code_hash, vm_type, vm_version);
+         }
+         wasm_instantiation_cache.modify(it, [&](auto& c) {
+            c.module = std::move(module);
+         });
+         return it->module;
+      }
 
-            auto timer_pause = fc::make_scoped_exit([&](){
-               trx_context.resume_billing_timer();
+      // swaps in the eos-vm-jit module once compiled, or starts compiling it once the module was executed often enough.
+      // No module is executing here, the swapped out one is not referenced anymore
+      void jit_tierup(const wasm_cache_index::iterator& it) {
+         if(it->jit_tierup.valid()) {
+            if(it->jit_tierup.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+               return;
+            const digest_type& code_hash = it->code_hash;
+            std::unique_ptr<wasm_instantiated_module_interface> module;
+            try {
+               module = it->jit_tierup.get();
+            } FC_LOG_AND_DROP( (code_hash) );
+            if(module)
+               ++stats.jit_tierups;
+            else
+               ++stats.jit_tierup_failures;
+            wasm_instantiation_cache.modify(it, [&](wasm_cache_entry& e) {
+               if(module)
+                  e.module = std::move(module);
+               e.jit_tierup_done = true;
             });
-            trx_context.pause_billing_timer();
-            IR::Module module;
-            std::vector<U8> bytes = {
-                (const U8*)codeobject->code.data(),
-                (const U8*)codeobject->code.data() + codeobject->code.size()};
+            return;
+         }
+         if(it->use_count < jit_tierup_threshold)
+            return;
+
+         // the thread must not read chainbase, it works on a copy of the code
+         const code_object& codeobject = db.get<code_object,by_code_hash>(boost::make_tuple(it->code_hash, it->vm_type, it->vm_version));
+         auto code = std::make_shared<std::vector<char>>(codeobject.code.begin(), codeobject.code.end());
+         it->jit_tierup = async_thread_pool(jit_tierup_pool->get_executor(),
+                                            [this, code, code_hash = it->code_hash, vm_type = it->vm_type, vm_version = it->vm_version]() {
+            return instantiate(*jit_runtime_interface, code->data(), code->size(), code_hash, vm_type, vm_version);
+         });
+      }
+
+      void instantiate_in_background(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version,
+                                     const char* code_data, size_t code_size, uint32_t block_num) {
+         if(!instantiation_pool)
+            return;
+         if(wasm_instantiation_cache.find(boost::make_tuple(code_hash, vm_type, vm_version)) != wasm_instantiation_cache.end())
+            return;
+
+         // the threads must not read chainbase, they work on a copy of the code
+         auto code = std::make_shared<std::vector<char>>(code_data, code_data + code_size);
+         auto it = wasm_instantiation_cache.emplace( wasm_interface_impl::wasm_cache_entry{
+                                                        .code_hash = code_hash,
+                                                        .first_block_num_used = block_num,
+                                                        .last_block_num_used = block_num,
+                                                        .module = nullptr,
+                                                        .vm_type = vm_type,
+                                                        .vm_version = vm_version,
+                                                        .speculative = true
+                                                     } ).first;
+         it->pending = async_thread_pool(instantiation_pool->get_executor(), [this, code, code_hash, vm_type, vm_version]() {
             try {
-               Serialization::MemoryInputStream stream((const U8*)bytes.data(),
-                                                       bytes.size());
-               WASM::serialize(stream, module);
-               module.userSections.clear();
-            } catch (const Serialization::FatalSerializationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            } catch (const IR::ValidationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+               auto m = instantiate(code->data(), code->size(), code_hash, vm_type, vm_version);
+               ++background_count;
+               return m;
+            } catch(...) {
+               ++background_failure_count;
+               throw;
             }
-            if (runtime_interface->inject_module(module)) {
-               try {
-                  Serialization::ArrayOutputStream outstream;
-                  WASM::serialize(outstream, module);
-                  bytes = outstream.getBytes();
-               } catch (const Serialization::FatalSerializationException& e) {
-                  EOS_ASSERT(false, wasm_serialization_error,
-                             e.message.c_str());
-               } catch (const IR::ValidationException& e) {
-                  EOS_ASSERT(false, wasm_serialization_error,
-                             e.message.c_str());
-               }
+         });
+      }
+
+      void warm_up(uint32_t block_num) {
+         if(!instantiation_pool || warmup_modules == 0 || !boost::filesystem::exists(warmup_path))
+            return;
+         const auto file = warmup_path.generic_string();
+         std::vector<wasm_warmup_entry> entries;
+         try {
+            std::ifstream in(file, std::ios::in | std::ios::binary);
+            std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            fc::datastream<const char*> ds(data.data(), data.size());
+            uint32_t version = 0;
+            fc::raw::unpack(ds, version);
+            if(version != warmup_file_version) {
+               wlog("ignoring ${f}, unsupported version ${v}", ("f", file)("v", version));
+               return;
             }
+            fc::raw::unpack(ds, entries);
+         } FC_LOG_AND_DROP((file));
+
+         uint32_t started = 0;
+         for(const auto& e : entries) {
+            if(started >= warmup_modules)
+               break;
+            // code may have been replaced since it was recorded
+            const code_object* codeobject = db.find<code_object,by_code_hash>(boost::make_tuple(e.code_hash, e.vm_type, e.vm_version));
+            if(!codeobject)
+               continue;
+            instantiate_in_background(e.code_hash, e.vm_type, e.vm_version, codeobject->code.data(), codeobject->code.size(), block_num);
+            ++started;
+         }
+         ilog("instantiating ${n} of ${t} recently used contracts in the background", ("n", started)("t", entries.size()));
+      }
 
-            wasm_instantiation_cache.modify(it, [&](auto& c) {
-               c.module = runtime_interface->instantiate_module((const char*)bytes.data(), bytes.size(), parse_initial_memory(module), code_hash, vm_type, vm_version);
-            });
+      void save_warmup_entries() {
+         const auto file = warmup_path.generic_string();
+         try {
+            std::vector<const wasm_cache_entry*> used;
+            for(const auto& e : wasm_instantiation_cache)
+               if(e.use_count > 0)
+                  used.push_back(&e);
+            std::sort(used.begin(), used.end(), [](const auto* a, const auto* b) { return a->use_count > b->use_count; });
+            if(used.size() > warmup_modules)
+               used.resize(warmup_modules);
+
+            std::vector<wasm_warmup_entry> entries;
+            entries.reserve(used.size());
+            for(const auto* e : used)
+               entries.push_back(wasm_warmup_entry{ e->code_hash, e->vm_type, e->vm_version });
+
+            const auto data = fc::raw::pack(std::make_pair(warmup_file_version, entries));
+            std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::trunc);
+            out.write(data.data(), data.size());
+         } FC_LOG_AND_DROP((file));
+      }
+
+      wasm_interface::instantiation_stats get_instantiation_stats()const {
+         auto s = stats;
+         s.background = background_count;
+         s.background_failures = background_failure_count;
+         if(module_cache) {
+            s.disk_cache_hits = module_cache->hits();
+            s.disk_cache_misses = module_cache->misses();
          }
-         return it->module;
+         s.cached_modules = wasm_instantiation_cache.size();
+         return s;
       }
 
       bool is_shutting_down = false;
@@ -216,8 +467,21 @@ namespace eosio { namespace chain {
       const chainbase::database& db;
       const wasm_interface::vm_type wasm_runtime_time;
 
+      const boost::filesystem::path            warmup_path;
+      const uint32_t                           warmup_modules = 0;
+      wasm_interface::instantiation_stats      stats;
+      std::atomic<uint64_t>                    background_count{0};
+      std::atomic<uint64_t>                    background_failure_count{0};
+      fc::optional<wasm_module_cache>          module_cache;
+      const uint32_t                           jit_tierup_threshold = 0;
+      std::unique_ptr<wasm_runtime_interface>  jit_runtime_interface;
+      // pools last so that they are stopped before the members their threads use
+      fc::optional<named_thread_pool>          instantiation_pool;
+      fc::optional<named_thread_pool>          jit_tierup_pool;
+
 #ifdef EOSIO_EOS_VM_OC_RUNTIME_ENABLED
       fc::optional<eosvmoc_tier> eosvmoc;
+      uint64_t                   eosvmoc_fallbacks = 0;
 #endif
    };
 
@@ -0,0 +1,68 @@
+#pragma once
+#include <eosio/chain/types.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace eosio { namespace chain {
+
+   /**
+    * Contract code as prepared for a wasm runtime, after validation and injection, kept on disk across restarts.
+    *
+    * Preparing code parses and validates the whole module, injects it and serializes it again, which takes longer
+    * than instantiating it. A restarted node would otherwise do this for every contract before its first call.
+    *
+    * Each module is a file in the cache directory, named by code hash, vm type, vm version and the runtime it was
+    * prepared for:
+    *
+    * +-------+-------------------+---------+-----------+-------------+----------+------+----------------+
+    * | magic | injection version | runtime | code size | memory size | checksum | code | initial memory |
+    * +-------+-------------------+---------+-----------+-------------+----------+------+----------------+
+    *   4       4                   1         4           4             32
+    *
+    * Files of another injection version, or whose checksum does not match, are ignored and written again. Files are
+    * memory mapped when loaded, and written to a temporary file renamed into place so that no partial file is ever
+    * read. Files not used for the longest time are removed at startup to keep the directory under max_size, after
+    * which no more files are written until the next startup. Thread safe.
+    */
+   class wasm_module_cache {
+      public:
+         static constexpr uint32_t magic = 0x31434d57; // "WMC1"
+
+         struct loaded_module {
+            std::shared_ptr<const void> mapping; ///< keeps code mapped
+            const char*                 code = nullptr;
+            size_t                      code_size = 0;
+            std::vector<uint8_t>        initial_memory;
+         };
+
+         /// injection_version identifies what injection produces, files written with another one are not loaded
+         wasm_module_cache( const boost::filesystem::path& dir, uint64_t max_size, uint8_t runtime, uint32_t injection_version );
+
+         /// @return false if code_hash was not prepared for this runtime and injection version
+         bool load( const digest_type& code_hash, uint8_t vm_type, uint8_t vm_version, loaded_module& result )const;
+
+         /// failures to write are logged and otherwise ignored
+         void store( const digest_type& code_hash, uint8_t vm_type, uint8_t vm_version, const char* code, size_t code_size,
+                     const std::vector<uint8_t>& initial_memory );
+
+         uint64_t hits()const   { return hit_count; }
+         uint64_t misses()const { return miss_count; }
+
+      private:
+         boost::filesystem::path file_path( const digest_type& code_hash, uint8_t vm_type, uint8_t vm_version )const;
+         void prune();
+
+         const boost::filesystem::path dir;
+         const uint64_t                max_size;
+         const uint8_t                 runtime;
+         const uint32_t                injection_version;
+         std::atomic<uint64_t>         size{0};
+         mutable std::atomic<uint64_t> hit_count{0};
+         mutable std::atomic<uint64_t> miss_count{0};
+   };
+
+} } // eosio::chain
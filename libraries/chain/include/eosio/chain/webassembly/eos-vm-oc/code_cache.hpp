@@ -4,6 +4,7 @@
 
 #include <eosio/chain/webassembly/eos-vm-oc/eos-vm-oc.hpp>
 #include <eosio/chain/webassembly/eos-vm-oc/ipc_helpers.hpp>
+#include <eosio/chain/webassembly/eos-vm-oc/compile_queue.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
@@ -16,14 +17,6 @@
 
 #include <thread>
 
-namespace std {
-    template<> struct hash<eosio::chain::eosvmoc::code_tuple> {
-        size_t operator()(const eosio::chain::eosvmoc::code_tuple& ct) const noexcept {
-            return ct.code_id._hash[0];
-        }
-    };
-}
-
 namespace eosio { namespace chain { namespace eosvmoc {
 
 using namespace boost::multi_index;
@@ -73,7 +66,7 @@ class code_cache_base {
 
       //these are really only useful to the async code cache, but keep them here so
       //free_code can be shared
-      std::unordered_set<code_tuple> _queued_compiles;
+      compile_queue _queued_compiles;
       std::unordered_map<code_tuple, bool> _outstanding_compiles_and_poison;
 
       size_t _free_bytes_eviction_threshold;
@@ -88,20 +81,46 @@ class code_cache_base {
 
 class code_cache_async : public code_cache_base {
    public:
+      struct compile_stats {
+         uint64_t compiled = 0;
+         uint64_t failed = 0;
+         uint64_t total_compile_us = 0; ///< from sending code to the compile monitor to receiving its result
+         uint64_t max_compile_us = 0;
+      };
+
       code_cache_async(const bfs::path data_dir, const eosvmoc::config& eosvmoc_config, const chainbase::database& db);
       ~code_cache_async();
 
       //If code is in cache: returns pointer & bumps to front of MRU list
       //If code is not in cache, and not blacklisted, and not currently compiling: return nullptr and kick off compile
+      //  or, when all compile threads are busy, queue it. Queued code executed most often is compiled first
       //otherwise: return nullptr
       const code_descriptor* const get_descriptor_for_code(const digest_type& code_id, const uint8_t& vm_version);
 
+      //kick off compile of code not in cache ahead of its execution, ahead of any other queued code
+      void precompile(const digest_type& code_id, const uint8_t& vm_version);
+
+      size_t queued_compiles() const { return _queued_compiles.size(); }
+      size_t outstanding_compiles() const { return _outstanding_compiles_and_poison.size(); }
+      size_t cached_codes() const { return _cache_index.size(); }
+      size_t blacklisted_codes() const { return _blacklist.size(); }
+      const compile_stats& get_compile_stats() const { return _compile_stats; }
+
    private:
+      struct compile_result {
+         wasm_compilation_result_message message;
+         fc::time_point received;
+      };
+
       std::thread _monitor_reply_thread;
-      boost::lockfree::spsc_queue<wasm_compilation_result_message> _result_queue;
+      boost::lockfree::spsc_queue<compile_result> _result_queue;
       void wait_on_compile_monitor_message();
       std::tuple<size_t, size_t> consume_compile_thread_queue();
+      //false if the code no longer exists
+      bool start_compile(const code_tuple& ct);
       std::unordered_set<code_tuple> _blacklist;
+      std::unordered_map<code_tuple, fc::time_point> _compile_start_times;
+      compile_stats _compile_stats;
       size_t _threads;
 };
 
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <eosio/chain/webassembly/eos-vm-oc/ipc_protocol.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+namespace std {
+    template<> struct hash<eosio::chain::eosvmoc::code_tuple> {
+        size_t operator()(const eosio::chain::eosvmoc::code_tuple& ct) const noexcept {
+            return ct.code_id._hash[0];
+        }
+    };
+}
+
+namespace eosio { namespace chain { namespace eosvmoc {
+
+//code waiting for a compile thread. The code executed most often while waiting is compiled first, and code
+//queued by precompile ahead of all of it
+class compile_queue {
+   public:
+      static constexpr uint64_t precompile_priority = std::numeric_limits<uint64_t>::max();
+
+      //queues code executed while all compile threads are busy, or raises its priority if already queued
+      void executed(const code_tuple& ct) {
+         auto it = _queue.find(ct);
+         if(it == _queue.end())
+            _queue.emplace(ct, 1);
+         else if(it->second != precompile_priority)
+            ++it->second;
+      }
+
+      void precompile(const code_tuple& ct) {
+         _queue[ct] = precompile_priority;
+      }
+
+      bool contains(const code_tuple& ct) const { return _queue.find(ct) != _queue.end(); }
+      bool empty() const { return _queue.empty(); }
+      size_t size() const { return _queue.size(); }
+      void erase(const code_tuple& ct) { _queue.erase(ct); }
+
+      //removes and returns the code to compile next, the queue must not be empty
+      code_tuple pop() {
+         auto nextup = std::max_element(_queue.begin(), _queue.end(), [](const auto& a, const auto& b) {
+            return a.second < b.second;
+         });
+         const code_tuple ct = nextup->first;
+         _queue.erase(nextup);
+         return ct;
+      }
+
+   private:
+      //code to its priority: the number of times it was executed while waiting, or precompile_priority
+      std::unordered_map<code_tuple, uint64_t> _queue;
+};
+
+}}}
@@ -0,0 +1,85 @@
+#include <eosio/chain/recovered_keys_cache.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+namespace eosio { namespace chain {
+
+fc::microseconds recovered_keys_cache::get_signature_keys( const signed_transaction& trx, const chain_id_type& chain_id,
+                                                           fc::time_point deadline, flat_set<public_key_type>& recovered_pub_keys,
+                                                           bool allow_duplicate_keys )
+{ try {
+   if( max_entries == 0 )
+      return trx.get_signature_keys( chain_id, deadline, recovered_pub_keys, allow_duplicate_keys );
+
+   auto start = fc::time_point::now();
+   recovered_pub_keys.clear();
+   const digest_type digest = trx.sig_digest( chain_id, trx.context_free_data );
+
+   for( const signature_type& sig : trx.signatures ) {
+      auto now = fc::time_point::now();
+      EOS_ASSERT( now < deadline, tx_cpu_usage_exceeded, "transaction signature verification executed for too long ${time}us",
+                  ("time", now - start)("now", now)("deadline", deadline)("start", start) );
+
+      digest_type::encoder enc;
+      fc::raw::pack( enc, digest );
+      fc::raw::pack( enc, sig );
+      const digest_type key = enc.result();
+
+      public_key_type pub_key;
+      if( !find( key, pub_key ) ) {
+         pub_key = public_key_type( sig, digest );
+         add( key, pub_key );
+      }
+      auto[ itr, successful_insertion ] = recovered_pub_keys.emplace( std::move( pub_key ) );
+      EOS_ASSERT( allow_duplicate_keys || successful_insertion, tx_duplicate_sig,
+                  "transaction includes more than one signature signed using the same key associated with public key: ${key}",
+                  ("key", *itr ) );
+   }
+
+   return fc::time_point::now() - start;
+} FC_CAPTURE_AND_RETHROW() }
+
+bool recovered_keys_cache::find( const digest_type& key, public_key_type& result ) {
+   std::lock_guard<std::mutex> g( mtx );
+   auto itr = current.find( key );
+   if( itr != current.end() ) {
+      result = itr->second;
+      ++hit_count;
+      return true;
+   }
+   itr = previous.find( key );
+   if( itr != previous.end() ) {
+      result = itr->second;
+      ++hit_count;
+      current.emplace( key, std::move( itr->second ) );
+      previous.erase( itr );
+      return true;
+   }
+   ++miss_count;
+   return false;
+}
+
+void recovered_keys_cache::add( const digest_type& key, const public_key_type& pub_key ) {
+   std::lock_guard<std::mutex> g( mtx );
+   if( current.size() >= max_entries / 2 ) {
+      previous = std::move( current );
+      current = entries_type();
+   }
+   current.emplace( key, pub_key );
+}
+
+size_t recovered_keys_cache::size()const {
+   std::lock_guard<std::mutex> g( mtx );
+   return current.size() + previous.size();
+}
+
+uint64_t recovered_keys_cache::hits()const {
+   std::lock_guard<std::mutex> g( mtx );
+   return hit_count;
+}
+
+uint64_t recovered_keys_cache::misses()const {
+   std::lock_guard<std::mutex> g( mtx );
+   return miss_count;
+}
+
+} } // eosio::chain
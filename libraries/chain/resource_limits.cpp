@@ -65,9 +65,16 @@ void resource_limits_manager::initialize_database() {
    });
 }
 
-void resource_limits_manager::add_to_snapshot( const snapshot_writer_ptr& snapshot ) const {
-   resource_index_set::walk_indices([this, &snapshot]( auto utils ){
-      snapshot->write_section<typename decltype(utils)::index_t::value_type>([this]( auto& section ){
+void resource_limits_manager::add_to_snapshot( const snapshot_writer_ptr& snapshot,
+                                               const std::function<bool(const std::string&)>& include_section ) const {
+   resource_index_set::walk_indices([this, &snapshot, &include_section]( auto utils ){
+      using section_t = typename decltype(utils)::index_t::value_type;
+
+      if (include_section && !include_section(detail::snapshot_section_traits<section_t>::section_name())) {
+         return;
+      }
+
+      snapshot->write_section<section_t>([this]( auto& section ){
          decltype(utils)::walk(_db, [this, &section]( const auto &row ) {
             section.add_row(row, _db);
          });
@@ -88,6 +95,20 @@ void resource_limits_manager::read_from_snapshot( const snapshot_reader_ptr& sna
    });
 }
 
+void resource_limits_manager::add_changed_snapshot_sections( std::set<std::string>& sections ) const {
+   resource_index_set::walk_indices([this, &sections]( auto utils ){
+      if (decltype(utils)::changed_in_head_undo_session(_db)) {
+         sections.insert(detail::snapshot_section_traits<typename decltype(utils)::index_t::value_type>::section_name());
+      }
+   });
+}
+
+void resource_limits_manager::add_snapshot_sections( std::set<std::string>& sections ) const {
+   resource_index_set::walk_indices([&sections]( auto utils ){
+      sections.insert(detail::snapshot_section_traits<typename decltype(utils)::index_t::value_type>::section_name());
+   });
+}
+
 void resource_limits_manager::initialize_account(const account_name& account) {
    _db.create<resource_limits_object>([&]( resource_limits_object& bl ) {
       bl.owner = account;
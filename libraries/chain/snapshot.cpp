@@ -1,9 +1,140 @@
 #include <eosio/chain/snapshot.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <fc/scoped_exit.hpp>
+#include <boost/interprocess/streams/bufferstream.hpp>
+
+#include <algorithm>
+#include <zlib.h>
 
 namespace eosio { namespace chain {
 
+namespace {
+   // wait for every future before rethrowing, jobs still running may reference the caller's state
+   template<typename T, typename F>
+   void consume_in_order( std::vector<std::future<T>>& results, F&& consume ) {
+      auto wait_all = fc::make_scoped_exit([&results]() {
+         for( auto& r : results ) {
+            if( r.valid() ) r.wait();
+         }
+      });
+      for( auto& r : results ) {
+         consume( r.get() );
+      }
+   }
+}
+
+/**
+ * Forwards to another writer, keeping a section open while consecutive sections share its name
+ */
+class snapshot_writer::section_joining_writer : public snapshot_writer {
+   public:
+      explicit section_joining_writer( snapshot_writer& target )
+      :target(target)
+      {}
+
+      void write_start_section( const std::string& section_name ) override {
+         if( open && section_name == open_section ) {
+            return;
+         }
+         close();
+         target.write_start_section( section_name );
+         open_section = section_name;
+         open = true;
+      }
+
+      void write_row( const detail::abstract_snapshot_row_writer& row_writer ) override {
+         target.write_row( row_writer );
+      }
+
+      void write_end_section( ) override {
+         // deferred until a differently named section starts or close()
+      }
+
+      void write_row_buffer( const snapshot_section_buffer& buffer ) override {
+         write_start_section( buffer.section_name );
+         target.write_row_buffer( buffer );
+      }
+
+      void close() {
+         if( open ) {
+            target.write_end_section();
+            open = false;
+         }
+      }
+
+   private:
+      snapshot_writer& target;
+      std::string      open_section;
+      bool             open = false;
+};
+
+void snapshot_writer::write_sections( const std::vector<section_job>& jobs, boost::asio::io_context* thread_pool ) {
+   auto joiner = std::make_shared<section_joining_writer>( *this );
+   if( !thread_pool || !supports_row_buffers() || jobs.size() < 2 ) {
+      for( const auto& job : jobs ) {
+         job( joiner );
+      }
+   } else {
+      std::vector<std::future<std::vector<snapshot_section_buffer>>> results;
+      results.reserve( jobs.size() );
+      for( const auto& job : jobs ) {
+         results.emplace_back( async_thread_pool( *thread_pool, [this, &job]() {
+            auto buffered = std::make_shared<buffered_snapshot_writer>();
+            job( buffered );
+            for( auto& section : buffered->sections ) {
+               encode_row_buffer( section );
+            }
+            return std::move( buffered->sections );
+         }));
+      }
+
+      consume_in_order( results, [&joiner]( std::vector<snapshot_section_buffer>&& sections ) {
+         for( const auto& section : sections ) {
+            joiner->write_row_buffer( section );
+         }
+      });
+   }
+   joiner->close();
+}
+
+void snapshot_writer::write_row_buffer( const snapshot_section_buffer& ) {
+   EOS_THROW( snapshot_exception, "Snapshot writer does not support serialized row buffers" );
+}
+
+void snapshot_reader::read_sections( const std::vector<section_job>& jobs, boost::asio::io_context* thread_pool ) {
+   if( !thread_pool || !supports_row_buffers() || jobs.size() < 2 ) {
+      // the jobs need a shared_ptr, but this reader is owned elsewhere
+      snapshot_reader_ptr self( snapshot_reader_ptr(), this );
+      for( const auto& job : jobs ) {
+         job.read( self );
+      }
+      return;
+   }
+
+   std::mutex mtx;
+   std::vector<std::future<std::shared_ptr<buffered_snapshot_reader>>> results;
+   results.reserve( jobs.size() );
+   for( const auto& job : jobs ) {
+      results.emplace_back( async_thread_pool( *thread_pool, [this, &mtx, &job]() {
+         auto buffered = std::make_shared<buffered_snapshot_reader>( *this, mtx );
+         for( const auto& section_name : job.sections ) {
+            buffered->prefetch( section_name );
+         }
+         return buffered;
+      }));
+   }
+
+   size_t next_job = 0;
+   consume_in_order( results, [&jobs, &next_job]( std::shared_ptr<buffered_snapshot_reader>&& buffered ) {
+      jobs[next_job++].read( buffered );
+   });
+}
+
+snapshot_section_buffer snapshot_reader::read_row_buffer( const std::string& ) {
+   EOS_THROW( snapshot_exception, "Snapshot reader does not support serialized row buffers" );
+}
+
 variant_snapshot_writer::variant_snapshot_writer(fc::mutable_variant_object& snapshot)
 : snapshot(snapshot)
 {
@@ -120,6 +251,11 @@ void variant_snapshot_reader::return_to_header() {
 }
 
 ostream_snapshot_writer::ostream_snapshot_writer(std::ostream& snapshot)
+:ostream_snapshot_writer(snapshot, current_snapshot_version)
+{
+}
+
+ostream_snapshot_writer::ostream_snapshot_writer(std::ostream& snapshot, uint32_t version)
 :snapshot(snapshot)
 ,header_pos(snapshot.tellp())
 ,section_pos(-1)
@@ -130,7 +266,6 @@ ostream_snapshot_writer::ostream_snapshot_writer(std::ostream& snapshot)
    snapshot.write((char*)&totem, sizeof(totem));
 
    // write version
-   auto version = current_snapshot_version;
    snapshot.write((char*)&version, sizeof(version));
 }
 
@@ -164,6 +299,11 @@ void ostream_snapshot_writer::write_row( const detail::abstract_snapshot_row_wri
    row_count++;
 }
 
+void ostream_snapshot_writer::write_row_buffer( const snapshot_section_buffer& buffer ) {
+   snapshot.write(buffer.rows.data(), buffer.rows.size());
+   row_count += buffer.row_count;
+}
+
 void ostream_snapshot_writer::write_end_section( ) {
    auto restore = snapshot.tellp();
 
@@ -191,8 +331,15 @@ void ostream_snapshot_writer::finalize() {
 }
 
 istream_snapshot_reader::istream_snapshot_reader(std::istream& snapshot)
+:istream_snapshot_reader(snapshot, current_snapshot_version)
+{
+}
+
+istream_snapshot_reader::istream_snapshot_reader(std::istream& snapshot, uint32_t version)
 :snapshot(snapshot)
+,version(version)
 ,header_pos(snapshot.tellg())
+,section_end(-1)
 ,num_rows(0)
 ,cur_row(0)
 {
@@ -217,7 +364,7 @@ void istream_snapshot_reader::validate() const {
                  "Binary snapshot has unexpected magic number!");
 
       // validate version
-      auto expected_version = current_snapshot_version;
+      auto expected_version = version;
       decltype(expected_version) actual_version;
       snapshot.read((char*)&actual_version, sizeof(actual_version));
       EOS_ASSERT(actual_version == expected_version, snapshot_exception,
@@ -240,12 +387,16 @@ bool istream_snapshot_reader::validate_section() const {
       return false;
    }
 
-   // seek past the section
-   snapshot.seekg(snapshot.tellg() + std::streamoff(section_size));
+   validate_section_contents(snapshot.tellg() + std::streamoff(section_size));
 
    return true;
 }
 
+void istream_snapshot_reader::validate_section_contents( const std::streampos& section_end ) const {
+   // seek past the section
+   snapshot.seekg(section_end);
+}
+
 bool istream_snapshot_reader::has_section( const string& section_name ) {
    auto restore_pos = fc::make_scoped_exit([this,pos=snapshot.tellg()](){
       snapshot.seekg(pos);
@@ -317,6 +468,7 @@ void istream_snapshot_reader::set_section( const string& section_name ) {
       if (match && snapshot.get() == 0) {
          cur_row = 0;
          num_rows = row_count;
+         section_end = next_section_pos;
 
          // leave the stream at the right point
          restore_pos.cancel();
@@ -346,6 +498,352 @@ void istream_snapshot_reader::return_to_header() {
    clear_section();
 }
 
+snapshot_section_buffer istream_snapshot_reader::read_row_buffer( const std::string& section_name ) {
+   set_section(section_name);
+   auto clear = fc::make_scoped_exit([this](){
+      clear_section();
+   });
+
+   snapshot_section_buffer buffer;
+   buffer.section_name = section_name;
+   buffer.row_count = num_rows;
+   buffer.rows.resize(section_end - snapshot.tellg());
+   snapshot.read(buffer.rows.data(), buffer.rows.size());
+   EOS_ASSERT(snapshot.good(), snapshot_exception, "Binary snapshot section ${n} is truncated", ("n", section_name));
+   return buffer;
+}
+
+namespace {
+   struct snapshot_chunk_header {
+      uint64_t    compressed_size = 0;
+      uint64_t    uncompressed_size = 0;
+      fc::sha256  checksum;
+   };
+
+   constexpr size_t snapshot_chunk_header_size = 2 * sizeof(uint64_t) + 32;
+
+   void pack_chunk_header( char* out, const snapshot_chunk_header& header ) {
+      memcpy( out, &header.compressed_size, sizeof(uint64_t) );
+      memcpy( out + sizeof(uint64_t), &header.uncompressed_size, sizeof(uint64_t) );
+      memcpy( out + 2 * sizeof(uint64_t), header.checksum.data(), header.checksum.data_size() );
+   }
+
+   snapshot_chunk_header unpack_chunk_header( const char* in, const std::string& section_name ) {
+      snapshot_chunk_header header;
+      memcpy( &header.compressed_size, in, sizeof(uint64_t) );
+      memcpy( &header.uncompressed_size, in + sizeof(uint64_t), sizeof(uint64_t) );
+      memcpy( header.checksum.data(), in + 2 * sizeof(uint64_t), header.checksum.data_size() );
+
+      // bound the sizes before anything is allocated for them
+      EOS_ASSERT( header.uncompressed_size <= compressed_ostream_snapshot_writer::chunk_size &&
+                  header.compressed_size <= compressBound( compressed_ostream_snapshot_writer::chunk_size ),
+                  snapshot_exception, "Binary snapshot section ${n} has a corrupt chunk header", ("n", section_name) );
+      return header;
+   }
+
+   void verify_chunk_checksum( const snapshot_chunk_header& header, const char* compressed, const std::string& section_name ) {
+      EOS_ASSERT( fc::sha256::hash( compressed, header.compressed_size ) == header.checksum, snapshot_exception,
+                  "Binary snapshot section ${n} has a chunk with a bad checksum", ("n", section_name) );
+   }
+
+   void inflate_chunk( const snapshot_chunk_header& header, const char* compressed, char* out, const std::string& section_name ) {
+      verify_chunk_checksum( header, compressed, section_name );
+      uLongf size = header.uncompressed_size;
+      const auto ret = uncompress( (Bytef*)out, &size, (const Bytef*)compressed, header.compressed_size );
+      EOS_ASSERT( ret == Z_OK && size == header.uncompressed_size, snapshot_exception,
+                  "Binary snapshot section ${n} has a chunk that failed to decompress", ("n", section_name) );
+   }
+
+   /// compress data as chunks of at most chunk_size bytes each
+   std::string compress_chunks( const char* data, size_t size ) {
+      std::string chunks;
+      for( size_t pos = 0; pos < size; ) {
+         const size_t n = std::min( compressed_ostream_snapshot_writer::chunk_size, size - pos );
+         const size_t header_pos = chunks.size();
+         uLongf compressed_size = compressBound( n );
+         chunks.resize( header_pos + snapshot_chunk_header_size + compressed_size );
+         char* compressed = &chunks[header_pos + snapshot_chunk_header_size];
+         EOS_ASSERT( compress2( (Bytef*)compressed, &compressed_size, (const Bytef*)data + pos, n, Z_DEFAULT_COMPRESSION ) == Z_OK,
+                     snapshot_exception, "Unable to compress snapshot rows" );
+
+         snapshot_chunk_header header;
+         header.compressed_size = compressed_size;
+         header.uncompressed_size = n;
+         header.checksum = fc::sha256::hash( compressed, compressed_size );
+         pack_chunk_header( &chunks[header_pos], header );
+
+         chunks.resize( header_pos + snapshot_chunk_header_size + compressed_size );
+         pos += n;
+      }
+      return chunks;
+   }
+}
+
+compressed_ostream_snapshot_writer::compressed_ostream_snapshot_writer(std::ostream& snapshot)
+:ostream_snapshot_writer(snapshot, compressed_snapshot_version)
+,pending_rows(std::ios::out | std::ios::binary | std::ios::ate)
+,pending_rows_wrapper(pending_rows)
+{
+}
+
+void compressed_ostream_snapshot_writer::write_row( const detail::abstract_snapshot_row_writer& row_writer ) {
+   row_writer.write(pending_rows_wrapper);
+   row_count++;
+
+   if (pending_rows.tellp() >= std::streamoff(chunk_size)) {
+      flush_pending_rows(false);
+   }
+}
+
+void compressed_ostream_snapshot_writer::write_end_section( ) {
+   flush_pending_rows(true);
+   ostream_snapshot_writer::write_end_section();
+}
+
+void compressed_ostream_snapshot_writer::write_row_buffer( const snapshot_section_buffer& buffer ) {
+   // keep rows in order when a section mixes single rows and buffers
+   flush_pending_rows(true);
+
+   if (buffer.encoded) {
+      snapshot.write(buffer.rows.data(), buffer.rows.size());
+   } else {
+      const auto chunks = compress_chunks(buffer.rows.data(), buffer.rows.size());
+      snapshot.write(chunks.data(), chunks.size());
+   }
+   row_count += buffer.row_count;
+}
+
+void compressed_ostream_snapshot_writer::encode_row_buffer( snapshot_section_buffer& buffer ) const {
+   if (!buffer.encoded) {
+      buffer.rows = compress_chunks(buffer.rows.data(), buffer.rows.size());
+      buffer.encoded = true;
+   }
+}
+
+void compressed_ostream_snapshot_writer::flush_pending_rows( bool include_partial_chunk ) {
+   const auto rows = pending_rows.str();
+   const size_t n = include_partial_chunk ? rows.size() : rows.size() - rows.size() % chunk_size;
+   if (n == 0) {
+      return;
+   }
+
+   // rows may span chunks, the reader decompresses a section as one stream
+   const auto chunks = compress_chunks(rows.data(), n);
+   snapshot.write(chunks.data(), chunks.size());
+   pending_rows.str(rows.substr(n));
+}
+
+/**
+ * Decompresses the chunks of one section on demand, so a section is never held in memory as a whole
+ */
+class compressed_istream_snapshot_reader::chunk_streambuf : public std::streambuf {
+   public:
+      chunk_streambuf( std::istream& snapshot, std::streampos begin, std::streampos end, std::string section_name )
+      :snapshot(snapshot)
+      ,next_chunk_pos(begin)
+      ,section_end(end)
+      ,section_name(std::move(section_name))
+      {}
+
+   protected:
+      int_type underflow() override {
+         while (gptr() == egptr()) {
+            if (std::streamoff(next_chunk_pos) >= std::streamoff(section_end)) {
+               return traits_type::eof();
+            }
+            load_chunk();
+         }
+         return traits_type::to_int_type(*gptr());
+      }
+
+   private:
+      void load_chunk() {
+         snapshot.seekg(next_chunk_pos);
+         char header_data[snapshot_chunk_header_size];
+         snapshot.read(header_data, sizeof(header_data));
+         EOS_ASSERT(snapshot.good(), snapshot_exception, "Binary snapshot section ${n} is truncated", ("n", section_name));
+         const auto header = unpack_chunk_header(header_data, section_name);
+
+         compressed.resize(header.compressed_size);
+         snapshot.read(compressed.data(), compressed.size());
+         EOS_ASSERT(snapshot.good(), snapshot_exception, "Binary snapshot section ${n} is truncated", ("n", section_name));
+         next_chunk_pos = snapshot.tellg();
+
+         rows.resize(header.uncompressed_size);
+         inflate_chunk(header, compressed.data(), rows.data(), section_name);
+         setg(rows.data(), rows.data(), rows.data() + rows.size());
+      }
+
+      std::istream&     snapshot;
+      std::streampos    next_chunk_pos;
+      std::streampos    section_end;
+      std::string       section_name;
+      std::vector<char> compressed;
+      std::vector<char> rows;
+};
+
+compressed_istream_snapshot_reader::compressed_istream_snapshot_reader(std::istream& snapshot)
+:istream_snapshot_reader(snapshot, compressed_snapshot_version)
+{
+}
+
+compressed_istream_snapshot_reader::~compressed_istream_snapshot_reader() = default;
+
+void compressed_istream_snapshot_reader::validate_section_contents( const std::streampos& section_end ) const {
+   uint64_t row_count = 0;
+   snapshot.read((char*)&row_count, sizeof(row_count));
+
+   std::string section_name;
+   std::getline(snapshot, section_name, '\0');
+
+   std::vector<char> compressed;
+   while (std::streamoff(snapshot.tellg()) < std::streamoff(section_end)) {
+      char header_data[snapshot_chunk_header_size];
+      snapshot.read(header_data, sizeof(header_data));
+      const auto header = unpack_chunk_header(header_data, section_name);
+
+      compressed.resize(header.compressed_size);
+      snapshot.read(compressed.data(), compressed.size());
+      verify_chunk_checksum(header, compressed.data(), section_name);
+   }
+
+   EOS_ASSERT(snapshot.tellg() == section_end, snapshot_exception,
+              "Binary snapshot section ${n} has chunks that overrun the section", ("n", section_name));
+}
+
+void compressed_istream_snapshot_reader::set_section( const string& section_name ) {
+   istream_snapshot_reader::set_section(section_name);
+   section_buf = std::make_unique<chunk_streambuf>(snapshot, snapshot.tellg(), section_end, section_name);
+   section_rows = std::make_unique<std::istream>(section_buf.get());
+}
+
+bool compressed_istream_snapshot_reader::read_row( detail::abstract_snapshot_row_reader& row_reader ) {
+   row_reader.provide(*section_rows);
+   return ++cur_row < num_rows;
+}
+
+void compressed_istream_snapshot_reader::clear_section() {
+   section_rows.reset();
+   section_buf.reset();
+   istream_snapshot_reader::clear_section();
+}
+
+snapshot_section_buffer compressed_istream_snapshot_reader::read_row_buffer( const std::string& section_name ) {
+   auto buffer = istream_snapshot_reader::read_row_buffer(section_name);
+   buffer.encoded = true;
+   return buffer;
+}
+
+void compressed_istream_snapshot_reader::decode_row_buffer( snapshot_section_buffer& buffer ) const {
+   if (!buffer.encoded) {
+      return;
+   }
+
+   std::string rows;
+   size_t pos = 0;
+   while (pos < buffer.rows.size()) {
+      EOS_ASSERT(buffer.rows.size() - pos >= snapshot_chunk_header_size, snapshot_exception,
+                 "Binary snapshot section ${n} is truncated", ("n", buffer.section_name));
+      const auto header = unpack_chunk_header(buffer.rows.data() + pos, buffer.section_name);
+      pos += snapshot_chunk_header_size;
+
+      EOS_ASSERT(buffer.rows.size() - pos >= header.compressed_size, snapshot_exception,
+                 "Binary snapshot section ${n} is truncated", ("n", buffer.section_name));
+      const size_t offset = rows.size();
+      rows.resize(offset + header.uncompressed_size);
+      inflate_chunk(header, buffer.rows.data() + pos, &rows[offset], buffer.section_name);
+      pos += header.compressed_size;
+   }
+
+   buffer.rows = std::move(rows);
+   buffer.encoded = false;
+}
+
+layered_snapshot_reader::layered_snapshot_reader( std::vector<snapshot_reader_ptr> layers )
+:layers(std::move(layers))
+{
+   EOS_ASSERT(!this->layers.empty(), snapshot_exception, "Layered snapshot requires at least a base snapshot");
+}
+
+void layered_snapshot_reader::validate() const {
+   for (const auto& layer : layers) {
+      layer->validate();
+   }
+}
+
+bool layered_snapshot_reader::has_section( const string& section_name ) {
+   for (const auto& layer : layers) {
+      if (layer->has_section(section_name)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+snapshot_reader& layered_snapshot_reader::layer_for( const std::string& section_name ) {
+   for (auto itr = layers.rbegin(); itr != layers.rend(); ++itr) {
+      if ((*itr)->has_section(section_name)) {
+         return **itr;
+      }
+   }
+   EOS_THROW(snapshot_exception, "Layered snapshot has no section named ${n}", ("n", section_name));
+}
+
+void layered_snapshot_reader::set_section( const string& section_name ) {
+   current = &layer_for(section_name);
+   current->set_section(section_name);
+}
+
+bool layered_snapshot_reader::read_row( detail::abstract_snapshot_row_reader& row_reader ) {
+   return current->read_row(row_reader);
+}
+
+bool layered_snapshot_reader::empty ( ) {
+   return current->empty();
+}
+
+void layered_snapshot_reader::clear_section() {
+   if (current) {
+      current->clear_section();
+      current = nullptr;
+   }
+}
+
+void layered_snapshot_reader::return_to_header() {
+   for (const auto& layer : layers) {
+      layer->return_to_header();
+   }
+   current = nullptr;
+}
+
+bool layered_snapshot_reader::supports_row_buffers() const {
+   return std::all_of(layers.begin(), layers.end(), [](const auto& layer) { return layer->supports_row_buffers(); });
+}
+
+snapshot_section_buffer layered_snapshot_reader::read_row_buffer( const std::string& section_name ) {
+   // decoded here, under the caller's lock, as decode_row_buffer does not know which layer a buffer came from
+   auto& layer = layer_for(section_name);
+   auto buffer = layer.read_row_buffer(section_name);
+   layer.decode_row_buffer(buffer);
+   return buffer;
+}
+
+std::shared_ptr<istream_snapshot_reader> make_istream_snapshot_reader(std::istream& snapshot) {
+   const auto pos = snapshot.tellg();
+   uint32_t totem = 0;
+   uint32_t version = 0;
+   snapshot.read((char*)&totem, sizeof(totem));
+   snapshot.read((char*)&version, sizeof(version));
+   EOS_ASSERT(snapshot.good(), snapshot_exception, "Binary snapshot is too short to contain a header");
+   snapshot.seekg(pos);
+
+   if (totem == ostream_snapshot_writer::magic_number && version == compressed_snapshot_version) {
+      return std::make_shared<compressed_istream_snapshot_reader>(snapshot);
+   }
+   // anything unexpected is reported by validate()
+   return std::make_shared<istream_snapshot_reader>(snapshot);
+}
+
 integrity_hash_snapshot_writer::integrity_hash_snapshot_writer(fc::sha256::encoder& enc)
 :enc(enc)
 {
@@ -360,6 +858,10 @@ void integrity_hash_snapshot_writer::write_row( const detail::abstract_snapshot_
    row_writer.write(enc);
 }
 
+void integrity_hash_snapshot_writer::write_row_buffer( const snapshot_section_buffer& buffer ) {
+   enc.write(buffer.rows.data(), buffer.rows.size());
+}
+
 void integrity_hash_snapshot_writer::write_end_section( ) {
    // no-op for structural details
 }
@@ -368,4 +870,91 @@ void integrity_hash_snapshot_writer::finalize() {
    // no-op for structural details
 }
 
+buffered_snapshot_writer::buffered_snapshot_writer()
+:rows_wrapper(rows)
+{
+}
+
+void buffered_snapshot_writer::write_start_section( const std::string& section_name ) {
+   sections.emplace_back();
+   sections.back().section_name = section_name;
+   rows.str(std::string());
+}
+
+void buffered_snapshot_writer::write_row( const detail::abstract_snapshot_row_writer& row_writer ) {
+   row_writer.write(rows_wrapper);
+   sections.back().row_count++;
+}
+
+void buffered_snapshot_writer::write_end_section( ) {
+   sections.back().rows = rows.str();
+}
+
+buffered_snapshot_reader::buffered_snapshot_reader( snapshot_reader& source, std::mutex& source_mtx )
+:source(source)
+,source_mtx(source_mtx)
+{
+}
+
+void buffered_snapshot_reader::validate() const {
+   std::lock_guard<std::mutex> g(source_mtx);
+   source.validate();
+}
+
+bool buffered_snapshot_reader::has_section( const string& section_name ) {
+   if( prefetched.count(section_name) ) {
+      return true;
+   }
+   std::lock_guard<std::mutex> g(source_mtx);
+   return source.has_section(section_name);
+}
+
+void buffered_snapshot_reader::prefetch( const string& section_name ) {
+   snapshot_section_buffer buffer;
+   {
+      std::lock_guard<std::mutex> g(source_mtx);
+      if( !source.has_section(section_name) ) {
+         return;
+      }
+      buffer = source.read_row_buffer(section_name);
+   }
+   source.decode_row_buffer(buffer);
+   prefetched[section_name] = std::move(buffer);
+}
+
+void buffered_snapshot_reader::set_section( const string& section_name ) {
+   auto itr = prefetched.find(section_name);
+   if( itr != prefetched.end() ) {
+      section = std::move(itr->second);
+      prefetched.erase(itr);
+   } else {
+      {
+         std::lock_guard<std::mutex> g(source_mtx);
+         section = source.read_row_buffer(section_name);
+      }
+      source.decode_row_buffer(section);
+   }
+   rows = std::make_unique<boost::interprocess::ibufferstream>(section.rows.data(), section.rows.size());
+   cur_row = 0;
+}
+
+bool buffered_snapshot_reader::read_row( detail::abstract_snapshot_row_reader& row_reader ) {
+   row_reader.provide(*rows);
+   return ++cur_row < section.row_count;
+}
+
+bool buffered_snapshot_reader::empty ( ) {
+   return section.row_count == 0;
+}
+
+void buffered_snapshot_reader::clear_section() {
+   rows.reset();
+   section = snapshot_section_buffer();
+   cur_row = 0;
+}
+
+void buffered_snapshot_reader::return_to_header() {
+   clear_section();
+}
+
 }}
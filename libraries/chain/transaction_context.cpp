@@ -6,6 +6,7 @@
 #include <eosio/chain/generated_transaction_object.hpp>
 #include <eosio/chain/transaction_object.hpp>
 #include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/wasm_interface.hpp>
 
 #pragma push_macro("N")
 #undef N
@@ -47,7 +48,8 @@ namespace eosio { namespace chain {
                                              const signed_transaction& t,
                                              const transaction_id_type& trx_id,
                                              transaction_checktime_timer&& tmr,
-                                             fc::time_point s )
+                                             fc::time_point s,
+                                             bool ro )
    :control(c)
    ,trx(t)
    ,id(trx_id)
@@ -55,10 +57,11 @@ namespace eosio { namespace chain {
    ,trace(std::make_shared<transaction_trace>())
    ,start(s)
    ,transaction_timer(std::move(tmr))
+   ,read_only(ro)
    ,net_usage(trace->net_usage)
    ,pseudo_start(s)
    {
-      if (!c.skip_db_sessions()) {
+      if (!read_only && !c.skip_db_sessions()) {
          undo_session = c.mutable_db().start_undo_session(true);
       }
       trace->id = id;
@@ -260,6 +263,54 @@ namespace eosio { namespace chain {
       init( 0 );
    }
 
+   void transaction_context::init_for_read_only_trx()
+   {
+      EOS_ASSERT( read_only, transaction_exception, "transaction context is not read-only" );
+      EOS_ASSERT( !is_initialized, transaction_exception, "cannot initialize twice" );
+      if( trx.transaction_extensions.size() > 0 ) {
+         disallow_transaction_extensions( "no transaction extensions supported yet for read-only transactions" );
+      }
+      EOS_ASSERT( trx.delay_sec.value == 0, transaction_exception, "read-only transactions cannot be delayed" );
+      EOS_ASSERT( trx.actions.size() > 0 || trx.context_free_actions.size() > 0, tx_no_action,
+                  "read-only transaction must have at least one action" );
+
+      const auto& db = control.db();
+      for( const auto* acts : { &trx.context_free_actions, &trx.actions } ) {
+         for( const auto& a : *acts ) {
+            EOS_ASSERT( db.find<account_object, by_name>(a.account) != nullptr, transaction_exception,
+                        "action's code account '${account}' does not exist", ("account", a.account) );
+         }
+      }
+
+      // nothing is billed, so only the objective limits apply; account resources are neither checked nor updated
+      const auto& cfg = control.get_global_properties().configuration;
+      published = control.pending_block_time();
+      net_limit = cfg.max_transaction_net_usage;
+      eager_net_limit = (net_limit/8)*8;
+      net_limit_due_to_block = false;
+
+      objective_duration_limit = fc::microseconds( cfg.max_transaction_cpu_usage );
+      if( trx.max_cpu_usage_ms > 0 && fc::milliseconds( trx.max_cpu_usage_ms ) < objective_duration_limit ) {
+         objective_duration_limit = fc::milliseconds( trx.max_cpu_usage_ms );
+      }
+      initial_objective_duration_limit = objective_duration_limit;
+      billing_timer_exception_code = tx_cpu_usage_exceeded::code_value;
+      _deadline = start + objective_duration_limit;
+      billing_timer_duration_limit = _deadline - start;
+
+      if( deadline < _deadline ) {
+         _deadline = deadline;
+         deadline_exception_code = deadline_exception::code_value;
+      } else {
+         deadline_exception_code = billing_timer_exception_code;
+      }
+
+      checktime(); // Fail early if deadline has already been exceeded
+      transaction_timer.start(_deadline);
+
+      is_initialized = true;
+   }
+
    void transaction_context::exec() {
       EOS_ASSERT( is_initialized, transaction_exception, "must first initialize" );
 
@@ -289,6 +340,13 @@ namespace eosio { namespace chain {
    void transaction_context::finalize() {
       EOS_ASSERT( is_initialized, transaction_exception, "must first initialize" );
 
+      if( read_only ) {
+         auto now = fc::time_point::now();
+         trace->elapsed = now - start;
+         update_billed_cpu_time( now ); // reported, not billed
+         return;
+      }
+
       if( is_input ) {
          auto& am = control.get_mutable_authorization_manager();
          for( const auto& act : trx.actions ) {
@@ -469,7 +527,22 @@ namespace eosio { namespace chain {
       }
    }
 
+   void transaction_context::require_writable( const char* what )const {
+      EOS_ASSERT( !read_only, read_only_trx_write_exception, "read-only transaction cannot change ${what}", ("what", what) );
+   }
+
+   wasm_interface& transaction_context::get_wasm_interface() {
+      return wasmif_override ? *wasmif_override : control.get_wasm_interface();
+   }
+
+#if defined(EOSIO_EOS_VM_RUNTIME_ENABLED) || defined(EOSIO_EOS_VM_JIT_RUNTIME_ENABLED)
+   vm::wasm_allocator& transaction_context::get_wasm_allocator() {
+      return wasm_alloc_override ? *wasm_alloc_override : control.get_wasm_allocator();
+   }
+#endif
+
    void transaction_context::add_ram_usage( account_name account, int64_t ram_delta ) {
+      require_writable( "RAM usage" );
       auto& rl = control.get_mutable_resource_limits_manager();
       rl.add_pending_ram_usage( account, ram_delta );
       if( ram_delta > 0 ) {
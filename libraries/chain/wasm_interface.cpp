@@ -32,8 +32,9 @@
 namespace eosio { namespace chain {
    using namespace webassembly::common;
 
-   wasm_interface::wasm_interface(vm_type vm, bool eosvmoc_tierup, const chainbase::database& d, const boost::filesystem::path data_dir, const eosvmoc::config& eosvmoc_config)
-     : my( new wasm_interface_impl(vm, eosvmoc_tierup, d, data_dir, eosvmoc_config) ) {}
+   wasm_interface::wasm_interface(vm_type vm, bool eosvmoc_tierup, const chainbase::database& d, const boost::filesystem::path data_dir, const eosvmoc::config& eosvmoc_config,
+                                  const instantiation_config& inst_config)
+     : my( new wasm_interface_impl(vm, eosvmoc_tierup, d, data_dir, eosvmoc_config, inst_config) ) {}
 
    wasm_interface::~wasm_interface() {}
 
@@ -56,9 +57,9 @@ namespace eosio { namespace chain {
       root_resolver resolver( pso.whitelisted_intrinsics );
       LinkResult link_result = linkModule(module, resolver);
 
-      //there are a couple opportunties for improvement here--
-      //Easy: Cache the Module created here so it can be reused for instantiaion
-      //Hard: Kick off instantiation in a separate thread at this location
+      //there is an opportunity for improvement here--
+      //Cache the Module created here so it can be reused for instantiation
+      //(instantiation itself is started in the background by setcode, see instantiate_in_background)
 	 }
 
    void wasm_interface::indicate_shutting_down() {
@@ -73,6 +74,50 @@ namespace eosio { namespace chain {
       my->current_lib(lib);
    }
 
+   void wasm_interface::instantiate_in_background(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, const bytes& code, uint32_t block_num) {
+      my->instantiate_in_background(code_hash, vm_type, vm_version, code.data(), code.size(), block_num);
+   }
+
+   void wasm_interface::warm_up(uint32_t block_num) {
+      my->warm_up(block_num);
+   }
+
+   wasm_interface::instantiation_stats wasm_interface::get_instantiation_stats()const {
+      return my->get_instantiation_stats();
+   }
+
+   void wasm_interface::eosvmoc_precompile(const digest_type& code_hash, const uint8_t& vm_version) {
+#ifdef EOSIO_EOS_VM_OC_RUNTIME_ENABLED
+      if(my->eosvmoc) {
+         try {
+            my->eosvmoc->cc.precompile(code_hash, vm_version);
+         } FC_LOG_AND_DROP( (code_hash) );
+      }
+#endif
+   }
+
+   wasm_interface::eosvmoc_tierup_stats wasm_interface::get_eosvmoc_tierup_stats()const {
+      eosvmoc_tierup_stats result;
+#ifdef EOSIO_EOS_VM_OC_RUNTIME_ENABLED
+      if(my->eosvmoc) {
+         const auto& cc = my->eosvmoc->cc;
+         const auto& compile_stats = cc.get_compile_stats();
+         result.enabled = true;
+         result.queued = cc.queued_compiles();
+         result.compiling = cc.outstanding_compiles();
+         result.cached = cc.cached_codes();
+         result.blacklisted = cc.blacklisted_codes();
+         result.compiled = compile_stats.compiled;
+         result.failed = compile_stats.failed;
+         if(compile_stats.compiled + compile_stats.failed > 0)
+            result.avg_compile_us = compile_stats.total_compile_us / (compile_stats.compiled + compile_stats.failed);
+         result.max_compile_us = compile_stats.max_compile_us;
+         result.fallbacks = my->eosvmoc_fallbacks;
+      }
+#endif
+      return result;
+   }
+
    void wasm_interface::apply( const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, apply_context& context ) {
 #ifdef EOSIO_EOS_VM_OC_RUNTIME_ENABLED
       if(my->eosvmoc) {
@@ -92,6 +137,7 @@ namespace eosio { namespace chain {
             my->eosvmoc->exec.execute(*cd, my->eosvmoc->mem, context);
             return;
          }
+         ++my->eosvmoc_fallbacks;
       }
 #endif
       my->get_instantiated_module(code_hash, vm_type, vm_version, context.trx_context)->apply(context);
@@ -115,6 +161,14 @@ class context_aware_api {
       {
          if( context.is_context_free() )
             EOS_ASSERT( context_free, unaccessible_api, "only context free api's can be used in this context" );
+         // constructed for each intrinsic call
+         if( context.profile_intrinsics )
+            intrinsic_start = fc::time_point::now();
+      }
+
+      ~context_aware_api() {
+         if( context.profile_intrinsics )
+            context.intrinsic_time += fc::time_point::now() - intrinsic_start;
       }
 
       void checktime() {
@@ -124,6 +178,8 @@ class context_aware_api {
    protected:
       apply_context&             context;
 
+   private:
+      fc::time_point             intrinsic_start;
 };
 
 class context_free_api : public context_aware_api {
@@ -174,6 +230,7 @@ class privileged_api : public context_aware_api {
        *  Also fails if the feature was already activated or pre-activated.
        */
       void preactivate_feature( const digest_type& feature_digest ) {
+         context.trx_context.require_writable( "protocol features" );
          context.control.preactivate_feature( feature_digest );
       }
 
@@ -190,6 +247,7 @@ class privileged_api : public context_aware_api {
          EOS_ASSERT(ram_bytes >= -1, wasm_execution_error, "invalid value for ram resource limit expected [-1,INT64_MAX]");
          EOS_ASSERT(net_weight >= -1, wasm_execution_error, "invalid value for net resource weight expected [-1,INT64_MAX]");
          EOS_ASSERT(cpu_weight >= -1, wasm_execution_error, "invalid value for cpu resource weight expected [-1,INT64_MAX]");
+         context.trx_context.require_writable( "resource limits" );
          if( context.control.get_mutable_resource_limits_manager().set_account_limits(account, ram_bytes, net_weight, cpu_weight) ) {
             context.trx_context.validate_ram_usage.insert( account );
          }
@@ -244,6 +302,7 @@ class privileged_api : public context_aware_api {
          }
          EOS_ASSERT( producers.size() == unique_producers.size(), wasm_execution_error, "duplicate producer name in producer schedule" );
 
+         context.trx_context.require_writable( "proposed producers" );
          return context.control.set_proposed_producers( std::move(producers) );
       }
 
@@ -297,6 +356,7 @@ class privileged_api : public context_aware_api {
          chain::chain_config cfg;
          fc::raw::unpack(ds, cfg);
          cfg.validate();
+         context.trx_context.require_writable( "blockchain parameters" );
          context.db.modify( context.control.get_global_properties(),
             [&]( auto& gprops ) {
                  gprops.configuration = cfg;
@@ -308,6 +368,7 @@ class privileged_api : public context_aware_api {
       }
 
       void set_privileged( account_name n, bool is_priv ) {
+         context.trx_context.require_writable( "privileged accounts" );
          const auto& a = context.db.get<account_metadata_object, by_name>( n );
          context.db.modify( a, [&]( auto& ma ){
             ma.set_privileged( is_priv );
@@ -1107,7 +1168,7 @@ public:
    }
 
    void eosio_exit(int32_t code) {
-      context.control.get_wasm_interface().exit();
+      context.trx_context.get_wasm_interface().exit();
    }
 
 };
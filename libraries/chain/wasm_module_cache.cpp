@@ -0,0 +1,158 @@
+#include <eosio/chain/wasm_module_cache.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <fc/io/raw.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <ctime>
+#include <fstream>
+
+namespace eosio { namespace chain {
+
+   namespace bip = boost::interprocess;
+   namespace bfs = boost::filesystem;
+
+   namespace {
+      constexpr size_t header_size = 4 + 4 + 1 + 4 + 4 + sizeof(fc::sha256);
+
+      fc::sha256 checksum( const char* code, size_t code_size, const uint8_t* memory, size_t memory_size ) {
+         fc::sha256::encoder enc;
+         enc.write( code, code_size );
+         enc.write( reinterpret_cast<const char*>( memory ), memory_size );
+         return enc.result();
+      }
+   }
+
+   wasm_module_cache::wasm_module_cache( const bfs::path& dir, uint64_t max_size, uint8_t runtime, uint32_t injection_version )
+   : dir( dir )
+   , max_size( max_size )
+   , runtime( runtime )
+   , injection_version( injection_version )
+   {
+      bfs::create_directories( dir );
+      prune();
+   }
+
+   bfs::path wasm_module_cache::file_path( const digest_type& code_hash, uint8_t vm_type, uint8_t vm_version )const {
+      return dir / ( code_hash.str() + "-" + std::to_string( vm_type ) + "-" + std::to_string( vm_version ) + "-"
+                     + std::to_string( runtime ) + ".wasm" );
+   }
+
+   bool wasm_module_cache::load( const digest_type& code_hash, uint8_t vm_type, uint8_t vm_version, loaded_module& result )const {
+      const auto path = file_path( code_hash, vm_type, vm_version );
+      const auto file = path.generic_string();
+      try {
+         if( !bfs::exists( path ) ) {
+            ++miss_count;
+            return false;
+         }
+         bip::file_mapping mapping( file.c_str(), bip::read_only );
+         auto region = std::make_shared<bip::mapped_region>( mapping, bip::read_only );
+         const char* data = reinterpret_cast<const char*>( region->get_address() );
+         const size_t file_size = region->get_size();
+
+         uint32_t file_magic = 0, file_injection_version = 0, code_size = 0, memory_size = 0;
+         uint8_t file_runtime = 0;
+         fc::sha256 file_checksum;
+         bool valid = file_size >= header_size;
+         if( valid ) {
+            fc::datastream<const char*> ds( data, header_size );
+            fc::raw::unpack( ds, file_magic );
+            fc::raw::unpack( ds, file_injection_version );
+            fc::raw::unpack( ds, file_runtime );
+            fc::raw::unpack( ds, code_size );
+            fc::raw::unpack( ds, memory_size );
+            fc::raw::unpack( ds, file_checksum );
+            valid = file_magic == magic && file_injection_version == injection_version && file_runtime == runtime
+                    && file_size == header_size + code_size + memory_size;
+         }
+         const char* code = data + header_size;
+         const uint8_t* memory = reinterpret_cast<const uint8_t*>( code + code_size );
+         if( !valid || checksum( code, code_size, memory, memory_size ) != file_checksum ) {
+            wlog( "ignoring invalid or outdated cached module ${f}", ("f", file) );
+            ++miss_count;
+            return false;
+         }
+
+         result.code = code;
+         result.code_size = code_size;
+         result.initial_memory.assign( memory, memory + memory_size );
+         result.mapping = std::move( region );
+         ++hit_count;
+         // the file's time orders eviction at startup
+         bfs::last_write_time( path, std::time( nullptr ) );
+         return true;
+      } FC_LOG_AND_DROP( (file) );
+      ++miss_count;
+      return false;
+   }
+
+   void wasm_module_cache::store( const digest_type& code_hash, uint8_t vm_type, uint8_t vm_version, const char* code, size_t code_size,
+                                  const std::vector<uint8_t>& initial_memory ) {
+      const uint64_t file_size = header_size + code_size + initial_memory.size();
+      if( size + file_size > max_size )
+         return;
+      const auto path = file_path( code_hash, vm_type, vm_version );
+      const auto file = path.generic_string();
+      const auto tmp_path = dir / bfs::unique_path( "%%%%-%%%%-%%%%-%%%%.tmp" );
+      bool written = false;
+      try {
+         std::vector<char> header( header_size );
+         fc::datastream<char*> ds( header.data(), header.size() );
+         fc::raw::pack( ds, magic );
+         fc::raw::pack( ds, injection_version );
+         fc::raw::pack( ds, runtime );
+         fc::raw::pack( ds, static_cast<uint32_t>( code_size ) );
+         fc::raw::pack( ds, static_cast<uint32_t>( initial_memory.size() ) );
+         fc::raw::pack( ds, checksum( code, code_size, initial_memory.data(), initial_memory.size() ) );
+         {
+            std::ofstream out( tmp_path.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+            out.write( header.data(), header.size() );
+            out.write( code, code_size );
+            out.write( reinterpret_cast<const char*>( initial_memory.data() ), initial_memory.size() );
+            out.close();
+            FC_ASSERT( out, "write failed" );
+         }
+         bfs::rename( tmp_path, path );
+         size += file_size;
+         written = true;
+      } FC_LOG_AND_DROP( (file) );
+      if( !written ) {
+         boost::system::error_code ec;
+         bfs::remove( tmp_path, ec );
+      }
+   }
+
+   void wasm_module_cache::prune() {
+      struct file_entry {
+         bfs::path   path;
+         std::time_t last_used;
+         uint64_t    size;
+      };
+      std::vector<file_entry> files;
+      uint64_t total = 0;
+      for( bfs::directory_iterator itr( dir ), end; itr != end; ++itr ) {
+         if( !bfs::is_regular_file( itr->path() ) )
+            continue;
+         // left behind by a crash while writing
+         if( itr->path().extension() == ".tmp" ) {
+            boost::system::error_code ec;
+            bfs::remove( itr->path(), ec );
+            continue;
+         }
+         files.push_back( file_entry{ itr->path(), bfs::last_write_time( itr->path() ), bfs::file_size( itr->path() ) } );
+         total += files.back().size;
+      }
+
+      std::sort( files.begin(), files.end(), []( const auto& a, const auto& b ) { return a.last_used < b.last_used; } );
+      for( auto itr = files.begin(); itr != files.end() && total > max_size; ++itr ) {
+         boost::system::error_code ec;
+         if( bfs::remove( itr->path, ec ) )
+            total -= itr->size;
+      }
+      size = total;
+   }
+
+} } // eosio::chain
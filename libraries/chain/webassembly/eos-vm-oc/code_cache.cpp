@@ -74,7 +74,7 @@ void code_cache_async::wait_on_compile_monitor_message() {
          return;
       }
 
-      _result_queue.push(message.get<wasm_compilation_result_message>());
+      _result_queue.push(compile_result{message.get<wasm_compilation_result_message>(), fc::time_point::now()});
 
       wait_on_compile_monitor_message();
    });
@@ -84,15 +84,24 @@ void code_cache_async::wait_on_compile_monitor_message() {
 //number processed, bytes available (only if number processed > 0)
 std::tuple<size_t, size_t> code_cache_async::consume_compile_thread_queue() {
    size_t bytes_remaining = 0;
-   size_t gotsome = _result_queue.consume_all([&](const wasm_compilation_result_message& result) {
+   size_t gotsome = _result_queue.consume_all([&](const compile_result& r) {
+      const wasm_compilation_result_message& result = r.message;
+      if(auto started = _compile_start_times.find(result.code); started != _compile_start_times.end()) {
+         const uint64_t compile_us = (r.received - started->second).count();
+         _compile_stats.total_compile_us += compile_us;
+         _compile_stats.max_compile_us = std::max(_compile_stats.max_compile_us, compile_us);
+         _compile_start_times.erase(started);
+      }
       if(_outstanding_compiles_and_poison[result.code] == false) {
          result.result.visit(overloaded {
             [&](const code_descriptor& cd) {
                _cache_index.push_front(cd);
+               ++_compile_stats.compiled;
             },
             [&](const compilation_result_unknownfailure&) {
                wlog("code ${c} failed to tier-up with EOS VM OC", ("c", result.code.code_id));
                _blacklist.emplace(result.code);
+               ++_compile_stats.failed;
             },
             [&](const compilation_result_toofull&) {
                run_eviction_round();
@@ -114,20 +123,11 @@ const code_descriptor* const code_cache_async::get_descriptor_for_code(const dig
       if(count_processed)
          check_eviction_threshold(bytes_remaining);
 
-      while(count_processed && _queued_compiles.size()) {
-         auto nextup = _queued_compiles.begin();
-
+      while(count_processed && !_queued_compiles.empty()) {
          //it's not clear this check is required: if apply() was called for code then it existed in the code_index; and then
          // if we got notification of it no longer existing we would have removed it from queued_compiles
-         const code_object* const codeobject = _db.find<code_object,by_code_hash>(boost::make_tuple(nextup->code_id, 0, nextup->vm_version));
-         if(codeobject) {
-            _outstanding_compiles_and_poison.emplace(*nextup, false);
-            std::vector<wrapped_fd> fds_to_pass;
-            fds_to_pass.emplace_back(memfd_for_bytearray(codeobject->code));
-            FC_ASSERT(write_message_with_fds(_compile_monitor_write_socket, compile_wasm_message{ *nextup }, fds_to_pass), "EOS VM failed to communicate to OOP manager");
+         if(start_compile(_queued_compiles.pop()))
             --count_processed;
-         }
-         _queued_compiles.erase(nextup);
       }
    }
 
@@ -146,23 +146,40 @@ const code_descriptor* const code_cache_async::get_descriptor_for_code(const dig
       it->second = false;
       return nullptr;
    }
-   if(_queued_compiles.find(ct) != _queued_compiles.end())
+   if(_queued_compiles.contains(ct) || _outstanding_compiles_and_poison.size() >= _threads) {
+      _queued_compiles.executed(ct);
       return nullptr;
+   }
+
+   start_compile(ct); //code not existing should be impossible right?
+   return nullptr;
+}
+
+void code_cache_async::precompile(const digest_type& code_id, const uint8_t& vm_version) {
+   const code_tuple ct = code_tuple{code_id, vm_version};
+
+   if(_cache_index.get<by_hash>().count(boost::make_tuple(code_id, vm_version)) || _blacklist.count(ct) || _outstanding_compiles_and_poison.count(ct))
+      return;
 
    if(_outstanding_compiles_and_poison.size() >= _threads) {
-      _queued_compiles.emplace(ct);
-      return nullptr;
+      _queued_compiles.precompile(ct);
+      return;
    }
 
-   const code_object* const codeobject = _db.find<code_object,by_code_hash>(boost::make_tuple(code_id, 0, vm_version));
-   if(!codeobject) //should be impossible right?
-      return nullptr;
+   start_compile(ct);
+}
+
+bool code_cache_async::start_compile(const code_tuple& ct) {
+   const code_object* const codeobject = _db.find<code_object,by_code_hash>(boost::make_tuple(ct.code_id, 0, ct.vm_version));
+   if(!codeobject)
+      return false;
 
    _outstanding_compiles_and_poison.emplace(ct, false);
+   _compile_start_times[ct] = fc::time_point::now();
    std::vector<wrapped_fd> fds_to_pass;
    fds_to_pass.emplace_back(memfd_for_bytearray(codeobject->code));
-   write_message_with_fds(_compile_monitor_write_socket, compile_wasm_message{ ct }, fds_to_pass);
-   return nullptr;
+   FC_ASSERT(write_message_with_fds(_compile_monitor_write_socket, compile_wasm_message{ ct }, fds_to_pass), "EOS VM failed to communicate to OOP manager");
+   return true;
 }
 
 code_cache_sync::~code_cache_sync() {
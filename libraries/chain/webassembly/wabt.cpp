@@ -11,7 +11,8 @@
 namespace eosio { namespace chain { namespace webassembly { namespace wabt_runtime {
 
 //yep 🤮
-static wabt_apply_instance_vars* static_wabt_vars;
+//thread local as read-only transactions run on several threads, each with its own wasm_interface
+static thread_local wabt_apply_instance_vars* static_wabt_vars;
 
 using namespace wabt;
 using namespace wabt::interp;
@@ -153,7 +153,7 @@ namespace eosio { namespace testing {
          virtual ~base_tester() {};
 
          void              init(const setup_policy policy = setup_policy::full, db_read_mode read_mode = db_read_mode::SPECULATIVE, optional<uint32_t> genesis_max_inline_action_size = optional<uint32_t>{}, optional<uint32_t> config_max_nonprivileged_inline_action_size = optional<uint32_t>{});
-         void              init(controller::config config, const snapshot_reader_ptr& snapshot);
+         void              init(controller::config config, const snapshot_reader_ptr& snapshot, const std::vector<snapshot_reader_ptr>& deltas = {});
          void              init(controller::config config, const genesis_state& genesis);
          void              init(controller::config config);
          void              init(controller::config config, protocol_feature_set&& pfs, const snapshot_reader_ptr& snapshot);
@@ -164,10 +164,10 @@ namespace eosio { namespace testing {
          void              close();
          template <typename Lambda>
          void              open( protocol_feature_set&& pfs, fc::optional<chain_id_type> expected_chain_id, Lambda lambda );
-         void              open( protocol_feature_set&& pfs, const snapshot_reader_ptr& snapshot );
+         void              open( protocol_feature_set&& pfs, const snapshot_reader_ptr& snapshot, const std::vector<snapshot_reader_ptr>& deltas = {} );
          void              open( protocol_feature_set&& pfs, const genesis_state& genesis );
          void              open( protocol_feature_set&& pfs, fc::optional<chain_id_type> expected_chain_id = {} );
-         void              open( const snapshot_reader_ptr& snapshot );
+         void              open( const snapshot_reader_ptr& snapshot, const std::vector<snapshot_reader_ptr>& deltas = {} );
          void              open( const genesis_state& genesis );
          void              open( fc::optional<chain_id_type> expected_chain_id = {} );
          bool              is_same_chain( base_tester& other );
@@ -159,9 +159,9 @@ namespace eosio { namespace testing {
       execute_setup_policy(policy);
    }
 
-   void base_tester::init(controller::config config, const snapshot_reader_ptr& snapshot) {
+   void base_tester::init(controller::config config, const snapshot_reader_ptr& snapshot, const std::vector<snapshot_reader_ptr>& deltas) {
       cfg = config;
-      open(snapshot);
+      open(snapshot, deltas);
    }
 
    void base_tester::init(controller::config config, const genesis_state& genesis) {
@@ -234,8 +234,8 @@ namespace eosio { namespace testing {
       chain_transactions.clear();
    }
 
-   void base_tester::open( const snapshot_reader_ptr& snapshot ) {
-      open( make_protocol_feature_set(), snapshot );
+   void base_tester::open( const snapshot_reader_ptr& snapshot, const std::vector<snapshot_reader_ptr>& deltas ) {
+      open( make_protocol_feature_set(), snapshot, deltas );
    }
 
    void base_tester::open( const genesis_state& genesis ) {
@@ -277,11 +277,11 @@ namespace eosio { namespace testing {
       });
    }
 
-   void base_tester::open( protocol_feature_set&& pfs, const snapshot_reader_ptr& snapshot ) {
+   void base_tester::open( protocol_feature_set&& pfs, const snapshot_reader_ptr& snapshot, const std::vector<snapshot_reader_ptr>& deltas ) {
       const auto& snapshot_chain_id = controller::extract_chain_id( *snapshot );
       snapshot->return_to_header();
-      open(std::move(pfs), snapshot_chain_id, [&snapshot,&control=this->control]() {
-         control->startup([]() { return false; }, snapshot );
+      open(std::move(pfs), snapshot_chain_id, [&snapshot,&deltas,&control=this->control]() {
+         control->startup([]() { return false; }, snapshot, deltas );
       });
    }
 
@@ -1,4 +1,5 @@
 #include <eosio/chain_plugin/chain_plugin.hpp>
+#include <eosio/chain_plugin/read_only_trx_executor.hpp>
 #include <eosio/chain/fork_database.hpp>
 #include <eosio/chain/block_log.hpp>
 #include <eosio/chain/exceptions.hpp>
@@ -123,6 +124,9 @@ using fc::flat_map;
 
 using boost::signals2::scoped_connection;
 
+/// read-only transactions beyond this many waiting for a window are rejected
+static constexpr uint32_t max_queued_read_only_trxs = 10000;
+
 class chain_plugin_impl {
 public:
    chain_plugin_impl()
@@ -154,6 +158,12 @@ public:
    fc::optional<vm_type>            wasm_runtime;
    fc::microseconds                 abi_serializer_max_time_us;
    fc::optional<bfs::path>          snapshot_path;
+   vector<bfs::path>                snapshot_delta_paths;
+
+   uint16_t                                 read_only_threads = 0;
+   fc::microseconds                         read_only_window;
+   fc::microseconds                         read_only_max_trx_time;
+   std::shared_ptr<read_only_trx_executor>  read_only_executor;
 
 
    // retained references to channels for easy publication
@@ -229,6 +239,19 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
    cfg.add_options()
          ("blocks-dir", bpo::value<bfs::path>()->default_value("blocks"),
           "the location of the blocks directory (absolute path or relative to application data dir)")
+         ("blocks-log-mmap", bpo::bool_switch()->default_value(false),
+          "Memory map blocks.log and blocks.index and serve random access block reads from the mapping")
+         ("blocks-log-stride", bpo::value<uint32_t>()->default_value(std::numeric_limits<uint32_t>::max()),
+          "split the block log file when the head block number is a multiple of the stride\n"
+          "When the stride is reached, the current block log and index are renamed to 'blocks-<first>-<last>.log/.index'\n"
+          "and a new current block log and index are started with the next block.")
+         ("max-retained-block-files", bpo::value<uint16_t>()->default_value(10),
+          "the maximum number of split block log files kept in blocks-dir and available for reading")
+         ("blocks-archive-dir", bpo::value<bfs::path>()->default_value("archive"),
+          "the location of the directory for split block log files beyond max-retained-block-files (absolute path or relative to blocks dir).\n"
+          "If the value is empty, those files are deleted instead of archived.")
+         ("blocks-log-compress-segments", bpo::bool_switch()->default_value(false),
+          "compress split block log files into 'blocks-<first>-<last>.clog' in the background; blocks in them remain readable")
          ("protocol-features-dir", bpo::value<bfs::path>()->default_value("protocol_features"),
           "the location of the protocol_features directory (absolute path or relative to application config dir)")
          ("checkpoint", bpo::value<vector<string>>()->composing(), "Pairs of [BLOCK_NUM,BLOCK_ID] that should be enforced as checkpoints.")
@@ -242,6 +265,14 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
 #endif
          })->default_value(eosio::chain::config::default_wasm_runtime, default_wasm_runtime_str), wasm_runtime_opt.c_str()
          )
+         ("wasm-instantiation-threads", bpo::value<uint16_t>()->default_value(2),
+          "Number of threads instantiating contracts in the background when their code is set, 0 instantiates contracts on first use only")
+         ("wasm-warmup-modules", bpo::value<uint32_t>()->default_value(64),
+          "Number of most used contracts recorded at shutdown and instantiated in the background at the next startup, 0 to disable. Requires wasm-instantiation-threads")
+         ("wasm-disk-cache-size-mb", bpo::value<uint64_t>()->default_value(256),
+          "Maximum size (in MiB) of contracts prepared for the wasm runtime kept in the state directory across restarts, 0 to disable")
+         ("wasm-jit-tierup-threshold", bpo::value<uint32_t>()->default_value(0),
+          "Number of executions after which a contract run by the eos-vm interpreter is compiled by eos-vm-jit in the background and run by it from then on, 0 to disable. Requires wasm-runtime eos-vm")
          ("abi-serializer-max-time-ms", bpo::value<uint32_t>()->default_value(config::default_abi_serializer_max_time_us / 1000),
           "Override default maximum ABI serialization time allowed in ms")
          ("chain-state-db-size-mb", bpo::value<uint64_t>()->default_value(config::default_state_size / (1024  * 1024)), "Maximum size (in MiB) of the chain state database")
@@ -252,8 +283,21 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
           "Percentage of actual signature recovery cpu to bill. Whole number percentages, e.g. 50 for 50%")
          ("chain-threads", bpo::value<uint16_t>()->default_value(config::default_controller_thread_pool_size),
           "Number of worker threads in controller thread pool")
+         ("replay-read-ahead-blocks", bpo::value<uint32_t>()->default_value(64),
+          "Number of blocks read from the block log and prepared on the controller thread pool ahead of the block being replayed")
+         ("trusted-replay-checkpoint", bpo::value<vector<string>>()->composing(),
+          "Pairs of [BLOCK_NUM,BLOCK_ID] of the block log that are trusted: when replaying, blocks up to the highest one skip "
+          "signature, authorization and transaction checks even with force-all-checks or disable-replay-opts")
+         ("trust-block-log-replay", bpo::bool_switch()->default_value(false),
+          "when replaying, trust every block of the block log as if its last block was a trusted-replay-checkpoint")
+         ("replay-snapshot-interval", bpo::value<uint32_t>()->default_value(0),
+          "write a snapshot to 'replay-snapshots' in the data dir every this many blocks while replaying the block log, "
+          "so that an interrupted --replay-blockchain resumes from the last one (0 disables)")
          ("contracts-console", bpo::bool_switch()->default_value(false),
           "print contract's output to console")
+         ("enable-snapshot-deltas", bpo::bool_switch()->default_value(false),
+          "track the state changed by every block so that a snapshot following another snapshot can be written as a delta of it, "
+          "requested with create_snapshot {\"delta\": true}")
          ("actor-whitelist", boost::program_options::value<vector<string>>()->composing()->multitoken(),
           "Account added to actor whitelist (may specify multiple times)")
          ("actor-blacklist", boost::program_options::value<vector<string>>()->composing()->multitoken(),
@@ -276,6 +320,12 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
           "In \"irreversible\" mode: database contains state changes by only transactions in the blockchain up to the last irreversible block; transactions received via the P2P network are not relayed and transactions cannot be pushed via the chain API.\n"
           )
          ( "api-accept-transactions", bpo::value<bool>()->default_value(true), "Allow API transactions to be evaluated and relayed if valid.")
+         ("read-only-threads", bpo::value<uint16_t>()->default_value(0),
+          "Number of worker threads executing read-only transactions sent to /v1/chain/send_read_only_transaction, 0 disables read-only transactions.")
+         ("read-only-window-ms", bpo::value<uint32_t>()->default_value(10),
+          "Time in milliseconds the main thread lets the worker threads execute queued read-only transactions before resuming other work.")
+         ("read-only-max-transaction-ms", bpo::value<uint32_t>()->default_value(10),
+          "Limit (between 1 and 1000, at most read-only-window-ms) on the time in milliseconds a read-only transaction may execute.")
          ("validation-mode", boost::program_options::value<eosio::chain::validation_mode>()->default_value(eosio::chain::validation_mode::FULL),
           "Chain validation mode (\"full\" or \"light\").\n"
           "In \"full\" mode all incoming blocks will be fully validated.\n"
@@ -284,6 +334,8 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
           "Disable the check which subjectively fails a transaction if a contract bills more RAM to another account within the context of a notification handler (i.e. when the receiver is not the code of the action).")
          ("maximum-variable-signature-length", bpo::value<uint32_t>()->default_value(16384u),
           "Subjectively limit the maximum length of variable components in a variable legnth signature to this size in bytes")
+         ("recovered-keys-cache-size", bpo::value<uint32_t>()->default_value(config::default_recovered_keys_cache_size),
+          "Number of signatures whose recovered public keys are kept, so that transactions received before their block are not recovered again when the block is validated. 0 disables the cache.")
          ("trusted-producer", bpo::value<vector<string>>()->composing(), "Indicate a producer whose blocks headers signed by it will be fully validated, but transactions in those validated blocks will be trusted.")
          ("database-map-mode", bpo::value<chainbase::pinnable_mapped_file::map_mode>()->default_value(chainbase::pinnable_mapped_file::map_mode::mapped),
           "Database map mode (\"mapped\", \"heap\", or \"locked\").\n"
@@ -308,6 +360,8 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
                }
          }), "Number of threads to use for EOS VM OC tier-up")
          ("eos-vm-oc-enable", bpo::bool_switch(), "Enable EOS VM OC tier-up runtime")
+         ("eos-vm-oc-precompile-account", bpo::value<vector<string>>()->composing()->multitoken(),
+          "Account whose contract is compiled with EOS VM OC at startup, ahead of any other code, when tier-up is enabled (e.g. rem.token, rem.system) (may specify multiple times)")
 #endif
          ("enable-account-queries", bpo::value<bool>()->default_value(false), "enable queries to find accounts by various metadata.")
          ("max-nonprivileged-inline-action-size", bpo::value<uint32_t>()->default_value(config::default_max_nonprivileged_inline_action_size), "maximum allowed size (in bytes) of an inline action for a nonprivileged account")
@@ -342,6 +396,9 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
           "disable optimizations that specifically target replay")
          ("replay-blockchain", bpo::bool_switch()->default_value(false),
           "clear chain state database and replay all blocks")
+         ("replay-from-start", bpo::bool_switch()->default_value(false),
+          "with --replay-blockchain, delete the snapshots left by an interrupted replay (see replay-snapshot-interval) "
+          "and replay from the start of the block log instead of resuming from the last one")
          ("hard-replay-blockchain", bpo::bool_switch()->default_value(false),
           "clear chain state database, recover as many blocks as possible from the block log, and then replay those blocks")
          ("delete-all-blocks", bpo::bool_switch()->default_value(false),
@@ -352,7 +409,9 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
           "replace reversible block database with blocks imported from specified file and then exit")
          ("export-reversible-blocks", bpo::value<bfs::path>(),
            "export reversible block database in portable format into specified file and then exit")
-         ("snapshot", bpo::value<bfs::path>(), "File to read Snapshot State from")
+         ("snapshot", bpo::value<bfs::path>(), "File to read Snapshot State from, either uncompressed or compressed binary format")
+         ("snapshot-delta", bpo::value<vector<bfs::path>>()->composing(),
+          "Snapshot delta to apply on top of --snapshot, in the order they were written (may specify multiple times)")
          ;
 
 }
@@ -385,6 +444,25 @@ fc::time_point calculate_genesis_timestamp( string tstr ) {
    return genesis_timestamp;
 }
 
+/// the replay snapshot of the highest block in dir, if any
+fc::optional<bfs::path> find_replay_snapshot( const bfs::path& dir ) {
+   using boost::filesystem::directory_iterator;
+
+   fc::optional<bfs::path> result;
+   uint32_t highest = 0;
+   if( !fc::is_directory( dir ) )
+      return result;
+   for( directory_iterator enditr, itr{dir}; itr != enditr; ++itr ) {
+      uint32_t block_num = 0;
+      if( sscanf( itr->path().filename().generic_string().c_str(), "replay-snapshot-%u.bin", &block_num ) == 1 &&
+          block_num > highest ) {
+         highest = block_num;
+         result = itr->path();
+      }
+   }
+   return result;
+}
+
 void clear_directory_contents( const fc::path& p ) {
    using boost::filesystem::directory_iterator;
 
@@ -733,6 +811,12 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
          my->abi_serializer_max_time_us = fc::microseconds(options.at("abi-serializer-max-time-ms").as<uint32_t>() * 1000);
 
       my->chain_config->blocks_dir = my->blocks_dir;
+      my->chain_config->blocks_log_mapped_reads = options.at( "blocks-log-mmap" ).as<bool>();
+      my->chain_config->blocks_log_stride = options.at( "blocks-log-stride" ).as<uint32_t>();
+      EOS_ASSERT( my->chain_config->blocks_log_stride > 0, plugin_config_exception, "blocks-log-stride must be greater than 0" );
+      my->chain_config->max_retained_block_files = options.at( "max-retained-block-files" ).as<uint16_t>();
+      my->chain_config->blocks_archive_dir = options.at( "blocks-archive-dir" ).as<bfs::path>();
+      my->chain_config->compress_block_log_segments = options.at( "blocks-log-compress-segments" ).as<bool>();
       my->chain_config->state_dir = app().data_dir() / config::default_state_dir_name;
       my->chain_config->read_only = my->readonly;
 
@@ -769,8 +853,25 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       my->chain_config->force_all_checks = options.at( "force-all-checks" ).as<bool>();
       my->chain_config->disable_replay_opts = options.at( "disable-replay-opts" ).as<bool>();
       my->chain_config->contracts_console = options.at( "contracts-console" ).as<bool>();
+      my->chain_config->replay_read_ahead_blocks = options.at( "replay-read-ahead-blocks" ).as<uint32_t>();
+      my->chain_config->trust_block_log_replay = options.at( "trust-block-log-replay" ).as<bool>();
+      my->chain_config->replay_snapshot_interval = options.at( "replay-snapshot-interval" ).as<uint32_t>();
+      my->chain_config->replay_snapshots_dir = app().data_dir() / "replay-snapshots";
+      if( options.count( "trusted-replay-checkpoint" ) ) {
+         for( const auto& cp : options.at( "trusted-replay-checkpoint" ).as<vector<string>>() ) {
+            auto item = fc::json::from_string(cp).as<std::pair<uint32_t,block_id_type>>();
+            auto itr = my->chain_config->trusted_replay_checkpoints.find( item.first );
+            EOS_ASSERT( itr == my->chain_config->trusted_replay_checkpoints.end() || itr->second == item.second,
+                        plugin_config_exception,
+                        "redefining existing trusted replay checkpoint at block number ${num}: original: ${orig} new: ${new}",
+                        ("num", item.first)("orig", itr->second)("new", item.second) );
+            my->chain_config->trusted_replay_checkpoints[item.first] = item.second;
+         }
+      }
+      my->chain_config->track_snapshot_deltas = options.at( "enable-snapshot-deltas" ).as<bool>();
       my->chain_config->allow_ram_billing_in_notify = options.at( "disable-ram-billing-notify-checks" ).as<bool>();
       my->chain_config->maximum_variable_signature_length = options.at( "maximum-variable-signature-length" ).as<uint32_t>();
+      my->chain_config->recovered_keys_cache_size = options.at( "recovered-keys-cache-size" ).as<uint32_t>();
 
       if( options.count( "extract-genesis-json" ) || options.at( "print-genesis-json" ).as<bool>()) {
          fc::optional<genesis_state> gs;
@@ -845,6 +946,18 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
                ilog( "Reversible blocks database was not corrupted." );
             }
          }
+         if( options.at( "replay-from-start" ).as<bool>() ) {
+            ilog( "Deleting snapshots of interrupted replays" );
+            clear_directory_contents( my->chain_config->replay_snapshots_dir );
+         } else if( !options.count( "snapshot" ) && !options.count( "genesis-json" ) ) {
+            // a snapshot left by an interrupted replay is the state of a block of this block log
+            auto resume_from = find_replay_snapshot( my->chain_config->replay_snapshots_dir );
+            if( resume_from ) {
+               wlog( "Resuming interrupted replay from ${path}, use --replay-from-start to replay the whole block log",
+                     ("path", resume_from->generic_string()) );
+               my->snapshot_path = *resume_from;
+            }
+         }
       } else if( options.at( "fix-reversible-blocks" ).as<bool>()) {
          if( !recover_reversible_blocks( my->chain_config->blocks_dir / config::reversible_blocks_dir_name,
                                          my->chain_config->reversible_cache_size,
@@ -873,17 +986,27 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       }
 
       fc::optional<chain_id_type> chain_id;
-      if (options.count( "snapshot" )) {
-         my->snapshot_path = options.at( "snapshot" ).as<bfs::path>();
+      if (options.count( "snapshot-delta" )) {
+         EOS_ASSERT( options.count( "snapshot" ), plugin_config_exception, "--snapshot-delta requires --snapshot" );
+         my->snapshot_delta_paths = options.at( "snapshot-delta" ).as<vector<bfs::path>>();
+         for( const auto& delta_path : my->snapshot_delta_paths ) {
+            EOS_ASSERT( fc::exists(delta_path), plugin_config_exception,
+                        "Cannot load snapshot delta, ${name} does not exist", ("name", delta_path.generic_string()) );
+         }
+      }
+
+      if (options.count( "snapshot" ) || my->snapshot_path) {
+         if( options.count( "snapshot" ) )
+            my->snapshot_path = options.at( "snapshot" ).as<bfs::path>();
          EOS_ASSERT( fc::exists(*my->snapshot_path), plugin_config_exception,
                      "Cannot load snapshot, ${name} does not exist", ("name", my->snapshot_path->generic_string()) );
 
          // recover genesis information from the snapshot
          // used for validation code below
          auto infile = std::ifstream(my->snapshot_path->generic_string(), (std::ios::in | std::ios::binary));
-         istream_snapshot_reader reader(infile);
-         reader.validate();
-         chain_id = controller::extract_chain_id(reader);
+         auto reader = make_istream_snapshot_reader(infile);
+         reader->validate();
+         chain_id = controller::extract_chain_id(*reader);
          infile.close();
 
          EOS_ASSERT( options.count( "genesis-timestamp" ) == 0,
@@ -1048,6 +1171,21 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
          enable_accept_transactions();
       }
 
+      my->read_only_threads = options.at( "read-only-threads" ).as<uint16_t>();
+      my->read_only_window = fc::milliseconds( options.at( "read-only-window-ms" ).as<uint32_t>() );
+      const auto read_only_max_trx_ms = options.at( "read-only-max-transaction-ms" ).as<uint32_t>();
+      EOS_ASSERT( read_only_max_trx_ms > 0 && read_only_max_trx_ms <= 1000, plugin_config_exception,
+                  "read-only-max-transaction-ms ${ms} must be between 1 and 1000", ("ms", read_only_max_trx_ms) );
+      my->read_only_max_trx_time = fc::milliseconds( read_only_max_trx_ms );
+      if( my->read_only_threads > 0 ) {
+         EOS_ASSERT( my->read_only_window.count() > 0, plugin_config_exception, "read-only-window-ms must be greater than 0" );
+         EOS_ASSERT( my->read_only_max_trx_time <= my->read_only_window, plugin_config_exception,
+                     "read-only-max-transaction-ms ${ms} must not exceed read-only-window-ms ${w}",
+                     ("ms", read_only_max_trx_ms)("w", options.at( "read-only-window-ms" ).as<uint32_t>()) );
+         EOS_ASSERT( my->chain_config->read_mode != db_read_mode::IRREVERSIBLE && my->chain_config->read_mode != db_read_mode::READ_ONLY,
+                     plugin_config_exception, "read-only-threads is not supported with read-mode irreversible or read-only" );
+      }
+
       if ( options.count("validation-mode") ) {
          my->chain_config->block_validation_mode = options.at("validation-mode").as<validation_mode>();
       }
@@ -1065,8 +1203,14 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
          my->chain_config->eosvmoc_config.threads = options.at("eos-vm-oc-compile-threads").as<uint64_t>();
       if( options["eos-vm-oc-enable"].as<bool>() )
          my->chain_config->eosvmoc_tierup = true;
+      LOAD_VALUE_SET( options, "eos-vm-oc-precompile-account", my->chain_config->eosvmoc_precompile_accounts );
 #endif
 
+      my->chain_config->wasm_instantiation.threads = options.at( "wasm-instantiation-threads" ).as<uint16_t>();
+      my->chain_config->wasm_instantiation.warmup_modules = options.at( "wasm-warmup-modules" ).as<uint32_t>();
+      my->chain_config->wasm_instantiation.disk_cache_size = options.at( "wasm-disk-cache-size-mb" ).as<uint64_t>() * 1024 * 1024;
+      my->chain_config->wasm_instantiation.jit_tierup_threshold = options.at( "wasm-jit-tierup-threshold" ).as<uint32_t>();
+
       my->account_queries_enabled = options.at("enable-account-queries").as<bool>();
 
       my->chain.emplace( *my->chain_config, std::move(pfs), *chain_id );
@@ -1147,8 +1291,17 @@ void chain_plugin::plugin_startup()
       auto shutdown = [](){ return app().is_quiting(); };
       if (my->snapshot_path) {
          auto infile = std::ifstream(my->snapshot_path->generic_string(), (std::ios::in | std::ios::binary));
-         auto reader = std::make_shared<istream_snapshot_reader>(infile);
-         my->chain->startup(shutdown, reader);
+         auto reader = make_istream_snapshot_reader(infile);
+
+         std::vector<std::ifstream> delta_files;
+         std::vector<snapshot_reader_ptr> deltas;
+         delta_files.reserve( my->snapshot_delta_paths.size() );
+         for( const auto& delta_path : my->snapshot_delta_paths ) {
+            delta_files.emplace_back( delta_path.generic_string(), (std::ios::in | std::ios::binary) );
+            deltas.emplace_back( make_istream_snapshot_reader(delta_files.back()) );
+         }
+
+         my->chain->startup(shutdown, reader, deltas);
          infile.close();
       } else if( my->genesis ) {
          my->chain->startup(shutdown, *my->genesis);
@@ -1184,6 +1337,12 @@ void chain_plugin::plugin_startup()
       } FC_LOG_AND_DROP(("Unable to enable account queries"));
    }
 
+   if( my->read_only_threads > 0 ) {
+      my->read_only_executor = std::make_shared<read_only_trx_executor>( *my->chain, my->read_only_threads, my->read_only_window,
+                                                                         my->read_only_max_trx_time, max_queued_read_only_trxs );
+      ilog( "executing read-only transactions on ${n} threads", ("n", my->read_only_threads) );
+   }
+
 
 } FC_CAPTURE_AND_RETHROW() }
 
@@ -1194,15 +1353,25 @@ void chain_plugin::plugin_shutdown() {
    my->irreversible_block_connection.reset();
    my->accepted_transaction_connection.reset();
    my->applied_transaction_connection.reset();
+   if( my->read_only_executor ) {
+      my->read_only_executor->stop();
+      my->read_only_executor.reset();
+   }
    if(app().is_quiting())
       my->chain->get_wasm_interface().indicate_shutting_down();
    my->chain.reset();
 }
 
-chain_apis::read_write::read_write(controller& db, const fc::microseconds& abi_serializer_max_time, bool api_accept_transactions)
+chain_apis::read_write chain_plugin::get_read_write_api() {
+   return chain_apis::read_write(chain(), get_abi_serializer_max_time(), api_accept_transactions(), my->read_only_executor.get());
+}
+
+chain_apis::read_write::read_write(controller& db, const fc::microseconds& abi_serializer_max_time, bool api_accept_transactions,
+                                   read_only_trx_executor* read_only_executor)
 : db(db)
 , abi_serializer_max_time(abi_serializer_max_time)
 , api_accept_transactions(api_accept_transactions)
+, read_only_executor(read_only_executor)
 {
 }
 
@@ -2373,6 +2542,45 @@ void read_write::send_transaction(const read_write::send_transaction_params& par
    } CATCH_AND_CALL(next);
 }
 
+void read_write::send_read_only_transaction(const read_write::send_read_only_transaction_params& params, next_function<read_write::send_read_only_transaction_results> next) {
+
+   try {
+      EOS_ASSERT( read_only_executor, unsupported_feature, "Read-only transactions are not enabled, see read-only-threads" );
+
+      auto pretty_input = std::make_shared<packed_transaction>();
+      auto resolver = make_resolver(this, abi_serializer::create_yield_function( abi_serializer_max_time ));
+      try {
+         abi_serializer::from_variant(params, *pretty_input, resolver, abi_serializer::create_yield_function( abi_serializer_max_time ));
+      } EOS_RETHROW_EXCEPTIONS(chain::packed_transaction_type_exception, "Invalid packed transaction")
+
+      // authorizations are not checked, so there is no need to recover the signing keys
+      auto trx = transaction_metadata::create_no_recover_keys( *pretty_input, transaction_metadata::trx_type::input );
+      read_only_executor->execute( trx, [this, next](const fc::static_variant<fc::exception_ptr, transaction_trace_ptr>& result) -> void {
+         if (result.contains<fc::exception_ptr>()) {
+            next(result.get<fc::exception_ptr>());
+         } else {
+            auto trx_trace_ptr = result.get<transaction_trace_ptr>();
+
+            try {
+               fc::variant output;
+               try {
+                  output = db.to_variant_with_abi( *trx_trace_ptr, abi_serializer::create_yield_function( abi_serializer_max_time ) );
+               } catch( chain::abi_exception& ) {
+                  output = *trx_trace_ptr;
+               }
+
+               const chain::transaction_id_type& id = trx_trace_ptr->id;
+               next(read_write::send_read_only_transaction_results{id, output});
+            } CATCH_AND_CALL(next);
+         }
+      });
+   } catch ( boost::interprocess::bad_alloc& ) {
+      chain_plugin::handle_db_exhaustion();
+   } catch ( const std::bad_alloc& ) {
+      chain_plugin::handle_bad_alloc();
+   } CATCH_AND_CALL(next);
+}
+
 read_only::get_abi_results read_only::get_abi( const get_abi_params& params )const {
    get_abi_results result;
    result.account_name = params.account_name;
@@ -2643,6 +2851,14 @@ read_only::get_transaction_id_result read_only::get_transaction_id( const read_o
    return params.id();
 }
 
+read_only::get_wasm_cache_stats_results read_only::get_wasm_cache_stats( const read_only::get_wasm_cache_stats_params& )const {
+   return db.get_wasm_interface().get_instantiation_stats();
+}
+
+read_only::get_eos_vm_oc_stats_results read_only::get_eos_vm_oc_stats( const read_only::get_eos_vm_oc_stats_params& )const {
+   return db.get_wasm_interface().get_eosvmoc_tierup_stats();
+}
+
 account_query_db::get_accounts_by_authorizers_result read_only::get_accounts_by_authorizers( const account_query_db::get_accounts_by_authorizers_params& args) const
 {
    EOS_ASSERT(aqdb.valid(), plugin_config_exception, "Account Queries being accessed when not enabled");
@@ -42,6 +42,8 @@ namespace eosio {
    using chain::abi_def;
    using chain::abi_serializer;
 
+   class read_only_trx_executor;
+
 namespace chain_apis {
 struct empty{};
 
@@ -277,6 +279,16 @@ public:
 
    get_transaction_id_result get_transaction_id( const get_transaction_id_params& params)const;
 
+   using get_wasm_cache_stats_params = empty;
+   using get_wasm_cache_stats_results = chain::wasm_interface::instantiation_stats;
+
+   get_wasm_cache_stats_results get_wasm_cache_stats( const get_wasm_cache_stats_params& params)const;
+
+   using get_eos_vm_oc_stats_params = empty;
+   using get_eos_vm_oc_stats_results = chain::wasm_interface::eosvmoc_tierup_stats;
+
+   get_eos_vm_oc_stats_results get_eos_vm_oc_stats( const get_eos_vm_oc_stats_params& params)const;
+
    struct get_block_params {
       string block_num_or_id;
    };
@@ -613,8 +625,10 @@ class read_write {
    controller& db;
    const fc::microseconds abi_serializer_max_time;
    const bool api_accept_transactions;
+   read_only_trx_executor* read_only_executor;
 public:
-   read_write(controller& db, const fc::microseconds& abi_serializer_max_time, bool api_accept_transactions);
+   read_write(controller& db, const fc::microseconds& abi_serializer_max_time, bool api_accept_transactions,
+              read_only_trx_executor* read_only_executor = nullptr);
    void validate() const;
 
    using push_block_params = chain::signed_block;
@@ -637,6 +651,11 @@ public:
    using send_transaction_results = push_transaction_results;
    void send_transaction(const send_transaction_params& params, chain::plugin_interface::next_function<send_transaction_results> next);
 
+   /// execute without changing state or relaying, the trace is returned whether the transaction succeeded or not
+   using send_read_only_transaction_params = push_transaction_params;
+   using send_read_only_transaction_results = push_transaction_results;
+   void send_read_only_transaction(const send_read_only_transaction_params& params, chain::plugin_interface::next_function<send_read_only_transaction_results> next);
+
    friend resolver_factory<read_write>;
 };
 
@@ -724,7 +743,7 @@ public:
    void plugin_startup();
    void plugin_shutdown();
 
-   chain_apis::read_write get_read_write_api() { return chain_apis::read_write(chain(), get_abi_serializer_max_time(), api_accept_transactions()); }
+   chain_apis::read_write get_read_write_api();
    chain_apis::read_only get_read_only_api() const;
 
    bool accept_block( const chain::signed_block_ptr& block, const chain::block_id_type& id );
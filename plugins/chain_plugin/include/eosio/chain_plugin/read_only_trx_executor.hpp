@@ -0,0 +1,65 @@
+#pragma once
+
+#include <eosio/chain/controller.hpp>
+#include <eosio/chain/transaction_metadata.hpp>
+#include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/plugin_interface.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+
+#include <deque>
+#include <memory>
+
+namespace eosio {
+
+   /**
+    * Executes read-only transactions on a pool of threads, several at once, against the state of the pending block.
+    *
+    * chainbase cannot be read while it is written, so read-only transactions do not run while the main thread
+    * works. They are queued instead and executed in windows: a task on the main thread hands the queued
+    * transactions to the threads and waits until they are done, starting new ones only until the window time is
+    * up. Transactions left over wait for the next window, posted at low priority so that blocks and incoming
+    * transactions are processed in between. Transactions are cut short at the end of the window. One cut short is
+    * executed again first thing in the next window, then with all of max_trx_time, which must not exceed the
+    * window. Each thread executes with a wasm runtime of its own.
+    *
+    * All member functions are called on the main thread.
+    */
+   class read_only_trx_executor : public std::enable_shared_from_this<read_only_trx_executor> {
+   public:
+      using next_function = chain::plugin_interface::next_function<chain::transaction_trace_ptr>;
+
+      read_only_trx_executor( chain::controller& chain, uint16_t threads, fc::microseconds window, fc::microseconds max_trx_time,
+                              uint32_t max_queued );
+      ~read_only_trx_executor();
+
+      /// queue trx, next is called on the main thread with its trace, or with an exception if it could not be executed
+      void execute( const chain::transaction_metadata_ptr& trx, next_function next );
+
+      void stop();
+
+      size_t queued()const { return queue.size(); }
+
+   private:
+      struct queued_trx {
+         chain::transaction_metadata_ptr trx;
+         next_function                   next;
+         bool                            carried = false; ///< cut short by the end of a window, runs with max_trx_time
+      };
+
+      void schedule_window();
+      void run_window();
+
+      chain::controller&                                              chain;
+      const fc::microseconds                                          window;
+      const fc::microseconds                                          max_trx_time;
+      const uint32_t                                                  max_queued;
+      std::vector<std::shared_ptr<chain::controller::read_only_thread_state>> thread_states;
+      chain::named_thread_pool                                        thread_pool;
+      boost::asio::steady_timer                                       retry_timer;
+      std::deque<queued_trx>                                          queue;
+      bool                                                            window_scheduled = false;
+      bool                                                            stopped = false;
+   };
+
+}
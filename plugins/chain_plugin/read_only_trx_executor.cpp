@@ -0,0 +1,136 @@
+#include <eosio/chain_plugin/read_only_trx_executor.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <appbase/application.hpp>
+
+#include <atomic>
+
+namespace eosio {
+
+using namespace eosio::chain;
+using namespace appbase;
+
+read_only_trx_executor::read_only_trx_executor( controller& chain, uint16_t threads, fc::microseconds window,
+                                                fc::microseconds max_trx_time, uint32_t max_queued )
+: chain( chain )
+, window( window )
+, max_trx_time( max_trx_time )
+, max_queued( max_queued )
+, thread_pool( "rdonly", threads )
+, retry_timer( app().get_io_service() )
+{
+   EOS_ASSERT( max_trx_time <= window, plugin_config_exception,
+               "read-only transaction time ${t}us exceeds the window of ${w}us", ("t", max_trx_time.count())("w", window.count()) );
+   thread_states.reserve( threads );
+   for( uint16_t i = 0; i < threads; ++i )
+      thread_states.emplace_back( chain.create_read_only_thread_state() );
+}
+
+read_only_trx_executor::~read_only_trx_executor() {
+   stop();
+}
+
+void read_only_trx_executor::stop() {
+   if( stopped ) return;
+   stopped = true;
+   retry_timer.cancel();
+   thread_pool.stop();
+   thread_states.clear();
+   for( auto& q : queue ) {
+      try {
+         EOS_THROW( tx_resource_exhaustion, "read-only transaction not executed, node shutting down" );
+      } CATCH_AND_CALL( q.next );
+   }
+   queue.clear();
+}
+
+void read_only_trx_executor::execute( const transaction_metadata_ptr& trx, next_function next ) {
+   try {
+      EOS_ASSERT( !stopped, tx_resource_exhaustion, "read-only transactions are not executed, node shutting down" );
+      const auto read_mode = chain.get_read_mode();
+      EOS_ASSERT( read_mode != db_read_mode::IRREVERSIBLE && read_mode != db_read_mode::READ_ONLY, unsupported_feature,
+                  "read-only transactions are not supported in read-mode ${m}", ("m", static_cast<uint32_t>(read_mode)) );
+      EOS_ASSERT( queue.size() < max_queued, tx_resource_exhaustion,
+                  "read-only transaction queue full, ${n} transactions waiting", ("n", queue.size()) );
+      queue.push_back( queued_trx{ trx, std::move( next ) } );
+      schedule_window();
+   } CATCH_AND_CALL( next );
+}
+
+void read_only_trx_executor::schedule_window() {
+   if( window_scheduled || stopped || queue.empty() ) return;
+   window_scheduled = true;
+   app().post( priority::low, [weak = weak_from_this()]() {
+      if( auto self = weak.lock() ) {
+         self->window_scheduled = false;
+         self->run_window();
+      }
+   } );
+}
+
+void read_only_trx_executor::run_window() {
+   if( stopped || queue.empty() ) return;
+
+   // no pending block between blocks or while syncing, try again shortly
+   if( !chain.is_building_block() ) {
+      window_scheduled = true;
+      retry_timer.expires_from_now( std::chrono::milliseconds( 1 ) );
+      retry_timer.async_wait( [weak = weak_from_this()]( const boost::system::error_code& ec ) {
+         auto self = weak.lock();
+         if( !self ) return;
+         self->window_scheduled = false;
+         if( !ec ) self->run_window();
+      } );
+      return;
+   }
+
+   using result_type = fc::static_variant<fc::exception_ptr, transaction_trace_ptr>;
+   std::vector<queued_trx> batch( std::make_move_iterator( queue.begin() ), std::make_move_iterator( queue.end() ) );
+   queue.clear();
+   std::vector<result_type> results( batch.size() );
+   std::vector<char> cut_off( batch.size(), false ); // not vector<bool>, written from several threads
+   std::atomic<size_t> next_index{ 0 };
+   const auto window_end = fc::time_point::now() + window;
+
+   // the main thread waits below, so nothing changes chainbase while the threads read it
+   std::vector<std::future<void>> tasks;
+   tasks.reserve( thread_states.size() );
+   for( auto& state : thread_states ) {
+      tasks.emplace_back( async_thread_pool( thread_pool.get_executor(), [&, state = state.get()]() {
+         while( fc::time_point::now() < window_end ) {
+            const size_t i = next_index++;
+            if( i >= batch.size() ) break;
+            auto set_result = [&results, i]( result_type r ) { results[i] = std::move( r ); };
+            try {
+               // never run past the window, a transaction the window cuts short gets another try in the next one
+               const auto trx_deadline = fc::time_point::now() + max_trx_time;
+               const bool window_deadline = window_end < trx_deadline && !batch[i].carried;
+               auto trace = chain.push_read_only_transaction( batch[i].trx, window_deadline ? window_end : trx_deadline, *state );
+               cut_off[i] = window_deadline && trace->except && trace->except->code() == deadline_exception::code_value;
+               results[i] = std::move( trace );
+            } CATCH_AND_CALL( set_result );
+         }
+      } ) );
+   }
+   for( auto& t : tasks )
+      t.wait();
+
+   // indexes below next_index were claimed, and every claimed index was executed
+   const size_t claimed = std::min<size_t>( next_index.load(), batch.size() );
+   std::vector<queued_trx> carried;
+   for( size_t i = 0; i < claimed; ++i ) {
+      if( cut_off[i] ) {
+         batch[i].carried = true;
+         carried.push_back( std::move( batch[i] ) );
+      } else {
+         batch[i].next( std::move( results[i] ) );
+      }
+   }
+   // the next window starts with the transactions cut short, given all of max_trx_time, then those not started
+   queue.insert( queue.begin(), std::make_move_iterator( batch.begin() + claimed ), std::make_move_iterator( batch.end() ) );
+   queue.insert( queue.begin(), std::make_move_iterator( carried.begin() ), std::make_move_iterator( carried.end() ) );
+
+   schedule_window();
+}
+
+} // namespace eosio
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <eosio/net_plugin/protocol.hpp>
+#include <eosio/chain/merkle.hpp>
+
+#include <functional>
+#include <vector>
+
+namespace eosio {
+
+   /// b with its packed transactions replaced by their short ids
+   inline compact_block_message make_compact_block( const chain::signed_block& b ) {
+      compact_block_message msg;
+      msg.header = b;
+      msg.block_extensions = b.block_extensions;
+      msg.transactions.reserve( b.transactions.size() );
+      for( const auto& r : b.transactions ) {
+         compact_transaction_receipt cr;
+         static_cast<chain::transaction_receipt_header&>( cr ) = r;
+         if( r.trx.contains<chain::transaction_id_type>() ) {
+            cr.trx = r.trx.get<chain::transaction_id_type>();
+         } else {
+            cr.trx = r.trx.get<chain::packed_transaction>().id()._hash[0];
+         }
+         msg.transactions.push_back( std::move( cr ) );
+      }
+      return msg;
+   }
+
+   /**
+    * Rebuild the block of a compact block, taking its packed transactions from find_trx by short id. The positions
+    * of those find_trx does not return are appended to missing, they hold an empty packed_transaction until
+    * fill_compact_block.
+    */
+   inline chain::signed_block_ptr expand_compact_block( compact_block_message&& msg,
+                                                        const std::function<chain::packed_transaction_ptr( uint64_t )>& find_trx,
+                                                        std::vector<uint32_t>& missing ) {
+      chain::signed_block_ptr b = std::make_shared<chain::signed_block>( msg.header );
+      b->block_extensions = std::move( msg.block_extensions );
+      b->transactions.reserve( msg.transactions.size() );
+      for( auto& cr : msg.transactions ) {
+         chain::transaction_receipt r;
+         static_cast<chain::transaction_receipt_header&>( r ) = cr;
+         if( cr.trx.contains<chain::transaction_id_type>() ) {
+            r.trx = std::move( cr.trx.get<chain::transaction_id_type>() );
+         } else {
+            chain::packed_transaction_ptr trx = find_trx( cr.trx.get<uint64_t>() );
+            if( trx ) {
+               r.trx = *trx;
+            } else {
+               r.trx = chain::packed_transaction();
+               missing.push_back( b->transactions.size() );
+            }
+         }
+         b->transactions.push_back( std::move( r ) );
+      }
+      return b;
+   }
+
+   /**
+    * Put the transactions of a compact_block_transactions_message at the missing positions of b.
+    * @return false, leaving b unchanged, if there is not exactly one transaction per missing position
+    */
+   inline bool fill_compact_block( chain::signed_block& b, const std::vector<uint32_t>& missing,
+                                   const std::vector<chain::packed_transaction>& transactions ) {
+      if( transactions.size() != missing.size() ) return false;
+      for( uint32_t i : missing ) {
+         if( i >= b.transactions.size() ) return false;
+      }
+      for( size_t i = 0; i < missing.size(); ++i ) {
+         b.transactions[missing[i]].trx = transactions[i];
+      }
+      return true;
+   }
+
+   /// a short id that matched the wrong transaction shows up as a different transaction merkle root
+   inline bool transaction_mroot_matches( const chain::signed_block& b ) {
+      std::vector<chain::digest_type> digests;
+      digests.reserve( b.transactions.size() );
+      for( const auto& r : b.transactions ) {
+         digests.emplace_back( r.digest() );
+      }
+      return chain::merkle( std::move( digests ) ) == b.transaction_mroot;
+   }
+
+}
@@ -135,6 +135,34 @@ namespace eosio {
       uint32_t end_block{0};
    };
 
+   struct compact_transaction_receipt : transaction_receipt_header {
+      /// the id of a deferred transaction, or the first 8 bytes of the id of a packed transaction
+      static_variant<transaction_id_type, uint64_t> trx;
+   };
+
+   /**
+    * A block with its packed transactions replaced by short ids, sent instead of signed_block to peers of
+    * protocol version proto_compact_blocks or later. Peers usually received the transactions of a new block
+    * before the block itself, so the receiver fills them in and asks for the others with a
+    * compact_block_request_message. A block whose transaction merkle root does not match after being filled in
+    * is requested in full.
+    */
+   struct compact_block_message {
+      signed_block_header                 header;
+      vector<compact_transaction_receipt> transactions;
+      extensions_type                     block_extensions;
+   };
+
+   struct compact_block_request_message {
+      block_id_type    id;
+      vector<uint32_t> indexes; ///< positions in compact_block_message::transactions of the missing transactions
+   };
+
+   struct compact_block_transactions_message {
+      block_id_type              id;
+      vector<packed_transaction> transactions; ///< in the order of compact_block_request_message::indexes
+   };
+
    using net_message = static_variant<handshake_message,
                                       chain_size_message,
                                       go_away_message,
@@ -142,8 +170,11 @@ namespace eosio {
                                       notice_message,
                                       request_message,
                                       sync_request_message,
-                                      signed_block,         // which = 7
-                                      packed_transaction>;  // which = 8
+                                      signed_block,                         // which = 7
+                                      packed_transaction,                   // which = 8
+                                      compact_block_message,                // which = 9
+                                      compact_block_request_message,        // which = 10
+                                      compact_block_transactions_message>;  // which = 11
 
 } // namespace eosio
 
@@ -162,6 +193,10 @@ FC_REFLECT( eosio::time_message, (org)(rec)(xmt)(dst) )
 FC_REFLECT( eosio::notice_message, (known_trx)(known_blocks) )
 FC_REFLECT( eosio::request_message, (req_trx)(req_blocks) )
 FC_REFLECT( eosio::sync_request_message, (start_block)(end_block) )
+FC_REFLECT_DERIVED( eosio::compact_transaction_receipt, (eosio::chain::transaction_receipt_header), (trx) )
+FC_REFLECT( eosio::compact_block_message, (header)(transactions)(block_extensions) )
+FC_REFLECT( eosio::compact_block_request_message, (id)(indexes) )
+FC_REFLECT( eosio::compact_block_transactions_message, (id)(transactions) )
 
 /**
  *
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace eosio {
+
+   /**
+    * Block ranges requested from several peers at once while syncing to the last irreversible block, and the
+    * blocks received for them.
+    *
+    * Ranges of span blocks are handed out in order to idle peers, fastest first, with at most max_requests of
+    * them outstanding. Blocks arrive out of order across peers and are kept until all blocks before them have
+    * arrived, so they can be applied in order. Only blocks within max_requests * span of the next block to
+    * apply are accepted, which bounds the blocks kept. The rest of the range of a peer that disconnects, or
+    * that delivers nothing for request_timeout, is requested again from another peer.
+    *
+    * Peers are identified by connection id. Not thread safe.
+    */
+   template<typename Block>
+   class sync_window {
+   public:
+      struct request {
+         uint32_t peer;
+         uint32_t start;
+         uint32_t end;
+      };
+
+      sync_window( uint32_t span, uint32_t max_requests, fc::microseconds request_timeout )
+      : span( std::max( span, 1u ) )
+      , max_requests( std::max( max_requests, 1u ) )
+      , request_timeout( request_timeout ) {}
+
+      /// start over at block num next, forgetting outstanding requests and received blocks
+      void reset( uint32_t next ) {
+         next_num = next;
+         next_unrequested = next;
+         outstanding.clear();
+         unassigned.clear();
+         received.clear();
+      }
+
+      void set_target( uint32_t target ) { target_num = std::max( target_num, target ); }
+
+      uint32_t target()const        { return target_num; }
+      uint32_t next()const          { return next_num; }
+      bool     done()const          { return next_num > target_num; }
+      size_t   buffered()const      { return received.size(); }
+      size_t   requests()const      { return outstanding.size(); }
+      uint32_t window_blocks()const { return span * max_requests; }
+
+      bool has_request( uint32_t peer )const { return outstanding.count( peer ) != 0; }
+
+      /// the highest block num requested so far
+      uint32_t last_requested()const { return next_unrequested - 1; }
+
+      /**
+       * Hand out ranges to the idle peers among peers until max_requests are outstanding or the window is full.
+       * Ranges of stalled peers are taken back first, and ranges taken back are handed out before new ones.
+       */
+      std::vector<request> assign( const std::vector<uint32_t>& peers, const fc::time_point& now ) {
+         for( auto itr = outstanding.begin(); itr != outstanding.end(); ) {
+            if( now - std::max( itr->second.requested_at, itr->second.last_block_at ) > request_timeout ) {
+               // remember the peer as slow so it is only used when no faster peer is idle
+               latency[itr->first] = std::max( latency[itr->first], request_timeout.count() );
+               take_back( itr->second );
+               itr = outstanding.erase( itr );
+            } else {
+               ++itr;
+            }
+         }
+
+         std::vector<uint32_t> idle;
+         for( auto p : peers ) {
+            if( !outstanding.count( p ) ) idle.push_back( p );
+         }
+         // peers not heard from yet have no latency and are tried first
+         std::stable_sort( idle.begin(), idle.end(), [this]( uint32_t a, uint32_t b ) {
+            return latency_of( a ) < latency_of( b );
+         } );
+
+         std::vector<request> result;
+         for( auto p : idle ) {
+            if( outstanding.size() >= max_requests ) break;
+            uint32_t start = 0, end = 0;
+            if( !unassigned.empty() ) {
+               start = std::max( unassigned.begin()->first, next_num );
+               end = unassigned.begin()->second;
+               unassigned.erase( unassigned.begin() );
+            } else {
+               if( next_unrequested > target_num || next_unrequested >= next_num + window_blocks() ) break;
+               start = next_unrequested;
+               end = std::min( { start + span - 1, target_num, next_num + window_blocks() - 1 } );
+               next_unrequested = end + 1;
+            }
+            outstanding[p] = outstanding_request{ start, end, start, now, fc::time_point() };
+            result.push_back( request{ p, start, end } );
+         }
+         return result;
+      }
+
+      /**
+       * Keep a block received from peer.
+       * @return false if the block was not wanted: already applied or received, or outside the window
+       */
+      bool receive( uint32_t peer, uint32_t num, Block b, const fc::time_point& now ) {
+         auto itr = outstanding.find( peer );
+         if( itr != outstanding.end() && num >= itr->second.next && num <= itr->second.end ) {
+            auto& r = itr->second;
+            r.next = num + 1;
+            r.last_block_at = now;
+            if( num == r.end ) {
+               const int64_t per_block = ( now - r.requested_at ).count() / ( r.end - r.start + 1 );
+               auto& l = latency[peer];
+               l = l == 0 ? per_block : ( 3 * l + per_block ) / 4;
+               outstanding.erase( itr );
+            }
+         }
+         if( num < next_num || num > target_num || num >= next_num + window_blocks() ) return false;
+         return received.emplace( num, std::move( b ) ).second;
+      }
+
+      /// remove and return the received blocks that can be applied now, in block order
+      std::vector<Block> pop_ready() {
+         std::vector<Block> result;
+         auto itr = received.begin();
+         while( itr != received.end() && itr->first == next_num ) {
+            result.push_back( std::move( itr->second ) );
+            itr = received.erase( itr );
+            ++next_num;
+         }
+         // a range taken back may have been completed meanwhile by its original peer
+         while( !unassigned.empty() && unassigned.begin()->second < next_num ) {
+            unassigned.erase( unassigned.begin() );
+         }
+         return result;
+      }
+
+      /// take back the rest of the range requested from a peer that went away
+      void release( uint32_t peer ) {
+         auto itr = outstanding.find( peer );
+         if( itr == outstanding.end() ) return;
+         take_back( itr->second );
+         outstanding.erase( itr );
+      }
+
+      /// microseconds per block of the last ranges received from peer, 0 if unknown
+      int64_t latency_of( uint32_t peer )const {
+         auto itr = latency.find( peer );
+         return itr == latency.end() ? 0 : itr->second;
+      }
+
+   private:
+      struct outstanding_request {
+         uint32_t       start;
+         uint32_t       end;
+         uint32_t       next; ///< next block expected, peers send a range in order
+         fc::time_point requested_at;
+         fc::time_point last_block_at;
+      };
+
+      void take_back( const outstanding_request& r ) {
+         uint32_t start = std::max( r.next, next_num );
+         while( start <= r.end && received.count( start ) ) ++start;
+         if( start <= r.end ) unassigned[start] = r.end;
+      }
+
+      const uint32_t         span;
+      const uint32_t         max_requests;
+      const fc::microseconds request_timeout;
+
+      uint32_t next_num = 1;         ///< next block to apply
+      uint32_t next_unrequested = 1; ///< first block of the next new range
+      uint32_t target_num = 0;       ///< last block to sync
+
+      std::map<uint32_t, outstanding_request> outstanding; ///< by peer
+      std::map<uint32_t, uint32_t>            unassigned;  ///< ranges taken back, start to end
+      std::map<uint32_t, Block>               received;    ///< by block num
+      std::map<uint32_t, int64_t>             latency;     ///< microseconds per block by peer
+   };
+
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <eosio/chain/types.hpp>
+#include <eosio/chain/multi_index_includes.hpp>
+#include <eosio/chain/transaction.hpp>
+
+#include <fc/time.hpp>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace eosio {
+
+   struct node_transaction_state {
+      chain::transaction_id_type id;
+      fc::time_point_sec  expires;        /// time after which this may be purged.
+      uint32_t            block_num = 0;  /// block transaction was included in
+      uint32_t            connection_id = 0;
+      chain::packed_transaction_ptr trx;  /// kept to fill in compact blocks until included in a block, may be empty
+
+      /// the first 8 bytes of the id, see compact_block_message
+      uint64_t short_id()const { return id._hash[0]; }
+   };
+
+   struct by_expiry;
+   struct by_block_num;
+   struct by_short_id;
+
+   typedef boost::multi_index_container<
+      node_transaction_state,
+      indexed_by<
+         ordered_unique<
+            tag<by_id>,
+            composite_key< node_transaction_state,
+               member<node_transaction_state, chain::transaction_id_type, &node_transaction_state::id>,
+               member<node_transaction_state, uint32_t, &node_transaction_state::connection_id>
+            >,
+            composite_key_compare< chain::sha256_less, std::less<uint32_t> >
+         >,
+         ordered_non_unique<
+            tag< by_expiry >,
+            member< node_transaction_state, fc::time_point_sec, &node_transaction_state::expires > >,
+         ordered_non_unique<
+            tag<by_block_num>,
+            member< node_transaction_state, uint32_t, &node_transaction_state::block_num > >,
+         ordered_non_unique<
+            tag<by_short_id>,
+            const_mem_fun< node_transaction_state, uint64_t, &node_transaction_state::short_id > >
+         >
+      >
+   node_transaction_index;
+
+   /**
+    * The transactions received from each connection, used to avoid sending a transaction back to a peer that
+    * already has it.
+    *
+    * Entries are spread over shards by transaction id, each a node_transaction_index with its own mutex, so that
+    * connection strands receiving different transactions rarely wait on each other. Calls about one transaction
+    * lock only its shard; calls about many (the transactions of a block, expiry) lock each shard once for the
+    * whole batch. All member functions are thread safe.
+    */
+   class transaction_dedup_index {
+   public:
+      static constexpr size_t default_shard_count = 32;
+
+      /// shard_count is rounded up to a power of two
+      explicit transaction_dedup_index( size_t shard_count = default_shard_count ) {
+         size_t n = 1;
+         while( n < shard_count ) n <<= 1;
+         shards.reset( new shard[n] );
+         shard_mask = n - 1;
+      }
+
+      size_t shard_count()const { return shard_mask + 1; }
+
+      /// @return false if the connection already had the transaction
+      bool add( const node_transaction_state& nts ) {
+         auto& s = shard_for( nts.id );
+         std::lock_guard<std::mutex> g( s.mtx );
+         return s.txns.insert( nts ).second;
+      }
+
+      bool has( const chain::transaction_id_type& id, uint32_t connection_id )const {
+         const auto& s = shard_for( id );
+         std::lock_guard<std::mutex> g( s.mtx );
+         return s.txns.find( std::make_tuple( std::cref( id ), connection_id ) ) != s.txns.end();
+      }
+
+      /// true if any connection has the transaction
+      bool has( const chain::transaction_id_type& id )const {
+         const auto& s = shard_for( id );
+         std::lock_guard<std::mutex> g( s.mtx );
+         return s.txns.find( id ) != s.txns.end();
+      }
+
+      /// a received transaction whose id starts with short_id, if any
+      chain::packed_transaction_ptr find_transaction( uint64_t short_id )const {
+         const auto& s = shards[short_id & shard_mask];
+         std::lock_guard<std::mutex> g( s.mtx );
+         auto range = s.txns.get<by_short_id>().equal_range( short_id );
+         for( auto itr = range.first; itr != range.second; ++itr ) {
+            if( itr->trx ) return itr->trx;
+         }
+         return chain::packed_transaction_ptr();
+      }
+
+      void update_block_num( const chain::transaction_id_type& id, uint32_t block_num ) {
+         auto& s = shard_for( id );
+         std::lock_guard<std::mutex> g( s.mtx );
+         set_block_num( s, id, block_num );
+      }
+
+      /// update the transactions of a block, locking each shard at most once
+      void update_block_num( const std::vector<chain::transaction_id_type>& ids, uint32_t block_num ) {
+         std::vector<std::vector<const chain::transaction_id_type*>> by_shard( shard_count() );
+         for( const auto& id : ids ) {
+            by_shard[shard_index( id )].push_back( &id );
+         }
+         for( size_t i = 0; i < by_shard.size(); ++i ) {
+            if( by_shard[i].empty() ) continue;
+            auto& s = shards[i];
+            std::lock_guard<std::mutex> g( s.mtx );
+            for( const auto* id : by_shard[i] ) {
+               set_block_num( s, *id, block_num );
+            }
+         }
+      }
+
+      /**
+       * Remove the transactions that expired by now and those included in blocks up to lib_num, one shard at a
+       * time so that other threads are not blocked for the whole sweep.
+       * @return the number of entries removed
+       */
+      size_t expire( const fc::time_point_sec& now, uint32_t lib_num ) {
+         size_t removed = 0;
+         for( size_t i = 0; i < shard_count(); ++i ) {
+            auto& s = shards[i];
+            std::lock_guard<std::mutex> g( s.mtx );
+            const auto start_size = s.txns.size();
+            auto& old = s.txns.get<by_expiry>();
+            old.erase( old.lower_bound( fc::time_point_sec( 0 ) ), old.upper_bound( now ) );
+            auto& stale = s.txns.get<by_block_num>();
+            stale.erase( stale.lower_bound( 1 ), stale.upper_bound( lib_num ) );
+            removed += start_size - s.txns.size();
+         }
+         return removed;
+      }
+
+      size_t size()const {
+         size_t result = 0;
+         for( size_t i = 0; i < shard_count(); ++i ) {
+            std::lock_guard<std::mutex> g( shards[i].mtx );
+            result += shards[i].txns.size();
+         }
+         return result;
+      }
+
+   private:
+      // aligned so that the mutexes of neighbouring shards do not share a cache line
+      struct alignas(64) shard {
+         mutable std::mutex     mtx;
+         node_transaction_index txns;
+      };
+
+      // a transaction in a block or rejected is no longer needed for compact blocks, only its id is kept until lib
+      static void set_block_num( shard& s, const chain::transaction_id_type& id, uint32_t block_num ) {
+         auto range = s.txns.equal_range( id );
+         for( auto itr = range.first; itr != range.second; ++itr ) {
+            s.txns.modify( itr, [block_num]( node_transaction_state& nts ) {
+               nts.block_num = block_num;
+               nts.trx.reset();
+            } );
+         }
+      }
+
+      size_t shard_index( const chain::transaction_id_type& id )const {
+         // transaction ids are hashes, so any of their words spreads evenly; the first is also the short id
+         return id._hash[0] & shard_mask;
+      }
+
+      shard&       shard_for( const chain::transaction_id_type& id )       { return shards[shard_index( id )]; }
+      const shard& shard_for( const chain::transaction_id_type& id )const { return shards[shard_index( id )]; }
+
+      std::unique_ptr<shard[]> shards;
+      size_t                   shard_mask = 0;
+   };
+
+}
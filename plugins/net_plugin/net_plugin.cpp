@@ -2,9 +2,13 @@
 
 #include <eosio/net_plugin/net_plugin.hpp>
 #include <eosio/net_plugin/protocol.hpp>
+#include <eosio/net_plugin/compact_block.hpp>
+#include <eosio/net_plugin/transaction_dedup_index.hpp>
+#include <eosio/net_plugin/sync_window.hpp>
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <eosio/chain/block.hpp>
+#include <eosio/chain/merkle.hpp>
 #include <eosio/chain/plugin_interface.hpp>
 #include <eosio/chain/thread_utils.hpp>
 #include <eosio/producer_plugin/producer_plugin.hpp>
@@ -23,6 +27,7 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/ip/host_name.hpp>
 #include <boost/asio/steady_timer.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
 
 #include <atomic>
 #include <shared_mutex>
@@ -59,37 +64,6 @@ namespace eosio {
       }
    }
 
-   struct node_transaction_state {
-      transaction_id_type id;
-      time_point_sec  expires;        /// time after which this may be purged.
-      uint32_t        block_num = 0;  /// block transaction was included in
-      uint32_t        connection_id = 0;
-   };
-
-   struct by_expiry;
-   struct by_block_num;
-
-   typedef multi_index_container<
-      node_transaction_state,
-      indexed_by<
-         ordered_unique<
-            tag<by_id>,
-            composite_key< node_transaction_state,
-               member<node_transaction_state, transaction_id_type, &node_transaction_state::id>,
-               member<node_transaction_state, uint32_t, &node_transaction_state::connection_id>
-            >,
-            composite_key_compare< sha256_less, std::less<uint32_t> >
-         >,
-         ordered_non_unique<
-            tag< by_expiry >,
-            member< node_transaction_state, fc::time_point_sec, &node_transaction_state::expires > >,
-         ordered_non_unique<
-            tag<by_block_num>,
-            member< node_transaction_state, uint32_t, &node_transaction_state::block_num > >
-         >
-      >
-   node_transaction_index;
-
    struct peer_block_state {
       block_id_type id;
       uint32_t      block_num = 0;
@@ -98,6 +72,7 @@ namespace eosio {
    };
 
    struct by_block_id;
+   struct by_lru;
 
    typedef multi_index_container<
       eosio::peer_block_state,
@@ -121,12 +96,11 @@ namespace eosio {
       > peer_block_state_index;
 
 
-   struct update_block_num {
-      uint32_t new_bnum;
-      update_block_num(uint32_t bnum) : new_bnum(bnum) {}
-      void operator() (node_transaction_state& nts) {
-         nts.block_num = new_bnum;
-      }
+   /// a block received while syncing, kept until the blocks before it arrive
+   struct sync_block {
+      connection_ptr   c;
+      block_id_type    id;
+      signed_block_ptr block; ///< empty if the block was already received
    };
 
    class sync_manager {
@@ -142,7 +116,9 @@ namespace eosio {
       uint32_t       sync_last_requested_num{0};
       uint32_t       sync_next_expected_num{0};
       uint32_t       sync_req_span{0};
+      const uint32_t sync_parallel_requests{1};
       connection_ptr sync_source;
+      sync_window<sync_block> sync_ranges; ///< used instead of sync_source when sync_parallel_requests > 1
       std::atomic<stages> sync_state{in_sync};
 
    private:
@@ -150,13 +126,16 @@ namespace eosio {
       void set_state( stages s );
       bool is_sync_required( uint32_t fork_head_block_num );
       void request_next_chunk( std::unique_lock<std::mutex> g_sync, const connection_ptr& conn = connection_ptr() );
+      void request_next_ranges( std::unique_lock<std::mutex> g_sync );
       void start_sync( const connection_ptr& c, uint32_t target );
       bool verify_catchup( const connection_ptr& c, uint32_t num, const block_id_type& id );
 
    public:
-      explicit sync_manager( uint32_t span );
+      sync_manager( uint32_t span, uint32_t parallel_requests );
       static void send_handshakes();
       bool syncing_with_peer() const { return sync_state == lib_catchup; }
+      bool parallel_sync() const { return sync_parallel_requests > 1; }
+      bool buffer_sync_block( const connection_ptr& c, const block_id_type& blk_id, uint32_t blk_num, const signed_block_ptr& b );
       void sync_reset_lib_num( const connection_ptr& conn );
       void sync_reassign_fetch( const connection_ptr& c, go_away_reason reason );
       void rejected_block( const connection_ptr& c, uint32_t blk_num );
@@ -166,11 +145,46 @@ namespace eosio {
       void sync_recv_notice( const connection_ptr& c, const notice_message& msg );
    };
 
+   using send_buffer_type = std::shared_ptr<std::vector<char>>;
+
+   struct block_buffer_state {
+      block_id_type    id;
+      send_buffer_type buffer;
+   };
+
+   typedef multi_index_container<
+      block_buffer_state,
+      indexed_by<
+         ordered_unique< tag<by_block_id>, member<block_buffer_state, block_id_type, &block_buffer_state::id>, sha256_less >,
+         bmi::sequenced< tag<by_lru> >
+      >
+   > block_buffer_index;
+
+   /**
+    * Ready to send signed_block messages keyed by block id. A block is serialized once, either from the
+    * accepted block or copied straight from the packed bytes in the block log, and every connection that
+    * sends it enqueues the same buffer. Least recently used buffers are dropped past max_bytes.
+    * Thread safe.
+    */
+   class block_buffer_cache {
+      mutable std::mutex  mtx;
+      block_buffer_index  buffers;
+      size_t              cached_bytes = 0;
+      const size_t        max_bytes;
+
+   public:
+      explicit block_buffer_cache( size_t max_bytes )
+      : max_bytes( max_bytes ) {}
+
+      send_buffer_type get( const block_id_type& id );
+      // returns the cached buffer if another thread added one first, otherwise buffer
+      send_buffer_type add( const block_id_type& id, const send_buffer_type& buffer );
+   };
+
    class dispatch_manager {
       mutable std::mutex      blk_state_mtx;
       peer_block_state_index  blk_state;
-      mutable std::mutex      local_txns_mtx;
-      node_transaction_index  local_txns;
+      transaction_dedup_index local_txns;
 
    public:
       boost::asio::io_context::strand  strand;
@@ -178,7 +192,7 @@ namespace eosio {
       explicit dispatch_manager(boost::asio::io_context& io_context)
       : strand( io_context ) {}
 
-      void bcast_transaction(const packed_transaction& trx);
+      void bcast_transaction(const packed_transaction_ptr& trx);
       void rejected_transaction(const packed_transaction_ptr& trx, uint32_t head_blk_num);
       void bcast_block( const signed_block_ptr& b, const block_id_type& id );
       void bcast_notice( const block_id_type& id );
@@ -199,6 +213,7 @@ namespace eosio {
       void update_txns_block_num( const transaction_id_type& id, uint32_t blk_num );
       bool peer_has_txn( const transaction_id_type& tid, uint32_t connection_id ) const;
       bool have_txn( const transaction_id_type& tid ) const;
+      packed_transaction_ptr find_txn( uint64_t short_id ) const;
       void expire_txns( uint32_t lib_num );
    };
 
@@ -209,6 +224,7 @@ namespace eosio {
 
       unique_ptr< sync_manager >       sync_master;
       unique_ptr< dispatch_manager >   dispatcher;
+      unique_ptr< block_buffer_cache > block_buffers;
 
       /**
        * Thread safe, only updated in plugin initialize
@@ -373,6 +389,9 @@ namespace eosio {
 
    static net_plugin_impl *my_impl;
 
+   static send_buffer_type create_send_buffer( const signed_block_ptr& sb );
+   static send_buffer_type fetch_block_send_buffer( uint32_t block_num );
+
    /**
     * default value initializers
     */
@@ -387,11 +406,15 @@ namespace eosio {
    constexpr auto     def_conn_retry_wait = 30;
    constexpr auto     def_txn_expire_wait = std::chrono::seconds(3);
    constexpr auto     def_resp_expected_wait = std::chrono::seconds(5);
+   constexpr auto     def_compact_block_wait = std::chrono::milliseconds(500); // then the full block is requested
    constexpr auto     def_sync_fetch_span = 100;
+   constexpr auto     def_sync_parallel_requests = 1;
+   constexpr auto     def_block_buffer_cache_size_mb = 64;
 
    constexpr auto     message_header_size = 4;
    constexpr uint32_t signed_block_which = 7;        // see protocol net_message
    constexpr uint32_t packed_transaction_which = 8;  // see protocol net_message
+   constexpr uint32_t compact_block_which = 9;       // see protocol net_message
 
    /**
     *  For a while, network version was a 16 bit value equal to the second set of 16 bits
@@ -414,8 +437,9 @@ namespace eosio {
    constexpr uint16_t proto_base = 0;
    constexpr uint16_t proto_explicit_sync = 1;
    constexpr uint16_t block_id_notify = 2; // reserved. feature was removed. next net_version should be 3
+   constexpr uint16_t proto_compact_blocks = 3; // compact_block_message relay of new blocks
 
-   constexpr uint16_t net_version = proto_explicit_sync;
+   constexpr uint16_t net_version = proto_compact_blocks;
 
    /**
     * Index by start_block_num
@@ -574,7 +598,7 @@ namespace eosio {
       int16_t                 sent_handshake_count = 0;
       std::atomic<bool>       connecting{true};
       std::atomic<bool>       syncing{false};
-      uint16_t                protocol_version = 0;
+      std::atomic<uint16_t>   protocol_version = 0; // read by bcast_block off the strand
       uint16_t                consecutive_rejected_blocks = 0;
       std::atomic<uint16_t>   consecutive_immediate_connection_close = 0;
 
@@ -583,6 +607,16 @@ namespace eosio {
 
       std::atomic<go_away_reason>           no_retry{no_reason};
 
+      /// a compact block waiting for the transactions requested from the peer, only accessed from strand
+      struct pending_compact_block {
+         block_id_type        id;
+         signed_block_ptr     block;
+         vector<uint32_t>     missing;
+      };
+      optional<pending_compact_block> pending_compact;
+      /// requests the full block if the transactions of pending_compact do not arrive in time
+      boost::asio::steady_timer       compact_block_timer;
+
       mutable std::mutex          conn_mtx; //< mtx for last_req .. local_endpoint_port
       optional<request_message>   last_req;
       handshake_message           last_handshake_recv;
@@ -666,7 +700,7 @@ namespace eosio {
       void stop_send();
 
       void enqueue( const net_message &msg );
-      void enqueue_block( const signed_block_ptr& sb, bool to_sync_queue = false);
+      void enqueue_block( const send_buffer_type& send_buffer, uint32_t block_num, bool to_sync_queue = false);
       void enqueue_buffer( const std::shared_ptr<std::vector<char>>& send_buffer,
                            go_away_reason close_after_send,
                            bool to_sync_queue = false);
@@ -713,6 +747,13 @@ namespace eosio {
       void handle_message( const block_id_type& id, signed_block_ptr msg );
       void handle_message( const packed_transaction& msg ) = delete; // packed_transaction_ptr overload used instead
       void handle_message( packed_transaction_ptr msg );
+      void handle_message( const block_id_type& id, compact_block_message&& msg );
+      void handle_message( const compact_block_request_message& msg );
+      void handle_message( const compact_block_transactions_message& msg );
+
+      void finish_compact_block( const block_id_type& id, signed_block_ptr b );
+      void compact_block_timeout( const block_id_type& id, boost::system::error_code ec );
+      void request_block( const block_id_type& id );
 
       void process_signed_block( const block_id_type& id, signed_block_ptr msg );
 
@@ -783,6 +824,18 @@ namespace eosio {
          fc_dlog( logger, "handle sync_request_message" );
          c->handle_message( msg );
       }
+
+      void operator()( const compact_block_request_message& msg ) const {
+         // continue call to handle_message on connection strand
+         fc_dlog( logger, "handle compact_block_request_message" );
+         c->handle_message( msg );
+      }
+
+      void operator()( const compact_block_transactions_message& msg ) const {
+         // continue call to handle_message on connection strand
+         fc_dlog( logger, "handle compact_block_transactions_message" );
+         c->handle_message( msg );
+      }
    };
 
    template<typename Function>
@@ -810,6 +863,7 @@ namespace eosio {
         socket( new tcp::socket( my_impl->thread_pool->get_executor() ) ),
         connection_id( ++my_impl->current_connection_id ),
         response_expected_timer( my_impl->thread_pool->get_executor() ),
+        compact_block_timer( my_impl->thread_pool->get_executor() ),
         last_handshake_recv(),
         last_handshake_sent()
    {
@@ -822,6 +876,7 @@ namespace eosio {
         socket( new tcp::socket( my_impl->thread_pool->get_executor() ) ),
         connection_id( ++my_impl->current_connection_id ),
         response_expected_timer( my_impl->thread_pool->get_executor() ),
+        compact_block_timer( my_impl->thread_pool->get_executor() ),
         last_handshake_recv(),
         last_handshake_sent()
    {
@@ -938,6 +993,8 @@ namespace eosio {
          my_impl->dispatcher->retry_fetch( self->shared_from_this() );
       }
       self->peer_requested.reset();
+      self->pending_compact.reset();
+      self->compact_block_timer.cancel();
       self->sent_handshake_count = 0;
       if( !shutdown) my_impl->sync_master->sync_reset_lib_num( self->shared_from_this() );
       fc_ilog( logger, "closing '${a}', ${p}", ("a", self->peer_address())("p", self->peer_name()) );
@@ -1029,13 +1086,18 @@ namespace eosio {
          connection_ptr c = weak.lock();
          if( !c ) return;
          try {
-            controller& cc = my_impl->chain_plug->chain();
-            signed_block_ptr b = cc.fetch_block_by_id( blkid );
-            if( b ) {
-               fc_dlog( logger, "found block for id at num ${n}", ("n", b->block_num()) );
+            const uint32_t bnum = block_header::num_from_id( blkid );
+            send_buffer_type sb = my_impl->block_buffers->get( blkid );
+            if( !sb ) {
+               controller& cc = my_impl->chain_plug->chain();
+               signed_block_ptr b = cc.fetch_block_by_id( blkid );
+               if( b ) sb = my_impl->block_buffers->add( blkid, create_send_buffer( b ) );
+            }
+            if( sb ) {
+               fc_dlog( logger, "found block for id at num ${n}", ("n", bnum) );
                my_impl->dispatcher->add_peer_block( blkid, c->connection_id );
-               c->strand.post( [c, b{std::move(b)}]() {
-                  c->enqueue_block( b );
+               c->strand.post( [c, sb{std::move(sb)}, bnum]() {
+                  c->enqueue_block( sb, bnum );
                } );
             } else {
                fc_ilog( logger, "fetch block by id returned null, id ${id} for ${p}",
@@ -1181,14 +1243,13 @@ namespace eosio {
       app().post( priority::medium, [num, weak{std::move(weak)}]() {
          connection_ptr c = weak.lock();
          if( !c ) return;
-         controller& cc = my_impl->chain_plug->chain();
-         signed_block_ptr sb;
+         send_buffer_type sb;
          try {
-            sb = cc.fetch_block_by_number( num );
+            sb = fetch_block_send_buffer( num );
          } FC_LOG_AND_DROP();
          if( sb ) {
-            c->strand.post( [c, sb{std::move(sb)}]() {
-               c->enqueue_block( sb, true );
+            c->strand.post( [c, sb{std::move(sb)}, num]() {
+               c->enqueue_block( sb, num, true );
             });
          } else {
             c->strand.post( [c, num]() {
@@ -1250,16 +1311,65 @@ namespace eosio {
       return create_send_buffer( signed_block_which, *sb );
    }
 
+   static std::shared_ptr<std::vector<char>> create_send_buffer( const packed_block_span& packed_block ) {
+      // block log stores exactly fc::raw::pack(signed_block), so the bytes are copied without unpack/repack
+      const uint32_t which_size = fc::raw::pack_size( unsigned_int( signed_block_which ) );
+      const uint32_t payload_size = which_size + packed_block.size;
+
+      const char* const header = reinterpret_cast<const char* const>(&payload_size); // avoid variable size encoding of uint32_t
+      constexpr size_t header_size = sizeof( payload_size );
+      static_assert( header_size == message_header_size, "invalid message_header_size" );
+      const size_t buffer_size = header_size + payload_size;
+
+      auto send_buffer = std::make_shared<vector<char>>( buffer_size );
+      fc::datastream<char*> ds( send_buffer->data(), buffer_size );
+      ds.write( header, header_size );
+      fc::raw::pack( ds, unsigned_int( signed_block_which ) );
+      ds.write( packed_block.data, packed_block.size );
+
+      return send_buffer;
+   }
+
+   static std::shared_ptr<std::vector<char>> create_compact_send_buffer( const signed_block_ptr& sb ) {
+      return create_send_buffer( compact_block_which, make_compact_block( *sb ) );
+   }
+
    static std::shared_ptr<std::vector<char>> create_send_buffer( const packed_transaction& trx ) {
       // this implementation is to avoid copy of packed_transaction to net_message
       // matches which of net_message for packed_transaction
       return create_send_buffer( packed_transaction_which, trx );
    }
 
-   void connection::enqueue_block( const signed_block_ptr& sb, bool to_sync_queue) {
-      fc_dlog( logger, "enqueue block ${num}", ("num", sb->block_num()) );
+   // called from application thread
+   static send_buffer_type fetch_block_send_buffer( uint32_t block_num ) {
+      controller& cc = my_impl->chain_plug->chain();
+      block_id_type id;
+      try {
+         id = cc.get_block_id_for_num( block_num );
+      } catch( const unknown_block_exception& ) {
+         // a block we do not have, the caller reports it as unable to fetch
+         return send_buffer_type();
+      }
+      send_buffer_type sb = my_impl->block_buffers->get( id );
+      if( sb ) return sb;
+
+      // irreversible blocks come straight from the block log, reversible ones have to be packed
+      packed_block_span packed_block = cc.fetch_packed_block_by_number( block_num );
+      if( !packed_block.empty() ) {
+         fc_dlog( logger, "sending block ${bn} from block log", ("bn", block_num) );
+         sb = create_send_buffer( packed_block );
+      } else {
+         signed_block_ptr b = cc.fetch_block_by_id( id );
+         if( !b ) return sb;
+         sb = create_send_buffer( b );
+      }
+      return my_impl->block_buffers->add( id, sb );
+   }
+
+   void connection::enqueue_block( const send_buffer_type& send_buffer, uint32_t block_num, bool to_sync_queue) {
+      fc_dlog( logger, "enqueue block ${num}", ("num", block_num) );
       verify_strand_in_this_thread( strand, __func__, __LINE__ );
-      enqueue_buffer( create_send_buffer( sb ), no_reason, to_sync_queue);
+      enqueue_buffer( send_buffer, no_reason, to_sync_queue);
    }
 
    void connection::enqueue_buffer( const std::shared_ptr<std::vector<char>>& send_buffer,
@@ -1353,12 +1463,15 @@ namespace eosio {
 
    //-----------------------------------------------------------
 
-    sync_manager::sync_manager( uint32_t req_span )
+    sync_manager::sync_manager( uint32_t req_span, uint32_t parallel_requests )
       :sync_known_lib_num( 0 )
       ,sync_last_requested_num( 0 )
       ,sync_next_expected_num( 1 )
       ,sync_req_span( req_span )
+      ,sync_parallel_requests( parallel_requests )
       ,sync_source()
+      ,sync_ranges( req_span, parallel_requests,
+                    fc::microseconds( std::chrono::duration_cast<std::chrono::microseconds>( def_resp_expected_wait ).count() ) )
       ,sync_state(in_sync)
    {
    }
@@ -1391,12 +1504,98 @@ namespace eosio {
          if( c->last_handshake_recv.last_irreversible_block_num > sync_known_lib_num ) {
             sync_known_lib_num = c->last_handshake_recv.last_irreversible_block_num;
          }
+      } else if( parallel_sync() ) {
+         if( sync_state == lib_catchup && sync_ranges.has_request( c->connection_id ) ) {
+            sync_ranges.release( c->connection_id );
+            request_next_ranges( std::move(g) );
+         }
       } else if( c == sync_source ) {
          sync_last_requested_num = 0;
          request_next_chunk( std::move(g) );
       }
    }
 
+   // call with g_sync locked
+   void sync_manager::request_next_ranges( std::unique_lock<std::mutex> g_sync ) {
+      uint32_t lib_block_num = 0;
+      std::tie( lib_block_num, std::ignore, std::ignore,
+                std::ignore, std::ignore, std::ignore ) = my_impl->get_chain_info();
+
+      // every current peer whose lib covers the next block to apply can serve a range
+      std::map<uint32_t, connection_ptr> sources;
+      std::vector<uint32_t> peers;
+      const uint32_t next = sync_ranges.next();
+      for_each_block_connection( [&sources, &peers, next]( const connection_ptr& c ) {
+         if( c->current() ) {
+            std::lock_guard<std::mutex> g_conn( c->conn_mtx );
+            if( c->last_handshake_recv.last_irreversible_block_num >= next ) {
+               sources[c->connection_id] = c;
+               peers.push_back( c->connection_id );
+            }
+         }
+         return true;
+      } );
+
+      sync_ranges.set_target( sync_known_lib_num );
+      auto requests = sync_ranges.assign( peers, fc::time_point::now() );
+      if( sync_ranges.requests() == 0 && !sync_ranges.done() ) {
+         fc_elog( logger, "Unable to continue syncing at this time");
+         sync_known_lib_num = lib_block_num;
+         sync_last_requested_num = 0;
+         set_state( in_sync ); // probably not, but we can't do anything else
+         return;
+      }
+
+      fc_dlog( logger, "next block ${n}, ${r} ranges outstanding, ${b} blocks buffered, sync_known_lib_num: ${k}",
+               ("n", next)("r", sync_ranges.requests())("b", sync_ranges.buffered())("k", sync_known_lib_num) );
+      sync_last_requested_num = sync_ranges.last_requested();
+      g_sync.unlock();
+
+      for( const auto& r : requests ) {
+         connection_ptr c = sources[r.peer];
+         c->strand.post( [c, start = r.start, end = r.end]() {
+            fc_ilog( logger, "requesting range ${s} to ${e}, from ${n}", ("n", c->peer_name())( "s", start )( "e", end ) );
+            c->request_sync_blocks( start, end );
+         } );
+      }
+   }
+
+   // called from connection strand
+   bool sync_manager::buffer_sync_block( const connection_ptr& c, const block_id_type& blk_id, uint32_t blk_num, const signed_block_ptr& b ) {
+      // called for every block received, serial sync and in sync nodes never need sync_mtx here
+      if( !parallel_sync() || sync_state != lib_catchup ) return false;
+      std::unique_lock<std::mutex> g_sync( sync_mtx );
+      if( sync_state != lib_catchup ) return false;
+
+      if( !sync_ranges.receive( c->connection_id, blk_num, sync_block{ c, blk_id, b }, fc::time_point::now() ) ) {
+         // a block past the sync target is a new block, let it through
+         if( blk_num > sync_ranges.target() ) return false;
+         fc_dlog( logger, "dropping block ${n} from ${p}, not waiting for it", ("n", blk_num)("p", c->peer_name()) );
+         return true;
+      }
+      auto ready = sync_ranges.pop_ready();
+      const bool range_done = !sync_ranges.has_request( c->connection_id );
+      if( range_done || !ready.empty() ) {
+         request_next_ranges( std::move( g_sync ) );
+      } else {
+         g_sync.unlock();
+      }
+
+      if( range_done ) {
+         c->cancel_wait();
+      } else {
+         c->sync_wait();
+      }
+      // same priority, so the application thread applies them in block order
+      for( auto& r : ready ) {
+         if( !r.block ) continue;
+         app().post( priority::medium, [r{std::move(r)}]() mutable {
+            r.c->process_signed_block( r.id, std::move( r.block ) );
+         } );
+      }
+      return true;
+   }
+
    // call with g_sync locked
    void sync_manager::request_next_chunk( std::unique_lock<std::mutex> g_sync, const connection_ptr& conn ) {
       uint32_t fork_head_block_num = 0;
@@ -1536,7 +1735,8 @@ namespace eosio {
          return;
       }
 
-      if( sync_state == in_sync ) {
+      const bool starting = sync_state == in_sync;
+      if( starting ) {
          set_state( lib_catchup );
       }
       sync_next_expected_num = std::max( lib_num + 1, sync_next_expected_num );
@@ -1544,6 +1744,13 @@ namespace eosio {
       fc_ilog( logger, "Catching up with chain, our last req is ${cc}, theirs is ${t} peer ${p}",
                ("cc", sync_last_requested_num)( "t", target )( "p", c->peer_name() ) );
 
+      if( parallel_sync() ) {
+         if( starting ) {
+            sync_ranges.reset( sync_next_expected_num );
+         }
+         request_next_ranges( std::move( g_sync ) );
+         return;
+      }
       request_next_chunk( std::move( g_sync ), c );
    }
 
@@ -1553,7 +1760,13 @@ namespace eosio {
       fc_ilog( logger, "reassign_fetch, our last req is ${cc}, next expected is ${ne} peer ${p}",
                ("cc", sync_last_requested_num)( "ne", sync_next_expected_num )( "p", c->peer_name() ) );
 
-      if( c == sync_source ) {
+      if( parallel_sync() ) {
+         if( sync_ranges.has_request( c->connection_id ) ) {
+            c->cancel_sync(reason);
+            sync_ranges.release( c->connection_id );
+            request_next_ranges( std::move(g) );
+         }
+      } else if( c == sync_source ) {
          c->cancel_sync(reason);
          sync_last_requested_num = 0;
          request_next_chunk( std::move(g) );
@@ -1750,6 +1963,14 @@ namespace eosio {
          g.unlock();
          c->close();
       } else {
+         if( parallel_sync() && sync_state == lib_catchup ) {
+            // blocks received after the rejected one will not link, start over after the head
+            uint32_t head = 0;
+            std::tie( std::ignore, std::ignore, head,
+                      std::ignore, std::ignore, std::ignore ) = my_impl->get_chain_info();
+            sync_ranges.reset( head + 1 );
+         }
+         g.unlock();
          c->send_handshake( true );
       }
    }
@@ -1814,6 +2035,14 @@ namespace eosio {
             send_handshakes();
          }
       } else if( state == lib_catchup ) {
+         if( parallel_sync() && blk_num < sync_known_lib_num ) {
+            g_sync.unlock();
+            if( !blk_applied ) {
+               // already received, it still fills its place in the window
+               buffer_sync_block( c, blk_id, blk_num, signed_block_ptr() );
+            }
+            return;
+         }
          if( blk_num == sync_known_lib_num ) {
             fc_dlog( logger, "All caught up with last known last irreversible block resending handshake" );
             set_state( in_sync );
@@ -1864,69 +2093,40 @@ namespace eosio {
    }
 
    bool dispatch_manager::add_peer_txn( const node_transaction_state& nts ) {
-      std::lock_guard<std::mutex> g( local_txns_mtx );
-      auto tptr = local_txns.get<by_id>().find( std::make_tuple( std::ref( nts.id ), nts.connection_id ) );
-      bool added = (tptr == local_txns.end());
-      if( added ) {
-         local_txns.insert( nts );
-      }
-      return added;
+      return local_txns.add( nts );
    }
 
    // thread safe
    void dispatch_manager::update_txns_block_num( const signed_block_ptr& sb ) {
-      update_block_num ubn( sb->block_num() );
-      std::lock_guard<std::mutex> g( local_txns_mtx );
+      vector<transaction_id_type> ids;
+      ids.reserve( sb->transactions.size() );
       for( const auto& recpt : sb->transactions ) {
-         const transaction_id_type& id = (recpt.trx.which() == 0) ? recpt.trx.get<transaction_id_type>()
-                                                                  : recpt.trx.get<packed_transaction>().id();
-         auto range = local_txns.get<by_id>().equal_range( id );
-         for( auto itr = range.first; itr != range.second; ++itr ) {
-            local_txns.modify( itr, ubn );
-         }
+         ids.push_back( (recpt.trx.which() == 0) ? recpt.trx.get<transaction_id_type>()
+                                                 : recpt.trx.get<packed_transaction>().id() );
       }
+      local_txns.update_block_num( ids, sb->block_num() );
    }
 
    // thread safe
    void dispatch_manager::update_txns_block_num( const transaction_id_type& id, uint32_t blk_num ) {
-      update_block_num ubn( blk_num );
-      std::lock_guard<std::mutex> g( local_txns_mtx );
-      auto range = local_txns.get<by_id>().equal_range( id );
-      for( auto itr = range.first; itr != range.second; ++itr ) {
-         local_txns.modify( itr, ubn );
-      }
+      local_txns.update_block_num( id, blk_num );
    }
 
    bool dispatch_manager::peer_has_txn( const transaction_id_type& tid, uint32_t connection_id ) const {
-      std::lock_guard<std::mutex> g( local_txns_mtx );
-      const auto tptr = local_txns.get<by_id>().find( std::make_tuple( std::ref( tid ), connection_id ) );
-      return tptr != local_txns.end();
+      return local_txns.has( tid, connection_id );
    }
 
    bool dispatch_manager::have_txn( const transaction_id_type& tid ) const {
-      std::lock_guard<std::mutex> g( local_txns_mtx );
-      const auto tptr = local_txns.get<by_id>().find( tid );
-      return tptr != local_txns.end();
+      return local_txns.has( tid );
    }
 
-   void dispatch_manager::expire_txns( uint32_t lib_num ) {
-      size_t start_size = 0, end_size = 0;
-
-      std::unique_lock<std::mutex> g( local_txns_mtx );
-      start_size = local_txns.size();
-      auto& old = local_txns.get<by_expiry>();
-      auto ex_lo = old.lower_bound( fc::time_point_sec( 0 ) );
-      auto ex_up = old.upper_bound( time_point::now() );
-      old.erase( ex_lo, ex_up );
-      g.unlock(); // allow other threads opportunity to use local_txns
-
-      g.lock();
-      auto& stale = local_txns.get<by_block_num>();
-      stale.erase( stale.lower_bound( 1 ), stale.upper_bound( lib_num ) );
-      end_size = local_txns.size();
-      g.unlock();
+   packed_transaction_ptr dispatch_manager::find_txn( uint64_t short_id ) const {
+      return local_txns.find_transaction( short_id );
+   }
 
-      fc_dlog( logger, "expire_local_txns size ${s} removed ${r}", ("s", start_size)( "r", start_size - end_size ) );
+   void dispatch_manager::expire_txns( uint32_t lib_num ) {
+      size_t removed = local_txns.expire( time_point::now(), lib_num );
+      fc_dlog( logger, "expire_local_txns removed ${r}", ("r", removed) );
    }
 
    void dispatch_manager::expire_blocks( uint32_t lib_num ) {
@@ -1942,7 +2142,8 @@ namespace eosio {
       if( my_impl->sync_master->syncing_with_peer() ) return;
 
       bool have_connection = false;
-      for_each_block_connection( [&have_connection]( auto& cp ) {
+      bool have_compact_connection = false;
+      for_each_block_connection( [&have_connection, &have_compact_connection]( auto& cp ) {
          peer_dlog( cp, "socket_is_open ${s}, connecting ${c}, syncing ${ss}",
                     ("s", cp->socket_is_open())("c", cp->connecting.load())("ss", cp->syncing.load()) );
 
@@ -1950,17 +2151,29 @@ namespace eosio {
             return true;
          }
          have_connection = true;
-         return false;
+         if( cp->protocol_version >= proto_compact_blocks ) {
+            have_compact_connection = true;
+            return false;
+         }
+         return true;
       } );
 
       if( !have_connection ) return;
-      std::shared_ptr<std::vector<char>> send_buffer = create_send_buffer( b );
+      send_buffer_type send_buffer = my_impl->block_buffers->get( id );
+      if( !send_buffer ) {
+         send_buffer = my_impl->block_buffers->add( id, create_send_buffer( b ) );
+      }
+      // peers that negotiated proto_compact_blocks get the block without the transactions they already have
+      send_buffer_type compact_buffer;
+      if( have_compact_connection ) {
+         compact_buffer = create_compact_send_buffer( b );
+      }
 
-      for_each_block_connection( [this, &id, bnum = b->block_num(), &send_buffer]( auto& cp ) {
+      for_each_block_connection( [this, &id, bnum = b->block_num(), &send_buffer, &compact_buffer]( auto& cp ) {
          if( !cp->current() ) {
             return true;
          }
-         cp->strand.post( [this, cp, id, bnum, send_buffer]() {
+         cp->strand.post( [this, cp, id, bnum, send_buffer, compact_buffer]() {
             std::unique_lock<std::mutex> g_conn( cp->conn_mtx );
             bool has_block = cp->last_handshake_recv.last_irreversible_block_num >= bnum;
             g_conn.unlock();
@@ -1969,14 +2182,38 @@ namespace eosio {
                   fc_dlog( logger, "not bcast block ${b} to ${p}", ("b", bnum)("p", cp->peer_name()) );
                   return;
                }
-               fc_dlog( logger, "bcast block ${b} to ${p}", ("b", bnum)("p", cp->peer_name()) );
-               cp->enqueue_buffer( send_buffer, no_reason );
+               const bool compact = compact_buffer && cp->protocol_version >= proto_compact_blocks;
+               fc_dlog( logger, "bcast ${c}block ${b} to ${p}", ("c", compact ? "compact " : "")("b", bnum)("p", cp->peer_name()) );
+               cp->enqueue_buffer( compact ? compact_buffer : send_buffer, no_reason );
             }
          });
          return true;
       } );
    }
 
+   send_buffer_type block_buffer_cache::get( const block_id_type& id ) {
+      std::lock_guard<std::mutex> g( mtx );
+      auto itr = buffers.get<by_block_id>().find( id );
+      if( itr == buffers.get<by_block_id>().end() ) return send_buffer_type();
+      auto& lru = buffers.get<by_lru>();
+      lru.relocate( lru.end(), buffers.project<by_lru>( itr ) );
+      return itr->buffer;
+   }
+
+   send_buffer_type block_buffer_cache::add( const block_id_type& id, const send_buffer_type& buffer ) {
+      std::lock_guard<std::mutex> g( mtx );
+      auto r = buffers.insert( block_buffer_state{ id, buffer } );
+      if( !r.second ) return r.first->buffer;
+      cached_bytes += buffer->size();
+
+      auto& lru = buffers.get<by_lru>();
+      while( cached_bytes > max_bytes && lru.size() > 1 ) {
+         cached_bytes -= lru.front().buffer->size();
+         lru.pop_front();
+      }
+      return buffer;
+   }
+
    // called from connection strand
    void dispatch_manager::recv_block(const connection_ptr& c, const block_id_type& id, uint32_t bnum) {
       std::unique_lock<std::mutex> g( c->conn_mtx );
@@ -1998,10 +2235,10 @@ namespace eosio {
       fc_dlog( logger, "rejected block ${id}", ("id", id) );
    }
 
-   void dispatch_manager::bcast_transaction(const packed_transaction& trx) {
-      const auto& id = trx.id();
-      time_point_sec trx_expiration = trx.expiration();
-      node_transaction_state nts = {id, trx_expiration, 0, 0};
+   void dispatch_manager::bcast_transaction(const packed_transaction_ptr& trx) {
+      const auto& id = trx->id();
+      time_point_sec trx_expiration = trx->expiration();
+      node_transaction_state nts = {id, trx_expiration, 0, 0, trx};
 
       std::shared_ptr<std::vector<char>> send_buffer;
       for_each_connection( [this, &trx, &nts, &send_buffer]( auto& cp ) {
@@ -2013,7 +2250,7 @@ namespace eosio {
             return true;
          }
          if( !send_buffer ) {
-            send_buffer = create_send_buffer( trx );
+            send_buffer = create_send_buffer( *trx );
          }
 
          cp->strand.post( [cp, send_buffer]() {
@@ -2377,6 +2614,21 @@ namespace eosio {
    }
 
    // called from connection strand
+   static bool has_webauthn_signature( const signed_block& b ) {
+      auto is_webauthn_sig = []( const fc::crypto::signature& s ) {
+         return s.which() == fc::crypto::signature::storage_type::position<fc::crypto::webauthn::signature>();
+      };
+      bool has_webauthn_sig = is_webauthn_sig( b.producer_signature );
+
+      constexpr auto additional_sigs_eid = additional_block_signatures_extension::extension_id();
+      auto exts = b.validate_and_extract_extensions();
+      if( exts.count( additional_sigs_eid ) ) {
+         const auto &additional_sigs = exts.lower_bound( additional_sigs_eid )->second.get<additional_block_signatures_extension>().signatures;
+         has_webauthn_sig |= std::any_of( additional_sigs.begin(), additional_sigs.end(), is_webauthn_sig );
+      }
+      return has_webauthn_sig;
+   }
+
    bool connection::process_next_message( uint32_t message_length ) {
       try {
          // if next message is a block we already have, exit early
@@ -2428,19 +2680,7 @@ namespace eosio {
             shared_ptr<signed_block> ptr = std::make_shared<signed_block>();
             fc::raw::unpack( ds, *ptr );
 
-            auto is_webauthn_sig = []( const fc::crypto::signature& s ) {
-               return s.which() == fc::crypto::signature::storage_type::position<fc::crypto::webauthn::signature>();
-            };
-            bool has_webauthn_sig = is_webauthn_sig( ptr->producer_signature );
-
-            constexpr auto additional_sigs_eid = additional_block_signatures_extension::extension_id();
-            auto exts = ptr->validate_and_extract_extensions();
-            if( exts.count( additional_sigs_eid ) ) {
-               const auto &additional_sigs = exts.lower_bound( additional_sigs_eid )->second.get<additional_block_signatures_extension>().signatures;
-               has_webauthn_sig |= std::any_of( additional_sigs.begin(), additional_sigs.end(), is_webauthn_sig );
-            }
-
-            if( has_webauthn_sig ) {
+            if( has_webauthn_signature( *ptr ) ) {
                fc_dlog( logger, "WebAuthn signed block received from ${p}, closing connection", ("p", peer_name()));
                close();
                return false;
@@ -2448,6 +2688,27 @@ namespace eosio {
 
             handle_message( blk_id, std::move( ptr ) );
 
+         } else if( which == compact_block_which ) {
+            auto ds = pending_message_buffer.create_datastream();
+            fc::raw::unpack( ds, which ); // throw away
+            compact_block_message msg;
+            fc::raw::unpack( ds, msg );
+
+            const block_id_type blk_id = msg.header.id();
+            const uint32_t blk_num = msg.header.block_num();
+            if( my_impl->dispatcher->have_block( blk_id ) ) {
+               fc_dlog( logger, "canceling wait on ${p}, already received compact block ${num}, id ${id}...",
+                        ("p", peer_name())("num", blk_num)("id", blk_id.str().substr(8,16)) );
+               my_impl->sync_master->sync_recv_block( shared_from_this(), blk_id, blk_num, false );
+               cancel_wait();
+               return true;
+            }
+            fc_dlog( logger, "${p} received compact block ${num}, id ${id}..., latency: ${latency}",
+                     ("p", peer_name())("num", blk_num)("id", blk_id.str().substr(8,16))
+                     ("latency", (fc::time_point::now() - msg.header.timestamp).count()/1000) );
+
+            handle_message( blk_id, std::move( msg ) );
+
          } else if( which == packed_transaction_which ) {
             if( !my_impl->p2p_accept_transactions ) {
                fc_dlog( logger, "p2p-accept-transaction=false - dropping txn" );
@@ -2611,7 +2872,7 @@ namespace eosio {
          protocol_version = my_impl->to_protocol_version(msg.network_version);
          if( protocol_version != net_version ) {
             fc_ilog( logger, "Local network version: ${nv} Remote version: ${mnv}",
-                     ("nv", net_version)( "mnv", protocol_version ) );
+                     ("nv", net_version)( "mnv", protocol_version.load() ) );
          }
 
          g_conn.lock();
@@ -2859,7 +3120,8 @@ namespace eosio {
       }
 
       bool have_trx = my_impl->dispatcher->have_txn( tid );
-      node_transaction_state nts = {tid, trx->expiration(), 0, connection_id};
+      // only the first copy received is kept to fill in compact blocks, the others would just take up memory
+      node_transaction_state nts = {tid, trx->expiration(), 0, connection_id, have_trx ? packed_transaction_ptr() : trx};
       my_impl->dispatcher->add_peer_txn( nts );
 
       if( have_trx ) {
@@ -2893,12 +3155,137 @@ namespace eosio {
    // called from connection strand
    void connection::handle_message( const block_id_type& id, signed_block_ptr ptr ) {
       peer_dlog( this, "received signed_block ${id}", ("id", ptr->block_num() ) );
+      if( my_impl->sync_master->buffer_sync_block( shared_from_this(), id, ptr->block_num(), ptr ) ) {
+         return;
+      }
       auto priority = my_impl->sync_master->syncing_with_peer() ? priority::medium : priority::high;
       app().post(priority, [ptr{std::move(ptr)}, id, c = shared_from_this()]() mutable {
          c->process_signed_block( id, std::move( ptr ) );
       });
    }
 
+   // called from connection strand
+   void connection::handle_message( const block_id_type& id, compact_block_message&& msg ) {
+      vector<uint32_t> missing;
+      signed_block_ptr b = expand_compact_block( std::move( msg ), []( uint64_t short_id ) {
+         return my_impl->dispatcher->find_txn( short_id );
+      }, missing );
+
+      if( missing.empty() ) {
+         finish_compact_block( id, std::move( b ) );
+         return;
+      }
+
+      peer_dlog( this, "requesting ${m} of ${t} transactions of compact block #${n}",
+                 ("m", missing.size())("t", b->transactions.size())("n", b->block_num()) );
+      if( pending_compact ) {
+         // only the latest block is reconstructed, an earlier one still missing transactions is fetched in full
+         request_block( pending_compact->id );
+      }
+      compact_block_request_message req{ id, missing };
+      pending_compact = pending_compact_block{ id, std::move( b ), std::move( missing ) };
+      enqueue( req );
+
+      compact_block_timer.expires_from_now( def_compact_block_wait );
+      compact_block_timer.async_wait(
+            boost::asio::bind_executor( strand, [c = shared_from_this(), id]( boost::system::error_code ec ) {
+               c->compact_block_timeout( id, ec );
+            } ) );
+   }
+
+   // called from connection strand
+   void connection::compact_block_timeout( const block_id_type& id, boost::system::error_code ec ) {
+      if( ec == boost::asio::error::operation_aborted ) return;
+      if( ec ) {
+         fc_elog( logger, "setting timer for compact block got error ${ec}", ("ec", ec.message()) );
+      }
+      // the timer may have expired just before the transactions arrived or another compact block replaced this one
+      if( !pending_compact || pending_compact->id != id ) return;
+      peer_wlog( this, "transactions of compact block ${id} not received in time, requesting full block", ("id", id) );
+      pending_compact.reset();
+      request_block( id );
+   }
+
+   // called from connection strand
+   void connection::handle_message( const compact_block_request_message& msg ) {
+      connection_wptr weak = shared_from_this();
+      app().post( priority::medium, [msg, weak{std::move(weak)}]() {
+         connection_ptr c = weak.lock();
+         if( !c ) return;
+         signed_block_ptr b;
+         try {
+            b = my_impl->chain_plug->chain().fetch_block_by_id( msg.id );
+         } catch( ... ) {
+            fc_elog( logger, "caught exception fetching block id ${id} for ${p}", ("id", msg.id)( "p", c->peer_address() ) );
+         }
+         if( !b ) {
+            fc_ilog( logger, "compact block ${id} requested by ${p} not found", ("id", msg.id)( "p", c->peer_address() ) );
+            return;
+         }
+
+         compact_block_transactions_message reply;
+         reply.id = msg.id;
+         reply.transactions.reserve( msg.indexes.size() );
+         for( uint32_t i : msg.indexes ) {
+            if( i >= b->transactions.size() || !b->transactions[i].trx.contains<packed_transaction>() ) {
+               fc_elog( logger, "Invalid compact_block_request_message, index ${i} of block ${id}, closing ${p}",
+                        ("i", i)("id", msg.id)( "p", c->peer_address() ) );
+               c->close();
+               return;
+            }
+            reply.transactions.push_back( b->transactions[i].trx.get<packed_transaction>() );
+         }
+         c->strand.post( [c, reply{std::move(reply)}]() {
+            c->enqueue( reply );
+         } );
+      });
+   }
+
+   // called from connection strand
+   void connection::handle_message( const compact_block_transactions_message& msg ) {
+      if( !pending_compact || pending_compact->id != msg.id ) {
+         peer_dlog( this, "ignoring transactions of compact block ${id} not waited for", ("id", msg.id) );
+         return;
+      }
+      pending_compact_block pending = std::move( *pending_compact );
+      pending_compact.reset();
+      compact_block_timer.cancel();
+
+      if( !fill_compact_block( *pending.block, pending.missing, msg.transactions ) ) {
+         peer_wlog( this, "received ${r} of ${m} missing transactions of compact block ${id}, requesting full block",
+                    ("r", msg.transactions.size())("m", pending.missing.size())("id", msg.id) );
+         request_block( pending.id );
+         return;
+      }
+      finish_compact_block( pending.id, std::move( pending.block ) );
+   }
+
+   // called from connection strand
+   void connection::finish_compact_block( const block_id_type& id, signed_block_ptr b ) {
+      if( !transaction_mroot_matches( *b ) ) {
+         peer_wlog( this, "compact block #${n} ${id}... did not match its transaction merkle root, requesting full block",
+                    ("n", b->block_num())("id", id.str().substr(8,16)) );
+         request_block( id );
+         return;
+      }
+
+      if( has_webauthn_signature( *b ) ) {
+         fc_dlog( logger, "WebAuthn signed block received from ${p}, closing connection", ("p", peer_name()));
+         close();
+         return;
+      }
+
+      handle_message( id, std::move( b ) );
+   }
+
+   // called from connection strand
+   void connection::request_block( const block_id_type& id ) {
+      request_message req;
+      req.req_blocks.mode = normal;
+      req.req_blocks.ids.push_back( id );
+      enqueue( req );
+   }
+
    // called from application thread
    void connection::process_signed_block( const block_id_type& blk_id, signed_block_ptr msg ) {
       controller& cc = my_impl->chain_plug->chain();
@@ -3136,7 +3523,7 @@ namespace eosio {
             dispatcher->rejected_transaction(results.second->packed_trx(), head_blk_num);
          } else {
             fc_dlog( logger, "signaled ACK, trx-id = ${id}", ("id", id) );
-            dispatcher->bcast_transaction(*results.second->packed_trx());
+            dispatcher->bcast_transaction(results.second->packed_trx());
          }
       });
    }
@@ -3292,6 +3679,11 @@ namespace eosio {
          ( "net-threads", bpo::value<uint16_t>()->default_value(my->thread_pool_size),
            "Number of worker threads in net_plugin thread pool" )
          ( "sync-fetch-span", bpo::value<uint32_t>()->default_value(def_sync_fetch_span), "number of blocks to retrieve in a chunk from any individual peer during synchronization")
+         ( "sync-parallel-requests", bpo::value<uint32_t>()->default_value(def_sync_parallel_requests),
+           "Maximum number of sync-fetch-span chunks requested at once, each from a different peer, while syncing to the last irreversible block. "
+           "Blocks arriving out of order are held until they can be applied. 1 requests one chunk at a time from one peer.")
+         ( "p2p-block-cache-size-mb", bpo::value<uint32_t>()->default_value(def_block_buffer_cache_size_mb),
+           "Maximum size (in MiB) of serialized blocks kept for sending to peers, shared by all connections")
          ( "use-socket-read-watermark", bpo::value<bool>()->default_value(false), "Enable experimental socket read watermark optimization")
          ( "peer-log-format", bpo::value<string>()->default_value( "[\"${_name}\" ${_ip}:${_port}]" ),
            "The string used to format peers when logging messages about them.  Variables are escaped with ${<variable name>}.\n"
@@ -3316,7 +3708,9 @@ namespace eosio {
       try {
          peer_log_format = options.at( "peer-log-format" ).as<string>();
 
-         my->sync_master.reset( new sync_manager( options.at( "sync-fetch-span" ).as<uint32_t>()));
+         my->sync_master.reset( new sync_manager( options.at( "sync-fetch-span" ).as<uint32_t>(),
+                                                  options.at( "sync-parallel-requests" ).as<uint32_t>() ));
+         my->block_buffers.reset( new block_buffer_cache( uint64_t(options.at( "p2p-block-cache-size-mb" ).as<uint32_t>()) * 1024 * 1024 ) );
 
          my->connector_period = std::chrono::seconds( options.at( "connection-cleanup-period" ).as<int>());
          my->max_cleanup_time_ms = options.at("max-cleanup-time-msec").as<int>();
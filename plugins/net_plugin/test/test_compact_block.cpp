@@ -0,0 +1,115 @@
+#define BOOST_TEST_MODULE compact_block
+#include <boost/test/included/unit_test.hpp>
+
+#include <eosio/net_plugin/compact_block.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <map>
+
+using namespace eosio;
+using namespace eosio::chain;
+
+namespace {
+
+   packed_transaction_ptr make_trx( uint32_t n ) {
+      signed_transaction t;
+      t.expiration = fc::time_point_sec( 1000 + n );
+      return std::make_shared<packed_transaction>( std::move( t ) );
+   }
+
+   /// a block of packed transactions with a deferred transaction receipt in the middle
+   signed_block make_block( const std::vector<packed_transaction_ptr>& trxs ) {
+      signed_block b;
+      b.block_extensions.emplace_back( 1, bytes{ 'x' } );
+      for( size_t i = 0; i < trxs.size(); ++i ) {
+         if( i == trxs.size() / 2 ) {
+            b.transactions.emplace_back( transaction_id_type( fc::sha256::hash( std::string( "deferred" ) ) ) );
+         }
+         b.transactions.emplace_back( *trxs[i] );
+         b.transactions.back().cpu_usage_us = 100 + i;
+      }
+      vector<digest_type> digests;
+      for( const auto& r : b.transactions ) {
+         digests.emplace_back( r.digest() );
+      }
+      b.transaction_mroot = merkle( std::move( digests ) );
+      return b;
+   }
+
+   /// the compact block as received from the network
+   compact_block_message round_trip( const signed_block& b ) {
+      const auto packed = fc::raw::pack( make_compact_block( b ) );
+      return fc::raw::unpack<compact_block_message>( packed );
+   }
+
+   std::function<packed_transaction_ptr( uint64_t )> finder( const std::map<uint64_t, packed_transaction_ptr>& known ) {
+      return [&known]( uint64_t short_id ) {
+         auto itr = known.find( short_id );
+         return itr == known.end() ? packed_transaction_ptr() : itr->second;
+      };
+   }
+
+}
+
+BOOST_AUTO_TEST_SUITE(compact_block_tests)
+
+BOOST_AUTO_TEST_CASE(all_transactions_known) {
+   std::vector<packed_transaction_ptr> trxs;
+   std::map<uint64_t, packed_transaction_ptr> known;
+   for( uint32_t i = 0; i < 10; ++i ) {
+      trxs.push_back( make_trx( i ) );
+      known[trxs.back()->id()._hash[0]] = trxs.back();
+   }
+   const signed_block b = make_block( trxs );
+
+   vector<uint32_t> missing;
+   signed_block_ptr rebuilt = expand_compact_block( round_trip( b ), finder( known ), missing );
+   BOOST_TEST( missing.empty() );
+   BOOST_TEST( transaction_mroot_matches( *rebuilt ) );
+   BOOST_TEST( rebuilt->calculate_id() == b.calculate_id() );
+   BOOST_TEST( fc::raw::pack( *rebuilt ) == fc::raw::pack( b ) );
+}
+
+BOOST_AUTO_TEST_CASE(missing_transactions) {
+   std::vector<packed_transaction_ptr> trxs;
+   std::map<uint64_t, packed_transaction_ptr> known;
+   for( uint32_t i = 0; i < 10; ++i ) {
+      trxs.push_back( make_trx( i ) );
+      if( i % 3 != 0 ) known[trxs.back()->id()._hash[0]] = trxs.back();
+   }
+   const signed_block b = make_block( trxs );
+
+   vector<uint32_t> missing;
+   signed_block_ptr rebuilt = expand_compact_block( round_trip( b ), finder( known ), missing );
+   // transactions 0, 3, 6 and 9, with the deferred receipt at position 5
+   BOOST_TEST( missing == ( vector<uint32_t>{ 0, 3, 7, 10 } ) );
+   BOOST_TEST( !transaction_mroot_matches( *rebuilt ) );
+
+   // what the peer sends back for a compact_block_request_message
+   vector<packed_transaction> reply;
+   for( uint32_t i : missing ) {
+      reply.emplace_back( b.transactions[i].trx.get<packed_transaction>() );
+   }
+   BOOST_TEST( !fill_compact_block( *rebuilt, missing, vector<packed_transaction>() ) );
+   BOOST_REQUIRE( fill_compact_block( *rebuilt, missing, reply ) );
+   BOOST_TEST( transaction_mroot_matches( *rebuilt ) );
+   BOOST_TEST( fc::raw::pack( *rebuilt ) == fc::raw::pack( b ) );
+}
+
+BOOST_AUTO_TEST_CASE(short_id_collision) {
+   std::vector<packed_transaction_ptr> trxs{ make_trx( 0 ), make_trx( 1 ) };
+   const signed_block b = make_block( trxs );
+
+   // another transaction known under the short id of the first one
+   std::map<uint64_t, packed_transaction_ptr> known;
+   known[trxs[0]->id()._hash[0]] = make_trx( 2 );
+   known[trxs[1]->id()._hash[0]] = trxs[1];
+
+   vector<uint32_t> missing;
+   signed_block_ptr rebuilt = expand_compact_block( round_trip( b ), finder( known ), missing );
+   BOOST_TEST( missing.empty() );
+   BOOST_TEST( !transaction_mroot_matches( *rebuilt ) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
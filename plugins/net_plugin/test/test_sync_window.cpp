@@ -0,0 +1,163 @@
+#define BOOST_TEST_MODULE sync_window
+#include <boost/test/included/unit_test.hpp>
+
+#include <eosio/net_plugin/sync_window.hpp>
+
+#include <deque>
+
+using namespace eosio;
+
+namespace {
+
+   const fc::microseconds request_timeout = fc::seconds( 5 );
+
+   /// a peer serving sync requests in order at a fixed rate, until it stalls or disconnects
+   struct fake_peer {
+      uint32_t             id;
+      fc::microseconds     per_block;
+      bool                 connected = true;
+      bool                 stalled = false;
+      std::deque<uint32_t> to_send;
+      fc::time_point       next_send;
+      uint32_t             ranges_served = 0;
+   };
+
+   struct sync_run {
+      std::vector<uint32_t> applied;
+      size_t                max_buffered = 0;
+   };
+
+   /**
+    * Drive the window with a simulated clock until target is applied, the way sync_manager does: ranges are
+    * requested from idle peers whenever a block arrives, and every peer sends its range at its own pace.
+    * on_tick may disconnect or stall peers.
+    */
+   template<typename OnTick>
+   sync_run run_sync( sync_window<uint32_t>& window, std::vector<fake_peer>& peers, uint32_t target, OnTick&& on_tick ) {
+      sync_run result;
+      fc::time_point now = fc::time_point::from_iso_string( "2020-01-01T00:00:00" );
+      window.reset( 1 );
+      window.set_target( target );
+      for( uint32_t tick = 0; !window.done() && tick < 1000000; ++tick ) {
+         now += fc::milliseconds( 1 );
+         on_tick( tick, window, peers );
+
+         std::vector<uint32_t> ids;
+         for( const auto& p : peers ) {
+            if( p.connected ) ids.push_back( p.id );
+         }
+         for( const auto& r : window.assign( ids, now ) ) {
+            auto& p = peers[r.peer];
+            p.to_send.clear(); // a new request replaces the old one, as in connection::handle_message
+            for( uint32_t n = r.start; n <= r.end; ++n ) p.to_send.push_back( n );
+            p.next_send = now + p.per_block;
+            ++p.ranges_served;
+         }
+
+         for( auto& p : peers ) {
+            if( !p.connected || p.stalled ) continue;
+            while( !p.to_send.empty() && p.next_send <= now ) {
+               window.receive( p.id, p.to_send.front(), p.to_send.front(), now );
+               p.to_send.pop_front();
+               p.next_send += p.per_block;
+            }
+         }
+         result.max_buffered = std::max( result.max_buffered, window.buffered() );
+         for( auto n : window.pop_ready() ) result.applied.push_back( n );
+      }
+      return result;
+   }
+
+   std::vector<fake_peer> make_peers( const std::vector<int64_t>& us_per_block ) {
+      std::vector<fake_peer> peers;
+      for( uint32_t i = 0; i < us_per_block.size(); ++i ) {
+         peers.push_back( fake_peer{ i, fc::microseconds( us_per_block[i] ) } );
+      }
+      return peers;
+   }
+
+   void check_applied_in_order( const sync_run& run, uint32_t target ) {
+      BOOST_REQUIRE_EQUAL( run.applied.size(), target );
+      for( uint32_t i = 0; i < target; ++i ) {
+         BOOST_REQUIRE_EQUAL( run.applied[i], i + 1 );
+      }
+   }
+
+   auto no_events = []( uint32_t, sync_window<uint32_t>&, std::vector<fake_peer>& ) {};
+
+}
+
+BOOST_AUTO_TEST_SUITE(sync_window_tests)
+
+BOOST_AUTO_TEST_CASE(receive_within_window) {
+   sync_window<uint32_t> window( 10, 2, request_timeout );
+   window.reset( 1 );
+   window.set_target( 100 );
+   const auto now = fc::time_point::now();
+   auto requests = window.assign( { 7, 8, 9 }, now );
+   BOOST_REQUIRE_EQUAL( requests.size(), 2u );
+   BOOST_TEST( requests[0].start == 1u );
+   BOOST_TEST( requests[0].end == 10u );
+   BOOST_TEST( requests[1].start == 11u );
+   BOOST_TEST( requests[1].end == 20u );
+   BOOST_TEST( window.last_requested() == 20u );
+
+   BOOST_TEST( window.receive( requests[1].peer, 11, 11, now ) );
+   BOOST_TEST( !window.receive( requests[1].peer, 11, 11, now ) ); // duplicate
+   BOOST_TEST( !window.receive( 9, 21, 21, now ) );                 // past the window
+   BOOST_TEST( window.pop_ready().empty() );
+
+   BOOST_TEST( window.receive( requests[0].peer, 1, 1, now ) );
+   BOOST_TEST( (window.pop_ready() == std::vector<uint32_t>{ 1 }) );
+   BOOST_TEST( !window.receive( requests[0].peer, 1, 1, now ) );    // already applied
+   BOOST_TEST( window.next() == 2u );
+}
+
+BOOST_AUTO_TEST_CASE(out_of_order_arrival) {
+   const uint32_t target = 2000;
+   sync_window<uint32_t> window( 20, 4, request_timeout );
+   auto peers = make_peers( { 100, 300, 1000, 4000, 200 } );
+
+   auto run = run_sync( window, peers, target, no_events );
+   check_applied_in_order( run, target );
+   BOOST_TEST( run.max_buffered <= window.window_blocks() );
+   BOOST_TEST( peers[0].ranges_served > peers[3].ranges_served );
+   BOOST_TEST( window.latency_of( 0 ) < window.latency_of( 3 ) );
+}
+
+BOOST_AUTO_TEST_CASE(disconnected_peer) {
+   const uint32_t target = 1000;
+   sync_window<uint32_t> window( 20, 3, request_timeout );
+   auto peers = make_peers( { 500, 500, 500 } );
+
+   uint32_t served_before_disconnect = 0;
+   auto run = run_sync( window, peers, target, [&]( uint32_t tick, sync_window<uint32_t>& w, std::vector<fake_peer>& ps ) {
+      if( tick == 25 ) {
+         // mid range, as sync_manager::sync_reset_lib_num does when the connection closes
+         BOOST_REQUIRE( !ps[1].to_send.empty() );
+         ps[1].connected = false;
+         w.release( 1 );
+         served_before_disconnect = ps[1].ranges_served;
+      }
+   } );
+   check_applied_in_order( run, target );
+   BOOST_TEST( !window.has_request( 1 ) );
+   BOOST_TEST( peers[1].ranges_served == served_before_disconnect );
+}
+
+BOOST_AUTO_TEST_CASE(stalled_peer) {
+   const uint32_t target = 1000;
+   sync_window<uint32_t> window( 20, 3, request_timeout );
+   auto peers = make_peers( { 500, 500, 500 } );
+
+   auto run = run_sync( window, peers, target, []( uint32_t tick, sync_window<uint32_t>&, std::vector<fake_peer>& ps ) {
+      if( tick == 25 ) ps[2].stalled = true;
+      if( tick == 10000 ) ps[2].stalled = false;
+   } );
+   check_applied_in_order( run, target );
+   // the stalled range was taken back after request_timeout and the peer is tried last afterwards
+   BOOST_TEST( window.latency_of( 2 ) > window.latency_of( 0 ) );
+   BOOST_TEST( window.latency_of( 2 ) > window.latency_of( 1 ) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
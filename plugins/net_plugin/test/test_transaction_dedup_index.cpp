@@ -0,0 +1,129 @@
+#define BOOST_TEST_MODULE transaction_dedup_index
+#include <boost/test/included/unit_test.hpp>
+
+#include <eosio/net_plugin/transaction_dedup_index.hpp>
+
+#include <fc/crypto/sha256.hpp>
+
+#include <chrono>
+#include <thread>
+
+using namespace eosio;
+using eosio::chain::transaction_id_type;
+
+namespace {
+
+   std::vector<transaction_id_type> make_ids( size_t n ) {
+      std::vector<transaction_id_type> ids;
+      ids.reserve( n );
+      for( size_t i = 0; i < n; ++i ) {
+         ids.push_back( fc::sha256::hash( std::to_string( i ) ) );
+      }
+      return ids;
+   }
+
+   /**
+    * Every thread plays a connection strand receiving the same flood of transactions from its peer, in a
+    * different order than the other connections, and records each one the way net_plugin does.
+    * @return elapsed time in microseconds
+    */
+   int64_t flood( transaction_dedup_index& index, const std::vector<transaction_id_type>& ids, uint32_t connections ) {
+      const fc::time_point_sec expires = fc::time_point::now() + fc::minutes( 1 );
+      const auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for( uint32_t c = 0; c < connections; ++c ) {
+         threads.emplace_back( [&index, &ids, expires, c, connections]() {
+            const size_t offset = ids.size() * c / connections;
+            for( size_t i = 0; i < ids.size(); ++i ) {
+               const auto& id = ids[( i + offset ) % ids.size()];
+               index.has( id );
+               index.add( node_transaction_state{ id, expires, 0, c + 1 } );
+               index.has( id, c + 1 );
+            }
+         } );
+      }
+      for( auto& t : threads ) t.join();
+      return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+   }
+
+}
+
+BOOST_AUTO_TEST_SUITE(transaction_dedup_index_tests)
+
+BOOST_AUTO_TEST_CASE(add_and_find) {
+   transaction_dedup_index index( 5 );
+   BOOST_TEST( index.shard_count() == 8u );
+
+   const auto ids = make_ids( 100 );
+   const fc::time_point_sec expires( 1000 );
+   for( const auto& id : ids ) {
+      BOOST_TEST( index.add( node_transaction_state{ id, expires, 0, 1 } ) );
+   }
+   BOOST_TEST( !index.add( node_transaction_state{ ids[0], expires, 0, 1 } ) );
+   BOOST_TEST( index.add( node_transaction_state{ ids[0], expires, 0, 2 } ) );
+   BOOST_TEST( index.size() == 101u );
+
+   BOOST_TEST( index.has( ids[0] ) );
+   BOOST_TEST( index.has( ids[0], 2 ) );
+   BOOST_TEST( !index.has( ids[1], 2 ) );
+   BOOST_TEST( !index.has( fc::sha256::hash( std::string( "unknown" ) ) ) );
+}
+
+BOOST_AUTO_TEST_CASE(expire) {
+   transaction_dedup_index index;
+   const auto ids = make_ids( 300 );
+   for( size_t i = 0; i < ids.size(); ++i ) {
+      // the first hundred expire at 100, the others at 200
+      index.add( node_transaction_state{ ids[i], fc::time_point_sec( i < 100 ? 100 : 200 ), 0, 1 } );
+   }
+
+   // transactions of a block up to the lib are dropped even before they expire
+   std::vector<transaction_id_type> in_block( ids.begin() + 100, ids.begin() + 150 );
+   index.update_block_num( in_block, 10 );
+   index.update_block_num( ids[150], 11 );
+
+   BOOST_TEST( index.expire( fc::time_point_sec( 50 ), 9 ) == 0u );
+   BOOST_TEST( index.expire( fc::time_point_sec( 100 ), 10 ) == 150u );
+   BOOST_TEST( !index.has( ids[0] ) );
+   BOOST_TEST( !index.has( ids[100] ) );
+   BOOST_TEST( index.has( ids[150] ) );
+   BOOST_TEST( index.expire( fc::time_point_sec( 150 ), 11 ) == 1u );
+   BOOST_TEST( index.size() == 149u );
+   BOOST_TEST( index.expire( fc::time_point_sec( 200 ), 11 ) == 149u );
+   BOOST_TEST( index.size() == 0u );
+}
+
+BOOST_AUTO_TEST_CASE(release_transaction_in_block) {
+   transaction_dedup_index index;
+   chain::signed_transaction t;
+   t.expiration = fc::time_point_sec( 1000 );
+   auto trx = std::make_shared<chain::packed_transaction>( std::move( t ) );
+   const auto& id = trx->id();
+   index.add( node_transaction_state{ id, trx->expiration(), 0, 1, trx } );
+   index.add( node_transaction_state{ id, trx->expiration(), 0, 2 } );
+   BOOST_TEST( index.find_transaction( id._hash[0] ) == trx );
+
+   // only the id is needed once in a block
+   index.update_block_num( id, 10 );
+   BOOST_TEST( !index.find_transaction( id._hash[0] ) );
+   BOOST_TEST( trx.use_count() == 1 );
+   BOOST_TEST( index.has( id, 1 ) );
+   BOOST_TEST( index.has( id, 2 ) );
+}
+
+BOOST_AUTO_TEST_CASE(contention_benchmark) {
+   const uint32_t connections = std::max( 4u, std::thread::hardware_concurrency() );
+   const auto ids = make_ids( 20000 );
+
+   transaction_dedup_index single( 1 );
+   transaction_dedup_index sharded;
+   const auto single_us  = flood( single, ids, connections );
+   const auto sharded_us = flood( sharded, ids, connections );
+
+   BOOST_TEST_MESSAGE( connections << " connections receiving " << ids.size() << " transactions: "
+                       << single_us << "us with 1 shard, " << sharded_us << "us with " << sharded.shard_count() << " shards" );
+   BOOST_TEST( single.size() == ids.size() * connections );
+   BOOST_TEST( sharded.size() == ids.size() * connections );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -71,6 +71,16 @@ struct async_result_visitor : public fc::visitor<fc::variant> {
 #define INVOKE_R_V_ASYNC(api_handle, call_name)\
      api_handle.call_name(next);
 
+#define INVOKE_R_R_ASYNC(api_handle, call_name, in_param)\
+     in_param params;\
+     try {\
+        params = fc::json::from_string(body).as<in_param>();\
+     } catch (const fc::exception& e) {\
+        next(e.dynamic_copy_exception());\
+        return;\
+     }\
+     api_handle.call_name(params, next);
+
 #define INVOKE_V_R(api_handle, call_name, in_param) \
      api_handle.call_name(fc::json::from_string(body).as<in_param>()); \
      eosio::detail::producer_api_plugin_response result{"ok"};
@@ -114,7 +124,7 @@ void producer_api_plugin::plugin_startup() {
        CALL(producer, producer, get_integrity_hash,
             INVOKE_R_V(producer, get_integrity_hash), 201),
        CALL_ASYNC(producer, producer, create_snapshot, producer_plugin::snapshot_information,
-            INVOKE_R_V_ASYNC(producer, create_snapshot), 201),
+            INVOKE_R_R_ASYNC(producer, create_snapshot, producer_plugin::create_snapshot_params), 201),
        CALL(producer, producer, get_scheduled_protocol_feature_activations,
             INVOKE_R_V(producer, get_scheduled_protocol_feature_activations), 201),
        CALL(producer, producer, schedule_protocol_feature_activations,
@@ -124,6 +134,10 @@ void producer_api_plugin::plugin_startup() {
                                  producer_plugin::get_supported_protocol_features_params), 201),
        CALL(producer, producer, get_account_ram_corrections,
             INVOKE_R_R(producer, get_account_ram_corrections, producer_plugin::get_account_ram_corrections_params), 201),
+       CALL(producer, producer, get_subjective_billing,
+            INVOKE_R_R(producer, get_subjective_billing, producer_plugin::get_subjective_billing_params), 201),
+       CALL(producer, producer, get_contract_profile,
+            INVOKE_R_R(producer, get_contract_profile, producer_plugin::get_contract_profile_params), 201),
    }, appbase::priority::medium_high);
 }
 
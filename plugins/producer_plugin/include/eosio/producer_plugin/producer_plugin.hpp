@@ -1,6 +1,7 @@
 #pragma once
 
 #include <eosio/chain_plugin/chain_plugin.hpp>
+#include <eosio/chain/contract_profiler.hpp>
 #include <eosio/http_client_plugin/http_client_plugin.hpp>
 
 #include <appbase/application.hpp>
@@ -22,6 +23,7 @@ public:
       fc::optional<int32_t>   subjective_cpu_leeway_us;
       fc::optional<double>    incoming_defer_ratio;
       fc::optional<uint32_t>  greylist_limit;
+      fc::optional<bool>      profile_contracts; ///< enabling discards the profile recorded so far
    };
 
    struct whitelist_blacklist {
@@ -42,6 +44,11 @@ public:
       chain::digest_type   integrity_hash;
    };
 
+   struct create_snapshot_params {
+      /// only the state changed since the previous snapshot, needs enable-snapshot-deltas
+      bool                 delta = false;
+   };
+
    struct snapshot_information {
       chain::block_id_type head_block_id;
       std::string          snapshot_name;
@@ -68,6 +75,35 @@ public:
       optional<account_name>   more;
    };
 
+   struct get_subjective_billing_params {
+      optional<account_name>  account;     ///< only this account, otherwise the most billed
+      uint32_t                limit = 10;
+   };
+
+   struct account_subjective_billing {
+      account_name            account;
+      uint64_t                billed_us = 0;
+   };
+
+   struct get_subjective_billing_result {
+      uint64_t                                 accounts = 0;
+      uint64_t                                 failed_trxs = 0;
+      uint64_t                                 rejected_trxs = 0;
+      uint64_t                                 total_billed_us = 0;
+      std::vector<account_subjective_billing>  rows;
+   };
+
+   struct get_contract_profile_params {
+      uint32_t                limit = 100;
+   };
+
+   struct get_contract_profile_result {
+      bool                                           enabled = false;
+      fc::time_point                                 since;
+      std::vector<chain::contract_profiler::entry>   rows;   ///< up to limit, most wall time first
+      std::string                                    folded; ///< rows in folded stack format, for flamegraph.pl or pprof
+   };
+
    template<typename T>
    using next_function = std::function<void(const fc::static_variant<fc::exception_ptr, T>&)>;
 
@@ -101,7 +137,7 @@ public:
    void set_whitelist_blacklist(const whitelist_blacklist& params);
 
    integrity_hash_information get_integrity_hash() const;
-   void create_snapshot(next_function<snapshot_information> next);
+   void create_snapshot(const create_snapshot_params& params, next_function<snapshot_information> next);
 
    scheduled_protocol_feature_activations get_scheduled_protocol_feature_activations() const;
    void schedule_protocol_feature_activations(const scheduled_protocol_feature_activations& schedule);
@@ -110,6 +146,10 @@ public:
 
    get_account_ram_corrections_result  get_account_ram_corrections( const get_account_ram_corrections_params& params ) const;
 
+   get_subjective_billing_result  get_subjective_billing( const get_subjective_billing_params& params ) const;
+
+   get_contract_profile_result  get_contract_profile( const get_contract_profile_params& params ) const;
+
    void log_failed_transaction(const transaction_id_type& trx_id, const char* reason) const;
 
  private:
@@ -118,12 +158,18 @@ public:
 
 } //eosio
 
-FC_REFLECT(eosio::producer_plugin::runtime_options, (max_transaction_time)(max_irreversible_block_age)(produce_time_offset_us)(last_block_time_offset_us)(max_scheduled_transaction_time_per_block_ms)(subjective_cpu_leeway_us)(incoming_defer_ratio)(greylist_limit));
+FC_REFLECT(eosio::producer_plugin::runtime_options, (max_transaction_time)(max_irreversible_block_age)(produce_time_offset_us)(last_block_time_offset_us)(max_scheduled_transaction_time_per_block_ms)(subjective_cpu_leeway_us)(incoming_defer_ratio)(greylist_limit)(profile_contracts));
 FC_REFLECT(eosio::producer_plugin::greylist_params, (accounts));
 FC_REFLECT(eosio::producer_plugin::whitelist_blacklist, (actor_whitelist)(actor_blacklist)(contract_whitelist)(contract_blacklist)(action_blacklist)(key_blacklist) )
 FC_REFLECT(eosio::producer_plugin::integrity_hash_information, (head_block_id)(integrity_hash))
+FC_REFLECT(eosio::producer_plugin::create_snapshot_params, (delta))
 FC_REFLECT(eosio::producer_plugin::snapshot_information, (head_block_id)(snapshot_name))
 FC_REFLECT(eosio::producer_plugin::scheduled_protocol_feature_activations, (protocol_features_to_activate))
 FC_REFLECT(eosio::producer_plugin::get_supported_protocol_features_params, (exclude_disabled)(exclude_unactivatable))
 FC_REFLECT(eosio::producer_plugin::get_account_ram_corrections_params, (lower_bound)(upper_bound)(limit)(reverse))
 FC_REFLECT(eosio::producer_plugin::get_account_ram_corrections_result, (rows)(more))
+FC_REFLECT(eosio::producer_plugin::get_subjective_billing_params, (account)(limit))
+FC_REFLECT(eosio::producer_plugin::account_subjective_billing, (account)(billed_us))
+FC_REFLECT(eosio::producer_plugin::get_subjective_billing_result, (accounts)(failed_trxs)(rejected_trxs)(total_billed_us)(rows))
+FC_REFLECT(eosio::producer_plugin::get_contract_profile_params, (limit))
+FC_REFLECT(eosio::producer_plugin::get_contract_profile_result, (enabled)(since)(rows)(folded))
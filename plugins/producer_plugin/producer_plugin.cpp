@@ -5,6 +5,8 @@
 #include <eosio/chain/snapshot.hpp>
 #include <eosio/chain/transaction_object.hpp>
 #include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/recovered_keys_cache.hpp>
+#include <eosio/chain/subjective_billing.hpp>
 #include <eosio/chain/unapplied_transaction_queue.hpp>
 
 #include <fc/io/json.hpp>
@@ -122,16 +124,16 @@ public:
       return block_header::num_from_id(block_id);
    }
 
-   static bfs::path get_final_path(const block_id_type& block_id, const bfs::path& snapshots_dir) {
-      return snapshots_dir / fc::format_string("snapshot-${id}.bin", fc::mutable_variant_object()("id", block_id));
+   static bfs::path get_final_path(const block_id_type& block_id, const bfs::path& snapshots_dir, bool delta = false) {
+      return snapshots_dir / fc::format_string(delta ? "snapshot-delta-${id}.bin" : "snapshot-${id}.bin", fc::mutable_variant_object()("id", block_id));
    }
 
-   static bfs::path get_pending_path(const block_id_type& block_id, const bfs::path& snapshots_dir) {
-      return snapshots_dir / fc::format_string(".pending-snapshot-${id}.bin", fc::mutable_variant_object()("id", block_id));
+   static bfs::path get_pending_path(const block_id_type& block_id, const bfs::path& snapshots_dir, bool delta = false) {
+      return snapshots_dir / fc::format_string(delta ? ".pending-snapshot-delta-${id}.bin" : ".pending-snapshot-${id}.bin", fc::mutable_variant_object()("id", block_id));
    }
 
-   static bfs::path get_temp_path(const block_id_type& block_id, const bfs::path& snapshots_dir) {
-      return snapshots_dir / fc::format_string(".incomplete-snapshot-${id}.bin", fc::mutable_variant_object()("id", block_id));
+   static bfs::path get_temp_path(const block_id_type& block_id, const bfs::path& snapshots_dir, bool delta = false) {
+      return snapshots_dir / fc::format_string(delta ? ".incomplete-snapshot-delta-${id}.bin" : ".incomplete-snapshot-${id}.bin", fc::mutable_variant_object()("id", block_id));
    }
 
    producer_plugin::snapshot_information finalize( const chain::controller& chain ) const {
@@ -206,8 +208,22 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       std::map<chain::account_name, producer_watermark>         _producer_watermarks;
       pending_block_mode                                        _pending_block_mode = pending_block_mode::speculating;
       unapplied_transaction_queue                               _unapplied_transactions;
+      subjective_billing                                        _subjective_billing;
       fc::optional<named_thread_pool>                           _thread_pool;
 
+      /// an incoming transaction waiting for its keys to be recovered
+      struct pending_key_recovery {
+         packed_transaction_ptr                trx;
+         bool                                  persist_until_expired = false;
+         next_function<transaction_trace_ptr>  next;
+         fc::microseconds                      time_limit;
+         uint32_t                              max_variable_sig_size = 0;
+      };
+      std::mutex                                                _key_recovery_mtx;
+      std::deque<pending_key_recovery>                          _key_recovery_queue;    // guarded by _key_recovery_mtx
+      uint32_t                                                  _key_recovery_tasks = 0; // guarded by _key_recovery_mtx, tasks posted but not started
+      uint32_t                                                  _key_recovery_batch_size = 16;
+
       std::atomic<int32_t>                                      _max_transaction_time_ms; // modified by app thread, read by net_plugin thread pool
       fc::microseconds                                          _max_irreversible_block_age_us;
       int32_t                                                   _produce_time_offset_us = 0;
@@ -255,6 +271,7 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
 
       // path to write the snapshots to
       bfs::path _snapshots_dir;
+      bool      _compress_snapshots = false;
 
       void consider_new_watermark( account_name producer, uint32_t block_num, block_timestamp_type timestamp) {
          auto itr = _producer_watermarks.find( producer );
@@ -462,33 +479,69 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
          const auto max_trx_time_ms = _max_transaction_time_ms.load();
          fc::microseconds max_trx_cpu_usage = max_trx_time_ms < 0 ? fc::microseconds::maximum() : fc::milliseconds( max_trx_time_ms );
 
-         auto future = transaction_metadata::start_recover_keys( trx, _thread_pool->get_executor(),
-                chain.get_chain_id(), fc::microseconds( max_trx_cpu_usage ), chain.configured_subjective_signature_length_limit() );
-
-         auto trx_id = trx->id();
-         boost::asio::post(_thread_pool->get_executor(), [self = this, future{std::move(future)}, persist_until_expired,
-                                                          next{std::move(next)}, trx_id]() mutable {
-            if( future.valid() ) {
-               future.wait();
-               app().post( priority::low, [self, future{std::move(future)}, persist_until_expired, next{std::move( next )}, trx_id]() mutable {
-                  auto exception_handler = [&next, trx_id](fc::exception_ptr ex) {
-                     fc_dlog(_trx_successful_trace_log, "[TRX_TRACE] Speculative execution is REJECTING tx: ${txid} : ${why} ",
-                            ("txid", trx_id)("why",ex->what()));
-                     fc_dlog(_trx_failed_trace_log, "[TRX_TRACE] Speculative execution is REJECTING tx: ${txid} : ${why} ",
-                            ("txid", trx_id)("why",ex->what()));
-                     next(ex);
-                  };
-                  try {
-                     auto result = future.get();
-                     if( !self->process_incoming_transaction_async( result, persist_until_expired, next ) ) {
-                        if( self->_pending_block_mode == pending_block_mode::producing ) {
-                           self->schedule_maybe_produce_block( true );
-                        }
+         // transactions arriving while the thread pool is busy are recovered together, a task per batch
+         std::lock_guard<std::mutex> g( _key_recovery_mtx );
+         _key_recovery_queue.push_back( pending_key_recovery{ trx, persist_until_expired, std::move( next ),
+                                                              max_trx_cpu_usage, chain.configured_subjective_signature_length_limit() } );
+         schedule_key_recovery();
+      }
+
+      // call with _key_recovery_mtx locked
+      void schedule_key_recovery() {
+         if( _key_recovery_queue.size() <= _key_recovery_tasks * _key_recovery_batch_size ) return;
+         ++_key_recovery_tasks;
+         boost::asio::post( _thread_pool->get_executor(), [self = this]() {
+            self->recover_keys_batch();
+         } );
+      }
+
+      // called from producer thread pool
+      void recover_keys_batch() {
+         std::vector<pending_key_recovery> batch;
+         {
+            std::lock_guard<std::mutex> g( _key_recovery_mtx );
+            --_key_recovery_tasks;
+            const size_t n = std::min<size_t>( _key_recovery_queue.size(), _key_recovery_batch_size );
+            batch.reserve( n );
+            std::move( _key_recovery_queue.begin(), _key_recovery_queue.begin() + n, std::back_inserter( batch ) );
+            _key_recovery_queue.erase( _key_recovery_queue.begin(), _key_recovery_queue.begin() + n );
+            schedule_key_recovery();
+         }
+
+         chain::controller& chain = chain_plug->chain();
+         const chain_id_type chain_id = chain.get_chain_id();
+         recovered_keys_cache& cache = chain.get_recovered_keys_cache();
+         for( auto& p : batch ) {
+            transaction_metadata_ptr result;
+            fc::exception_ptr except;
+            auto keep_exception = [&except]( fc::exception_ptr ex ) { except = std::move( ex ); };
+            try {
+               result = transaction_metadata::recover_keys( p.trx, chain_id, p.time_limit, p.max_variable_sig_size, &cache );
+            } CATCH_AND_CALL(keep_exception);
+
+            app().post( priority::low, [self = this, result{std::move(result)}, except{std::move(except)},
+                                        persist_until_expired = p.persist_until_expired, next{std::move( p.next )},
+                                        trx_id = p.trx->id()]() mutable {
+               auto exception_handler = [&next, trx_id](fc::exception_ptr ex) {
+                  fc_dlog(_trx_successful_trace_log, "[TRX_TRACE] Speculative execution is REJECTING tx: ${txid} : ${why} ",
+                         ("txid", trx_id)("why",ex->what()));
+                  fc_dlog(_trx_failed_trace_log, "[TRX_TRACE] Speculative execution is REJECTING tx: ${txid} : ${why} ",
+                         ("txid", trx_id)("why",ex->what()));
+                  next(ex);
+               };
+               if( except ) {
+                  exception_handler( except );
+                  return;
+               }
+               try {
+                  if( !self->process_incoming_transaction_async( result, persist_until_expired, next ) ) {
+                     if( self->_pending_block_mode == pending_block_mode::producing ) {
+                        self->schedule_maybe_produce_block( true );
                      }
-                  } CATCH_AND_CALL(exception_handler);
-               } );
-            }
-         });
+                  }
+               } CATCH_AND_CALL(exception_handler);
+            } );
+         }
       }
 
       bool process_incoming_transaction_async(const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next) {
@@ -555,6 +608,14 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
                return true;
             }
 
+            const account_name first_auth = trx->packed_trx()->get_transaction().first_authorizer();
+            if( _subjective_billing.reject( first_auth, fc::time_point::now() ) ) {
+               send_response( std::static_pointer_cast<fc::exception>( std::make_shared<tx_cpu_usage_exceeded>(
+                     FC_LOG_MESSAGE( error, "transaction ${id} dropped, ${a} is over its subjective cpu budget for failed transactions",
+                                     ("id", id)("a", first_auth)))) );
+               return true;
+            }
+
             auto deadline = fc::time_point::now() + fc::milliseconds( _max_transaction_time_ms );
             bool deadline_is_subjective = false;
             const auto block_deadline = calculate_block_deadline( chain.pending_block_time() );
@@ -580,6 +641,7 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
                   if( !exhausted )
                      exhausted = block_is_exhausted();
                } else {
+                  _subjective_billing.bill_failed( first_auth, trace->elapsed, fc::time_point::now() );
                   auto e_ptr = trace->except->dynamic_copy_exception();
                   send_response( e_ptr );
                }
@@ -727,10 +789,20 @@ void producer_plugin::set_program_options(
           "ratio between incoming transactions and deferred transactions when both are queued for execution")
          ("incoming-transaction-queue-size-mb", bpo::value<uint16_t>()->default_value( 1024 ),
           "Maximum size (in MiB) of the incoming transaction queue. Exceeding this value will subjectively drop transaction with resource exhaustion.")
+         ("fair-unapplied-transactions", bpo::bool_switch()->default_value(false),
+          "Retry unapplied transactions one account (first authorizer) at a time, cheapest previously billed cpu first, instead of in arrival order")
+         ("subjective-billing-decay-sec", bpo::value<uint32_t>()->default_value(300),
+          "Seconds over which cpu spent on failed transactions, billed subjectively to their first authorizer, decays to zero; 0 disables subjective billing")
+         ("subjective-account-max-failed-cpu-us", bpo::value<uint64_t>()->default_value(0),
+          "Drop incoming transactions, without executing them, of accounts with more subjectively billed cpu of failed transactions than this; 0 never drops")
          ("producer-threads", bpo::value<uint16_t>()->default_value(config::default_controller_thread_pool_size),
           "Number of worker threads in producer thread pool")
+         ("key-recovery-batch-size", bpo::value<uint32_t>()->default_value(16),
+          "Maximum number of incoming transactions whose signatures are recovered by one producer thread pool task")
          ("snapshots-dir", bpo::value<bfs::path>()->default_value("snapshots"),
           "the location of the snapshots directory (absolute path or relative to application data dir)")
+         ("snapshots-compress", bpo::bool_switch()->default_value(false),
+          "write snapshots in the compressed binary format, which is loaded faster but cannot be read by older versions")
          ;
    config_file_options.add(producer_options);
 }
@@ -811,9 +883,13 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
    unapplied_transaction_queue::process_mode unapplied_mode =
       (chain.get_read_mode() != chain::db_read_mode::SPECULATIVE) ? unapplied_transaction_queue::process_mode::non_speculative :
          my->_producers.empty() ? unapplied_transaction_queue::process_mode::speculative_non_producer :
-            unapplied_transaction_queue::process_mode::speculative_producer;
+            options.at( "fair-unapplied-transactions" ).as<bool>() ? unapplied_transaction_queue::process_mode::speculative_fair_producer :
+               unapplied_transaction_queue::process_mode::speculative_producer;
    my->_unapplied_transactions.set_mode( unapplied_mode );
 
+   my->_subjective_billing = subjective_billing( fc::seconds( options.at( "subjective-billing-decay-sec" ).as<uint32_t>() ),
+                                                 options.at( "subjective-account-max-failed-cpu-us" ).as<uint64_t>() );
+
    if( options.count("private-key") )
    {
       const std::vector<std::string> key_id_to_wif_pair_strings = options["private-key"].as<std::vector<std::string>>();
@@ -915,6 +991,10 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
                "producer-threads ${num} must be greater than 0", ("num", thread_pool_size));
    my->_thread_pool.emplace( "prod", thread_pool_size );
 
+   my->_key_recovery_batch_size = options.at( "key-recovery-batch-size" ).as<uint32_t>();
+   EOS_ASSERT( my->_key_recovery_batch_size > 0, plugin_config_exception,
+               "key-recovery-batch-size ${num} must be greater than 0", ("num", my->_key_recovery_batch_size));
+
    if( options.count( "snapshots-dir" )) {
       auto sd = options.at( "snapshots-dir" ).as<bfs::path>();
       if( sd.is_relative()) {
@@ -929,6 +1009,7 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
       EOS_ASSERT( fc::is_directory(my->_snapshots_dir), snapshot_directory_not_found_exception,
                   "No such directory '${dir}'", ("dir", my->_snapshots_dir.generic_string()) );
    }
+   my->_compress_snapshots = options.at( "snapshots-compress" ).as<bool>();
 
    my->_incoming_block_subscription = app().get_channel<incoming::channels::block>().subscribe(
          [this](const signed_block_ptr& block) {
@@ -1104,6 +1185,10 @@ void producer_plugin::update_runtime_options(const runtime_options& options) {
    if (options.greylist_limit) {
       chain.set_greylist_limit(*options.greylist_limit);
    }
+
+   if (options.profile_contracts) {
+      chain.get_contract_profiler().enable(*options.profile_contracts);
+   }
 }
 
 producer_plugin::runtime_options producer_plugin::get_runtime_options() const {
@@ -1117,7 +1202,8 @@ producer_plugin::runtime_options producer_plugin::get_runtime_options() const {
             my->chain_plug->chain().get_subjective_cpu_leeway()->count() :
             fc::optional<int32_t>(),
       my->_incoming_defer_ratio,
-      my->chain_plug->chain().get_greylist_limit()
+      my->chain_plug->chain().get_greylist_limit(),
+      my->chain_plug->chain().get_contract_profiler().enabled()
    };
 }
 
@@ -1185,12 +1271,19 @@ producer_plugin::integrity_hash_information producer_plugin::get_integrity_hash(
    return {chain.head_block_id(), chain.calculate_integrity_hash()};
 }
 
-void producer_plugin::create_snapshot(producer_plugin::next_function<producer_plugin::snapshot_information> next) {
+void producer_plugin::create_snapshot(const create_snapshot_params& params, producer_plugin::next_function<producer_plugin::snapshot_information> next) {
    chain::controller& chain = my->chain_plug->chain();
 
    auto head_id = chain.head_block_id();
-   const auto& snapshot_path = pending_snapshot::get_final_path(head_id, my->_snapshots_dir);
-   const auto& temp_path     = pending_snapshot::get_temp_path(head_id, my->_snapshots_dir);
+   const bool delta = params.delta;
+   if( delta && !chain.has_snapshot_delta_base() ) {
+      auto ex = snapshot_exception( FC_LOG_MESSAGE( error, "no snapshot to base a snapshot delta on, enable-snapshot-deltas is off "
+                                                           "or no full snapshot was created since the changes were tracked" ) );
+      next(ex.dynamic_copy_exception());
+      return;
+   }
+   const auto& snapshot_path = pending_snapshot::get_final_path(head_id, my->_snapshots_dir, delta);
+   const auto& temp_path     = pending_snapshot::get_temp_path(head_id, my->_snapshots_dir, delta);
 
    // maintain legacy exception if the snapshot exists
    if( fc::is_regular_file(snapshot_path) ) {
@@ -1215,8 +1308,13 @@ void producer_plugin::create_snapshot(producer_plugin::next_function<producer_pl
 
       // create the snapshot
       auto snap_out = std::ofstream(p.generic_string(), (std::ios::out | std::ios::binary));
-      auto writer = std::make_shared<ostream_snapshot_writer>(snap_out);
-      chain.write_snapshot(writer);
+      auto writer = my->_compress_snapshots ? std::make_shared<compressed_ostream_snapshot_writer>(snap_out)
+                                            : std::make_shared<ostream_snapshot_writer>(snap_out);
+      if( delta ) {
+         chain.write_delta_snapshot(writer);
+      } else {
+         chain.write_delta_base_snapshot(writer);
+      }
       writer->finalize();
       snap_out.flush();
       snap_out.close();
@@ -1245,7 +1343,11 @@ void producer_plugin::create_snapshot(producer_plugin::next_function<producer_pl
    // determine if this snapshot is already in-flight
    auto& pending_by_id = my->_pending_snapshot_index.get<by_id>();
    auto existing = pending_by_id.find(head_id);
-   if( existing != pending_by_id.end() ) {
+   if( existing != pending_by_id.end() && existing->final_path != snapshot_path.generic_string() ) {
+      auto ex = snapshot_exception( FC_LOG_MESSAGE( error, "a snapshot of another kind is already pending for block ${id}", ("id", head_id) ) );
+      next(ex.dynamic_copy_exception());
+      return;
+   } else if( existing != pending_by_id.end() ) {
       // if a snapshot at this block is already pending, attach this requests handler to it
       pending_by_id.modify(existing, [&next]( auto& entry ){
          entry.next = [prev = entry.next, next](const fc::static_variant<fc::exception_ptr, producer_plugin::snapshot_information>& res){
@@ -1254,7 +1356,7 @@ void producer_plugin::create_snapshot(producer_plugin::next_function<producer_pl
          };
       });
    } else {
-      const auto& pending_path = pending_snapshot::get_pending_path(head_id, my->_snapshots_dir);
+      const auto& pending_path = pending_snapshot::get_pending_path(head_id, my->_snapshots_dir, delta);
 
       try {
          write_snapshot( temp_path ); // create a new pending snapshot
@@ -1333,6 +1435,38 @@ fc::variants producer_plugin::get_supported_protocol_features( const get_support
    return results;
 }
 
+producer_plugin::get_subjective_billing_result
+producer_plugin::get_subjective_billing( const get_subjective_billing_params& params ) const {
+   const auto& billing = my->_subjective_billing;
+   const auto now = fc::time_point::now();
+   get_subjective_billing_result result;
+   result.accounts = billing.size();
+   result.failed_trxs = billing.failed_trxs();
+   result.rejected_trxs = billing.rejected_trxs();
+   result.total_billed_us = billing.total_billed_us();
+   if( params.account ) {
+      result.rows.push_back( { *params.account, billing.get_billed_us( *params.account, now ) } );
+   } else {
+      for( const auto& a : billing.top( params.limit, now ) ) {
+         result.rows.push_back( { a.first, a.second } );
+      }
+   }
+   return result;
+}
+
+producer_plugin::get_contract_profile_result
+producer_plugin::get_contract_profile( const get_contract_profile_params& params ) const {
+   const auto& profiler = my->chain_plug->chain().get_contract_profiler();
+   get_contract_profile_result result;
+   result.enabled = profiler.enabled();
+   result.since = profiler.since();
+   result.rows = profiler.entries();
+   if( result.rows.size() > params.limit )
+      result.rows.resize( params.limit );
+   result.folded = chain::contract_profiler::to_folded( result.rows );
+   return result;
+}
+
 producer_plugin::get_account_ram_corrections_result
 producer_plugin::get_account_ram_corrections( const get_account_ram_corrections_params& params ) const {
    get_account_ram_corrections_result result;
@@ -1616,6 +1750,7 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
             return start_block_result::exhausted;
          if( !remove_expired_blacklisted_trxs( preprocess_deadline ) )
             return start_block_result::exhausted;
+         _subjective_billing.expire( fc::time_point::now() );
 
          // limit execution of pending incoming to once per block
          size_t pending_incoming_process_limit = _pending_incoming_transactions.size();
@@ -1778,6 +1913,8 @@ bool producer_plugin_impl::process_unapplied_trxs( const fc::time_point& deadlin
                } else {
                   // this failed our configured maximum transaction time, we don't want to replay it
                   ++num_failed;
+                  _subjective_billing.bill_failed( trx->packed_trx()->get_transaction().first_authorizer(), trace->elapsed,
+                                                   fc::time_point::now() );
                   itr = _unapplied_transactions.erase( itr );
                   continue;
                }
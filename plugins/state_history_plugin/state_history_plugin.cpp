@@ -1,4 +1,5 @@
 #include <eosio/chain/config.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <eosio/state_history_plugin/state_history_log.hpp>
 #include <eosio/state_history_plugin/state_history_serialization.hpp>
 
@@ -13,6 +14,11 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/signals2/connection.hpp>
 
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <list>
+
 using tcp    = boost::asio::ip::tcp;
 namespace ws = boost::beast::websocket;
 
@@ -38,10 +44,10 @@ auto catch_and_log(F f) {
 }
 
 namespace bio = boost::iostreams;
-static bytes zlib_compress_bytes(bytes in) {
+static bytes zlib_compress_bytes(const bytes& in, int level = bio::zlib::default_compression) {
    bytes                  out;
    bio::filtering_ostream comp;
-   comp.push(bio::zlib_compressor(bio::zlib::default_compression));
+   comp.push(bio::zlib_compressor(bio::zlib_params(level)));
    comp.push(bio::back_inserter(out));
    bio::write(comp, in.data(), in.size());
    bio::close(comp);
@@ -58,6 +64,82 @@ static bytes zlib_decompress(const bytes& in) {
    return out;
 }
 
+/// log entries recently sent to sessions, shared so that clients following head do not each read and inflate the
+/// same entry. The size of an entry counts both its compressed and its decompressed form, if present.
+class log_entry_cache {
+ public:
+   void set_max_bytes(uint64_t max) {
+      max_bytes = max;
+      evict();
+   }
+
+   /// the entry of block_num, compressed as stored or decompressed; read_compressed() is called on a miss
+   template <typename F>
+   std::shared_ptr<const bytes> get(const state_history_log& log, uint32_t block_num, bool compressed, F read_compressed) {
+      const key_type key{&log, block_num};
+      auto           it = entries.find(key);
+      if (it == entries.end()) {
+         ++misses;
+         auto data = std::make_shared<const bytes>(read_compressed());
+         it        = entries.emplace(key, node{data, {}, lru.insert(lru.begin(), key)}).first;
+         total_bytes += data->size();
+      } else {
+         ++hits;
+         lru.splice(lru.begin(), lru, it->second.lru_pos);
+      }
+
+      auto& n = it->second;
+      std::shared_ptr<const bytes> result = n.compressed;
+      if (!compressed) {
+         if (!n.decompressed) {
+            n.decompressed = std::make_shared<const bytes>(zlib_decompress(*n.compressed));
+            total_bytes += n.decompressed->size();
+         }
+         result = n.decompressed;
+      }
+      evict();
+      return result;
+   }
+
+   /// drop the entries of block_num and later, which are about to be rewritten
+   void erase_from(const state_history_log& log, uint32_t block_num) {
+      for (auto it = entries.lower_bound(key_type{&log, block_num}); it != entries.end() && it->first.first == &log;)
+         it = erase(it);
+   }
+
+   uint64_t hit_count() const { return hits; }
+   uint64_t miss_count() const { return misses; }
+
+ private:
+   using key_type = std::pair<const state_history_log*, uint32_t>;
+
+   struct node {
+      std::shared_ptr<const bytes>  compressed;
+      std::shared_ptr<const bytes>  decompressed;
+      std::list<key_type>::iterator lru_pos;
+   };
+
+   std::map<key_type, node>::iterator erase(std::map<key_type, node>::iterator it) {
+      total_bytes -= it->second.compressed->size();
+      if (it->second.decompressed)
+         total_bytes -= it->second.decompressed->size();
+      lru.erase(it->second.lru_pos);
+      return entries.erase(it);
+   }
+
+   void evict() {
+      while (total_bytes > max_bytes && !lru.empty())
+         erase(entries.find(lru.back()));
+   }
+
+   std::map<key_type, node> entries;
+   std::list<key_type>      lru; ///< most recently used first
+   uint64_t                 total_bytes = 0;
+   uint64_t                 max_bytes   = 0;
+   uint64_t                 hits        = 0;
+   uint64_t                 misses      = 0;
+};
+
 template <typename T>
 bool include_delta(const T& old, const T& curr) {
    return true;
@@ -124,18 +206,43 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
    std::unique_ptr<tcp::acceptor>                             acceptor;
    std::map<transaction_id_type, augmented_transaction_trace> cached_traces;
    fc::optional<augmented_transaction_trace>                  onblock_trace;
+   fc::optional<named_thread_pool>                            thread_pool;
+   int                                                        compression_level = bio::zlib::default_compression;
+   size_t                                                     max_pending_entries = 0;
 
-   void get_log_entry(state_history_log& log, uint32_t block_num, fc::optional<bytes>& result) {
+   struct compressed_entry {
+      bytes            data;
+      fc::microseconds compress_time;
+   };
+
+   /// a log entry whose payload is being compressed on the thread pool; entries are written in the order queued
+   struct pending_entry {
+      state_history_log*             log  = nullptr;
+      const char*                    name = "";
+      block_state_ptr                block_state;
+      fc::time_point                 accepted;
+      fc::microseconds               pack_time;
+      std::future<compressed_entry>  compressed;
+   };
+   std::deque<pending_entry>                                  pending_entries;
+   log_entry_cache                                            entry_cache;
+
+   void get_log_entry(state_history_log& log, uint32_t block_num, bool compressed, fc::optional<bytes>& result) {
+      if (block_num >= log.end_block() && !pending_entries.empty())
+         write_pending_entries(0);
       if (block_num < log.begin_block() || block_num >= log.end_block())
          return;
-      state_history_log_header header;
-      auto&                    stream = log.get_entry(block_num, header);
-      uint32_t                 s;
-      stream.read((char*)&s, sizeof(s));
-      bytes compressed(s);
-      if (s)
-         stream.read(compressed.data(), s);
-      result = zlib_decompress(compressed);
+      auto entry = entry_cache.get(log, block_num, compressed, [&]() {
+         state_history_log_header header;
+         auto&                    stream = log.get_entry(block_num, header);
+         uint32_t                 s;
+         stream.read((char*)&s, sizeof(s));
+         bytes data(s);
+         if (s)
+            stream.read(data.data(), s);
+         return data;
+      });
+      result = *entry;
    }
 
    void get_block(uint32_t block_num, fc::optional<bytes>& result) {
@@ -170,6 +277,7 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       bool                                       sent_abi = false;
       std::vector<std::vector<char>>             send_queue;
       fc::optional<get_blocks_request_v0>        current_request;
+      bool                                       compressed_entries  = false;
       bool                                       need_to_send_update = false;
 
       session(std::shared_ptr<state_history_plugin_impl> plugin)
@@ -254,6 +362,16 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       }
 
       void operator()(get_blocks_request_v0& req) {
+         compressed_entries = false;
+         start_get_blocks(req);
+      }
+
+      void operator()(get_blocks_request_v1& req) {
+         compressed_entries = req.compressed_entries;
+         start_get_blocks(req);
+      }
+
+      void start_get_blocks(get_blocks_request_v0& req) {
          for (auto& cp : req.have_positions) {
             if (req.start_block_num <= cp.block_num)
                continue;
@@ -292,9 +410,11 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
                if (current_request->fetch_block)
                   plugin->get_block(current_request->start_block_num, result.block);
                if (current_request->fetch_traces && plugin->trace_log)
-                  plugin->get_log_entry(*plugin->trace_log, current_request->start_block_num, result.traces);
+                  plugin->get_log_entry(*plugin->trace_log, current_request->start_block_num, compressed_entries,
+                                        result.traces);
                if (current_request->fetch_deltas && plugin->chain_state_log)
-                  plugin->get_log_entry(*plugin->chain_state_log, current_request->start_block_num, result.deltas);
+                  plugin->get_log_entry(*plugin->chain_state_log, current_request->start_block_num, compressed_entries,
+                                        result.deltas);
             }
             ++current_request->start_block_num;
          }
@@ -427,14 +547,93 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       store_chain_state(block_state);
       for (auto& s : sessions) {
          auto& p = s.second;
-         if (p) {
-            if (p->current_request && block_state->block_num < p->current_request->start_block_num)
-               p->current_request->start_block_num = block_state->block_num;
+         if (p && p->current_request && block_state->block_num < p->current_request->start_block_num)
+            p->current_request->start_block_num = block_state->block_num;
+      }
+      // sessions hear about the block once its log entries are written
+      if (pending_entries.empty())
+         notify_sessions(block_state);
+   }
+
+   void notify_sessions(const block_state_ptr& block_state) {
+      for (auto& s : sessions) {
+         auto& p = s.second;
+         if (p)
             p->send_update(block_state);
+      }
+   }
+
+   /// compress payload on the thread pool and append it to log once it and all entries queued before it are done
+   void queue_entry(state_history_log& log, const char* name, const block_state_ptr& block_state, bytes payload,
+                    fc::microseconds pack_time) {
+      auto promise = std::make_shared<std::promise<compressed_entry>>();
+      pending_entries.push_back(pending_entry{&log, name, block_state, fc::time_point::now(), pack_time, promise->get_future()});
+
+      boost::asio::post(thread_pool->get_executor(),
+                        [self = shared_from_this(), promise, payload = std::move(payload), level = compression_level]() {
+         try {
+            auto start = fc::time_point::now();
+            auto data  = zlib_compress_bytes(payload, level);
+            promise->set_value(compressed_entry{std::move(data), fc::time_point::now() - start});
+         } catch (...) {
+            promise->set_exception(std::current_exception());
+         }
+         app().post(priority::medium, [self]() {
+            if (!self->stopping)
+               self->write_pending_entries(self->max_pending_entries);
+         });
+      });
+
+      // block apply instead of growing without bound when compression falls behind, e.g. during replay
+      if (pending_entries.size() > max_pending_entries)
+         write_pending_entries(max_pending_entries);
+   }
+
+   /// write the completed entries at the front of the queue, waiting for more until at most max_remaining are left
+   void write_pending_entries(size_t max_remaining) {
+      while (!pending_entries.empty()) {
+         auto& entry = pending_entries.front();
+         if (pending_entries.size() <= max_remaining &&
+             entry.compressed.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;
+
+         auto compressed = entry.compressed.get();
+         EOS_ASSERT(compressed.data.size() == (uint32_t)compressed.data.size(), plugin_exception, "${name} entry is too big",
+                    ("name", entry.name));
+         state_history_log_header header{.magic        = ship_magic(ship_current_version),
+                                         .block_id     = entry.block_state->block->id(),
+                                         .payload_size = sizeof(uint32_t) + compressed.data.size()};
+         entry_cache.erase_from(*entry.log, entry.block_state->block_num);
+         entry.log->write_entry(header, entry.block_state->block->previous, [&](auto& stream) {
+            uint32_t s = (uint32_t)compressed.data.size();
+            stream.write((char*)&s, sizeof(s));
+            if (!compressed.data.empty())
+               stream.write(compressed.data.data(), compressed.data.size());
+         });
+
+         dlog("${name} block ${n}: packed in ${pack}us, compressed ${size} bytes in ${comp}us, written ${latency}us after "
+              "being accepted",
+              ("name", entry.name)("n", entry.block_state->block_num)("pack", entry.pack_time.count())
+              ("size", compressed.data.size())("comp", compressed.compress_time.count())
+              ("latency", (fc::time_point::now() - entry.accepted).count()));
+
+         auto block_state = std::move(entry.block_state);
+         pending_entries.pop_front();
+         if (pending_entries.empty() || pending_entries.front().block_state != block_state) {
+            // may be called from within a session, so notify from a fresh call stack
+            app().post(priority::medium, [self = shared_from_this(), block_state]() {
+               if (!self->stopping)
+                  self->notify_sessions(block_state);
+            });
          }
       }
    }
 
+   bool has_pending_entries(const state_history_log& log) const {
+      return std::any_of(pending_entries.begin(), pending_entries.end(),
+                         [&log](const pending_entry& entry) { return entry.log == &log; });
+   }
+
    void on_block_start(uint32_t block_num) {
       clear_caches();
    }
@@ -463,30 +662,21 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       }
       clear_caches();
 
-      auto& db         = chain_plug->chain().db();
-      auto  traces_bin = zlib_compress_bytes(fc::raw::pack(make_history_context_wrapper(db, trace_debug_mode, traces)));
-      EOS_ASSERT(traces_bin.size() == (uint32_t)traces_bin.size(), plugin_exception, "traces is too big");
-
-      state_history_log_header header{.magic        = ship_magic(ship_current_version),
-                                      .block_id     = block_state->block->id(),
-                                      .payload_size = sizeof(uint32_t) + traces_bin.size()};
-      trace_log->write_entry(header, block_state->block->previous, [&](auto& stream) {
-         uint32_t s = (uint32_t)traces_bin.size();
-         stream.write((char*)&s, sizeof(s));
-         if (!traces_bin.empty())
-            stream.write(traces_bin.data(), traces_bin.size());
-      });
+      auto& db    = chain_plug->chain().db();
+      auto  start = fc::time_point::now();
+      auto  traces_bin = fc::raw::pack(make_history_context_wrapper(db, trace_debug_mode, traces));
+      queue_entry(*trace_log, "trace_history", block_state, std::move(traces_bin), fc::time_point::now() - start);
    }
 
    void store_chain_state(const block_state_ptr& block_state) {
       if (!chain_state_log)
          return;
-      bool fresh = chain_state_log->begin_block() == chain_state_log->end_block();
+      bool fresh = chain_state_log->begin_block() == chain_state_log->end_block() && !has_pending_entries(*chain_state_log);
       if (fresh)
          ilog("Placing initial state in block ${n}", ("n", block_state->block->block_num()));
 
-      std::vector<table_delta> deltas;
-      auto&                    db = chain_plug->chain().db();
+      auto start = fc::time_point::now();
+      auto& db   = chain_plug->chain().db();
 
       const auto&                                table_id_index = db.get_index<table_id_multi_index>();
       std::map<uint64_t, const table_id_object*> removed_table_id;
@@ -508,36 +698,42 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
          return fc::raw::pack(make_history_context_wrapper(db, get_table_id(row.t_id._id), row));
       };
 
+      // each table is packed on the thread pool; the state does not change until this returns
+      std::vector<std::future<fc::optional<table_delta>>> packed_tables;
       auto process_table = [&](auto* name, auto& index, auto& pack_row) {
-         if (fresh) {
-            if (index.indices().empty())
-               return;
-            deltas.push_back({});
-            auto& delta = deltas.back();
-            delta.name  = name;
-            for (auto& row : index.indices())
-               delta.rows.obj.emplace_back(true, pack_row(row));
-         } else {
-            if (index.stack().empty())
-               return;
-            auto& undo = index.stack().back();
-            if (undo.old_values.empty() && undo.new_ids.empty() && undo.removed_values.empty())
-               return;
-            deltas.push_back({});
-            auto& delta = deltas.back();
-            delta.name  = name;
-            for (auto& old : undo.old_values) {
-               auto& row = index.get(old.first);
-               if (include_delta(old.second, row))
+         packed_tables.emplace_back(async_thread_pool(thread_pool->get_executor(), [&, name]() {
+            fc::optional<table_delta> result;
+            if (fresh) {
+               if (index.indices().empty())
+                  return result;
+               result.emplace();
+               auto& delta = *result;
+               delta.name  = name;
+               for (auto& row : index.indices())
                   delta.rows.obj.emplace_back(true, pack_row(row));
+            } else {
+               if (index.stack().empty())
+                  return result;
+               auto& undo = index.stack().back();
+               if (undo.old_values.empty() && undo.new_ids.empty() && undo.removed_values.empty())
+                  return result;
+               result.emplace();
+               auto& delta = *result;
+               delta.name  = name;
+               for (auto& old : undo.old_values) {
+                  auto& row = index.get(old.first);
+                  if (include_delta(old.second, row))
+                     delta.rows.obj.emplace_back(true, pack_row(row));
+               }
+               for (auto& old : undo.removed_values)
+                  delta.rows.obj.emplace_back(false, pack_row(old.second));
+               for (auto id : undo.new_ids) {
+                  auto& row = index.get(id);
+                  delta.rows.obj.emplace_back(true, pack_row(row));
+               }
             }
-            for (auto& old : undo.removed_values)
-               delta.rows.obj.emplace_back(false, pack_row(old.second));
-            for (auto id : undo.new_ids) {
-               auto& row = index.get(id);
-               delta.rows.obj.emplace_back(true, pack_row(row));
-            }
-         }
+            return result;
+         }));
       };
 
       process_table("account", db.get_index<account_index>(), pack_row);
@@ -564,17 +760,25 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       process_table("resource_limits_state", db.get_index<resource_limits::resource_limits_state_index>(), pack_row);
       process_table("resource_limits_config", db.get_index<resource_limits::resource_limits_config_index>(), pack_row);
 
-      auto deltas_bin = zlib_compress_bytes(fc::raw::pack(deltas));
-      EOS_ASSERT(deltas_bin.size() == (uint32_t)deltas_bin.size(), plugin_exception, "deltas is too big");
-      state_history_log_header header{.magic        = ship_magic(ship_current_version),
-                                      .block_id     = block_state->block->id(),
-                                      .payload_size = sizeof(uint32_t) + deltas_bin.size()};
-      chain_state_log->write_entry(header, block_state->block->previous, [&](auto& stream) {
-         uint32_t s = (uint32_t)deltas_bin.size();
-         stream.write((char*)&s, sizeof(s));
-         if (!deltas_bin.empty())
-            stream.write(deltas_bin.data(), deltas_bin.size());
-      });
+      // wait for every table before rethrowing, the jobs refer to locals of this function
+      std::vector<table_delta> deltas;
+      std::exception_ptr       except_ptr;
+      for (auto& packed : packed_tables) {
+         try {
+            auto delta = packed.get();
+            if (delta)
+               deltas.push_back(std::move(*delta));
+         } catch (...) {
+            if (!except_ptr)
+               except_ptr = std::current_exception();
+         }
+      }
+      if (except_ptr)
+         std::rethrow_exception(except_ptr);
+
+      auto deltas_bin = fc::raw::pack(deltas);
+      queue_entry(*chain_state_log, "chain_state_history", block_state, std::move(deltas_bin),
+                  fc::time_point::now() - start);
    } // store_chain_state
 };   // state_history_plugin_impl
 
@@ -595,6 +799,14 @@ void state_history_plugin::set_program_options(options_description& cli, options
            "your internal network.");
    options("trace-history-debug-mode", bpo::bool_switch()->default_value(false),
            "enable debug mode for trace history");
+   options("state-history-threads", bpo::value<uint16_t>()->default_value(2),
+           "number of worker threads packing chain state tables and compressing state history log entries");
+   options("state-history-compression-level", bpo::value<int>()->default_value(bio::zlib::default_compression),
+           "zlib compression level of new state history log entries, from 0 (stored uncompressed) to 9 (smallest); "
+           "1 is the fastest. -1 selects the zlib default.");
+   options("state-history-cache-size-mb", bpo::value<uint32_t>()->default_value(64),
+           "maximum size (in MiB) of recently sent log entries kept in memory for other connected clients, 0 disables "
+           "the cache");
 }
 
 void state_history_plugin::plugin_initialize(const variables_map& options) {
@@ -638,6 +850,18 @@ void state_history_plugin::plugin_initialize(const variables_map& options) {
          my->trace_debug_mode = true;
       }
 
+      my->compression_level = options.at("state-history-compression-level").as<int>();
+      EOS_ASSERT(my->compression_level >= bio::zlib::default_compression && my->compression_level <= bio::zlib::best_compression,
+                 plugin_config_exception, "state-history-compression-level ${l} must be from -1 to 9",
+                 ("l", my->compression_level));
+
+      auto thread_pool_size = options.at("state-history-threads").as<uint16_t>();
+      EOS_ASSERT(thread_pool_size > 0, plugin_config_exception, "state-history-threads ${num} must be greater than 0",
+                 ("num", thread_pool_size));
+      my->thread_pool.emplace("ship", thread_pool_size);
+      my->max_pending_entries = 4 * thread_pool_size;
+      my->entry_cache.set_max_bytes(uint64_t(options.at("state-history-cache-size-mb").as<uint32_t>()) * 1024 * 1024);
+
       if (options.at("trace-history").as<bool>())
          my->trace_log.emplace("trace_history", (state_history_dir / "trace_history.log").string(),
                                (state_history_dir / "trace_history.index").string());
@@ -657,6 +881,11 @@ void state_history_plugin::plugin_shutdown() {
    while (!my->sessions.empty())
       my->sessions.begin()->second->close();
    my->stopping = true;
+   catch_and_log([&] { my->write_pending_entries(0); });
+   if (my->thread_pool)
+      my->thread_pool->stop();
+   ilog("state history entry cache: ${h} hits, ${m} misses",
+        ("h", my->entry_cache.hit_count())("m", my->entry_cache.miss_count()));
 }
 
 } // namespace eosio
@@ -32,6 +32,11 @@ extern const char* const state_history_plugin_abi = R"({
                 { "name": "fetch_deltas", "type": "bool" }
             ]
         },
+        {
+            "name": "get_blocks_request_v1", "base": "get_blocks_request_v0", "fields": [
+                { "name": "compressed_entries", "type": "bool" }
+            ]
+        },
         {
             "name": "get_blocks_ack_request_v0", "fields": [
                 { "name": "num_messages", "type": "uint32" }
@@ -497,7 +502,7 @@ extern const char* const state_history_plugin_abi = R"({
         { "new_type_name": "transaction_id", "type": "checksum256" }
     ],
     "variants": [
-        { "name": "request", "types": ["get_status_request_v0", "get_blocks_request_v0", "get_blocks_ack_request_v0"] },
+        { "name": "request", "types": ["get_status_request_v0", "get_blocks_request_v0", "get_blocks_ack_request_v0", "get_blocks_request_v1"] },
         { "name": "result", "types": ["get_status_result_v0", "get_blocks_result_v0"] },
 
         { "name": "action_receipt", "types": ["action_receipt_v0"] },
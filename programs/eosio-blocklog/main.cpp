@@ -1,9 +1,11 @@
 #include <memory>
 #include <eosio/chain/abi_serializer.hpp>
 #include <eosio/chain/block_log.hpp>
+#include <eosio/chain/compressed_block_file.hpp>
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/reversible_block_object.hpp>
 
+#include <fc/io/cfile.hpp>
 #include <fc/io/json.hpp>
 #include <fc/filesystem.hpp>
 #include <fc/variant.hpp>
@@ -15,6 +17,8 @@
 #include <boost/filesystem/path.hpp>
 
 #include <chrono>
+#include <random>
+#include <thread>
 
 #ifndef _WIN32
 #define FOPEN(p, m) fopen(p, m)
@@ -42,9 +46,15 @@ struct blocklog {
    bfs::path                        output_file;
    uint32_t                         first_block = 0;
    uint32_t                         last_block = std::numeric_limits<uint32_t>::max();
+   uint32_t                         index_threads = 0;
+   uint64_t                         seek_point_stride = compressed_block_file::default_seek_point_stride;
    bool                             no_pretty_print = false;
    bool                             as_json_array = false;
    bool                             make_index = false;
+   bool                             benchmark_index = false;
+   bool                             compress = false;
+   bool                             decompress = false;
+   bool                             benchmark_compression = false;
    bool                             trim_log = false;
    bool                             smoke_test = false;
    bool                             help = false;
@@ -181,6 +191,18 @@ void blocklog::set_program_options(options_description& cli)
           "Print out json blocks wrapped in json array (otherwise the output is free-standing json objects).")
          ("make-index", bpo::bool_switch(&make_index)->default_value(false),
           "Create blocks.index from blocks.log. Must give 'blocks-dir'. Give 'output-file' relative to current directory or absolute path (default is <blocks-dir>/blocks.index).")
+         ("index-threads", bpo::value<uint32_t>(&index_threads)->default_value(0),
+          "Number of threads scanning blocks.log concurrently for make-index, 0 uses one thread per core and 1 the serial builder.")
+         ("benchmark-index", bpo::bool_switch(&benchmark_index)->default_value(false),
+          "Measure blocks.index construction throughput for 1 up to 'index-threads' threads. Must give 'blocks-dir'. The index is written to 'output-file' (default is <blocks-dir>/blocks.index.bench) and removed afterwards.")
+         ("compress", bpo::bool_switch(&compress)->default_value(false),
+          "Compress blocks.log into the seekable compressed format, using blocks.index for seek points. Must give 'blocks-dir'. Give 'output-file' relative to current directory or absolute path (default is <blocks-dir>/blocks.clog).")
+         ("decompress", bpo::bool_switch(&decompress)->default_value(false),
+          "Restore blocks.log from <blocks-dir>/blocks.clog. Must give 'blocks-dir'. Give 'output-file' relative to current directory or absolute path (default is <blocks-dir>/blocks.log, which must not exist).")
+         ("seek-point-stride", bpo::value<uint64_t>(&seek_point_stride)->default_value(compressed_block_file::default_seek_point_stride),
+          "Minimum number of uncompressed bytes between seek points for compress and benchmark-compression.")
+         ("benchmark-compression", bpo::bool_switch(&benchmark_compression)->default_value(false),
+          "Compare size and random block read latency of blocks.log against its compressed form. Must give 'blocks-dir'. The compressed file is written to 'output-file' (default is <blocks-dir>/blocks.clog.bench) and removed afterwards.")
          ("trim-blocklog", bpo::bool_switch(&trim_log)->default_value(false),
           "Trim blocks.log and blocks.index. Must give 'blocks-dir' and 'first and/or 'last'.")
          ("smoke-test", bpo::bool_switch(&smoke_test)->default_value(false),
@@ -239,6 +261,88 @@ bool trim_blocklog_front(bfs::path block_dir, uint32_t n) {        //n is first
 }
 
 
+void benchmark_index(bfs::path block_dir, bfs::path out_file, uint32_t max_threads) {
+   using namespace std;
+   if (max_threads == 0)
+      max_threads = std::max(1u, std::thread::hardware_concurrency());
+   const bfs::path block_file = block_dir / "blocks.log";
+   const auto log_size = bfs::file_size(block_file);
+
+   cout << "\nBenchmark of blocks.index construction from " << block_file << " ("
+        << log_size / (1024 * 1024) << " MiB)\n";
+   for (uint32_t threads = 1; threads <= max_threads; threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1) {
+      const auto start = std::chrono::high_resolution_clock::now();
+      block_log::construct_index(block_file.generic_string(), out_file.generic_string(), threads);
+      const auto usec = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count());
+      const uint64_t num_blocks = bfs::exists(out_file) ? bfs::file_size(out_file) / sizeof(uint64_t) : 0;
+      cout << "threads: " << threads << "   msec: " << usec / 1000
+           << "   blocks/sec: " << num_blocks * 1000000 / usec
+           << "   MiB/sec: " << log_size * 1000000 / usec / (1024 * 1024) << '\n';
+   }
+   bfs::remove(out_file);
+}
+
+void benchmark_compression(bfs::path block_dir, bfs::path out_file, uint64_t seek_point_stride) {
+   using namespace std;
+   const bfs::path block_file = block_dir / "blocks.log";
+   const bfs::path index_file = block_dir / "blocks.index";
+   const auto log_size = bfs::file_size(block_file);
+
+   auto start = std::chrono::high_resolution_clock::now();
+   compressed_block_file::compress(block_file.generic_string(), index_file.generic_string(), out_file.generic_string(), seek_point_stride);
+   const auto compress_usec = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count());
+   const auto compressed_size = bfs::file_size(out_file);
+
+   // block extents from blocks.index, each block is followed by its 8 byte position
+   std::vector<uint64_t> positions(bfs::file_size(index_file) / sizeof(uint64_t));
+   EOS_ASSERT( !positions.empty(), block_log_exception, "No blocks found in ${file}", ("file", index_file.string()) );
+   fc::cfile index;
+   index.set_file_path(index_file.generic_string());
+   index.open("rb");
+   index.read(reinterpret_cast<char*>(positions.data()), positions.size() * sizeof(uint64_t));
+   positions.push_back(log_size);
+
+   constexpr size_t sample_count = 10000;
+   std::mt19937_64 gen(positions.size());
+   std::uniform_int_distribution<size_t> dist(0, positions.size() - 2);
+   std::vector<size_t> samples(sample_count);
+   for (auto& s : samples)
+      s = dist(gen);
+
+   std::vector<char> buffer;
+   auto time_reads = [&](auto&& read) {
+      const auto start = std::chrono::high_resolution_clock::now();
+      for (auto s : samples) {
+         buffer.resize(positions[s + 1] - sizeof(uint64_t) - positions[s]);
+         read(positions[s], buffer.data(), buffer.size());
+      }
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count() / sample_count;
+   };
+
+   fc::cfile raw;
+   raw.set_file_path(block_file.generic_string());
+   raw.open("rb");
+   const auto raw_nsec = time_reads([&](uint64_t pos, char* d, size_t n) {
+      raw.seek(pos);
+      raw.read(d, n);
+   });
+
+   compressed_block_file compressed(out_file.generic_string());
+   const auto compressed_nsec = time_reads([&](uint64_t pos, char* d, size_t n) {
+      compressed.read(pos, d, n);
+   });
+
+   cout << "\nBenchmark of compressed " << block_file << " with seek point stride " << seek_point_stride << '\n'
+        << "raw size: " << log_size << "   compressed size: " << compressed_size
+        << "   ratio: " << double(log_size) / compressed_size
+        << "   seek points: " << compressed.seek_point_count() << '\n'
+        << "compress msec: " << compress_usec / 1000 << "   MiB/sec: " << log_size * 1000000 / compress_usec / (1024 * 1024) << '\n'
+        << "random block reads: " << sample_count
+        << "   raw usec/read: " << raw_nsec / 1000.0
+        << "   compressed usec/read: " << compressed_nsec / 1000.0 << '\n';
+   bfs::remove(out_file);
+}
+
 void smoke_test(bfs::path block_dir) {
    using namespace std;
    cout << "\nSmoke test of blocks.log and blocks.index in directory " << block_dir << '\n';
@@ -312,11 +416,54 @@ int main(int argc, char** argv) {
          report_time rt("making index");
          const auto log_level = fc::logger::get(DEFAULT_LOGGER).get_log_level();
          fc::logger::get(DEFAULT_LOGGER).set_log_level(fc::log_level::debug);
-         block_log::construct_index(block_file.generic_string(), out_file.generic_string());
+         block_log::construct_index(block_file.generic_string(), out_file.generic_string(), blog.index_threads);
          fc::logger::get(DEFAULT_LOGGER).set_log_level(log_level);
          rt.report();
          return 0;
       }
+      if (blog.compress) {
+         const bfs::path blocks_dir = vmap.at("blocks-dir").as<bfs::path>();
+         bfs::path out_file = blocks_dir / "blocks.clog";
+         if (vmap.count("output-file") > 0)
+             out_file = vmap.at("output-file").as<bfs::path>();
+
+         report_time rt("compressing block log");
+         compressed_block_file::compress((blocks_dir / "blocks.log").generic_string(), (blocks_dir / "blocks.index").generic_string(),
+                                         out_file.generic_string(), blog.seek_point_stride);
+         rt.report();
+         return 0;
+      }
+      if (blog.decompress) {
+         const bfs::path blocks_dir = vmap.at("blocks-dir").as<bfs::path>();
+         bfs::path out_file = blocks_dir / "blocks.log";
+         if (vmap.count("output-file") > 0)
+             out_file = vmap.at("output-file").as<bfs::path>();
+         if (bfs::exists(out_file)) {
+            std::cerr << out_file << " already exists, decompress will not overwrite it.\n";
+            return -1;
+         }
+
+         report_time rt("decompressing block log");
+         compressed_block_file::decompress((blocks_dir / "blocks.clog").generic_string(), out_file.generic_string());
+         rt.report();
+         return 0;
+      }
+      if (blog.benchmark_compression) {
+         const bfs::path blocks_dir = vmap.at("blocks-dir").as<bfs::path>();
+         bfs::path out_file = blocks_dir / "blocks.clog.bench";
+         if (vmap.count("output-file") > 0)
+             out_file = vmap.at("output-file").as<bfs::path>();
+         benchmark_compression(blocks_dir, out_file, blog.seek_point_stride);
+         return 0;
+      }
+      if (blog.benchmark_index) {
+         const bfs::path blocks_dir = vmap.at("blocks-dir").as<bfs::path>();
+         bfs::path out_file = blocks_dir / "blocks.index.bench";
+         if (vmap.count("output-file") > 0)
+             out_file = vmap.at("output-file").as<bfs::path>();
+         benchmark_index(blocks_dir, out_file, blog.index_threads);
+         return 0;
+      }
       //else print blocks.log as JSON
       blog.initialize(vmap);
       blog.read_log();
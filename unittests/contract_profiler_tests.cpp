@@ -0,0 +1,64 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/chain/contract_profiler.hpp>
+#include <eosio/testing/tester.hpp>
+
+#include <fc/variant_object.hpp>
+
+#include <contracts.hpp>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+
+BOOST_AUTO_TEST_SUITE(contract_profiler_tests)
+
+BOOST_AUTO_TEST_CASE( contract_profiler_aggregate ) try {
+   contract_profiler profiler;
+   // nothing recorded unless enabled
+   profiler.record( N(alice), N(transfer), fc::microseconds( 100 ), fc::microseconds( 10 ) );
+   BOOST_CHECK( profiler.entries().empty() );
+
+   profiler.enable( true );
+   profiler.record( N(alice), N(transfer), fc::microseconds( 100 ), fc::microseconds( 10 ) );
+   profiler.record( N(alice), N(transfer), fc::microseconds( 300 ), fc::microseconds( 50 ) );
+   profiler.record( N(bob), N(transfer), fc::microseconds( 50 ), fc::microseconds( 0 ) );
+   auto entries = profiler.entries();
+   BOOST_REQUIRE_EQUAL( 2u, entries.size() );
+   BOOST_CHECK_EQUAL( N(alice), entries[0].receiver );
+   BOOST_CHECK_EQUAL( 2u, entries[0].executions );
+   BOOST_CHECK_EQUAL( 400u, entries[0].wall_us );
+   BOOST_CHECK_EQUAL( 300u, entries[0].max_wall_us );
+   BOOST_CHECK_EQUAL( 60u, entries[0].intrinsic_us );
+   BOOST_CHECK_EQUAL( N(bob), entries[1].receiver );
+
+   BOOST_CHECK_EQUAL( "alice;transfer;wasm 340\nalice;transfer;intrinsics 60\nbob;transfer;wasm 50\n",
+                      contract_profiler::to_folded( entries ) );
+
+   // enabling again starts over
+   profiler.enable( false );
+   profiler.enable( true );
+   BOOST_CHECK( profiler.entries().empty() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( contract_profiler_actions ) try {
+   tester chain;
+   chain.create_accounts( {N(payloadless)} );
+   chain.set_code( N(payloadless), contracts::payloadless_wasm() );
+   chain.set_abi( N(payloadless), contracts::payloadless_abi().data() );
+   chain.produce_block();
+
+   chain.control->get_contract_profiler().enable( true );
+   chain.push_action( N(payloadless), N(doit), N(payloadless), fc::mutable_variant_object() );
+   chain.produce_block();
+   chain.push_action( N(payloadless), N(doit), N(payloadless), fc::mutable_variant_object() );
+
+   const auto entries = chain.control->get_contract_profiler().entries();
+   auto itr = std::find_if( entries.begin(), entries.end(), []( const auto& e ) { return e.receiver == N(payloadless); } );
+   BOOST_REQUIRE( itr != entries.end() );
+   BOOST_CHECK_EQUAL( N(doit), itr->action );
+   BOOST_CHECK_EQUAL( 2u, itr->executions );
+   BOOST_CHECK( itr->intrinsic_us <= itr->wall_us );
+   chain.produce_block();
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
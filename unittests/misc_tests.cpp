@@ -3,6 +3,7 @@
 #include <eosio/chain/authority_checker.hpp>
 #include <eosio/chain/types.hpp>
 #include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/recovered_keys_cache.hpp>
 #include <eosio/testing/tester.hpp>
 
 #include <fc/io/json.hpp>
@@ -916,6 +917,63 @@ BOOST_AUTO_TEST_CASE(transaction_metadata_test) { try {
 
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE(recovered_keys_cache_test) { try {
+
+   testing::TESTER test;
+   const auto& chain_id = test.control->get_chain_id();
+
+   auto make_trx = [&]( const std::vector<account_name>& signers, uint32_t nonce ) {
+      signed_transaction trx;
+      test.set_transaction_headers( trx );
+      trx.actions.emplace_back( vector<permission_level>{{config::system_account_name, config::active_name}},
+                                config::system_account_name, N(nonce), fc::raw::pack( nonce ) );
+      for( const auto& s : signers )
+         trx.sign( test.get_private_key( s, "active" ), chain_id );
+      return trx;
+   };
+
+   recovered_keys_cache cache( 4 );
+   auto trx = make_trx( { N(alice), N(bob) }, 1 );
+   flat_set<public_key_type> expected, keys;
+   trx.get_signature_keys( chain_id, fc::time_point::maximum(), expected );
+   BOOST_REQUIRE_EQUAL( 2u, expected.size() );
+
+   cache.get_signature_keys( trx, chain_id, fc::time_point::maximum(), keys );
+   BOOST_CHECK( keys == expected );
+   BOOST_CHECK_EQUAL( 0u, cache.hits() );
+   BOOST_CHECK_EQUAL( 2u, cache.misses() );
+
+   // the same signatures, e.g. the transaction in a block after it was received on its own
+   keys.clear();
+   cache.get_signature_keys( trx, chain_id, fc::time_point::maximum(), keys );
+   BOOST_CHECK( keys == expected );
+   BOOST_CHECK_EQUAL( 2u, cache.hits() );
+   BOOST_CHECK_EQUAL( 2u, cache.misses() );
+
+   // through transaction_metadata, as the producer and block validation use it
+   auto mtrx = transaction_metadata::recover_keys( std::make_shared<packed_transaction>( trx ), chain_id,
+                                                   fc::microseconds::maximum(), UINT32_MAX, &cache );
+   BOOST_CHECK( mtrx->recovered_keys() == expected );
+   BOOST_CHECK_EQUAL( 4u, cache.hits() );
+
+   // duplicate signatures are still rejected when cached
+   auto dup = trx;
+   dup.signatures.push_back( dup.signatures.front() );
+   BOOST_CHECK_THROW( cache.get_signature_keys( dup, chain_id, fc::time_point::maximum(), keys ), tx_duplicate_sig );
+
+   // bounded: older entries are dropped as new ones are added
+   for( uint32_t i = 2; i < 10; ++i )
+      cache.get_signature_keys( make_trx( { N(alice) }, i ), chain_id, fc::time_point::maximum(), keys );
+   BOOST_CHECK_LE( cache.size(), 4u );
+
+   // a disabled cache recovers every time
+   recovered_keys_cache disabled( 0 );
+   disabled.get_signature_keys( trx, chain_id, fc::time_point::maximum(), keys );
+   BOOST_CHECK( keys == expected );
+   BOOST_CHECK_EQUAL( 0u, disabled.size() );
+
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE(reflector_init_test) {
    try {
 
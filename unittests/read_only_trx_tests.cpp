@@ -0,0 +1,148 @@
+#include <boost/test/unit_test.hpp>
+
+#include <eosio/testing/tester.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <eosio/chain_plugin/read_only_trx_executor.hpp>
+
+#include <appbase/application.hpp>
+
+#include <fc/variant_object.hpp>
+
+#include <contracts.hpp>
+
+#include <thread>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+using namespace fc;
+
+static const char busy_loop_wast[] = R"=====(
+(module
+ (export "apply" (func $apply))
+ (func $apply (param $0 i64) (param $1 i64) (param $2 i64)
+  (loop $l (br $l))
+ )
+)
+)=====";
+
+class read_only_trx_tester : public tester {
+public:
+   transaction_metadata_ptr make_read_only( account_name code, action_name act, const variant_object& data ) {
+      signed_transaction trx;
+      trx.actions.emplace_back( get_action( code, act, vector<permission_level>{}, data ) );
+      set_transaction_headers( trx );
+      return transaction_metadata::create_no_recover_keys( packed_transaction( trx ), transaction_metadata::trx_type::input );
+   }
+
+   transaction_trace_ptr push_read_only( account_name code, action_name act, const variant_object& data ) {
+      return control->push_read_only_transaction( make_read_only( code, act, data ), fc::time_point::now() + fc::milliseconds( 100 ),
+                                                  *thread_state );
+   }
+
+   /// run what read_only_trx_executor posts to the application until done, or fail after a while
+   static void run_app_until( const std::function<bool()>& done ) {
+      auto& io = appbase::app().get_io_service();
+      const auto give_up = fc::time_point::now() + fc::seconds( 30 );
+      while( !done() ) {
+         BOOST_REQUIRE( fc::time_point::now() < give_up );
+         io.restart();
+         io.poll();
+         while( appbase::app().get_priority_queue().execute_highest() );
+         std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+      }
+   }
+
+   std::shared_ptr<controller::read_only_thread_state> thread_state = control->create_read_only_thread_state();
+};
+
+BOOST_AUTO_TEST_SUITE(read_only_trx_tests)
+
+BOOST_FIXTURE_TEST_CASE( read_only_trx_reads, read_only_trx_tester ) try {
+   create_accounts( {N(payloadless)} );
+   set_code( N(payloadless), contracts::payloadless_wasm() );
+   set_abi( N(payloadless), contracts::payloadless_abi().data() );
+   produce_block();
+
+   const auto head_before = control->head_block_num();
+   auto trace = push_read_only( N(payloadless), N(doit), mutable_variant_object() );
+   BOOST_REQUIRE( !trace->except );
+   BOOST_REQUIRE_EQUAL( 1u, trace->action_traces.size() );
+   BOOST_CHECK_EQUAL( "Im a payloadless action", trace->action_traces.front().console );
+   // nothing is recorded for read-only transactions
+   BOOST_CHECK( !trace->receipt );
+   BOOST_CHECK_EQUAL( head_before, control->head_block_num() );
+   produce_block();
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( read_only_trx_writes_rejected, read_only_trx_tester ) try {
+   create_accounts( {N(tbl)} );
+   set_code( N(tbl), contracts::get_table_test_wasm() );
+   set_abi( N(tbl), contracts::get_table_test_abi().data() );
+   produce_block();
+
+   auto trace = push_read_only( N(tbl), N(addnumobj), mutable_variant_object()("input", 2) );
+   BOOST_REQUIRE( trace->except );
+   BOOST_CHECK_EQUAL( read_only_trx_write_exception::code_value, trace->except->code() );
+
+   // the failed read-only transaction left nothing behind, the same row can still be written
+   push_action( N(tbl), N(addnumobj), N(tbl), mutable_variant_object()("input", 2) );
+   produce_block();
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( read_only_trx_executor_windows, read_only_trx_tester ) try {
+   create_accounts( {N(payloadless), N(busy)} );
+   set_code( N(payloadless), contracts::payloadless_wasm() );
+   set_abi( N(payloadless), contracts::payloadless_abi().data() );
+   set_code( N(busy), busy_loop_wast );
+   produce_block();
+
+   using result_type = fc::static_variant<fc::exception_ptr, transaction_trace_ptr>;
+   const auto window = fc::milliseconds( 30 );
+   const auto max_trx_time = fc::milliseconds( 10 );
+   BOOST_REQUIRE_THROW( read_only_trx_executor( *control, 2, window, window + fc::milliseconds( 1 ), 100 ), plugin_config_exception );
+
+   const uint32_t max_queued = 16;
+   auto executor = std::make_shared<read_only_trx_executor>( *control, 2, window, max_trx_time, max_queued );
+
+   // two threads get through at most six busy transactions per window, the rest carry over to the next windows
+   const uint32_t busy_trxs = 12;
+   std::vector<optional<result_type>> results( max_queued + 1 );
+   for( uint32_t i = 0; i < results.size(); ++i ) {
+      const bool busy = i < busy_trxs;
+      auto trx = busy ? make_read_only( N(busy), N(doit), mutable_variant_object() )
+                      : make_read_only( N(payloadless), N(doit), mutable_variant_object() );
+      executor->execute( trx, [&results, i]( const result_type& r ) { results[i] = r; } );
+   }
+   BOOST_CHECK_EQUAL( max_queued, executor->queued() );
+
+   // beyond the limit transactions are rejected right away
+   BOOST_REQUIRE( results[max_queued] );
+   BOOST_REQUIRE( results[max_queued]->contains<fc::exception_ptr>() );
+   BOOST_CHECK_EQUAL( tx_resource_exhaustion::code_value, results[max_queued]->get<fc::exception_ptr>()->code() );
+
+   size_t windows_with_carry_over = 0;
+   run_app_until( [&]() {
+      if( executor->queued() > 0 && executor->queued() < max_queued ) ++windows_with_carry_over;
+      return executor->queued() == 0;
+   } );
+   BOOST_CHECK( windows_with_carry_over > 0 );
+
+   for( uint32_t i = 0; i < max_queued; ++i ) {
+      BOOST_REQUIRE( results[i] );
+      BOOST_REQUIRE( results[i]->contains<transaction_trace_ptr>() );
+      const auto& trace = results[i]->get<transaction_trace_ptr>();
+      if( i < busy_trxs ) {
+         // reported once it ran out its own time limit, those cut short by a window were executed again
+         BOOST_REQUIRE( trace->except );
+         BOOST_CHECK_EQUAL( deadline_exception::code_value, trace->except->code() );
+      } else {
+         BOOST_CHECK( !trace->except );
+      }
+   }
+
+   executor->stop();
+   produce_block();
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
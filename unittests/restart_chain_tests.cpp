@@ -1,6 +1,8 @@
+#include <fstream>
 #include <sstream>
 
 #include <eosio/chain/block_log.hpp>
+#include <eosio/chain/compressed_block_file.hpp>
 #include <eosio/chain/global_property_object.hpp>
 #include <eosio/chain/snapshot.hpp>
 #include <eosio/testing/tester.hpp>
@@ -22,6 +24,12 @@ void remove_existing_blocks(controller::config& config) {
    remove(block_index_path);
 }
 
+// leave only the block log, so that starting the chain replays it
+void remove_state(const controller::config& config) {
+   fc::remove_all(config.state_dir);
+   fc::remove_all(config.blocks_dir / config::reversible_blocks_dir_name);
+}
+
 BOOST_AUTO_TEST_SUITE(restart_chain_tests)
 
 BOOST_AUTO_TEST_CASE(test_existing_state_without_block_log)
@@ -78,4 +86,293 @@ BOOST_AUTO_TEST_CASE(test_restart_with_different_chain_id)
    BOOST_REQUIRE_EXCEPTION(other.open(chain_id), chain_id_type_exception, fc_exception_message_starts_with("chain ID in state "));
 }
 
+BOOST_AUTO_TEST_CASE(test_mapped_block_log_reads)
+{
+   tester chain;
+   chain.produce_blocks(20);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log file_log(blocks_dir);
+   block_log mapped_log(blocks_dir, block_log_config{ true });
+
+   BOOST_REQUIRE(mapped_log.head());
+   BOOST_REQUIRE_EQUAL(file_log.head_id(), mapped_log.head_id());
+   const uint32_t head_num = mapped_log.head()->block_num();
+
+   for (uint32_t num = mapped_log.first_block_num(); num <= head_num; ++num) {
+      auto expected = file_log.read_block_by_num(num);
+      BOOST_REQUIRE(expected);
+      auto mapped = mapped_log.read_block_by_num(num);
+      BOOST_REQUIRE(mapped);
+      BOOST_CHECK_EQUAL(expected->id(), mapped->id());
+      BOOST_CHECK_EQUAL(expected->id(), mapped_log.read_block_id_by_num(num));
+
+      const auto packed = fc::raw::pack(*expected);
+      for (const auto& span : { file_log.read_packed_block_by_num(num), mapped_log.read_packed_block_by_num(num) }) {
+         BOOST_REQUIRE_EQUAL(span.size, packed.size());
+         BOOST_CHECK(std::equal(packed.begin(), packed.end(), span.data));
+      }
+   }
+
+   BOOST_CHECK(!mapped_log.read_block_by_num(head_num + 1));
+   BOOST_CHECK(mapped_log.read_packed_block_by_num(head_num + 1).empty());
+   BOOST_CHECK(file_log.read_packed_block_by_num(head_num + 1).empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_construct_index_threads)
+{
+   tester chain;
+   chain.produce_blocks(20);
+   chain.close();
+
+   auto read_file = [](const fc::path& p) {
+      std::ifstream in(p.generic_string(), std::ios::binary);
+      return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+   };
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   const auto expected = read_file(blocks_dir / "blocks.index");
+   BOOST_REQUIRE(!expected.empty());
+   fc::temp_directory tempdir;
+   for (uint32_t threads : { 1u, 4u }) {
+      const auto index_path = tempdir.path() / ("blocks-" + std::to_string(threads) + ".index");
+      block_log::construct_index(blocks_dir / "blocks.log", index_path, threads);
+      BOOST_CHECK(read_file(index_path) == expected);
+   }
+
+   // a log without blocks replaces a stale index with an empty one, whichever builder is used
+   const auto empty_dir = tempdir.path() / "empty";
+   {
+      block_log empty_log(empty_dir);
+      empty_log.reset(block_log::extract_chain_id(blocks_dir), 10);
+   }
+   for (uint32_t threads : { 1u, 4u }) {
+      const auto index_path = tempdir.path() / "stale.index";
+      fc::copy(blocks_dir / "blocks.index", index_path);
+      block_log::construct_index(empty_dir / "blocks.log", index_path, threads);
+      BOOST_REQUIRE(fc::exists(index_path));
+      BOOST_CHECK_EQUAL(fc::file_size(index_path), 0u);
+      fc::remove(index_path);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_split_block_log)
+{
+   tester chain;
+   chain.produce_blocks(20);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log source_log(blocks_dir);
+   BOOST_REQUIRE_EQUAL(source_log.first_block_num(), 1u);
+   const uint32_t head_num = source_log.head()->block_num();
+
+   fc::temp_directory tempdir;
+   const auto split_dir = tempdir.path() / "blocks";
+   block_log_config config;
+   config.stride = 5;
+   config.max_retained_files = 2;
+   {
+      block_log split_log(split_dir, config);
+      split_log.reset(*block_log::extract_genesis_state(blocks_dir), source_log.read_block_by_num(1));
+      for (uint32_t num = 2; num <= head_num; ++num) {
+         split_log.append(source_log.read_block_by_num(num));
+      }
+      BOOST_CHECK_EQUAL(split_log.head_id(), source_log.head_id());
+   }
+
+   const uint32_t last_rolled = head_num - head_num % config.stride;
+   const uint32_t first_retained = last_rolled - config.stride * config.max_retained_files + 1;
+   BOOST_REQUIRE(first_retained > config.stride);
+   BOOST_CHECK(fc::exists(split_dir / "archive" / "blocks-1-5.log"));
+   BOOST_CHECK(fc::exists(split_dir / "archive" / "blocks-1-5.index"));
+   BOOST_CHECK(!fc::exists(split_dir / "blocks-1-5.log"));
+   // block 1 was archived, so only the chain id is left
+   BOOST_CHECK(!block_log::extract_genesis_state(split_dir));
+   BOOST_CHECK(block_log::extract_chain_id(split_dir) == block_log::extract_chain_id(blocks_dir));
+
+   for (bool mapped_reads : { false, true }) {
+      config.mapped_reads = mapped_reads;
+      block_log split_log(split_dir, config);
+      BOOST_REQUIRE(split_log.head());
+      BOOST_CHECK_EQUAL(split_log.head_id(), source_log.head_id());
+      BOOST_CHECK_EQUAL(split_log.first_block_num(), first_retained);
+      BOOST_CHECK(!split_log.read_block_by_num(first_retained - 1));
+
+      for (uint32_t num = first_retained; num <= head_num; ++num) {
+         auto expected = source_log.read_block_by_num(num);
+         auto actual = split_log.read_block_by_num(num);
+         BOOST_REQUIRE(actual);
+         BOOST_CHECK_EQUAL(expected->id(), actual->id());
+         BOOST_CHECK_EQUAL(expected->id(), split_log.read_block_id_by_num(num));
+         BOOST_CHECK_EQUAL(split_log.read_packed_block_by_num(num).size, fc::raw::pack_size(*expected));
+      }
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_compressed_block_log)
+{
+   tester chain;
+   chain.produce_blocks(20);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log source_log(blocks_dir);
+   const uint32_t head_num = source_log.head()->block_num();
+
+   fc::temp_directory tempdir;
+   const auto compressed_path = tempdir.path() / "blocks.clog";
+   // a tiny stride places a seek point before nearly every block
+   compressed_block_file::compress(blocks_dir / "blocks.log", blocks_dir / "blocks.index", compressed_path, 64);
+   BOOST_REQUIRE(compressed_block_file::is_compressed(compressed_path));
+   BOOST_REQUIRE(!compressed_block_file::is_compressed(blocks_dir / "blocks.log"));
+
+   compressed_block_file compressed(compressed_path);
+   BOOST_REQUIRE_EQUAL(compressed.size(), fc::file_size(blocks_dir / "blocks.log"));
+   BOOST_CHECK(compressed.seek_point_count() > 1);
+   for (uint32_t num = 1; num <= head_num; ++num) {
+      const auto packed = fc::raw::pack(*source_log.read_block_by_num(num));
+      const auto pos = source_log.get_block_pos(num);
+      BOOST_REQUIRE(compressed.read(pos, packed.size()) == packed);
+   }
+   BOOST_CHECK_THROW(compressed.read(compressed.size() - 4, 8), block_log_exception);
+
+   const auto restored_path = tempdir.path() / "blocks.log";
+   compressed_block_file::decompress(compressed_path, restored_path);
+   BOOST_REQUIRE_EQUAL(fc::file_size(restored_path), compressed.size());
+   BOOST_CHECK(block_log::extract_chain_id(blocks_dir) == block_log::extract_chain_id(tempdir.path()));
+
+   // segments compressed in place stay readable after reopening
+   const auto split_dir = tempdir.path() / "blocks";
+   block_log_config config;
+   config.stride = 5;
+   {
+      block_log split_log(split_dir, config);
+      split_log.reset(*block_log::extract_genesis_state(blocks_dir), source_log.read_block_by_num(1));
+      for (uint32_t num = 2; num <= head_num; ++num) {
+         split_log.append(source_log.read_block_by_num(num));
+      }
+   }
+   for (uint32_t first = 1; first + config.stride - 1 <= head_num; first += config.stride) {
+      const auto base = split_dir / ("blocks-" + std::to_string(first) + "-" + std::to_string(first + config.stride - 1));
+      compressed_block_file::compress(base.string() + ".log", base.string() + ".index", base.string() + ".clog");
+      fc::remove(base.string() + ".log");
+   }
+
+   // the active blocks.log was begun by a roll, the genesis state is found in blocks-1-5.clog
+   const auto genesis = block_log::extract_genesis_state(split_dir);
+   BOOST_REQUIRE(genesis);
+   BOOST_CHECK(genesis->compute_chain_id() == block_log::extract_chain_id(blocks_dir));
+   BOOST_CHECK(block_log::extract_chain_id(split_dir) == block_log::extract_chain_id(blocks_dir));
+
+   block_log split_log(split_dir, config);
+   BOOST_REQUIRE(split_log.head());
+   BOOST_CHECK_EQUAL(split_log.head_id(), source_log.head_id());
+   BOOST_CHECK_EQUAL(split_log.first_block_num(), 1u);
+   for (uint32_t num = 1; num <= head_num; ++num) {
+      auto actual = split_log.read_block_by_num(num);
+      BOOST_REQUIRE(actual);
+      BOOST_CHECK_EQUAL(source_log.read_block_id_by_num(num), actual->id());
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_replay_through_trusted_checkpoint)
+{
+   fc::temp_directory tempdir;
+   tester chain(tempdir, true);
+   chain.create_account(N(replay));
+   chain.produce_blocks(20);
+   chain.close();
+
+   auto cfg = chain.get_config();
+   cfg.force_all_checks = true;
+   const auto genesis = *block_log::extract_genesis_state(cfg.blocks_dir);
+   uint32_t head_num = 0, checkpoint_num = 0;
+   block_id_type head_id, checkpoint_id, wrong_id;
+   {
+      block_log blog(cfg.blocks_dir);
+      head_num = blog.head()->block_num();
+      head_id = blog.head_id();
+      checkpoint_num = head_num - 5;
+      checkpoint_id = blog.read_block_id_by_num(checkpoint_num);
+      wrong_id = blog.read_block_id_by_num(checkpoint_num - 1);
+   }
+
+   // a checkpoint that does not match the block log fails the replay
+   remove_state(cfg);
+   cfg.trusted_replay_checkpoints[checkpoint_num] = wrong_id;
+   BOOST_REQUIRE_THROW(tester{cfg, genesis}, checkpoint_exception);
+
+   // checkpoints beyond the block log are not verified
+   remove_state(cfg);
+   cfg.trusted_replay_checkpoints.clear();
+   cfg.trusted_replay_checkpoints[checkpoint_num] = checkpoint_id;
+   cfg.trusted_replay_checkpoints[head_num + 100] = wrong_id;
+   tester replayed(cfg, genesis);
+   BOOST_CHECK_EQUAL(replayed.control->head_block_num(), head_num);
+   BOOST_CHECK_EQUAL(replayed.control->head_block_id(), head_id);
+   BOOST_CHECK_EQUAL(replayed.control->fetch_block_by_number(checkpoint_num)->id(), checkpoint_id);
+   BOOST_CHECK(replayed.control->get_account(N(replay)).name == N(replay));
+
+   // the replayed chain keeps producing
+   replayed.create_account(N(replay1));
+   replayed.produce_block();
+}
+
+BOOST_AUTO_TEST_CASE(test_resume_replay_from_replay_snapshot)
+{
+   fc::temp_directory tempdir;
+   tester chain(tempdir, true);
+   chain.create_account(N(replay));
+   // replay checks for a shutdown every 500 blocks
+   chain.produce_blocks(600);
+   chain.close();
+
+   auto cfg = chain.get_config();
+   cfg.replay_snapshot_interval = 100;
+   cfg.replay_snapshots_dir = tempdir.path() / "replay-snapshots";
+   const auto genesis = *block_log::extract_genesis_state(cfg.blocks_dir);
+   const auto chain_id = genesis.compute_chain_id();
+   uint32_t head_num = 0;
+   block_id_type head_id;
+   {
+      block_log blog(cfg.blocks_dir);
+      head_num = blog.head()->block_num();
+      head_id = blog.head_id();
+   }
+   BOOST_REQUIRE_GT(head_num, 500u);
+
+   remove_state(cfg);
+   {
+      controller interrupted(cfg, make_protocol_feature_set(), chain_id);
+      interrupted.add_indices();
+      interrupted.startup([]() { return true; }, genesis);
+      BOOST_REQUIRE_EQUAL(interrupted.head_block_num(), 500u);
+   }
+   // only the snapshot of the last interval is kept
+   const auto resume_path = cfg.replay_snapshots_dir / "replay-snapshot-500.bin";
+   BOOST_REQUIRE(fc::exists(resume_path));
+   BOOST_CHECK(!fc::exists(cfg.replay_snapshots_dir / "replay-snapshot-400.bin"));
+
+   // resume the way --replay-blockchain does, from the replay snapshot into a new state
+   remove_state(cfg);
+   std::ifstream in(resume_path.generic_string(), std::ios::in | std::ios::binary);
+   auto reader = make_istream_snapshot_reader(in);
+   reader->validate();
+   reader->return_to_header();
+   {
+      controller resumed(cfg, make_protocol_feature_set(), chain_id);
+      resumed.add_indices();
+      resumed.startup([]() { return false; }, reader);
+      BOOST_CHECK_EQUAL(resumed.head_block_num(), head_num);
+      BOOST_CHECK_EQUAL(resumed.head_block_id(), head_id);
+      BOOST_CHECK(resumed.get_account(N(replay)).name == N(replay));
+   }
+   in.close();
+
+   // a completed replay leaves nothing to resume from
+   BOOST_CHECK(!fc::exists(resume_path));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
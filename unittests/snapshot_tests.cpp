@@ -1,8 +1,12 @@
+#include <atomic>
+#include <chrono>
 #include <sstream>
+#include <thread>
 
 #include <eosio/chain/block_log.hpp>
 #include <eosio/chain/global_property_object.hpp>
 #include <eosio/chain/snapshot.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <eosio/testing/tester.hpp>
 
 #include <boost/mpl/list.hpp>
@@ -15,6 +19,12 @@ using namespace eosio;
 using namespace testing;
 using namespace chain;
 
+struct snapshot_bench_row {
+   uint64_t    id = 0;
+   std::string payload;
+};
+FC_REFLECT(snapshot_bench_row, (id)(payload))
+
 chainbase::bfs::path get_parent_path(chainbase::bfs::path blocks_dir, int ordinal) {
    chainbase::bfs::path leaf_dir = blocks_dir.filename();
    if (leaf_dir.generic_string() == std::string("blocks")) {
@@ -51,14 +61,15 @@ class snapshotted_tester : public base_tester {
 public:
    enum config_file_handling { dont_copy_config_files, copy_config_files };
    snapshotted_tester(controller::config config, const snapshot_reader_ptr& snapshot, int ordinal,
-           config_file_handling copy_files_from_config = config_file_handling::dont_copy_config_files) {
+           config_file_handling copy_files_from_config = config_file_handling::dont_copy_config_files,
+           const std::vector<snapshot_reader_ptr>& deltas = {}) {
       FC_ASSERT(config.blocks_dir.filename().generic_string() != "."
                 && config.state_dir.filename().generic_string() != ".", "invalid path names in controller::config");
 
       controller::config copied_config = (copy_files_from_config == copy_config_files)
                                          ? copy_config_and_files(config, ordinal) : copy_config(config, ordinal);
 
-      init(copied_config, snapshot);
+      init(copied_config, snapshot, deltas);
    }
 
    signed_block_ptr produce_block( fc::microseconds skip_time = fc::milliseconds(config::block_interval_ms) )override {
@@ -167,9 +178,49 @@ struct buffered_snapshot_suite {
    }
 };
 
+struct compressed_snapshot_suite {
+   using writer_t = compressed_ostream_snapshot_writer;
+   using write_storage_t = std::ostringstream;
+   using snapshot_t = std::string;
+   using read_storage_t = std::istringstream;
+
+   struct writer : public writer_t {
+      writer( const std::shared_ptr<write_storage_t>& storage )
+      :writer_t(*storage)
+      ,storage(storage)
+      {
+
+      }
+
+      std::shared_ptr<write_storage_t> storage;
+   };
+
+   static auto get_writer() {
+      return std::make_shared<writer>(std::make_shared<write_storage_t>());
+   }
+
+   static auto finalize(const std::shared_ptr<writer>& w) {
+      w->finalize();
+      return w->storage->str();
+   }
+
+   // picks the reader from the header, so the uncompressed reference snapshots load as well
+   static std::shared_ptr<istream_snapshot_reader> get_reader( const snapshot_t& buffer) {
+      auto storage = std::make_shared<read_storage_t>(buffer);
+      auto reader = make_istream_snapshot_reader(*storage);
+      auto owner = std::make_shared<std::pair<std::shared_ptr<read_storage_t>, std::shared_ptr<istream_snapshot_reader>>>(storage, reader);
+      return std::shared_ptr<istream_snapshot_reader>(owner, reader.get());
+   }
+
+   template<typename Snapshot>
+   static snapshot_t load_from_file() {
+      return Snapshot::bin();
+   }
+};
+
 BOOST_AUTO_TEST_SUITE(snapshot_tests, *boost::unit_test::disabled())
 
-using snapshot_suites = boost::mpl::list<variant_snapshot_suite, buffered_snapshot_suite>;
+using snapshot_suites = boost::mpl::list<variant_snapshot_suite, buffered_snapshot_suite, compressed_snapshot_suite>;
 
 namespace {
    void variant_diff_helper(const fc::variant& lhs, const fc::variant& rhs, std::function<void(const std::string&, const fc::variant&, const fc::variant&)>&& out){
@@ -588,3 +639,248 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_restart_with_existing_state_and_truncated_blo
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+namespace {
+   // total_rows spread evenly over section_count sections, one job per section
+   std::vector<snapshot_writer::section_job> make_bench_write_jobs(const chainbase::database& db, size_t section_count, size_t total_rows) {
+      std::vector<snapshot_writer::section_job> jobs;
+      for (size_t s = 0; s < section_count; ++s) {
+         jobs.emplace_back([&db, s, rows = total_rows / section_count](const snapshot_writer_ptr& snapshot) {
+            snapshot->write_section("bench_section_" + std::to_string(s), [&db, s, rows](auto& section) {
+               for (uint64_t r = 0; r < rows; ++r) {
+                  section.add_row(snapshot_bench_row{ s * rows + r, std::string(64 + r % 64, 'a' + r % 26) }, db);
+               }
+            });
+         });
+      }
+      return jobs;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE(snapshot_section_tests)
+
+BOOST_AUTO_TEST_CASE(test_parallel_sections)
+{
+   tester chain;
+   const auto& db = chain.control->db();
+   named_thread_pool pool("snap", 4);
+   const size_t section_count = 8, total_rows = 8000;
+   auto jobs = make_bench_write_jobs(db, section_count, total_rows);
+
+   // a section split across jobs is joined into one
+   jobs.emplace_back([&db](const snapshot_writer_ptr& snapshot) {
+      snapshot->write_section("split", [&db](auto& section) { section.add_row(snapshot_bench_row{ 1, "first" }, db); });
+   });
+   jobs.emplace_back([&db](const snapshot_writer_ptr& snapshot) {
+      snapshot->write_section("split", [&db](auto& section) { section.add_row(snapshot_bench_row{ 2, "second" }, db); });
+   });
+
+   std::ostringstream sequential_out, parallel_out;
+   {
+      ostream_snapshot_writer writer(sequential_out);
+      writer.write_sections(jobs);
+      writer.finalize();
+   }
+   {
+      ostream_snapshot_writer writer(parallel_out);
+      writer.write_sections(jobs, &pool.get_executor());
+      writer.finalize();
+   }
+   BOOST_REQUIRE(sequential_out.str() == parallel_out.str());
+
+   std::istringstream in(parallel_out.str());
+   auto reader = std::make_shared<istream_snapshot_reader>(in);
+   reader->validate();
+   std::vector<std::vector<snapshot_bench_row>> sections(section_count + 1);
+   std::vector<snapshot_reader::section_job> read_jobs;
+   for (size_t s = 0; s <= section_count; ++s) {
+      const auto name = s == section_count ? std::string("split") : "bench_section_" + std::to_string(s);
+      // the split section is not read ahead, but when the job asks for it
+      std::vector<std::string> read_ahead;
+      if (s < section_count) {
+         read_ahead.push_back(name);
+      }
+      read_jobs.push_back({ read_ahead, [name, &rows = sections[s]](const snapshot_reader_ptr& snapshot) {
+         snapshot->read_section(name, [&rows](auto& section) {
+            bool more = !section.empty();
+            while (more) {
+               rows.emplace_back();
+               more = section.read_row(rows.back());
+            }
+         });
+      }});
+   }
+   reader->read_sections(read_jobs, &pool.get_executor());
+
+   const size_t rows_per_section = total_rows / section_count;
+   for (size_t s = 0; s < section_count; ++s) {
+      BOOST_REQUIRE_EQUAL(sections[s].size(), rows_per_section);
+      for (size_t r = 0; r < rows_per_section; ++r) {
+         BOOST_REQUIRE_EQUAL(sections[s][r].id, s * rows_per_section + r);
+      }
+   }
+   BOOST_REQUIRE_EQUAL(sections[section_count].size(), 2u);
+   BOOST_CHECK_EQUAL(sections[section_count][1].payload, "second");
+}
+
+BOOST_AUTO_TEST_CASE(test_compressed_snapshot_checksums)
+{
+   tester chain;
+   chain.create_account(N(snapshot));
+   chain.produce_blocks(1);
+   chain.set_code(N(snapshot), contracts::snapshot_test_wasm());
+   chain.set_abi(N(snapshot), contracts::snapshot_test_abi().data());
+   chain.produce_blocks(1);
+   chain.control->abort_block();
+
+   auto uncompressed_writer = buffered_snapshot_suite::get_writer();
+   chain.control->write_snapshot(uncompressed_writer);
+   const auto uncompressed = buffered_snapshot_suite::finalize(uncompressed_writer);
+
+   auto compressed_writer = compressed_snapshot_suite::get_writer();
+   chain.control->write_snapshot(compressed_writer);
+   const auto compressed = compressed_snapshot_suite::finalize(compressed_writer);
+   BOOST_CHECK_LT(compressed.size(), uncompressed.size());
+
+   compressed_snapshot_suite::get_reader(compressed)->validate();
+   BOOST_REQUIRE(std::dynamic_pointer_cast<compressed_istream_snapshot_reader>(compressed_snapshot_suite::get_reader(compressed)));
+
+   // the old reader rejects the new version instead of misreading it
+   BOOST_REQUIRE_THROW(buffered_snapshot_suite::get_reader(compressed)->validate(), snapshot_exception);
+
+   // the last byte before the end marker is compressed row data of the last section
+   auto corrupt = compressed;
+   corrupt[corrupt.size() - sizeof(uint64_t) - 1] ^= 0x5a;
+   BOOST_REQUIRE_THROW(compressed_snapshot_suite::get_reader(corrupt)->validate(), snapshot_exception);
+}
+
+BOOST_AUTO_TEST_CASE(test_delta_snapshots)
+{
+   fc::temp_directory tempdir;
+   tester chain(tempdir, [](controller::config& cfg) { cfg.track_snapshot_deltas = true; }, true);
+   chain.execute_setup_policy(setup_policy::full);
+
+   chain.create_account(N(snapshot));
+   chain.produce_blocks(1);
+   chain.set_code(N(snapshot), contracts::snapshot_test_wasm());
+   chain.set_abi(N(snapshot), contracts::snapshot_test_abi().data());
+   chain.produce_blocks(1);
+   chain.control->abort_block();
+   BOOST_REQUIRE(!chain.control->has_snapshot_delta_base());
+
+   // only a base snapshot starts a new delta
+   auto full_writer = buffered_snapshot_suite::get_writer();
+   chain.control->write_snapshot(full_writer);
+   buffered_snapshot_suite::finalize(full_writer);
+   BOOST_REQUIRE(!chain.control->has_snapshot_delta_base());
+
+   auto base_writer = buffered_snapshot_suite::get_writer();
+   chain.control->write_delta_base_snapshot(base_writer);
+   const auto base = buffered_snapshot_suite::finalize(base_writer);
+   BOOST_REQUIRE(chain.control->has_snapshot_delta_base());
+
+   auto write_delta = [&chain]() {
+      for (int itr = 0; itr < 3; itr++) {
+         chain.push_action(N(snapshot), N(increment), N(snapshot), mutable_variant_object()
+            ( "value", 1 )
+         );
+         chain.produce_block();
+      }
+      chain.control->abort_block();
+
+      auto writer = buffered_snapshot_suite::get_writer();
+      chain.control->write_delta_snapshot(writer);
+      return buffered_snapshot_suite::finalize(writer);
+   };
+
+   const auto first_delta = write_delta();
+   chain.create_account(N(snapshot1));
+   const auto second_delta = write_delta();
+   BOOST_CHECK_LT(first_delta.size(), base.size());
+   BOOST_CHECK_LT(second_delta.size(), base.size());
+
+   // a delta is not a full snapshot
+   int ordinal = 0;
+   BOOST_REQUIRE_THROW(snapshotted_tester(chain.get_config(), buffered_snapshot_suite::get_reader(first_delta), ordinal++,
+                                          snapshotted_tester::dont_copy_config_files,
+                                          { buffered_snapshot_suite::get_reader(second_delta) }),
+                       snapshot_exception);
+
+   // deltas have to be applied in the order they were written
+   BOOST_REQUIRE_THROW(snapshotted_tester(chain.get_config(), buffered_snapshot_suite::get_reader(base), ordinal++,
+                                          snapshotted_tester::dont_copy_config_files,
+                                          { buffered_snapshot_suite::get_reader(second_delta) }),
+                       snapshot_exception);
+
+   snapshotted_tester snap_chain(chain.get_config(), buffered_snapshot_suite::get_reader(base), ordinal++,
+                                 snapshotted_tester::dont_copy_config_files,
+                                 { buffered_snapshot_suite::get_reader(first_delta), buffered_snapshot_suite::get_reader(second_delta) });
+   BOOST_REQUIRE_EQUAL(chain.control->head_block_num(), snap_chain.control->head_block_num());
+   snapshot_tests::verify_integrity_hash<buffered_snapshot_suite>(*chain.control, *snap_chain.control);
+
+   // the loaded state keeps following the chain
+   chain.push_action(N(snapshot), N(increment), N(snapshot), mutable_variant_object()
+      ( "value", 1 )
+   );
+   snap_chain.push_block(chain.produce_block());
+   chain.control->abort_block();
+   snapshot_tests::verify_integrity_hash<buffered_snapshot_suite>(*chain.control, *snap_chain.control);
+}
+
+// takes too long for every run, run it with --run_test=snapshot_section_tests/benchmark_parallel_sections
+BOOST_AUTO_TEST_CASE(benchmark_parallel_sections, *boost::unit_test::disabled())
+{
+   tester chain;
+   const size_t threads = std::max(2u, std::thread::hardware_concurrency());
+   const size_t total_rows = 1 << 20;
+   named_thread_pool pool("snap", threads);
+
+   auto msec_since = [](auto start) {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+   };
+
+   std::cout << "snapshot sections benchmark, " << total_rows << " rows, " << threads << " threads" << std::endl;
+   for (size_t section_count : { 1, 4, 16, 64 }) {
+      const auto jobs = make_bench_write_jobs(chain.control->db(), section_count, total_rows);
+      int64_t write_msec[2], read_msec[2];
+      for (int parallel = 0; parallel < 2; ++parallel) {
+         boost::asio::io_context* exec = parallel ? &pool.get_executor() : nullptr;
+
+         std::ostringstream out;
+         auto start = std::chrono::steady_clock::now();
+         {
+            ostream_snapshot_writer writer(out);
+            writer.write_sections(jobs, exec);
+            writer.finalize();
+         }
+         write_msec[parallel] = msec_since(start);
+
+         std::istringstream in(out.str());
+         auto reader = std::make_shared<istream_snapshot_reader>(in);
+         std::vector<snapshot_reader::section_job> read_jobs;
+         std::atomic<size_t> rows_read{0};
+         for (size_t s = 0; s < section_count; ++s) {
+            const auto name = "bench_section_" + std::to_string(s);
+            read_jobs.push_back({ { name }, [name, &rows_read](const snapshot_reader_ptr& snapshot) {
+               snapshot->read_section(name, [&rows_read](auto& section) {
+                  snapshot_bench_row row;
+                  bool more = !section.empty();
+                  while (more) {
+                     more = section.read_row(row);
+                     ++rows_read;
+                  }
+               });
+            }});
+         }
+         start = std::chrono::steady_clock::now();
+         reader->read_sections(read_jobs, exec);
+         read_msec[parallel] = msec_since(start);
+         BOOST_REQUIRE_EQUAL(rows_read.load(), total_rows / section_count * section_count);
+      }
+      std::cout << "sections: " << section_count
+                << "   write msec sequential: " << write_msec[0] << " parallel: " << write_msec[1]
+                << "   read msec sequential: " << read_msec[0] << " parallel: " << read_msec[1] << std::endl;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,71 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/chain/subjective_billing.hpp>
+
+using namespace eosio;
+using namespace eosio::chain;
+
+BOOST_AUTO_TEST_SUITE(subjective_billing_tests)
+
+BOOST_AUTO_TEST_CASE( subjective_billing_decay ) try {
+   const auto start = fc::time_point::now();
+   const account_name a = N(alice);
+   const account_name b = N(bob);
+   subjective_billing sub( fc::seconds( 100 ), 0 );
+
+   sub.bill_failed( a, fc::microseconds( 1000 ), start );
+   sub.bill_failed( a, fc::microseconds( 1000 ), start );
+   sub.bill_failed( b, fc::microseconds( 500 ), start );
+   BOOST_CHECK_EQUAL( 2000u, sub.get_billed_us( a, start ) );
+   BOOST_CHECK_EQUAL( 500u, sub.get_billed_us( b, start ) );
+   BOOST_CHECK_EQUAL( 0u, sub.get_billed_us( N(carol), start ) );
+   BOOST_CHECK_EQUAL( 3u, sub.failed_trxs() );
+   BOOST_CHECK_EQUAL( 2500u, sub.total_billed_us() );
+
+   // linear decay over the window, new charges add to what is left
+   BOOST_CHECK_EQUAL( 1500u, sub.get_billed_us( a, start + fc::seconds( 25 ) ) );
+   BOOST_CHECK_EQUAL( 1000u, sub.get_billed_us( a, start + fc::seconds( 50 ) ) );
+   sub.bill_failed( a, fc::microseconds( 1000 ), start + fc::seconds( 50 ) );
+   BOOST_CHECK_EQUAL( 2000u, sub.get_billed_us( a, start + fc::seconds( 50 ) ) );
+   BOOST_CHECK_EQUAL( 1000u, sub.get_billed_us( a, start + fc::seconds( 100 ) ) );
+   BOOST_CHECK_EQUAL( 0u, sub.get_billed_us( b, start + fc::seconds( 100 ) ) );
+
+   auto top = sub.top( 10, start + fc::seconds( 60 ) );
+   BOOST_REQUIRE_EQUAL( 2u, top.size() );
+   BOOST_CHECK( top[0].first == a );
+   BOOST_CHECK( top[1].first == b );
+   BOOST_CHECK_EQUAL( 1u, sub.top( 1, start + fc::seconds( 60 ) ).size() );
+
+   // only accounts decayed to zero are forgotten
+   BOOST_CHECK_EQUAL( 1u, sub.expire( start + fc::seconds( 100 ) ) );
+   BOOST_CHECK_EQUAL( 1u, sub.size() );
+   BOOST_CHECK_EQUAL( 1u, sub.expire( start + fc::seconds( 150 ) ) );
+   BOOST_CHECK_EQUAL( 0u, sub.size() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( subjective_billing_reject ) try {
+   const auto start = fc::time_point::now();
+   const account_name a = N(alice);
+
+   subjective_billing keep_only( fc::seconds( 100 ), 0 );
+   keep_only.bill_failed( a, fc::seconds( 10 ), start );
+   BOOST_CHECK( !keep_only.reject( a, start ) );
+
+   subjective_billing disabled;
+   disabled.bill_failed( a, fc::seconds( 10 ), start );
+   BOOST_CHECK_EQUAL( 0u, disabled.size() );
+   BOOST_CHECK( !disabled.reject( a, start ) );
+
+   subjective_billing sub( fc::seconds( 100 ), 1000 );
+   sub.bill_failed( a, fc::microseconds( 1000 ), start );
+   BOOST_CHECK( !sub.reject( a, start ) );
+   sub.bill_failed( a, fc::microseconds( 1000 ), start );
+   BOOST_CHECK( sub.reject( a, start ) );
+   BOOST_CHECK( !sub.reject( N(bob), start ) );
+   BOOST_CHECK_EQUAL( 1u, sub.rejected_trxs() );
+   // accepted again once enough has decayed
+   BOOST_CHECK( sub.reject( a, start + fc::seconds( 40 ) ) );
+   BOOST_CHECK( !sub.reject( a, start + fc::seconds( 50 ) ) );
+   BOOST_CHECK_EQUAL( 2u, sub.rejected_trxs() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
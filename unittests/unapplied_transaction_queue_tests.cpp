@@ -20,6 +20,19 @@ auto unique_trx_meta_data() {
    return transaction_metadata::create_no_recover_keys( packed_transaction( trx ), transaction_metadata::trx_type::input );
 }
 
+auto trx_meta_data_from( account_name authorizer, uint32_t billed_cpu_time_us ) {
+
+   static uint64_t nextid = 0;
+   ++nextid;
+
+   signed_transaction trx;
+   trx.actions.emplace_back( vector<permission_level>{{authorizer,config::active_name}},
+                             onerror{ nextid, "fair", 4 });
+   auto trx_meta = transaction_metadata::create_no_recover_keys( packed_transaction( trx ), transaction_metadata::trx_type::input );
+   trx_meta->billed_cpu_time_us = billed_cpu_time_us;
+   return trx_meta;
+}
+
 auto next( unapplied_transaction_queue& q ) {
    transaction_metadata_ptr trx;
    auto itr = q.begin();
@@ -306,5 +319,127 @@ BOOST_AUTO_TEST_CASE( unapplied_transaction_queue_test ) try {
 
 } FC_LOG_AND_RETHROW() /// unapplied_transaction_queue_test
 
+BOOST_AUTO_TEST_CASE( unapplied_transaction_queue_fair_test ) try {
+
+   unapplied_transaction_queue q;
+   q.set_mode( unapplied_transaction_queue::process_mode::speculative_fair_producer );
+
+   auto alice1 = trx_meta_data_from( N(alice), 100 );
+   auto alice2 = trx_meta_data_from( N(alice), 10 );
+   auto alice3 = trx_meta_data_from( N(alice), 50 );
+   auto bob1   = trx_meta_data_from( N(bob), 20 );
+   auto carol1 = trx_meta_data_from( N(carol), 30 );
+   auto carol2 = trx_meta_data_from( N(carol), 5 );
+   auto dave1  = trx_meta_data_from( N(dave), 1 );
+
+   // one transaction per account per round, cheapest first within a round
+   q.add_aborted( { alice1, alice2, alice3, bob1, carol1, carol2 } );
+   BOOST_CHECK( q.size() == 6 );
+   BOOST_REQUIRE( next( q ) == bob1 );
+   BOOST_REQUIRE( next( q ) == carol1 );
+
+   // an account arriving later joins the round being served, ahead of accounts with more queued
+   q.add_aborted( { dave1 } );
+   BOOST_REQUIRE( next( q ) == dave1 );
+   BOOST_REQUIRE( next( q ) == alice1 );
+   BOOST_REQUIRE( next( q ) == carol2 );
+   BOOST_REQUIRE( next( q ) == alice2 );
+
+   // persisted transactions still come first
+   auto erin1 = trx_meta_data_from( N(erin), 1000 );
+   q.add_persisted( erin1 );
+   BOOST_CHECK( q.contains_persisted() );
+   BOOST_REQUIRE( q.persisted_begin() != q.persisted_end() );
+   BOOST_REQUIRE( next( q ) == erin1 );
+   BOOST_REQUIRE( next( q ) == alice3 );
+   BOOST_REQUIRE( next( q ) == nullptr );
+   BOOST_CHECK( q.empty() );
+
+   // an account whose transactions were all applied starts over in the current round
+   q.add_aborted( { alice1, bob1 } );
+   BOOST_REQUIRE( next( q ) == bob1 );
+   BOOST_REQUIRE( next( q ) == alice1 );
+   BOOST_CHECK( q.empty() );
+
+} FC_LOG_AND_RETHROW() /// unapplied_transaction_queue_fair_test
+
+BOOST_AUTO_TEST_CASE( unapplied_transaction_queue_fair_types_test ) try {
+
+   unapplied_transaction_queue q;
+   q.set_mode( unapplied_transaction_queue::process_mode::speculative_fair_producer );
+
+   auto alice1 = trx_meta_data_from( N(alice), 100 );
+   auto alice2 = trx_meta_data_from( N(alice), 100 );
+   auto alice3 = trx_meta_data_from( N(alice), 100 );
+   auto alice4 = trx_meta_data_from( N(alice), 10 );
+   auto bob1   = trx_meta_data_from( N(bob), 1000 );
+   auto bob2   = trx_meta_data_from( N(bob), 20 );
+
+   // rounds of aborted transactions do not push back the persisted transactions of the same account
+   q.add_aborted( { alice1, alice2, alice3 } );
+   q.add_persisted( bob1 );
+   q.add_persisted( alice4 );
+   BOOST_REQUIRE( next( q ) == alice4 );
+   BOOST_REQUIRE( next( q ) == bob1 );
+
+   // a transaction turned persisted leaves the rounds of its old type for those of persisted
+   q.add_aborted( { bob2 } );
+   q.add_persisted( alice3 );
+   BOOST_REQUIRE( q.persisted_begin() != q.persisted_end() );
+   BOOST_REQUIRE( next( q ) == alice3 );
+   BOOST_REQUIRE( next( q ) == bob2 );
+   BOOST_REQUIRE( next( q ) == alice1 );
+   BOOST_REQUIRE( next( q ) == alice2 );
+   BOOST_CHECK( q.empty() );
+
+} FC_LOG_AND_RETHROW() /// unapplied_transaction_queue_fair_types_test
+
+BOOST_AUTO_TEST_CASE( unapplied_transaction_queue_skewed_drain_benchmark ) try {
+
+   // one account floods the queue ahead of many accounts sending a few transactions each
+   const uint32_t flood_trxs = 20000;
+   const uint32_t light_accounts = 500;
+   const uint32_t light_trxs_per_account = 4;
+
+   std::vector<transaction_metadata_ptr> trxs;
+   for( uint32_t i = 0; i < flood_trxs; ++i )
+      trxs.push_back( trx_meta_data_from( N(flooder), 1000 ) );
+   for( uint32_t i = 0; i < light_trxs_per_account; ++i ) {
+      for( uint32_t a = 0; a < light_accounts; ++a )
+         trxs.push_back( trx_meta_data_from( name( N(light).to_uint64_t() + a + 1 ), 100 ) );
+   }
+
+   /// @return position in the drain order by which every light account had one transaction out, and drain time in us
+   auto drain = [&]( unapplied_transaction_queue::process_mode mode ) {
+      unapplied_transaction_queue q;
+      q.set_mode( mode );
+      q.add_aborted( trxs );
+      BOOST_REQUIRE_EQUAL( q.size(), trxs.size() );
+
+      std::set<account_name> served;
+      size_t all_served_at = 0, drained = 0;
+      auto start = fc::time_point::now();
+      while( auto trx = next( q ) ) {
+         ++drained;
+         const auto& actor = trx->packed_trx()->get_transaction().actions.front().authorization.front().actor;
+         if( actor != N(flooder) && served.insert( actor ).second && served.size() == light_accounts )
+            all_served_at = drained;
+      }
+      auto elapsed = fc::time_point::now() - start;
+      BOOST_REQUIRE_EQUAL( drained, trxs.size() );
+      BOOST_CHECK( q.empty() );
+      return std::make_pair( all_served_at, elapsed.count() );
+   };
+
+   auto fifo = drain( unapplied_transaction_queue::process_mode::speculative_producer );
+   auto fair = drain( unapplied_transaction_queue::process_mode::speculative_fair_producer );
+
+   BOOST_TEST_MESSAGE( "drained " << trxs.size() << " transactions, fifo: " << fifo.second << "us, every light account served after "
+                       << fifo.first << "; fair: " << fair.second << "us, every light account served after " << fair.first );
+   BOOST_CHECK_EQUAL( fifo.first, flood_trxs + light_accounts );
+   BOOST_CHECK_EQUAL( fair.first, light_accounts );
+
+} FC_LOG_AND_RETHROW() /// unapplied_transaction_queue_skewed_drain_benchmark
+
 
 BOOST_AUTO_TEST_SUITE_END()
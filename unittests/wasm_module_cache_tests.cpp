@@ -0,0 +1,99 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/chain/wasm_module_cache.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+
+using namespace eosio;
+using namespace eosio::chain;
+
+namespace {
+   const std::vector<char>    code = { 0, 'a', 's', 'm', 1, 0, 0, 0, 42 };
+   const std::vector<uint8_t> memory = { 1, 2, 3, 4 };
+   const digest_type          code_hash = fc::sha256::hash( code.data(), code.size() );
+
+   size_t file_count( const boost::filesystem::path& dir ) {
+      return std::distance( boost::filesystem::directory_iterator( dir ), boost::filesystem::directory_iterator() );
+   }
+}
+
+BOOST_AUTO_TEST_SUITE(wasm_module_cache_tests)
+
+BOOST_AUTO_TEST_CASE( wasm_module_cache_reload ) try {
+   fc::temp_directory tempdir;
+   const boost::filesystem::path dir = tempdir.path().generic_string() + "/wasm-cache";
+   {
+      wasm_module_cache cache( dir, 1024 * 1024, 1, 1 );
+      wasm_module_cache::loaded_module m;
+      BOOST_CHECK( !cache.load( code_hash, 0, 0, m ) );
+      cache.store( code_hash, 0, 0, code.data(), code.size(), memory );
+      BOOST_CHECK_EQUAL( 1u, cache.misses() );
+   }
+
+   // as after a restart
+   wasm_module_cache cache( dir, 1024 * 1024, 1, 1 );
+   wasm_module_cache::loaded_module m;
+   BOOST_REQUIRE( cache.load( code_hash, 0, 0, m ) );
+   BOOST_CHECK( std::vector<char>( m.code, m.code + m.code_size ) == code );
+   BOOST_CHECK( m.initial_memory == memory );
+   BOOST_CHECK_EQUAL( 1u, cache.hits() );
+
+   // prepared for another vm version, runtime or injection version
+   BOOST_CHECK( !cache.load( code_hash, 0, 1, m ) );
+   wasm_module_cache other_runtime( dir, 1024 * 1024, 2, 1 );
+   BOOST_CHECK( !other_runtime.load( code_hash, 0, 0, m ) );
+   wasm_module_cache other_injection( dir, 1024 * 1024, 1, 2 );
+   BOOST_CHECK( !other_injection.load( code_hash, 0, 0, m ) );
+   // replaced when prepared again
+   other_injection.store( code_hash, 0, 0, code.data(), code.size(), memory );
+   BOOST_CHECK( other_injection.load( code_hash, 0, 0, m ) );
+   BOOST_CHECK( !cache.load( code_hash, 0, 0, m ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( wasm_module_cache_corrupt ) try {
+   fc::temp_directory tempdir;
+   const boost::filesystem::path dir = tempdir.path().generic_string() + "/wasm-cache";
+   wasm_module_cache cache( dir, 1024 * 1024, 1, 1 );
+   cache.store( code_hash, 0, 0, code.data(), code.size(), memory );
+   BOOST_REQUIRE_EQUAL( 1u, file_count( dir ) );
+
+   const auto file = boost::filesystem::directory_iterator( dir )->path();
+   {
+      std::fstream f( file.generic_string(), std::ios::in | std::ios::out | std::ios::binary );
+      f.seekp( -1, std::ios::end );
+      f.put( 9 );
+   }
+   wasm_module_cache::loaded_module m;
+   BOOST_CHECK( !cache.load( code_hash, 0, 0, m ) );
+
+   // truncated
+   boost::filesystem::resize_file( file, 10 );
+   BOOST_CHECK( !cache.load( code_hash, 0, 0, m ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( wasm_module_cache_max_size ) try {
+   fc::temp_directory tempdir;
+   const boost::filesystem::path dir = tempdir.path().generic_string() + "/wasm-cache";
+   const digest_type other_hash = fc::sha256::hash( std::string( "other" ) );
+   {
+      wasm_module_cache cache( dir, 1024 * 1024, 1, 1 );
+      cache.store( code_hash, 0, 0, code.data(), code.size(), memory );
+      cache.store( other_hash, 0, 0, code.data(), code.size(), memory );
+      BOOST_CHECK_EQUAL( 2u, file_count( dir ) );
+   }
+   const auto file_size = boost::filesystem::file_size( boost::filesystem::directory_iterator( dir )->path() );
+
+   // least recently used file removed at startup
+   boost::filesystem::last_write_time( boost::filesystem::directory_iterator( dir )->path(), 0 );
+   wasm_module_cache cache( dir, file_size + file_size / 2, 1, 1 );
+   BOOST_CHECK_EQUAL( 1u, file_count( dir ) );
+
+   // full, nothing more is written
+   cache.store( code_hash, 0, 1, code.data(), code.size(), memory );
+   BOOST_CHECK_EQUAL( 1u, file_count( dir ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,7 @@
 #include <array>
+#include <chrono>
 #include <utility>
+#include <thread>
 
 #include <eosio/chain/abi_serializer.hpp>
 #include <eosio/chain/exceptions.hpp>
@@ -8,6 +10,9 @@
 #include <eosio/chain/wasm_eosio_constraints.hpp>
 #include <eosio/chain/wast_to_wasm.hpp>
 #include <eosio/testing/tester.hpp>
+#ifdef EOSIO_EOS_VM_OC_RUNTIME_ENABLED
+#include <eosio/chain/webassembly/eos-vm-oc/compile_queue.hpp>
+#endif
 
 #include <Inline/Serialization.h>
 #include <IR/Module.h>
@@ -2144,4 +2149,174 @@ BOOST_FIXTURE_TEST_CASE(weighted_net_usage_tests, tester ) try {
 } FC_LOG_AND_RETHROW()
 #endif
 
+// contracts are instantiated in the background when their code is set, and executed without instantiating again
+BOOST_AUTO_TEST_CASE( background_instantiation ) try {
+   fc::temp_directory tempdir;
+   tester chain( tempdir, []( controller::config& cfg ) { cfg.wasm_instantiation.threads = 1; }, true );
+   chain.create_accounts( {N(payloadless)} );
+   chain.produce_block();
+
+   const auto before = chain.control->get_wasm_interface().get_instantiation_stats();
+   chain.set_code( N(payloadless), contracts::payloadless_wasm() );
+   chain.set_abi( N(payloadless), contracts::payloadless_abi().data() );
+   chain.produce_block();
+
+   chain.push_action( N(payloadless), N(doit), N(payloadless), mutable_variant_object() );
+   auto stats = chain.control->get_wasm_interface().get_instantiation_stats();
+   BOOST_CHECK_EQUAL( before.background + 1, stats.background );
+   // a hit if the background instantiation was done by then, a wait otherwise
+   BOOST_CHECK_EQUAL( before.hits + before.waits + 1, stats.hits + stats.waits );
+   BOOST_CHECK_EQUAL( before.misses, stats.misses );
+   if( stats.waits == before.waits )
+      BOOST_CHECK_EQUAL( before.stall_us, stats.stall_us );
+
+   const auto first = stats;
+   chain.push_action( N(payloadless), N(doit), N(payloadless), mutable_variant_object() );
+   stats = chain.control->get_wasm_interface().get_instantiation_stats();
+   BOOST_CHECK_EQUAL( first.hits + 1, stats.hits );
+   BOOST_CHECK_EQUAL( first.waits, stats.waits );
+   BOOST_CHECK_EQUAL( first.stall_us, stats.stall_us );
+   BOOST_CHECK_EQUAL( before.misses, stats.misses );
+   chain.produce_block();
+} FC_LOG_AND_RETHROW()
+
+#if defined(EOSIO_EOS_VM_RUNTIME_ENABLED) && defined(EOSIO_EOS_VM_JIT_RUNTIME_ENABLED)
+BOOST_AUTO_TEST_CASE( jit_tierup ) try {
+   fc::temp_directory tempdir;
+   tester chain( tempdir, []( controller::config& cfg ) {
+      cfg.wasm_runtime = wasm_interface::vm_type::eos_vm;
+      cfg.wasm_instantiation.jit_tierup_threshold = 2;
+   }, true );
+   chain.create_accounts( {N(payloadless)} );
+   chain.set_code( N(payloadless), contracts::payloadless_wasm() );
+   chain.set_abi( N(payloadless), contracts::payloadless_abi().data() );
+   chain.produce_block();
+
+   const auto before = chain.control->get_wasm_interface().get_instantiation_stats();
+   // compiled in the background, swapped in by an execution after it is done
+   for( int i = 0; i < 500 && chain.control->get_wasm_interface().get_instantiation_stats().jit_tierups == before.jit_tierups; ++i ) {
+      auto trace = chain.push_action( N(payloadless), N(doit), N(payloadless), mutable_variant_object() );
+      BOOST_CHECK_EQUAL( "Im a payloadless action", trace->action_traces.front().console );
+      chain.produce_block();
+      std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+   }
+   BOOST_REQUIRE_EQUAL( before.jit_tierups + 1, chain.control->get_wasm_interface().get_instantiation_stats().jit_tierups );
+
+   auto trace = chain.push_action( N(payloadless), N(doit), N(payloadless), mutable_variant_object() );
+   BOOST_CHECK_EQUAL( "Im a payloadless action", trace->action_traces.front().console );
+   chain.produce_block();
+} FC_LOG_AND_RETHROW()
+#endif
+
+#ifdef EOSIO_EOS_VM_OC_RUNTIME_ENABLED
+// code waiting for a compile thread is compiled most executed first, precompiled code ahead of all of it
+BOOST_AUTO_TEST_CASE( eosvmoc_compile_queue_order ) try {
+   auto code = []( int i ) { return eosvmoc::code_tuple{ fc::sha256::hash( std::to_string( i ) ), 0 }; };
+   eosvmoc::compile_queue queue;
+   queue.executed( code( 1 ) );
+   for( int i = 0; i < 3; ++i )
+      queue.executed( code( 2 ) );
+   for( int i = 0; i < 2; ++i )
+      queue.executed( code( 3 ) );
+   queue.executed( code( 4 ) );
+   queue.precompile( code( 5 ) );
+   // executions do not lower precompiled code, and precompiling queued code moves it ahead
+   queue.executed( code( 5 ) );
+   queue.precompile( code( 4 ) );
+   queue.erase( code( 5 ) );
+   queue.precompile( code( 5 ) );
+   BOOST_REQUIRE_EQUAL( 5u, queue.size() );
+   BOOST_CHECK( queue.contains( code( 1 ) ) );
+
+   std::vector<eosvmoc::code_tuple> order;
+   while( !queue.empty() )
+      order.push_back( queue.pop() );
+   BOOST_REQUIRE_EQUAL( 5u, order.size() );
+   // 4 and 5 are both precompiled, in either order
+   BOOST_CHECK( ( order[0] == code( 4 ) && order[1] == code( 5 ) ) || ( order[0] == code( 5 ) && order[1] == code( 4 ) ) );
+   BOOST_CHECK( order[2] == code( 2 ) );
+   BOOST_CHECK( order[3] == code( 3 ) );
+   BOOST_CHECK( order[4] == code( 1 ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( eosvmoc_tierup_precompile_and_stats ) try {
+   fc::temp_directory tempdir;
+   tester chain( tempdir, []( controller::config& cfg ) {
+      cfg.wasm_runtime = wasm_interface::vm_type::wabt;
+      cfg.eosvmoc_tierup = true;
+      cfg.eosvmoc_config.threads = 1;
+   }, true );
+   chain.create_accounts( {N(payloadless), N(noop), N(asserter)} );
+   chain.set_code( N(payloadless), contracts::payloadless_wasm() );
+   chain.set_abi( N(payloadless), contracts::payloadless_abi().data() );
+   chain.set_code( N(noop), contracts::noop_wasm() );
+   chain.set_code( N(asserter), contracts::asserter_wasm() );
+   chain.produce_block();
+
+   auto& wasmif = chain.control->get_wasm_interface();
+   auto code_hash = [&]( account_name a ) {
+      return chain.control->db().get<account_metadata_object,by_name>( a ).code_hash;
+   };
+   auto doit = [&]() {
+      chain.push_action( N(payloadless), N(doit), N(payloadless), mutable_variant_object() );
+      chain.produce_block();
+   };
+   // compile results are taken in by executions
+   auto execute_until = [&]( const std::function<bool( const wasm_interface::eosvmoc_tierup_stats& )>& done ) {
+      for( int i = 0; i < 500 && !done( wasmif.get_eosvmoc_tierup_stats() ); ++i ) {
+         doit();
+         std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+      }
+      BOOST_REQUIRE( done( wasmif.get_eosvmoc_tierup_stats() ) );
+   };
+
+   const auto before = wasmif.get_eosvmoc_tierup_stats();
+   BOOST_REQUIRE( before.enabled );
+
+   // executed by the base runtime until compiled
+   doit();
+   auto stats = wasmif.get_eosvmoc_tierup_stats();
+   BOOST_CHECK_EQUAL( before.fallbacks + 1, stats.fallbacks );
+   execute_until( [&]( const auto& s ) { return s.compiled == before.compiled + 1; } );
+   stats = wasmif.get_eosvmoc_tierup_stats();
+   BOOST_CHECK_EQUAL( before.cached + 1, stats.cached );
+   BOOST_CHECK_EQUAL( 0u, stats.compiling );
+   BOOST_CHECK_EQUAL( 0u, stats.queued );
+   BOOST_CHECK_EQUAL( before.failed, stats.failed );
+   BOOST_CHECK_EQUAL( 0u, stats.blacklisted );
+   BOOST_CHECK( stats.max_compile_us > 0 );
+   BOOST_CHECK( stats.avg_compile_us > 0 && stats.avg_compile_us <= stats.max_compile_us );
+   const auto fallbacks = stats.fallbacks;
+   doit();
+   BOOST_CHECK_EQUAL( fallbacks, wasmif.get_eosvmoc_tierup_stats().fallbacks );
+
+   // cached code is not compiled again
+   wasmif.eosvmoc_precompile( code_hash( N(payloadless) ), 0 );
+   stats = wasmif.get_eosvmoc_tierup_stats();
+   BOOST_CHECK_EQUAL( 0u, stats.compiling );
+   BOOST_CHECK_EQUAL( 0u, stats.queued );
+
+   // nothing executes in between, so the compile stays in flight from the cache's view even if done already
+   wasmif.eosvmoc_precompile( code_hash( N(noop) ), 0 );
+   wasmif.eosvmoc_precompile( code_hash( N(noop) ), 0 );
+   stats = wasmif.get_eosvmoc_tierup_stats();
+   BOOST_CHECK_EQUAL( 1u, stats.compiling );
+   BOOST_CHECK_EQUAL( 0u, stats.queued );
+
+   // the only compile thread is busy, so precompiled code waits for it
+   wasmif.eosvmoc_precompile( code_hash( N(asserter) ), 0 );
+   stats = wasmif.get_eosvmoc_tierup_stats();
+   BOOST_CHECK_EQUAL( 1u, stats.compiling );
+   BOOST_CHECK_EQUAL( 1u, stats.queued );
+
+   execute_until( [&]( const auto& s ) { return s.compiled == before.compiled + 3; } );
+   stats = wasmif.get_eosvmoc_tierup_stats();
+   BOOST_CHECK_EQUAL( before.cached + 3, stats.cached );
+   BOOST_CHECK_EQUAL( 0u, stats.compiling );
+   BOOST_CHECK_EQUAL( 0u, stats.queued );
+   // none of it was executed, payloadless was executed by eos-vm-oc throughout
+   BOOST_CHECK_EQUAL( fallbacks, stats.fallbacks );
+} FC_LOG_AND_RETHROW()
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()